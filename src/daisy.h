@@ -23,12 +23,14 @@
 #include "per/adc.h"
 #include "per/uart.h"
 #include "hid/midi.h"
+#include "hid/midi_clock.h"
 #include "hid/encoder.h"
 #include "hid/switch.h"
 #include "hid/switch3.h"
 #include "hid/ctrl.h"
 #include "hid/gatein.h"
 #include "hid/parameter.h"
+#include "hid/parameter_bank.h"
 #include "hid/usb.h"
 #include "hid/logger.h"
 #include "per/sai.h"
@@ -43,10 +45,22 @@
 #include "dev/codec_pcm3060.h"
 #include "dev/codec_wm8731.h"
 #include "dev/lcd_hd44780.h"
+#include "dev/ws2812.h"
 #include "util/scopedirqblocker.h"
 #include "util/FixedCapStr.h"
 #include "util/WaveTableLoader.h"
+#include "util/WaveTableMipmap.h"
 #include "util/WavWriter.h"
+#include "util/LogStore.h"
+#include "util/QspiFlashRegion.h"
+#include "util/FatFileReader.h"
+#include "util/FatFileWriter.h"
+#include "util/WavHeader.h"
+#include "util/WavStreamer.h"
+#include "util/ImaAdpcm.h"
+#include "util/DiskSampler.h"
+#include "util/AudioCapture.h"
+#include "util/BrightnessCurve.h"
 #endif
 #endif
 
@@ -385,6 +385,7 @@ void DaisyField::VegasMode()
         }
 
         display.Update();
-        led_driver.SwapBuffersAndTransmit();
+        // Refused while the previous frame is on the bus
+        while(!led_driver.SwapBuffersAndTransmit()) {}
     }
 }
@@ -230,7 +230,8 @@ void DaisyPetal::ClearLeds()
 
 void DaisyPetal::UpdateLeds()
 {
-    led_driver_.SwapBuffersAndTransmit();
+    // Refused while the previous frame is on the bus
+    while(!led_driver_.SwapBuffersAndTransmit()) {}
 }
 
 void DaisyPetal::SetRingLed(RingLed idx, float r, float g, float b)
@@ -154,7 +154,9 @@ class DaisyPetal
     /** Turn all leds off */
     void ClearLeds();
 
-    /** Update Leds to values you had set. */
+    /** Update Leds to values you had set.
+     ** Waits for the previous update if it is still being sent, so the
+     ** last one before the loop goes idle isn't dropped. */
     void UpdateLeds();
 
     /**
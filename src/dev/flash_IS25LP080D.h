@@ -21,6 +21,8 @@ extern "C"
 #define IS25LP080D_DIE_ERASE_MAX_TIME 460000 /**< & */
 #define IS25LP080D_BLOCK_ERASE_MAX_TIME 1000 /**< & */
 #define IS25LP080D_SECTOR_ERASE_MAX_TIME 400 /**< & */
+#define IS25LP080D_PAGE_PROG_MAX_TIME_US 800 /**< & */
+#define IS25LP080D_SUSPEND_MAX_TIME_US 100   /**< & */
 
     /**
      * @brief  IS25LP08D Commands  
@@ -140,6 +142,10 @@ extern "C"
     ((uint8_t)0x80) /*!< Status register write enable/disable */
 #define IS25LP080D_SR_QE ((uint8_t)0x40) /**< & */
 
+    /* Function Register */
+#define IS25LP080D_FR_PSUS ((uint8_t)0x04) /*!< Program suspended */
+#define IS25LP080D_FR_ESUS ((uint8_t)0x08) /*!< Erase suspended */
+
     /* Non volatile Configuration Register */
 #define IS25LP080D_NVCR_NBADDR \
     ((uint16_t)0x0001) /*!< 3-bytes or 4-bytes addressing */
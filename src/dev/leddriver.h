@@ -7,14 +7,21 @@
 #include <stdint.h>
 #include "per/i2c.h"
 #include "per/gpio.h"
+#include "sys/system.h"
+#include "util/BrightnessCurve.h"
+#include "util/color.h"
 
 namespace daisy
 {
 /** LED driver for one or multiple PCA9685 12bit PWM chips connected to
  * a single I2C peripheral.
- * It includes gamma correction from 8bit brightness values but it 
- * can also be supplied with raw 12bit values.
+ * It includes gamma correction (2.8) from 8bit or float brightness values
+ * but it can also be supplied with raw 12bit values. The gamma table is
+ * generated by the compiler and shared by all instances, in flash.
  * This driver uses two buffers - one for drawing, one for transmitting.
+ * Only the leds that changed since the last transmission are sent: each
+ * driver gets the shortest run of registers that covers its changes, and
+ * drivers without changes are skipped.
  * Multiple LedDriverPca9685 instances can be used at the same time.
  * \param numDrivers    The number of PCA9685 driver attached to the I2C
  *                      peripheral.
@@ -73,6 +80,9 @@ class LedDriverPca9685
         for(int d = 0; d < numDrivers; d++)
             addresses_[d] = addresses[d];
         current_driver_idx_ = -1;
+        patched_byte_       = nullptr;
+        // the drivers are in an unknown state, send everything once
+        full_update_ = true;
 
         InitializeBuffers();
         InitializeDrivers();
@@ -81,19 +91,17 @@ class LedDriverPca9685
     /** Returns the number of leds available from this driver. */
     constexpr int GetNumLeds() const { return numDrivers * 16; }
 
-    /** Sets all leds to a gamma corrected brightness between 0.0f and 1.0f. */
+    /** Sets all leds to a gamma corrected brightness between 0.0f and 1.0f.
+     * The brightness is interpolated between the 8bit steps. */
     void SetAllTo(float brightness)
     {
-        const uint8_t intBrightness
-            = (uint8_t)(clamp(brightness * 255.0f, 0.0f, 255.0f));
-        SetAllTo(intBrightness);
+        SetAllToRaw(GammaTable::Interpolate(brightness));
     }
 
     /** Sets all leds to a gamma corrected brightness between 0 and 255. */
     void SetAllTo(uint8_t brightness)
     {
-        const uint16_t cycles = gamma_table_[brightness];
-        SetAllToRaw(cycles);
+        SetAllToRaw(GammaTable::Get(brightness));
     }
 
     /** Sets all leds to a raw 12bit brightness between 0 and 4095. */
@@ -103,19 +111,41 @@ class LedDriverPca9685
             SetLedRaw(led, rawBrightness);
     }
 
-    /** Sets a single led to a gamma corrected brightness between 0.0f and 1.0f. */
+    /** Sets a single led to a gamma corrected brightness between 0.0f and 1.0f.
+     * The brightness is interpolated between the 8bit steps. */
     void SetLed(int ledIndex, float brightness)
     {
-        const uint8_t intBrightness
-            = (uint8_t)(clamp(brightness * 255.0f, 0.0f, 255.0f));
-        SetLed(ledIndex, intBrightness);
+        SetLedRaw(ledIndex, GammaTable::Interpolate(brightness));
     }
 
     /** Sets a single led to a gamma corrected brightness between 0 and 255. */
     void SetLed(int ledIndex, uint8_t brightness)
     {
-        const uint16_t cycles = gamma_table_[brightness];
-        SetLedRaw(ledIndex, cycles);
+        SetLedRaw(ledIndex, GammaTable::Get(brightness));
+    }
+
+    /** Sets three leds to the gamma corrected channels of a color.
+     * \param redLed, greenLed, blueLed indices of the leds of the elements
+     * \param color 8bit color, e.g. from PackedColor::FromHsv()
+     */
+    void SetColor(int redLed, int greenLed, int blueLed, PackedColor color)
+    {
+        SetLedRaw(redLed, GammaTable::Get(color.Red()));
+        SetLedRaw(greenLed, GammaTable::Get(color.Green()));
+        SetLedRaw(blueLed, GammaTable::Get(color.Blue()));
+    }
+
+    /** Sets leds from an array of colors, e.g. a whole frame of animation.
+     * \param colors colors to set
+     * \param rgbLeds indices of the red, green and blue leds of each color
+     * \param numColors number of colors
+     */
+    void SetColors(const PackedColor* colors,
+                   const uint8_t      rgbLeds[][3],
+                   size_t             numColors)
+    {
+        for(size_t i = 0; i < numColors; i++)
+            SetColor(rgbLeds[i][0], rgbLeds[i][1], rgbLeds[i][2], colors[i]);
     }
 
     /** Sets a single led to a raw 12bit brightness between 0 and 4095. */
@@ -134,57 +164,116 @@ class LedDriverPca9685
     }
 
     /** Swaps the current draw buffer and the current transmit buffer and
-     *  starts transmitting the values to all chips.
+     *  starts transmitting the leds that changed.
+     *  This doesn't wait for the previous transmission. If it is still
+     *  running, nothing is swapped and the changes stay in the draw buffer,
+     *  to go out with the next call. Call this regularly, e.g. once per
+     *  main loop pass, so the last frame is sent as well.
+     *  \return false if the bus was still busy with the previous frame
      */
-    void SwapBuffersAndTransmit()
+    bool SwapBuffersAndTransmit()
     {
-        // wait for current transmission to complete
-        while(current_driver_idx_ >= 0) {};
+        if(current_driver_idx_ >= 0)
+            return false;
+
+        // The transmit buffer holds what the drivers show, so the changes
+        // are where the draw buffer differs from it.
+        bool changed = false;
+        for(int d = 0; d < numDrivers; d++)
+        {
+            dirty_[d] = full_update_ ? 0xFFFF : GetChangedChannels(d);
+            changed |= dirty_[d] != 0;
+        }
+        full_update_ = false;
+        if(!changed)
+            return true;
 
         // swap buffers
         auto tmp         = transmit_buffer_;
         transmit_buffer_ = draw_buffer_;
         draw_buffer_     = tmp;
 
-        // copy current transmit buffer contents to the new draw buffer
-        // to keep the led settings (if required)
+        // copy the changed leds to the new draw buffer to keep the led
+        // settings (if required), the others are the same in both buffers
         if(persistentBufferContents)
         {
             for(int d = 0; d < numDrivers; d++)
                 for(int ch = 0; ch < 16; ch++)
-                    draw_buffer_[d].leds[ch].off
-                        = transmit_buffer_[d].leds[ch].off;
+                    if(dirty_[d] & (1 << ch))
+                        draw_buffer_[d].leds[ch] = transmit_buffer_[d].leds[ch];
         }
 
         // start transmission
         current_driver_idx_ = -1;
         ContinueTransmission();
+        return true;
     }
 
+    /** Returns true while a frame is being transmitted. */
+    bool IsTransmitting() const { return current_driver_idx_ >= 0; }
+
   private:
     void ContinueTransmission()
     {
-        current_driver_idx_++;
+        RestorePatchedByte();
+        do
+        {
+            current_driver_idx_++;
+        } while(current_driver_idx_ < numDrivers
+                && dirty_[current_driver_idx_] == 0);
         if(current_driver_idx_ >= numDrivers)
         {
             current_driver_idx_ = -1;
             return;
         }
 
+        // The register address goes right in front of the first changed
+        // led, in place of the last byte of the led before it. That led
+        // isn't sent, and the byte is put back when the transfer is done.
         const auto    d       = current_driver_idx_;
+        const int     first   = __builtin_ctz(dirty_[d]);
+        const int     last    = 31 - __builtin_clz(dirty_[d]);
+        uint8_t*      start   = (uint8_t*)&transmit_buffer_[d].leds[first] - 1;
         const uint8_t address = PCA9685_I2C_BASE_ADDRESS | addresses_[d];
-        const auto    status  = i2c_.TransmitDma(address,
-                                             (uint8_t*)&transmit_buffer_[d],
-                                             PCA9685TransmitBuffer::size,
+        patched_byte_         = start;
+        patched_value_        = *start;
+        *start                = PCA9685_LED0 + first * 4;
+        const auto status     = i2c_.TransmitDma(address,
+                                             start,
+                                             (last - first + 1) * 4 + 1,
                                              &TxCpltCallback,
                                              this);
         if(status != I2CHandle::Result::OK)
         {
-            // TODO: fix this :-)
-            // Reinit I2C (probably a flag to kill, but hey this works fairly well for now.)
+            // Reinit I2C, and send everything with the next frame as
+            // the drivers may have missed some of it.
+            RestorePatchedByte();
             i2c_.Init(i2c_.GetConfig());
+            full_update_        = true;
+            current_driver_idx_ = -1;
+        }
+    }
+
+    void RestorePatchedByte()
+    {
+        if(patched_byte_)
+            *patched_byte_ = patched_value_;
+        patched_byte_ = nullptr;
+    }
+
+    uint16_t GetChangedChannels(int d) const
+    {
+        uint16_t changed = 0;
+        for(int ch = 0; ch < 16; ch++)
+        {
+            if(draw_buffer_[d].leds[ch].on != transmit_buffer_[d].leds[ch].on
+               || draw_buffer_[d].leds[ch].off
+                      != transmit_buffer_[d].leds[ch].off)
+                changed |= 1 << ch;
         }
+        return changed;
     }
+
     uint16_t GetStartCycleForLed(int ledIndex) const
     {
         return (ledIndex << 2) & 0x0FFF; // shift each led by 4 cycles
@@ -253,19 +342,15 @@ class LedDriverPca9685
         }
     }
 
-    // no std::clamp available in C++14.... remove this when C++17 is available
-    template <typename T>
-    T clamp(T in, T low, T high)
-    {
-        return (in < low) ? low : (high < in) ? high : in;
-    }
-
     // an internal function to handle i2c callbacks
     // called when an I2C transmission completes and the next driver must be updated
     static void TxCpltCallback(void* context, I2CHandle::Result result)
     {
         auto drv_ptr = reinterpret_cast<
             LedDriverPca9685<numDrivers, persistentBufferContents>*>(context);
+        // a driver that missed its update gets everything next time
+        if(result != I2CHandle::Result::OK)
+            drv_ptr->full_update_ = true;
         drv_ptr->ContinueTransmission();
     }
 
@@ -277,29 +362,14 @@ class LedDriverPca9685
     dsy_gpio               oe_pin_gpio_;
     // index of the dirver that is currently updated.
     volatile int8_t current_driver_idx_;
-    const uint16_t  gamma_table_[256] = {
-        0,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
-        2,    2,    2,    2,    2,    2,    2,    3,    3,    4,    4,    5,
-        5,    6,    7,    8,    8,    9,    10,   11,   12,   13,   15,   16,
-        17,   18,   20,   21,   23,   25,   26,   28,   30,   32,   34,   36,
-        38,   40,   43,   45,   48,   50,   53,   56,   59,   62,   65,   68,
-        71,   75,   78,   82,   85,   89,   93,   97,   101,  105,  110,  114,
-        119,  123,  128,  133,  138,  143,  149,  154,  159,  165,  171,  177,
-        183,  189,  195,  202,  208,  215,  222,  229,  236,  243,  250,  258,
-        266,  273,  281,  290,  298,  306,  315,  324,  332,  341,  351,  360,
-        369,  379,  389,  399,  409,  419,  430,  440,  451,  462,  473,  485,
-        496,  508,  520,  532,  544,  556,  569,  582,  594,  608,  621,  634,
-        648,  662,  676,  690,  704,  719,  734,  749,  764,  779,  795,  811,
-        827,  843,  859,  876,  893,  910,  927,  944,  962,  980,  998,  1016,
-        1034, 1053, 1072, 1091, 1110, 1130, 1150, 1170, 1190, 1210, 1231, 1252,
-        1273, 1294, 1316, 1338, 1360, 1382, 1404, 1427, 1450, 1473, 1497, 1520,
-        1544, 1568, 1593, 1617, 1642, 1667, 1693, 1718, 1744, 1770, 1797, 1823,
-        1850, 1877, 1905, 1932, 1960, 1988, 2017, 2045, 2074, 2103, 2133, 2162,
-        2192, 2223, 2253, 2284, 2315, 2346, 2378, 2410, 2442, 2474, 2507, 2540,
-        2573, 2606, 2640, 2674, 2708, 2743, 2778, 2813, 2849, 2884, 2920, 2957,
-        2993, 3030, 3067, 3105, 3143, 3181, 3219, 3258, 3297, 3336, 3376, 3416,
-        3456, 3496, 3537, 3578, 3619, 3661, 3703, 3745, 3788, 3831, 3874, 3918,
-        3962, 4006, 4050, 4095};
+    // channels of each driver sent with the current frame
+    uint16_t dirty_[numDrivers];
+    bool     full_update_;
+    // buffer byte replaced by the register address during a transfer
+    uint8_t* patched_byte_;
+    uint8_t  patched_value_;
+
+    using GammaTable = BrightnessTable<BrightnessCurve::Gamma<28>, 8, 12>;
 
     static constexpr uint8_t PCA9685_I2C_BASE_ADDRESS = 0b01000000;
     static constexpr uint8_t PCA9685_MODE1
@@ -0,0 +1,274 @@
+#pragma once
+#ifndef DSY_WS2812_H
+#define DSY_WS2812_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "per/spi.h"
+#include "util/color.h"
+
+namespace daisy
+{
+/** @addtogroup feedback
+    @{
+*/
+
+/** Driver for a chain of WS2812 or SK6812 addressable LEDs ("NeoPixels"),
+ ** on the MOSI pin of an SPI peripheral.
+ **
+ ** The LEDs read a bit from the length of a high pulse. Each bit becomes
+ ** one SPI byte at 6.25MHz: 160ns per SPI bit, 1.28us per LED bit, with
+ ** the high time set by the number of leading ones. A 16 entry table
+ ** encodes four bits at a time, when the pixels are set. A frame ends with
+ ** 300us of low, which latches it on WS2812B (280us) and SK6812 (80us).
+ **
+ ** Like LedDriverPca9685, this uses two buffers - one for drawing, one for
+ ** transmitting - which the DMA sends without the CPU. Each pixel takes 24
+ ** bytes (32 with white), so 300 RGB pixels need two buffers of 7.4KB,
+ ** and refresh at about 100Hz.
+ **
+ ** The data line floats between frames, so it needs a pull-down, e.g.
+ ** 10k. The LEDs need 5V levels, depending on the parts and supply a level
+ ** shifter may be needed as well.
+ **
+ ** \tparam numPixels number of LEDs in the chain
+ ** \tparam rgbw      true for SK6812 RGBW parts, which have a white channel
+ ** \tparam persistentBufferContents If set to true, the current draw
+ **         buffer contents will be copied to the next draw buffer during
+ **         SwapBuffersAndTransmit(). Use this, if you plan to write single
+ **         pixels at a time. If you always set all pixels before calling
+ **         SwapBuffersAndTransmit(), you can set this to false and save the
+ **         copy.
+ */
+template <size_t numPixels,
+          bool   rgbw                     = false,
+          bool   persistentBufferContents = true>
+class Ws2812
+{
+  public:
+    struct Config
+    {
+        enum class Chip
+        {
+            WS2812, /**< WS2812 and WS2812B: 1 is high for 0.8us */
+            SK6812, /**< SK6812, RGB and RGBW: 1 is high for 0.6us */
+        };
+
+        SpiHandle::Config::Peripheral periph; /**< SPI_1 to SPI_3 */
+        dsy_gpio_pin                  mosi;   /**< The data line */
+        Chip                          chip;   /**< & */
+
+        /** SPI1 on PB5, WS2812 */
+        void Defaults()
+        {
+            periph = SpiHandle::Config::Peripheral::SPI_1;
+            mosi   = {DSY_GPIOB, 5};
+            chip   = Chip::WS2812;
+        }
+    };
+
+    /** Return values for Ws2812 functions. */
+    enum class Result
+    {
+        OK, /**< & */
+        ERR /**< & */
+    };
+
+    /** Color bytes per pixel, sent as G, R, B and W */
+    static constexpr size_t kBytesPerPixel = rgbw ? 4 : 3;
+    /** SPI bytes of pixel data, one per bit */
+    static constexpr size_t kPixelSize = numPixels * kBytesPerPixel * 8;
+    /** SPI bytes of the low time that latches a frame, 300us */
+    static constexpr size_t kResetSize = 235;
+    /** Size of each DMA buffer in bytes */
+    static constexpr size_t kBufferSize = kPixelSize + kResetSize;
+
+    static_assert(numPixels > 0, "at least one pixel");
+    static_assert(kBufferSize <= 0xffff, "at most 2720 RGB pixels");
+
+    /** Buffer type for the DMA. */
+    using DmaBuffer = uint8_t[kBufferSize];
+
+    /** Initialises the driver, with all pixels off.
+     * \param config        The SPI peripheral, pin and chip to use.
+     * \param dma_buffer_a  The first buffer for the DMA. This must be placed
+     *                      in D2 memory by adding the DMA_BUFFER_MEM_SECTION
+     *                      attribute like this:
+     *                      `Ws2812<60>::DmaBuffer DMA_BUFFER_MEM_SECTION a;`
+     * \param dma_buffer_b  The second buffer for the DMA, placed the same way.
+     */
+    Result Init(const Config& config,
+                DmaBuffer     dma_buffer_a,
+                DmaBuffer     dma_buffer_b)
+    {
+        // The kernel clock of SPI1 to SPI3 is 25MHz
+        if(int(config.periph) > int(SpiHandle::Config::Peripheral::SPI_3))
+            return Result::ERR;
+
+        using SpiConfig = SpiHandle::Config;
+        SpiConfig spi_cfg;
+        spi_cfg.periph          = config.periph;
+        spi_cfg.mode            = SpiConfig::Mode::MASTER;
+        spi_cfg.direction       = SpiConfig::Direction::TWO_LINES_TX_ONLY;
+        spi_cfg.datasize        = 8;
+        spi_cfg.clock_polarity  = SpiConfig::ClockPolarity::LOW;
+        spi_cfg.clock_phase     = SpiConfig::ClockPhase::ONE_EDGE;
+        spi_cfg.nss             = SpiConfig::NSS::SOFT;
+        spi_cfg.baud_prescaler  = SpiConfig::BaudPrescaler::PS_4;
+        spi_cfg.pin_config.sclk = {DSY_GPIOX, 0};
+        spi_cfg.pin_config.miso = {DSY_GPIOX, 0};
+        spi_cfg.pin_config.mosi = config.mosi;
+        spi_cfg.pin_config.nss  = {DSY_GPIOX, 0};
+        if(spi_.Init(spi_cfg) != SpiHandle::Result::OK)
+            return Result::ERR;
+
+        // 0 is high for 2 SPI bits (320ns), 1 for 5 (800ns) or 4 (640ns)
+        const uint8_t zero = 0xc0;
+        const uint8_t one  = config.chip == Config::Chip::WS2812 ? 0xf8 : 0xf0;
+        for(int nibble = 0; nibble < 16; nibble++)
+            for(int bit = 0; bit < 4; bit++)
+                lut_[nibble][bit] = (nibble & (8 >> bit)) ? one : zero;
+
+        config_          = config;
+        draw_buffer_     = dma_buffer_a;
+        transmit_buffer_ = dma_buffer_b;
+        transmitting_    = false;
+        Fill(PackedColor(0));
+        memcpy(transmit_buffer_, draw_buffer_, kPixelSize);
+        memset(draw_buffer_ + kPixelSize, 0, kResetSize);
+        memset(transmit_buffer_ + kPixelSize, 0, kResetSize);
+        return Result::OK;
+    }
+
+    /** Returns the number of pixels of this driver. */
+    constexpr size_t GetNumPixels() const { return numPixels; }
+
+    /** Sets a pixel in the draw buffer. Indices out of range are ignored.
+     * \param idx   position in the chain, 0 is nearest to the controller
+     * \param color 8bit color, e.g. from PackedColor::FromHsv()
+     * \param white level of the white channel of RGBW parts
+     */
+    void SetPixel(size_t idx, PackedColor color, uint8_t white = 0)
+    {
+        if(idx >= numPixels)
+            return;
+        uint8_t* dst = draw_buffer_ + idx * kBytesPerPixel * 8;
+        EncodeByte(dst, color.Green());
+        EncodeByte(dst + 8, color.Red());
+        EncodeByte(dst + 16, color.Blue());
+        if(rgbw)
+            EncodeByte(dst + 24, white);
+    }
+
+    /** Sets pixels from an array of colors, e.g. a whole frame of
+     * animation, starting with the first pixel.
+     * \param colors    colors to set
+     * \param numColors number of colors, at most GetNumPixels()
+     */
+    void SetPixels(const PackedColor* colors, size_t numColors)
+    {
+        numColors = numColors < numPixels ? numColors : numPixels;
+        for(size_t i = 0; i < numColors; i++)
+            SetPixel(i, colors[i]);
+    }
+
+    /** Sets all pixels to a color. */
+    void Fill(PackedColor color, uint8_t white = 0)
+    {
+        SetPixel(0, color, white);
+        for(size_t i = 1; i < numPixels; i++)
+            memcpy(draw_buffer_ + i * kBytesPerPixel * 8,
+                   draw_buffer_,
+                   kBytesPerPixel * 8);
+    }
+
+    /** Swaps the current draw buffer and the current transmit buffer and
+     *  starts transmitting the frame with the DMA.
+     *  This doesn't wait for the previous transmission. If it is still
+     *  running, or the DMA is busy with another SPI transfer, nothing is
+     *  swapped and the frame stays in the draw buffer, to go out with the
+     *  next call.
+     *  \return false if the frame couldn't be sent yet
+     */
+    bool SwapBuffersAndTransmit()
+    {
+        if(transmitting_)
+            return false;
+
+        // swap buffers
+        uint8_t* tmp     = transmit_buffer_;
+        transmit_buffer_ = draw_buffer_;
+        draw_buffer_     = tmp;
+
+        transmitting_     = true;
+        const auto status = spi_.DmaTransmit(
+            transmit_buffer_, kBufferSize, &TxCpltCallback, this);
+        if(status != SpiHandle::Result::OK)
+        {
+            // swap back, the frame is still to be sent
+            transmitting_    = false;
+            draw_buffer_     = transmit_buffer_;
+            transmit_buffer_ = tmp;
+            return false;
+        }
+
+        // copy the frame to the new draw buffer to keep the pixels
+        // (if required)
+        if(persistentBufferContents)
+            memcpy(draw_buffer_, transmit_buffer_, kPixelSize);
+        return true;
+    }
+
+    /** Returns true while a frame is being transmitted. */
+    bool IsTransmitting() const { return transmitting_; }
+
+    /** Returns the current config. */
+    const Config& GetConfig() const { return config_; }
+
+  private:
+    // 8 SPI bytes for the 8 bits of a color, MSB first
+    void EncodeByte(uint8_t* dst, uint8_t value) const
+    {
+        memcpy(dst, lut_[value >> 4], 4);
+        memcpy(dst + 4, lut_[value & 0x0f], 4);
+    }
+
+    // called from the SPI interrupt when the frame is sent
+    static void TxCpltCallback(void* context, SpiHandle::Result result)
+    {
+        (void)result;
+        auto drv_ptr = reinterpret_cast<
+            Ws2812<numPixels, rgbw, persistentBufferContents>*>(context);
+        drv_ptr->transmitting_ = false;
+    }
+
+    Config        config_;
+    SpiHandle     spi_;
+    uint8_t*      draw_buffer_;
+    uint8_t*      transmit_buffer_;
+    volatile bool transmitting_;
+    // SPI bytes for each 4 bit value
+    uint8_t lut_[16][4];
+};
+
+template <size_t numPixels, bool rgbw, bool persistentBufferContents>
+constexpr size_t
+    Ws2812<numPixels, rgbw, persistentBufferContents>::kBytesPerPixel;
+
+template <size_t numPixels, bool rgbw, bool persistentBufferContents>
+constexpr size_t
+    Ws2812<numPixels, rgbw, persistentBufferContents>::kPixelSize;
+
+template <size_t numPixels, bool rgbw, bool persistentBufferContents>
+constexpr size_t
+    Ws2812<numPixels, rgbw, persistentBufferContents>::kResetSize;
+
+template <size_t numPixels, bool rgbw, bool persistentBufferContents>
+constexpr size_t
+    Ws2812<numPixels, rgbw, persistentBufferContents>::kBufferSize;
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -1,4 +1,6 @@
 #include "hid/audio.h"
+#include <math.h>
+#include <atomic>
 
 namespace daisy
 {
@@ -70,6 +72,34 @@ class AudioHandle::Impl
 
     AudioHandle::Result SetSampleRate(SaiHandle::Config::SampleRate sampelrate);
 
+    // Metering
+    // Sums over one block, in the float scale of the callback
+    struct MeterSum
+    {
+        float    peak, sum, sumsq;
+        uint32_t clips;
+    };
+
+    static FORCE_INLINE void
+    Meter2(MeterSum* m, float left, float right, float clip)
+    {
+        float a     = fabsf(left);
+        float b     = fabsf(right);
+        m[0].peak   = a > m[0].peak ? a : m[0].peak;
+        m[1].peak   = b > m[1].peak ? b : m[1].peak;
+        m[0].sum   += left;
+        m[1].sum   += right;
+        m[0].sumsq += left * left;
+        m[1].sumsq += right * right;
+        m[0].clips += a >= clip;
+        m[1].clips += b >= clip;
+    }
+
+    AudioHandle::Result StartMetering(const AudioHandle::MeterConfig& config);
+    void UpdateMeters(const MeterSum* in, const MeterSum* out, size_t frames);
+    AudioHandle::MeterLevel GetLevel(const AudioHandle::MeterLevel* levels,
+                                     size_t                         chn) const;
+
     // Internal Callback
     static void InternalCallback(int32_t* in, int32_t* out, size_t size);
 
@@ -81,6 +111,18 @@ class AudioHandle::Impl
     int32_t*            buff_rx_[2];
     int32_t*            buff_tx_[2];
     float               postgain_recip_;
+
+    // Meters, written by the audio interrupt at the end of each block
+    volatile bool            metering_;
+    AudioHandle::MeterConfig meter_config_;
+    size_t                   meter_frames_; // coefficients are for this
+    float                    meter_sr_;     // blocksize and samplerate
+    float                    rms_coeff_, dc_coeff_, peak_coeff_;
+    float                    ms_[2][kAudioMaxChannels]; // mean squares
+    AudioHandle::MeterLevel  levels_[2][kAudioMaxChannels]; // in, out
+    volatile uint32_t        level_seq_;   // odd while levels_ are written
+    volatile uint32_t        clip_resets_; // requested by the main loop
+    uint32_t                 clip_resets_done_;
 };
 
 // ================================================================
@@ -96,7 +138,8 @@ static AudioHandle::Impl audio_handle;
 AudioHandle::Result AudioHandle::Impl::Init(const AudioHandle::Config config,
                                             SaiHandle                 sai)
 {
-    config_ = config;
+    config_   = config;
+    metering_ = false;
 
     if(config_.postgain > 0.f)
         postgain_recip_ = 1.f / config_.postgain;
@@ -229,6 +272,96 @@ AudioHandle::Impl::SetSampleRate(SaiHandle::Config::SampleRate samplerate)
     return Result::OK;
 }
 
+AudioHandle::Result
+AudioHandle::Impl::StartMetering(const AudioHandle::MeterConfig& config)
+{
+    if(config.rms_time <= 0.f || config.peak_release <= 0.f
+       || config.dc_time <= 0.f)
+        return Result::ERR;
+    // The audio interrupt skips the meters while they are set up
+    metering_ = false;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    meter_config_ = config;
+    meter_frames_ = 0;
+    for(size_t d = 0; d < 2; d++)
+    {
+        for(size_t c = 0; c < kAudioMaxChannels; c++)
+        {
+            ms_[d][c]     = 0.f;
+            levels_[d][c] = {0.f, 0.f, 0.f, 0};
+        }
+    }
+    clip_resets_done_ = clip_resets_;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    metering_ = true;
+    return Result::OK;
+}
+
+void AudioHandle::Impl::UpdateMeters(const MeterSum* in,
+                                     const MeterSum* out,
+                                     size_t          frames)
+{
+    // The ballistics are per block, so they follow the block size
+    float sr = GetSampleRate();
+    if(frames != meter_frames_ || sr != meter_sr_)
+    {
+        float block   = frames / sr;
+        rms_coeff_    = 1.f - expf(-block / meter_config_.rms_time);
+        dc_coeff_     = 1.f - expf(-block / meter_config_.dc_time);
+        peak_coeff_   = expf(-2.302585f * block / meter_config_.peak_release);
+        meter_frames_ = frames;
+        meter_sr_     = sr;
+    }
+
+    // The sums are in the scale of the callback
+    const float     scale   = config_.postgain;
+    const float     recip_n = 1.f / frames;
+    const MeterSum* sums[2] = {in, out};
+    uint32_t        resets  = clip_resets_;
+    bool            reset   = resets != clip_resets_done_;
+
+    level_seq_ = level_seq_ + 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    for(size_t d = 0; d < 2; d++)
+    {
+        for(size_t c = 0; c < GetChannels(); c++)
+        {
+            const MeterSum&          sum   = sums[d][c];
+            AudioHandle::MeterLevel& level = levels_[d][c];
+            float                    peak  = sum.peak * scale;
+            float                    decay = level.peak * peak_coeff_;
+            level.peak                     = peak > decay ? peak : decay;
+            ms_[d][c] += rms_coeff_
+                         * (sum.sumsq * recip_n * scale * scale - ms_[d][c]);
+            level.rms = sqrtf(ms_[d][c]);
+            level.dc += dc_coeff_ * (sum.sum * recip_n * scale - level.dc);
+            level.clips = (reset ? 0 : level.clips) + sum.clips;
+        }
+    }
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    level_seq_        = level_seq_ + 1;
+    clip_resets_done_ = resets;
+}
+
+AudioHandle::MeterLevel
+AudioHandle::Impl::GetLevel(const AudioHandle::MeterLevel* levels,
+                            size_t                         chn) const
+{
+    AudioHandle::MeterLevel level = {0.f, 0.f, 0.f, 0};
+    if(chn >= kAudioMaxChannels)
+        return level;
+    // Copy again if a block ended in between
+    uint32_t seq;
+    do
+    {
+        seq = level_seq_;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        level = levels[chn];
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while((seq & 1) || seq != level_seq_);
+    return level;
+}
+
 // This turned into a very large function due to the bit-depth conversions..
 // I didn't want to do a conditional conversion in a single loop because it seemed
 // far less efficient, so this is where I landed.
@@ -244,6 +377,12 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
     chns = audio_handle.GetChannels();
     if(chns == 0)
         return;
+    // Meter sums for the block, in the scale of the callback
+    const bool  meter = audio_handle.metering_;
+    const float clip
+        = audio_handle.meter_config_.clip_level * audio_handle.postgain_recip_;
+    MeterSum sum_in[kAudioMaxChannels]  = {};
+    MeterSum sum_out[kAudioMaxChannels] = {};
     // Handle Interleaved / Non Interleaved separate
     if(audio_handle.interleaved_callback_)
     {
@@ -261,6 +400,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[i] = s162f(in[i]) * audio_handle.postgain_recip_;
                     fin[i + 1]
                         = s162f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[i], fin[i + 1], clip);
                 }
                 break;
             case SaiHandle::Config::BitDepth::SAI_24BIT:
@@ -269,6 +410,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[i] = s242f(in[i]) * audio_handle.postgain_recip_;
                     fin[i + 1]
                         = s242f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[i], fin[i + 1], clip);
                 }
                 break;
             case SaiHandle::Config::BitDepth::SAI_32BIT:
@@ -277,6 +420,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[i] = s322f(in[i]) * audio_handle.postgain_recip_;
                     fin[i + 1]
                         = s322f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[i], fin[i + 1], clip);
                 }
                 break;
             default: break;
@@ -290,6 +435,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     out[i] = f2s16(fout[i] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s16(fout[i + 1] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[i], fout[i + 1], clip);
                 }
                 break;
             case SaiHandle::Config::BitDepth::SAI_24BIT:
@@ -298,6 +445,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     out[i] = f2s24(fout[i] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s24(fout[i + 1] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[i], fout[i + 1], clip);
                 }
                 break;
             case SaiHandle::Config::BitDepth::SAI_32BIT:
@@ -306,6 +455,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     out[i] = f2s32(fout[i] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s32(fout[i + 1] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[i], fout[i + 1], clip);
                 }
                 break;
             default: break;
@@ -314,8 +465,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
     else if(audio_handle.callback_)
     {
         AudioCallback cb = (AudioCallback)audio_handle.callback_;
-        // offset needed for 2nd audio codec.
-        size_t offset    = audio_handle.sai2_.GetOffset();
+        // offset needed for 2nd audio codec, which may not be initialized.
+        size_t offset    = chns > 2 ? audio_handle.sai2_.GetOffset() : 0;
         size_t buff_size = chns > 2 ? size * 2 : size;
         float  finbuff[buff_size], foutbuff[buff_size];
         float* fin[chns];
@@ -340,6 +491,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[0][i / 2] = s162f(in[i]) * audio_handle.postgain_recip_;
                     fin[1][i / 2]
                         = s162f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[0][i / 2], fin[1][i / 2], clip);
                     if(chns > 2)
                     {
                         fin[2][i / 2]
@@ -348,6 +501,11 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         fin[3][i / 2]
                             = s162f(audio_handle.buff_rx_[1][offset + i + 1])
                               * audio_handle.postgain_recip_;
+                        if(meter)
+                            Meter2(sum_in + 2,
+                                   fin[2][i / 2],
+                                   fin[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
@@ -357,6 +515,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[0][i / 2] = s242f(in[i]) * audio_handle.postgain_recip_;
                     fin[1][i / 2]
                         = s242f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[0][i / 2], fin[1][i / 2], clip);
                     if(chns > 2)
                     {
                         fin[2][i / 2]
@@ -365,6 +525,11 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         fin[3][i / 2]
                             = s242f(audio_handle.buff_rx_[1][offset + i + 1])
                               * audio_handle.postgain_recip_;
+                        if(meter)
+                            Meter2(sum_in + 2,
+                                   fin[2][i / 2],
+                                   fin[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
@@ -374,6 +539,8 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                     fin[0][i / 2] = s322f(in[i]) * audio_handle.postgain_recip_;
                     fin[1][i / 2]
                         = s322f(in[i + 1]) * audio_handle.postgain_recip_;
+                    if(meter)
+                        Meter2(sum_in, fin[0][i / 2], fin[1][i / 2], clip);
                     if(chns > 2)
                     {
                         fin[2][i / 2]
@@ -382,6 +549,11 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         fin[3][i / 2]
                             = s322f(audio_handle.buff_rx_[1][offset + i + 1])
                               * audio_handle.postgain_recip_;
+                        if(meter)
+                            Meter2(sum_in + 2,
+                                   fin[2][i / 2],
+                                   fin[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
@@ -398,12 +570,19 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         = f2s16(fout[0][i / 2] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s16(fout[1][i / 2] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[0][i / 2], fout[1][i / 2], clip);
                     if(chns > 2)
                     {
                         audio_handle.buff_tx_[1][offset + i] = f2s16(
                             fout[2][i / 2] * audio_handle.config_.postgain);
                         audio_handle.buff_tx_[1][offset + i + 1] = f2s16(
                             fout[3][i / 2] * audio_handle.config_.postgain);
+                        if(meter)
+                            Meter2(sum_out + 2,
+                                   fout[2][i / 2],
+                                   fout[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
@@ -414,12 +593,19 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         = f2s24(fout[0][i / 2] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s24(fout[1][i / 2] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[0][i / 2], fout[1][i / 2], clip);
                     if(chns > 2)
                     {
                         audio_handle.buff_tx_[1][offset + i] = f2s24(
                             fout[2][i / 2] * audio_handle.config_.postgain);
                         audio_handle.buff_tx_[1][offset + i + 1] = f2s24(
                             fout[3][i / 2] * audio_handle.config_.postgain);
+                        if(meter)
+                            Meter2(sum_out + 2,
+                                   fout[2][i / 2],
+                                   fout[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
@@ -430,18 +616,27 @@ void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
                         = f2s32(fout[0][i / 2] * audio_handle.config_.postgain);
                     out[i + 1]
                         = f2s32(fout[1][i / 2] * audio_handle.config_.postgain);
+                    if(meter)
+                        Meter2(sum_out, fout[0][i / 2], fout[1][i / 2], clip);
                     if(chns > 2)
                     {
                         audio_handle.buff_tx_[1][offset + i] = f2s32(
                             fout[2][i / 2] * audio_handle.config_.postgain);
                         audio_handle.buff_tx_[1][offset + i + 1] = f2s32(
                             fout[3][i / 2] * audio_handle.config_.postgain);
+                        if(meter)
+                            Meter2(sum_out + 2,
+                                   fout[2][i / 2],
+                                   fout[3][i / 2],
+                                   clip);
                     }
                 }
                 break;
             default: break;
         }
     }
+    if(meter)
+        audio_handle.UpdateMeters(sum_in, sum_out, size / 2);
 }
 
 // ================================================================
@@ -520,4 +715,30 @@ AudioHandle::Result AudioHandle::SetPostGain(float val)
     return pimpl_->SetPostGain(val);
 }
 
+AudioHandle::Result AudioHandle::StartMetering(const MeterConfig& config)
+{
+    return pimpl_->StartMetering(config);
+}
+
+AudioHandle::Result AudioHandle::StopMetering()
+{
+    pimpl_->metering_ = false;
+    return Result::OK;
+}
+
+AudioHandle::MeterLevel AudioHandle::GetInputLevel(size_t chn) const
+{
+    return pimpl_->GetLevel(pimpl_->levels_[0], chn);
+}
+
+AudioHandle::MeterLevel AudioHandle::GetOutputLevel(size_t chn) const
+{
+    return pimpl_->GetLevel(pimpl_->levels_[1], chn);
+}
+
+void AudioHandle::ResetClipCounts()
+{
+    pimpl_->clip_resets_ = pimpl_->clip_resets_ + 1;
+}
+
 } // namespace daisy
@@ -59,6 +59,32 @@ class AudioHandle
                                               InterleavingOutputBuffer out,
                                               size_t                   size);
 
+    /** Levels of one channel, relative to the full scale of the codec */
+    struct MeterLevel
+    {
+        float    peak;  /**< highest absolute value, falls at peak_release */
+        float    rms;   /**< RMS averaged over rms_time */
+        float    dc;    /**< mean averaged over dc_time */
+        uint32_t clips; /**< samples at or over clip_level */
+    };
+
+    /** Ballistics of the meters */
+    struct MeterConfig
+    {
+        float rms_time;     /**< time constant in seconds, 0.3 as a VU meter */
+        float peak_release; /**< seconds for the peak to fall by 20dB */
+        float dc_time;      /**< time constant in seconds */
+        float clip_level;   /**< 0 to 1 of full scale */
+
+        void Defaults()
+        {
+            rms_time     = 0.3f;
+            peak_release = 1.5f;
+            dc_time      = 1.f;
+            clip_level   = 0.999f;
+        }
+    };
+
     AudioHandle() : pimpl_(nullptr) {}
     ~AudioHandle() {}
 
@@ -117,6 +143,29 @@ class AudioHandle
     /** Immediatley changes the audio callback to the interleaving callback passed in. */
     Result ChangeCallback(InterleavingAudioCallback callback);
 
+    /** Starts metering the input and output of every channel. The levels
+     ** are measured while the samples are converted to and from float, so
+     ** there's no extra pass over the buffers. They are measured before
+     ** the postgain on the way in and after it on the way out, so 1 is
+     ** always the full scale of the codec. Init turns metering off.
+     */
+    Result StartMetering(const MeterConfig& config);
+
+    /** Stops metering, the levels keep their last values */
+    Result StopMetering();
+
+    /** Returns the levels of an input channel as of the last block.
+     ** Safe to call from the main loop while audio runs: it never blocks
+     ** the audio interrupt, and the fields are all from the same block.
+     */
+    MeterLevel GetInputLevel(size_t chn) const;
+
+    /** Returns the levels of an output channel, the same way */
+    MeterLevel GetOutputLevel(size_t chn) const;
+
+    /** Sets the clip counts of all channels back to 0 with the next block */
+    void ResetClipCounts();
+
 
     class Impl;
 
@@ -2,10 +2,14 @@
 #ifndef DSY_KNOB_H
 #define DSY_KNOB_H /**< & */
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 namespace daisy
 {
+template <size_t N>
+class ParameterBank;
+
 /**
     @brief Hardware Interface for control inputs \n 
     Primarily designed for ADC input controls such as \n 
@@ -71,6 +75,10 @@ class AnalogControl
     void SetSampleRate(float sample_rate);
 
   private:
+    // Runs the smoothing of whole banks of controls
+    template <size_t N>
+    friend class ParameterBank;
+
     uint16_t *raw_;
     float     coeff_, samplerate_, val_;
     float     scale_, offset_;
@@ -1,19 +1,69 @@
 #include "hid/led.h"
 #include "per/tim.h"
+#include "util/BrightnessCurve.h"
 
 using namespace daisy;
 
 #define RESOLUTION_MAX (65535)
 
+// The cube, from 8 bit steps to 12 bits, in flash
+using LedCurve = BrightnessTable<BrightnessCurve::Gamma<30>, 8, 12>;
+
+// Number of steps a brightness is on for, rounded
+static uint32_t Quantize(float bright, uint32_t steps)
+{
+    bright = bright < 0.f ? 0.f : (bright > 1.f ? 1.f : bright);
+    return static_cast<uint32_t>(bright * steps + 0.5f);
+}
+
 void Led::Init(dsy_gpio_pin pin, bool invert, float samplerate)
 {
-    // Init hardware LED
-    // Simple OUTPUT GPIO for now.
+    // Simple OUTPUT GPIO, with software PWM
     hw_pin_.pin  = pin;
     hw_pin_.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    drive_       = Drive::SOFTWARE;
+    dma_         = nullptr;
     dsy_gpio_init(&hw_pin_);
+    InitState(invert, samplerate);
+}
+
+void Led::Init(dsy_gpio_pin pin, bool invert, TimerHandle &tim)
+{
+    // Only the channel is set up, the period and prescaler are the user's
+    TimerHandle::Config::Peripheral periph;
+    if(!TimerHandle::GetPwmChannel(pin, periph, chn_)
+       || periph != tim.GetConfig().periph
+       || tim.InitPwm(chn_, pin, invert) != TimerHandle::Result::OK)
+    {
+        Init(pin, invert);
+        return;
+    }
+    hw_pin_.pin = pin;
+    drive_      = Drive::TIMER;
+    dma_        = nullptr;
+    tim_        = tim;
+    InitState(invert, 1000.0f);
+}
+
+void Led::Init(dsy_gpio_pin pin, bool invert, GpioPwm &pwm)
+{
+    if(pin.port != pwm.GetConfig().port
+       || pwm.InitPin(pin.pin, invert) != GpioPwm::Result::OK)
+    {
+        Init(pin, invert);
+        return;
+    }
+    hw_pin_.pin = pin;
+    drive_      = Drive::DMA;
+    dma_        = &pwm;
+    InitState(invert, 1000.0f);
+}
+
+void Led::InitState(bool invert, float samplerate)
+{
     // Set internal stuff.
     bright_  = 0.0f;
+    pwm_     = 0.0f;
     pwm_cnt_ = 0;
     Set(bright_);
     invert_     = invert;
@@ -29,14 +79,44 @@ void Led::Init(dsy_gpio_pin pin, bool invert, float samplerate)
         off_ = false;
     }
 }
+
 void Led::Set(float val)
 {
-    bright_     = cube(val);
-    pwm_thresh_ = bright_ * static_cast<float>(RESOLUTION_MAX);
+    const uint32_t level = LedCurve::Interpolate(val);
+    bright_              = level * (1.f / LedCurve::kMax);
+    pwm_thresh_          = bright_ * static_cast<float>(RESOLUTION_MAX);
+    switch(drive_)
+    {
+        case Drive::TIMER:
+        {
+            // Scaled to the period, full on takes a compare value past it.
+            // TIM3 and TIM4 only hold 16 bits, so with their default period
+            // of 0xffff full on stays off for one tick of the period.
+            const TimerHandle::Config::Peripheral periph
+                = tim_.GetConfig().periph;
+            const uint64_t top
+                = periph == TimerHandle::Config::Peripheral::TIM_3
+                          || periph == TimerHandle::Config::Peripheral::TIM_4
+                      ? 0xffff
+                      : 0xffffffff;
+            const uint64_t ticks = uint64_t(tim_.GetPeriod()) + 1;
+            const uint64_t on    = level < LedCurve::kMax
+                                       ? level * ticks / (LedCurve::kMax + 1)
+                                       : ticks;
+            tim_.SetPwmCompare(chn_, on > top ? top : on);
+            break;
+        }
+        case Drive::DMA:
+            dma_->Set(hw_pin_.pin.pin, Quantize(bright_, dma_->GetSteps()));
+            break;
+        default: break;
+    }
 }
 
 void Led::Update()
 {
+    if(drive_ != Drive::SOFTWARE)
+        return;
     // Shout out to @grrwaaa for the quick fix for pwm
     pwm_ += 120.f / samplerate_;
     if(pwm_ > 1.f)
@@ -4,16 +4,21 @@
 #define DSY_LED_H
 #include "daisy_core.h"
 #include "per/gpio.h"
+#include "per/gpio_pwm.h"
+#include "per/tim.h"
 
 /* TODO - Get this set up to work with the dev_leddriver stuff as well
-- Setup Hardware PWM for pins that have it
 */
 
 namespace daisy
 {
 /**
-    @brief LED Class providing simple Software PWM ability, etc \n 
-    Eventually this will work with hardware PWM, and external LED Driver devices as well.
+    @brief LED Class with software PWM, or hardware PWM from a timer or a GpioPwm \n
+    By default the LED uses software PWM from Update(). \n
+    Pins on a channel of TIM3, TIM4 or TIM5 (see TimerHandle::GetPwmChannel())
+    can be driven by the timer instead, when it is passed to Init(). \n
+    Pins driven by a GpioPwm are updated by the DMA, with its resolution. \n
+    Update() does nothing for LEDs with hardware PWM.
     @author shensley
     @date March 2020
     @ingroup feedback
@@ -21,7 +26,7 @@ namespace daisy
 class Led
 {
   public:
-    Led() {}
+    Led() : drive_(Drive::SOFTWARE), dma_(nullptr) {}
     ~Led() {}
 
     /** 
@@ -32,16 +37,39 @@ class Led
     */
     void Init(dsy_gpio_pin pin, bool invert, float samplerate = 1000.0f);
 
+    /** Initializes an LED on a pin driven by a GpioPwm.
+    \param pin pin on the port of pwm
+    \param invert will set whether to internally invert the brightness due to hardware config.
+    \param pwm initialized GpioPwm, started before or after. With a pin on
+    another port, this is the same as Init(pin, invert).
+    */
+    void Init(dsy_gpio_pin pin, bool invert, GpioPwm &pwm);
+
+    /** Initializes an LED on a pin driven by a channel of a timer.
+    Only the channel is set up: the period and prescaler stay as they are,
+    so the timer can be shared, e.g. by the LEDs on its other channels, or
+    for a periodic callback. The resolution is the period, with the
+    compare value scaled to it at each Set(). E.g. a period of 4095 ticks
+    (prescaler 0) gives 12 bits at about 49kHz, above the audio band.
+    With the default period of TIM3 and TIM4 (0xffff), full brightness is
+    off for one tick per period, as their compare register has 16 bits.
+    \param pin pin on a channel of the timer, see TimerHandle::GetPwmChannel()
+    \param invert will set whether to internally invert the brightness due to hardware config.
+    \param tim initialized timer, started by InitPwm(). With a pin on
+    another timer, this is the same as Init(pin, invert).
+    */
+    void Init(dsy_gpio_pin pin, bool invert, TimerHandle &tim);
+
     /** 
     Sets the brightness of the Led.
-    \param val will be cubed for gamma correction, and then quantized to 8-bit values for Software PWM
-    8-bit is for more flexible update rate options, as 12-bit or more would require faster update rates.
+    \param val will be cubed for gamma correction, from a table interpolated to 12 bits,
+    and then quantized to the steps of a GpioPwm
     */
     void Set(float val);
 
     /** 
-    This processes the pwm of the LED
-    sets the hardware accordingly.
+    This processes the software pwm of the LED
+    sets the hardware accordingly. Does nothing with hardware PWM.
     */
     void Update();
 
@@ -51,12 +79,25 @@ class Led
     inline void SetSampleRate(float sample_rate) { samplerate_ = sample_rate; }
 
   private:
-    size_t   pwm_cnt_, pwm_thresh_;
-    float    bright_;
-    float    pwm_;
-    float    samplerate_;
-    bool     invert_, on_, off_;
-    dsy_gpio hw_pin_;
+    enum class Drive
+    {
+        SOFTWARE,
+        TIMER,
+        DMA,
+    };
+
+    void InitState(bool invert, float samplerate);
+
+    size_t               pwm_cnt_, pwm_thresh_;
+    float                bright_;
+    float                pwm_;
+    float                samplerate_;
+    bool                 invert_, on_, off_;
+    dsy_gpio             hw_pin_;
+    Drive                drive_;
+    TimerHandle          tim_;
+    TimerHandle::Channel chn_;
+    GpioPwm *            dma_;
 };
 
 } // namespace daisy
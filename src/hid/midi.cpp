@@ -10,6 +10,7 @@ const uint8_t kDataByteMask     = 0x7F;
 const uint8_t kSystemCommonMask = 0xF0;
 const uint8_t kChannelMask      = 0x0F;
 const uint8_t kRealTimeMask     = 0xF8;
+const uint8_t kSongPosition     = 0xF2;
 
 // Currently only setting this up to handle 3-byte messages (i.e. Notes, CCs, Pitchbend).
 // We'll have to do some minor tweaking to handle program changes, sysex,
@@ -74,11 +75,24 @@ void MidiHandler::Listen()
 
 void MidiHandler::Parse(uint8_t byte)
 {
+    // Real time messages may appear anywhere, even between the bytes
+    // of another message, and don't affect the parser state.
+    if((byte & kRealTimeMask) == kRealTimeMask)
+    {
+        if(clock_)
+            clock_->ProcessRealTime(byte, System::GetUs());
+        return;
+    }
+
     switch(pstate_)
     {
         case ParserEmpty:
+            if(byte == kSongPosition)
+            {
+                pstate_ = ParserSongPosition;
+            }
             // check byte for valid Status Byte
-            if(byte & kStatusByteMask)
+            else if(byte & kStatusByteMask)
             {
                 // Get MessageType, and Channel
                 incoming_message_.channel = byte & kChannelMask;
@@ -132,6 +146,25 @@ void MidiHandler::Parse(uint8_t byte)
             // because either the message is queued for handling or its not.
             pstate_ = ParserEmpty;
             break;
+        case ParserSongPosition:
+            if((byte & kStatusByteMask) == 0)
+            {
+                song_position_lsb_ = byte;
+                pstate_            = ParserSongPositionLsb;
+            }
+            else
+            {
+                pstate_ = ParserEmpty;
+            }
+            break;
+        case ParserSongPositionLsb:
+            if((byte & kStatusByteMask) == 0 && clock_)
+            {
+                clock_->SetSongPosition(((uint16_t)byte << 7)
+                                        | song_position_lsb_);
+            }
+            pstate_ = ParserEmpty;
+            break;
         default: break;
     }
 }
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include "per/uart.h"
 #include "util/ringbuffer.h"
+#include "hid/midi_clock.h"
 
 namespace daisy
 {
@@ -164,6 +165,14 @@ class MidiHandler
     */
     void SendMessage(uint8_t *bytes, size_t size);
 
+    /** Attaches a clock tracker that receives Timing Clock, Start, Continue, 
+    Stop and Song Position Pointer messages. \n
+    Real time messages are timestamped with System::GetUs() when they are parsed,
+    so Listen() should be called frequently (e.g. every pass of the main loop).
+    \param clock tracker to update, or nullptr to detach.
+    */
+    void SetClockTracker(MidiClockTracker *clock) { clock_ = clock; }
+
 
   private:
     enum ParserState
@@ -171,6 +180,8 @@ class MidiHandler
         ParserEmpty,
         ParserHasStatus,
         ParserHasData0,
+        ParserSongPosition,
+        ParserSongPositionLsb,
     };
     MidiInputMode              in_mode_;
     MidiOutputMode             out_mode_;
@@ -180,6 +191,8 @@ class MidiHandler
     RingBuffer<MidiEvent, 256> event_q_;
     uint32_t                   last_read_; // time of last byte
     MidiMessageType            running_status_;
+    MidiClockTracker *         clock_ = nullptr;
+    uint8_t                    song_position_lsb_;
 };
 
 /** @} */
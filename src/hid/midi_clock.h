@@ -0,0 +1,427 @@
+#pragma once
+#ifndef DSY_MIDI_CLOCK_H
+#define DSY_MIDI_CLOCK_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace daisy
+{
+/** @addtogroup external
+    @{
+*/
+
+/**
+    @brief MIDI Clock follower \n
+    Timestamps incoming MIDI Timing Clock messages (0xF8) and runs them
+    through a second order tracking loop (an alpha-beta filter, i.e. a
+    steady state Kalman filter for a constant tempo model) to estimate
+    a smooth tick period and phase. \n
+    Start, Stop, Continue and Song Position Pointer messages are handled so the
+    tracker knows the song position in ticks (24 per quarter note). \n
+    The filtered estimates can be used to drive tempo-synced delays and LFOs,
+    and to predict the sample position of the next beat for the audio engine. \n
+
+    Timestamps are given in microseconds (e.g. from System::GetUs()), and may wrap. \n
+    While acquiring lock, the loop starts with an expanding memory filter (the
+    least squares fit of the first few ticks) and narrows down to the
+    configured bandwidth, so the tempo is usable after a handful of ticks.
+
+    To use:
+    1. Init() the tracker
+    2. Pass it to MidiHandler::SetClockTracker(), or feed it manually via
+       ProcessRealTime() / SetSongPosition()
+    3. Read GetBpm(), GetBeatPhase() or GetSamplesToNextBeat() wherever needed.
+
+    Updates come from a single context, e.g. MidiHandler::Listen() in the main
+    loop. The getters may run in a context that interrupts the updates, such
+    as the audio callback, or is interrupted by them: every update publishes
+    a copy of the state, and the getters copy it again if an update was
+    published meanwhile.
+*/
+class MidiClockTracker
+{
+  public:
+    /** Number of MIDI Timing Clock messages per quarter note */
+    static constexpr uint32_t kTicksPerBeat = 24;
+    /** Number of MIDI Timing Clock messages per Song Position Pointer unit (a 16th note) */
+    static constexpr uint32_t kTicksPerSongPosition = 6;
+
+    /** Configuration for the tracking loop */
+    struct Config
+    {
+        /** Phase correction gain (0, 1]. Smaller values reject more jitter
+         ** but follow tempo changes more slowly. */
+        float smoothing;
+        /** Lowest accepted tempo. Slower clocks reset the tracker. */
+        float min_bpm;
+        /** Highest accepted tempo. */
+        float max_bpm;
+
+        /** Sets a gain of 0.05 (~20 tick time constant), and 20-400 BPM */
+        void Defaults()
+        {
+            smoothing = 0.05f;
+            min_bpm   = 20.f;
+            max_bpm   = 400.f;
+        }
+    };
+
+    MidiClockTracker() {}
+    ~MidiClockTracker() {}
+
+    /** Initializes the tracker with default settings */
+    void Init()
+    {
+        Config cfg;
+        cfg.Defaults();
+        Init(cfg);
+    }
+
+    /** Initializes the tracker
+    \param cfg configuration for the tracking loop
+    */
+    void Init(const Config &cfg)
+    {
+        cfg_ = cfg;
+        if(cfg_.smoothing <= 0.f || cfg_.smoothing > 1.f)
+            cfg_.smoothing = 0.05f;
+        // Critically damped alpha-beta pair for the chosen alpha
+        alpha_ = cfg_.smoothing;
+        beta_  = (alpha_ * alpha_) / (2.f - alpha_);
+        // Tick periods in us are 60e6 / (bpm * 24)
+        min_period_ = 2500000.f / cfg_.max_bpm;
+        max_period_ = 2500000.f / cfg_.min_bpm;
+
+        running_       = false;
+        pending_start_ = false;
+        song_tick_     = 0;
+        seq_           = 0;
+        ClearEstimate();
+        Publish();
+    }
+
+    /** Discards the tempo estimate. The song position is kept. */
+    void Reset()
+    {
+        ClearEstimate();
+        Publish();
+    }
+
+    /** Handles a MIDI System Real Time byte.
+    Bytes that aren't Clock, Start, Continue or Stop are ignored.
+    \param byte real time status byte (0xF8 - 0xFF)
+    \param now_us time of arrival in microseconds
+    */
+    void ProcessRealTime(uint8_t byte, uint32_t now_us)
+    {
+        switch(byte)
+        {
+            case 0xF8: Tick(now_us); break;
+            case 0xFA: Start(); break;
+            case 0xFB: Continue(); break;
+            case 0xFC: Stop(); break;
+            default: break;
+        }
+    }
+
+    /** Handles a Timing Clock message
+    \param now_us time of arrival in microseconds
+    */
+    void Tick(uint32_t now_us)
+    {
+        UpdateLoop(now_us);
+        if(running_)
+        {
+            if(pending_start_)
+                pending_start_ = false;
+            else
+                song_tick_++;
+        }
+        Publish();
+    }
+
+    /** Handles a Start message. The next clock is the first tick of the song. */
+    void Start()
+    {
+        song_tick_     = 0;
+        pending_start_ = true;
+        running_       = true;
+        Publish();
+    }
+
+    /** Handles a Continue message. Playback resumes from the current song position. */
+    void Continue()
+    {
+        running_ = true;
+        Publish();
+    }
+
+    /** Handles a Stop message. Clocks keep updating the tempo, but the song position holds. */
+    void Stop()
+    {
+        running_ = false;
+        Publish();
+    }
+
+    /** Handles a Song Position Pointer message.
+    The next clock after Continue will land on the new position.
+    \param sixteenths song position in 16th notes (14 bit value from the message)
+    */
+    void SetSongPosition(uint16_t sixteenths)
+    {
+        song_tick_ = static_cast<uint32_t>(sixteenths) * kTicksPerSongPosition;
+        pending_start_ = true;
+        Publish();
+    }
+
+    /** \return true if transport is running (after Start/Continue, before Stop) */
+    bool IsRunning() const { return Load().running; }
+
+    /** \return true once enough clocks have been received to trust the tempo estimate */
+    bool IsLocked() const { return Load().num_ticks > kTicksPerBeat; }
+
+    /** \return true if a clock was received within the last 4 tick periods
+    \param now_us current time in microseconds
+    */
+    bool IsReceiving(uint32_t now_us) const
+    {
+        const State s = Load();
+        if(s.num_ticks < 2)
+            return false;
+        return static_cast<float>(static_cast<int32_t>(now_us - s.last_tick))
+               < s.period * 4.f;
+    }
+
+    /** \return the filtered tempo in BPM, or 0 if no tempo has been measured yet. */
+    float GetBpm() const
+    {
+        const float period = Load().period;
+        return period > 0.f ? 2500000.f / period : 0.f;
+    }
+
+    /** \return the filtered time between clock messages in microseconds */
+    float GetTickPeriodUs() const { return Load().period; }
+
+    /** \return the filtered length of a quarter note in microseconds */
+    float GetBeatPeriodUs() const { return Load().period * kTicksPerBeat; }
+
+    /** \return the smoothed absolute deviation of incoming clocks from the
+     ** predicted arrival time in microseconds. Useful for diagnostics. */
+    float GetJitterUs() const { return Load().jitter; }
+
+    /** \return song position in ticks of the last received clock */
+    uint32_t GetSongTick() const { return Load().song_tick; }
+
+    /** Continuous song position in beats (quarter notes), interpolated between clocks.
+    The interpolation holds at the next tick if clocks stop arriving, and
+    while the transport is stopped.
+    \param now_us current time in microseconds
+    */
+    float GetBeatPosition(uint32_t now_us) const
+    {
+        const State s = Load();
+        return (static_cast<float>(s.song_tick) + GetTickFraction(s, now_us))
+               / kTicksPerBeat;
+    }
+
+    /** \return phase within the current beat in the range [0, 1)
+    \param now_us current time in microseconds
+    */
+    float GetBeatPhase(uint32_t now_us) const
+    {
+        const State s     = Load();
+        float       phase = (static_cast<float>(s.song_tick % kTicksPerBeat)
+                             + GetTickFraction(s, now_us))
+                            / kTicksPerBeat;
+        return phase >= 1.f ? phase - 1.f : phase;
+    }
+
+    /** Predicts the arrival time of the next beat (quarter note) boundary.
+    \param now_us current time in microseconds
+    \return predicted time in microseconds, or now_us if there is no estimate yet.
+    */
+    uint32_t GetNextBeatTime(uint32_t now_us) const
+    {
+        const State s = Load();
+        if(s.num_ticks < 2)
+            return now_us;
+        // Ticks from the last received clock until the next beat boundary
+        uint32_t ticks = kTicksPerBeat - (s.song_tick % kTicksPerBeat);
+        if(s.pending_start)
+            ticks = (s.song_tick % kTicksPerBeat) == 0 ? 1 : ticks + 1;
+        float    t    = s.tick_frac + s.period * ticks;
+        uint32_t next = s.last_tick + static_cast<uint32_t>(t);
+        // Step over boundaries that have already passed.
+        while(static_cast<int32_t>(next - now_us) < 0)
+            next += static_cast<uint32_t>(s.period * kTicksPerBeat);
+        return next;
+    }
+
+    /** Predicts the number of samples from now until the next beat.
+    \param now_us current time in microseconds
+    \param samplerate audio samplerate in Hz
+    */
+    uint32_t GetSamplesToNextBeat(uint32_t now_us, float samplerate) const
+    {
+        uint32_t dt = GetNextBeatTime(now_us) - now_us;
+        return static_cast<uint32_t>(static_cast<float>(dt) * samplerate
+                                     * 1e-6f);
+    }
+
+  private:
+    /** The part of the tracker the getters read */
+    struct State
+    {
+        float    period;
+        uint32_t last_tick;
+        float    tick_frac;
+        float    jitter;
+        uint32_t num_ticks;
+        uint32_t song_tick;
+        bool     running;
+        bool     pending_start;
+    };
+
+    /** Copies the state to the slot the getters don't read, then switches
+     ** them over to it. A getter that interrupts this still reads the
+     ** previous copy, which stays untouched until the next update. */
+    void Publish()
+    {
+        State &s        = published_[(seq_ + 1) & 1];
+        s.period        = period_;
+        s.last_tick     = last_tick_;
+        s.tick_frac     = tick_frac_;
+        s.jitter        = jitter_;
+        s.num_ticks     = num_ticks_;
+        s.song_tick     = song_tick_;
+        s.running       = running_;
+        s.pending_start = pending_start_;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        seq_ = seq_ + 1;
+    }
+
+    /** Copies the published state, again if an update interrupted the copy */
+    State Load() const
+    {
+        State    s;
+        uint32_t seq;
+        do
+        {
+            seq = seq_;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            s = published_[seq & 1];
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while(seq != seq_);
+        return s;
+    }
+
+    static float GetTickFraction(const State &s, uint32_t now_us)
+    {
+        if(s.num_ticks < 2 || !s.running || s.pending_start)
+            return 0.f;
+        float frac
+            = (static_cast<float>(static_cast<int32_t>(now_us - s.last_tick))
+               - s.tick_frac)
+              / s.period;
+        if(frac < 0.f)
+            return 0.f;
+        // Don't run past the next clock while waiting for it.
+        return frac > 1.f ? 1.f : frac;
+    }
+
+    void UpdateLoop(uint32_t now_us)
+    {
+        if(num_ticks_ == 0)
+        {
+            last_tick_ = now_us;
+            tick_frac_ = 0.f;
+            num_ticks_ = 1;
+            return;
+        }
+
+        float interval
+            = static_cast<float>(static_cast<int32_t>(now_us - last_tick_))
+              - tick_frac_;
+        if(interval > max_period_ * 2.f)
+        {
+            // Clock was gone for a while. Reacquire from this tick.
+            ClearEstimate();
+            UpdateLoop(now_us);
+            return;
+        }
+
+        if(num_ticks_ == 1)
+        {
+            period_ = interval < min_period_ ? min_period_ : interval;
+            Advance(interval);
+            return;
+        }
+
+        // Expanding memory gains while acquiring, then the fixed loop gains.
+        float k     = static_cast<float>(num_ticks_);
+        float alpha = 2.f * (2.f * k - 1.f) / (k * (k + 1.f));
+        float beta  = 6.f / (k * (k + 1.f));
+        if(alpha < alpha_)
+        {
+            alpha = alpha_;
+            beta  = beta_;
+        }
+
+        float predicted = period_;
+        float err       = interval - predicted;
+        // Limit single outliers (late bytes, UART bursts) to half a tick.
+        float lim = period_ * 0.5f;
+        if(err > lim)
+            err = lim;
+        else if(err < -lim)
+            err = -lim;
+        jitter_ += 0.05f * ((err < 0.f ? -err : err) - jitter_);
+
+        period_ += beta * err;
+        if(period_ < min_period_)
+            period_ = min_period_;
+        else if(period_ > max_period_)
+            period_ = max_period_;
+        Advance(predicted + alpha * err);
+    }
+
+    void ClearEstimate()
+    {
+        num_ticks_ = 0;
+        period_    = 0.f;
+        last_tick_ = 0;
+        tick_frac_ = 0.f;
+        jitter_    = 0.f;
+    }
+
+    /** Moves the estimated time of the last tick forward by dt microseconds,
+     ** keeping the sub-microsecond remainder. */
+    void Advance(float dt)
+    {
+        float    t     = tick_frac_ + dt;
+        uint32_t whole = static_cast<uint32_t>(t);
+        last_tick_ += whole;
+        tick_frac_ = t - static_cast<float>(whole);
+        num_ticks_++;
+    }
+
+    Config   cfg_;
+    float    alpha_, beta_;
+    float    min_period_, max_period_;
+    float    period_;
+    uint32_t last_tick_;
+    float    tick_frac_;
+    float    jitter_;
+    uint32_t num_ticks_;
+    uint32_t song_tick_;
+    bool     running_;
+    bool     pending_start_;
+
+    State             published_[2];
+    volatile uint32_t seq_; // published_[seq_ & 1] is the current copy
+};
+
+/** @} */
+} // namespace daisy
+#endif
@@ -8,7 +8,8 @@ namespace daisy
     @{
 */
 
-/**      Simple parameter mapping tool that takes a 0-1 input from an hid_ctrl. */
+/**      Simple parameter mapping tool that takes a 0-1 input from an hid_ctrl.
+    For many parameters, ParameterBank maps them all in one pass. */
 class Parameter
 {
   public:
@@ -0,0 +1,223 @@
+#pragma once
+#ifndef DSY_PARAMETER_BANK_H
+#define DSY_PARAMETER_BANK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "hid/ctrl.h"
+#include "hid/parameter.h"
+
+namespace daisy
+{
+/** @addtogroup controls
+    @{
+*/
+
+/** Processes a bank of AnalogControls and maps them with the curves of
+ ** Parameter, in one pass per block instead of two calls per control.
+ **
+ ** The one pole smoothing of the controls runs over arrays: the input
+ ** scaling of each control is folded into one multiply-add on the raw
+ ** reading when it is set up. The linear, exponential and cube curves
+ ** are all evaluated as the same cubic polynomial, with the coefficients
+ ** worked out at Init, so there is no branch per parameter. The
+ ** logarithmic curve uses Exp2(), a handful of multiply-adds, instead of
+ ** expf(). Exp2() is within 2e-7 (about 1 ulp) of the exact result. The
+ ** mapped value differs from Parameter by the rounding of the exponent, a
+ ** few parts per million for wide ranges such as 20Hz to 20kHz, the same
+ ** rounding error that Parameter has.
+ **
+ ** Measured with tests/bench on an x86 host (gcc 12, -O2), 24 controls
+ ** with half of them logarithmic: 99ns per block for the bank, against
+ ** 113ns for 24 Parameter::Process(). There, glibc's table driven expf()
+ ** (59ns for 24) is still faster than Exp2() (67ns for 24), the bank wins
+ ** on the smoothing and the curves. newlib's expf() on the Seed does a
+ ** full range reduction per call instead. The same benchmarks build for
+ ** the Seed (tests/bench/Makefile) and report DWT cycles there.
+ **
+ ** The controls are processed by the bank, so don't also call their
+ ** Process(). Their Value() is kept up to date. Unused slots stay at 0.
+ **
+ ** \tparam N number of parameters
+ */
+template <size_t N>
+class ParameterBank
+{
+  public:
+    ParameterBank() : log_count_(0)
+    {
+        for(size_t i = 0; i < N; i++)
+        {
+            ctrl_[i] = nullptr;
+            raw_[i]  = &kNoInput;
+            gain_[i] = bias_[i] = slew_[i] = smooth_[i] = 0.f;
+            for(size_t k = 0; k < 4; k++)
+                coeff_[k][i] = 0.f;
+            val_[i] = 0.f;
+        }
+    }
+    ~ParameterBank() {}
+
+    /** Sets up one parameter, the same way as Parameter::Init.
+     ** The settings of the control are copied, so call this again after
+     ** changing them (e.g. SetCoeff() or SetSampleRate()).
+     ** \param idx parameter, 0 to N-1
+     ** \param input control that feeds it, processed by the bank
+     ** \param min output when the input is 0
+     ** \param max output when the input is 1
+     ** \param curve scaling from the input to the output
+     */
+    void Init(size_t           idx,
+              AnalogControl *  input,
+              float            min,
+              float            max,
+              Parameter::Curve curve)
+    {
+        if(idx >= N)
+            return;
+        ctrl_[idx] = input;
+        if(input)
+        {
+            // The input scaling of AnalogControl::Process, as one
+            // multiply-add on the raw reading
+            float scale = input->scale_ * (input->invert_ ? -1.f : 1.f);
+            float offset
+                = input->flip_ ? 1.f - input->offset_ : -input->offset_;
+            raw_[idx]    = input->raw_;
+            gain_[idx]   = (input->flip_ ? -scale : scale) / 65536.f;
+            bias_[idx]   = offset * scale;
+            slew_[idx]   = input->coeff_;
+            smooth_[idx] = input->val_;
+        }
+        else
+        {
+            raw_[idx]  = &kNoInput;
+            gain_[idx] = bias_[idx] = slew_[idx] = smooth_[idx] = 0.f;
+        }
+        RemoveLog(idx);
+        for(size_t k = 0; k < 4; k++)
+            coeff_[k][idx] = 0.f;
+
+        float range = max - min;
+        switch(curve)
+        {
+            case Parameter::EXPONENTIAL:
+                coeff_[2][idx] = range;
+                coeff_[0][idx] = min;
+                break;
+            case Parameter::CUBE:
+                coeff_[3][idx] = range;
+                coeff_[0][idx] = min;
+                break;
+            case Parameter::LOGARITHMIC:
+            {
+                // exp(x * (lmax - lmin) + lmin) as a power of 2
+                float lmin = log2f(min < 0.0000001f ? 0.0000001f : min);
+
+                coeff_[1][idx]     = log2f(max) - lmin;
+                coeff_[0][idx]     = lmin;
+                log_[log_count_++] = (uint8_t)idx;
+                break;
+            }
+            default:
+                coeff_[1][idx] = range;
+                coeff_[0][idx] = min;
+                break;
+        }
+    }
+
+    /** Processes all controls and maps them. Call at the rate the
+     ** controls were initialized with.
+     */
+    void Process()
+    {
+        // The one pole smoothing of AnalogControl, for all controls at once
+        float *x = smooth_;
+        for(size_t i = 0; i < N; i++)
+        {
+            float t = (float)*raw_[i] * gain_[i] + bias_[i];
+            x[i] += slew_[i] * (t - x[i]);
+        }
+
+        // Every curve is a polynomial in x, the log curve in the exponent
+        for(size_t i = 0; i < N; i++)
+        {
+            val_[i] = ((coeff_[3][i] * x[i] + coeff_[2][i]) * x[i]
+                       + coeff_[1][i])
+                          * x[i]
+                      + coeff_[0][i];
+        }
+        for(size_t j = 0; j < log_count_; j++)
+            val_[log_[j]] = Exp2(val_[log_[j]]);
+
+        // So that the controls' Value() stays current
+        for(size_t i = 0; i < N; i++)
+            if(ctrl_[i])
+                ctrl_[i]->val_ = x[i];
+    }
+
+    /** \return the current value of a parameter, without processing */
+    float Value(size_t idx) const { return idx < N ? val_[idx] : 0.f; }
+
+    /** \return the current values of all N parameters */
+    const float *Values() const { return val_; }
+
+    /** Fast 2^x, for x from -126 to 128. Relative error below 2e-7.
+     ** The fraction goes through a degree 5 minimax polynomial, and the
+     ** integer part straight into the exponent bits.
+     */
+    static float Exp2(float x)
+    {
+        x         = x < -126.f ? -126.f : x;
+        x         = x > 127.999f ? 127.999f : x;
+        // floor, as truncation of a positive number
+        int32_t i = (int32_t)(x + 128.f) - 128;
+        float f = x - (float)i;
+        float p = ((((1.8775752e-3f * f + 8.9893453e-3f) * f + 5.5826314e-2f)
+                        * f
+                    + 2.4015363e-1f)
+                       * f
+                   + 6.9315308e-1f)
+                      * f
+                  + 9.9999994e-1f;
+        uint32_t bits = (uint32_t)(i + 127) << 23;
+        float    scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+  private:
+    void RemoveLog(size_t idx)
+    {
+        for(size_t j = 0; j < log_count_; j++)
+        {
+            if(log_[j] == idx)
+            {
+                log_[j] = log_[--log_count_];
+                return;
+            }
+        }
+    }
+
+    static_assert(N <= 256, "parameters are indexed with 8 bits");
+
+    static constexpr uint16_t kNoInput = 0;
+
+    AnalogControl * ctrl_[N];
+    const uint16_t *raw_[N];              // ADC readings
+    float           gain_[N], bias_[N];   // input scaling of the readings
+    float           slew_[N], smooth_[N]; // one pole coefficient and state
+    float           coeff_[4][N]; // polynomial coefficients, lowest first
+    float           val_[N];
+    uint8_t         log_[N]; // parameters with a logarithmic curve
+    size_t          log_count_;
+};
+
+template <size_t N>
+constexpr uint16_t ParameterBank<N>::kNoInput;
+/** @} */
+} // namespace daisy
+
+#endif
@@ -10,6 +10,28 @@ void RgbLed::Init(dsy_gpio_pin red,
     b_.Init(blue, invert);
 }
 
+void RgbLed::Init(dsy_gpio_pin red,
+                  dsy_gpio_pin green,
+                  dsy_gpio_pin blue,
+                  bool         invert,
+                  GpioPwm &    pwm)
+{
+    r_.Init(red, invert, pwm);
+    g_.Init(green, invert, pwm);
+    b_.Init(blue, invert, pwm);
+}
+
+void RgbLed::Init(dsy_gpio_pin red,
+                  dsy_gpio_pin green,
+                  dsy_gpio_pin blue,
+                  bool         invert,
+                  TimerHandle &tim)
+{
+    r_.Init(red, invert, tim);
+    g_.Init(green, invert, tim);
+    b_.Init(blue, invert, tim);
+}
+
 void RgbLed::Set(float r, float g, float b)
 {
     r_.Set(r);
@@ -24,6 +46,12 @@ void RgbLed::SetColor(Color c)
     b_.Set(c.Blue());
 }
 
+void RgbLed::SetColor(PackedColor c)
+{
+    r_.Set(c.Red() * (1.f / 255.f));
+    g_.Set(c.Green() * (1.f / 255.f));
+    b_.Set(c.Blue() * (1.f / 255.f));
+}
 
 void RgbLed::Update()
 {
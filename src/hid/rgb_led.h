@@ -26,6 +26,34 @@ class RgbLed
     void
     Init(dsy_gpio_pin red, dsy_gpio_pin green, dsy_gpio_pin blue, bool invert);
 
+    /** Initializes the 3 elements on pins driven by a GpioPwm, see
+    Led::Init(dsy_gpio_pin, bool, GpioPwm&)
+    \param red  Red element
+    \param green Green element
+    \param blue Blue element
+    \param invert Flips led polarity
+    \param pwm GpioPwm for the port of the pins
+    */
+    void Init(dsy_gpio_pin red,
+              dsy_gpio_pin green,
+              dsy_gpio_pin blue,
+              bool         invert,
+              GpioPwm &    pwm);
+
+    /** Initializes the 3 elements on the channels of a timer, see
+    Led::Init(dsy_gpio_pin, bool, TimerHandle&)
+    \param red  Red element
+    \param green Green element
+    \param blue Blue element
+    \param invert Flips led polarity
+    \param tim timer of the pins' channels
+    */
+    void Init(dsy_gpio_pin red,
+              dsy_gpio_pin green,
+              dsy_gpio_pin blue,
+              bool         invert,
+              TimerHandle &tim);
+
     /** Sets each element of the LED with a floating point number 0-1 
     \param r Red element
     \param g Green element
@@ -38,8 +66,14 @@ class RgbLed
      */
     void SetColor(Color c);
 
+    /** Sets the RGB using a PackedColor, 8 bits per element.
+    \param c PackedColor to set.
+     */
+    void SetColor(PackedColor c);
+
     /** Updates the PWM of the LED based on the current values.
     Should be called at a regular interval. (i.e. 1kHz/1ms)
+    Elements with hardware PWM don't need it.
     */
     void Update();
 
@@ -1,17 +1,16 @@
+#include <stdio.h>
 #include <string.h>
 #include "hid/wavplayer.h"
 #include "fatfs.h"
 
 using namespace daisy;
 
-void WavPlayer::Init()
+/** Name of the WavFileIndex file, in the searched directory */
+static const char kIndexName[] = "wavindex.bin";
+
+void WavPlayer::Init(const char *search_path)
 {
-    // First check for all .wav files, and add them to the list until its full or there are no more.
-    // Only checks '/'
-    FRESULT result = FR_OK;
-    FILINFO fno;
-    DIR     dir;
-    char *  fn;
+    char index_path[WAV_FILENAME_MAX];
     file_sel_ = 0;
     file_cnt_ = 0;
     playing_  = true;
@@ -20,58 +19,26 @@ void WavPlayer::Init()
     dsy_fatfs_init();
     // Mount SD Card
     f_mount(&SDFatFS, SDPath, 1);
-    // Open Dir and scan for files.
-    if(f_opendir(&dir, SDPath) != FR_OK)
+    // Find the files, through the index on the card.
+    if(search_path == nullptr)
+        search_path = SDPath;
+    size_t len = strlen(search_path);
+    snprintf(index_path,
+             sizeof(index_path),
+             "%s%s%s",
+             search_path,
+             len > 0 && search_path[len - 1] == '/' ? "" : "/",
+             kIndexName);
+    index_.Init(search_path, index_path);
+    file_cnt_ = index_.GetNumFiles();
+    if(file_cnt_ == 0)
     {
+        memset(buff_, 0, sizeof(buff_));
+        buff_state_ = BUFFER_STATE_IDLE;
+        read_ptr_   = 0;
+        playing_    = false;
         return;
     }
-    do
-    {
-        result = f_readdir(&dir, &fno);
-        // Exit if bad read or NULL fname
-        if(result != FR_OK || fno.fname[0] == 0)
-            break;
-        // Skip if its a directory or a hidden file.
-        if(fno.fattrib & (AM_HID | AM_DIR))
-            continue;
-        // Now we'll check if its .wav and add to the list.
-        fn = fno.fname;
-        if(file_cnt_ < kMaxFiles - 1)
-        {
-            if(strstr(fn, ".wav") || strstr(fn, ".WAV"))
-            {
-                strcpy(file_info_[file_cnt_].name, fn);
-                file_cnt_++;
-                // For now lets break anyway to test.
-                //                break;
-            }
-        }
-        else
-        {
-            break;
-        }
-    } while(result == FR_OK);
-    f_closedir(&dir);
-    // Now we'll go through each file and load the WavInfo.
-    for(size_t i = 0; i < file_cnt_; i++)
-    {
-        size_t bytesread;
-        if(f_open(&SDFile, file_info_[i].name, (FA_OPEN_EXISTING | FA_READ))
-           == FR_OK)
-        {
-            // Populate the WAV Info
-            if(f_read(&SDFile,
-                      (void *)&file_info_[i].raw_data,
-                      sizeof(WAV_FormatTypeDef),
-                      &bytesread)
-               != FR_OK)
-            {
-                // Maybe add return type
-                return;
-            }
-            f_close(&SDFile);
-        }
-    }
     // fill buffer with first file preemptively.
     buff_state_ = BUFFER_STATE_PREPARE_0;
     Open(0);
@@ -82,14 +49,17 @@ void WavPlayer::Init()
 
 int WavPlayer::Open(size_t sel)
 {
-    if(sel != file_sel_)
-    {
-        f_close(&SDFile);
-        file_sel_ = sel < file_cnt_ ? sel : file_cnt_ - 1;
-    }
+    if(file_cnt_ == 0)
+        return FR_NO_FILE;
+    f_close(&SDFile);
+    file_sel_ = sel < file_cnt_ ? sel : file_cnt_ - 1;
+    if(!index_.GetFileInfo(file_sel_, &file_info_))
+        return FR_NO_FILE;
     // Set Buffer Position
-    return f_open(
-        &SDFile, file_info_[file_sel_].name, (FA_OPEN_EXISTING | FA_READ));
+    int res = f_open(&SDFile, file_info_.name, (FA_OPEN_EXISTING | FA_READ));
+    if(res == FR_OK)
+        res = f_lseek(&SDFile, file_info_.data_offset);
+    return res;
 }
 
 int WavPlayer::Close()
@@ -150,9 +120,7 @@ void WavPlayer::Prepare()
 void WavPlayer::Restart()
 {
     playing_ = true;
-    f_lseek(&SDFile,
-            sizeof(WAV_FormatTypeDef)
-                + file_info_[file_sel_].raw_data.SubChunk1Size);
+    f_lseek(&SDFile, file_info_.data_offset);
 }
 
 WavPlayer::BufferState WavPlayer::GetNextBuffState()
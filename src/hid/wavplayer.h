@@ -10,22 +10,15 @@ this module. However, by using the extern'd SDFile, etc. I think that would brea
 #define DSY_WAVPLAYER_H /**< Macro */
 #include "daisy_core.h"
 #include "util/wav_format.h"
-
-#define WAV_FILENAME_MAX \
-    256 /**< Maximum LFN (set to same in FatFs (ffconf.h) */
+#include "util/WavFileIndex.h"
+#include "util/FatFileReader.h"
+#include "util/FatFileWriter.h"
+#include "util/FatDirectory.h"
 
 /** @file hid_wavplayer.h */
 
 namespace daisy
 {
-// TODO: add bitrate, samplerate, length, etc.
-/** Struct containing details of Wav File. */
-struct WavFileInfo
-{
-    WAV_FormatTypeDef raw_data;               /**< Raw wav data */
-    char              name[WAV_FILENAME_MAX]; /**< Wav filename */
-};
-
 /* 
 TODO:
 - Make template-y to reduce memory usage.
@@ -34,15 +27,23 @@ TODO:
 
 /** Wav Player that will load .wav files from an SD Card,
 and then provide a method of accessing the samples with
-double-buffering. */
+double-buffering.
+
+The files are found through a WavFileIndex, kept in the file
+wavindex.bin in the searched directory, so only new or changed
+files are opened at startup. If the index can't be written (e.g. the
+card is write protected), the first 8 files found are played. */
 class WavPlayer
 {
   public:
     WavPlayer() {}
     ~WavPlayer() {}
 
-    /** Initializes the WavPlayer, loading up to max_files of wav files from an SD Card. */
-    void Init();
+    /** Initializes the WavPlayer, and finds the wav files on the SD Card.
+    \param search_path directory to search, including its subdirectories.
+    The root of the card by default.
+     */
+    void Init(const char *search_path = nullptr);
 
     /** Opens the file at index sel for reading.
     \param sel File to open
@@ -77,6 +78,9 @@ class WavPlayer
     /** \return currently selected file.*/
     inline size_t GetCurrentFile() const { return file_sel_; }
 
+    /** \return details of the currently selected file */
+    inline const WavFileInfo &GetFileInfo() const { return file_info_; }
+
   private:
     enum BufferState
     {
@@ -87,9 +91,11 @@ class WavPlayer
 
     BufferState GetNextBuffState();
 
-    static constexpr size_t kMaxFiles   = 8;
+    using Index = WavFileIndex<FatFileReader, FatFileWriter, FatDirectory>;
+
     static constexpr size_t kBufferSize = 512;
-    WavFileInfo             file_info_[kMaxFiles];
+    Index                   index_;
+    WavFileInfo             file_info_;
     size_t                  file_cnt_, file_sel_;
     BufferState             buff_state_;
     int16_t                 buff_[kBufferSize];
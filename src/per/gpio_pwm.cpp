@@ -0,0 +1,113 @@
+#include "per/gpio_pwm.h"
+#include "per/gpio.h"
+#include "util/hal_map.h"
+
+namespace daisy
+{
+// One DMA stream per timer, indexed like TimerHandle::Config::Peripheral
+static DMA_HandleTypeDef gpio_pwm_dma[4];
+
+static DMA_Stream_TypeDef *const gpio_pwm_streams[4]
+    = {nullptr, DMA2_Stream2, DMA2_Stream3, DMA2_Stream4};
+
+static const uint32_t gpio_pwm_requests[4]
+    = {0, DMA_REQUEST_TIM3_UP, DMA_REQUEST_TIM4_UP, DMA_REQUEST_TIM5_UP};
+
+static TIM_TypeDef *const gpio_pwm_tims[4] = {TIM2, TIM3, TIM4, TIM5};
+
+GpioPwm::Result
+GpioPwm::Init(const Config &config, uint32_t *pattern, size_t steps)
+{
+    // TIM2 keeps the system time
+    if(config.periph == TimerHandle::Config::Peripheral::TIM_2
+       || pattern == nullptr || steps < 2 || steps > 0xffff
+       || config.port >= DSY_GPIOX || config.freq == 0)
+        return Result::ERR;
+
+    TimerHandle::Config tim_cfg;
+    tim_cfg.periph = config.periph;
+    tim_cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    if(tim_.Init(tim_cfg) != TimerHandle::Result::OK)
+        return Result::ERR;
+    uint32_t ticks = tim_.GetFreq() / (config.freq * steps);
+    if(ticks < 2)
+        return Result::ERR;
+    tim_.SetPeriod(ticks - 1);
+
+    config_   = config;
+    pattern_  = pattern;
+    steps_    = steps;
+    pins_     = 0;
+    inverted_ = 0;
+    for(size_t i = 0; i < steps; i++)
+        pattern_[i] = 0;
+    for(size_t i = 0; i < 16; i++)
+        levels_[i] = 0;
+    return Result::OK;
+}
+
+GpioPwm::Result GpioPwm::InitPin(uint8_t pin, bool invert)
+{
+    if(pin >= 16 || pattern_ == nullptr)
+        return Result::ERR;
+    dsy_gpio gpio;
+    gpio.pin  = {config_.port, pin};
+    gpio.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    gpio.pull = DSY_GPIO_NOPULL;
+    dsy_gpio_init(&gpio);
+    dsy_gpio_write(&gpio, invert);
+
+    pins_ |= 1u << pin;
+    if(invert)
+        inverted_ |= 1u << pin;
+    else
+        inverted_ &= ~(1u << pin);
+    levels_[pin] = 0;
+    Set(pin, 0);
+    return Result::OK;
+}
+
+GpioPwm::Result GpioPwm::Start()
+{
+    if(pattern_ == nullptr)
+        return Result::ERR;
+    const int          idx  = int(config_.periph);
+    DMA_HandleTypeDef *hdma = &gpio_pwm_dma[idx];
+
+    // Circular memory to BSRR, one word per update of the timer
+    hdma->Instance                 = gpio_pwm_streams[idx];
+    hdma->Init.Request             = gpio_pwm_requests[idx];
+    hdma->Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    hdma->Init.PeriphInc           = DMA_PINC_DISABLE;
+    hdma->Init.MemInc              = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma->Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+    hdma->Init.Mode                = DMA_CIRCULAR;
+    hdma->Init.Priority            = DMA_PRIORITY_LOW;
+    hdma->Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(hdma) != HAL_OK)
+        return Result::ERR;
+
+    dsy_gpio_pin   pin  = {config_.port, 0};
+    GPIO_TypeDef * port = dsy_hal_map_get_port(&pin);
+    if(HAL_DMA_Start(hdma, (uint32_t)pattern_, (uint32_t)&port->BSRR, steps_)
+       != HAL_OK)
+        return Result::ERR;
+
+    gpio_pwm_tims[idx]->DIER |= TIM_DIER_UDE;
+    return tim_.Start() == TimerHandle::Result::OK ? Result::OK
+                                                   : Result::ERR;
+}
+
+GpioPwm::Result GpioPwm::Stop()
+{
+    if(pattern_ == nullptr)
+        return Result::ERR;
+    const int idx = int(config_.periph);
+    tim_.Stop();
+    gpio_pwm_tims[idx]->DIER &= ~TIM_DIER_UDE;
+    return HAL_DMA_Abort(&gpio_pwm_dma[idx]) == HAL_OK ? Result::OK
+                                                       : Result::ERR;
+}
+
+} // namespace daisy
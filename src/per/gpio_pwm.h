@@ -0,0 +1,130 @@
+#pragma once
+#ifndef DSY_GPIO_PWM_H
+#define DSY_GPIO_PWM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "daisy_core.h"
+#include "per/tim.h"
+
+namespace daisy
+{
+/** @addtogroup per
+    @{
+*/
+
+/** PWM on any pins of one GPIO port, run by the DMA without the CPU.
+ **
+ ** A pattern buffer holds one word per step of the PWM period. On each
+ ** update of a timer the DMA writes the next word to the BSRR register of
+ ** the port, which sets and resets pins in one go. Word 0 turns the pins
+ ** on, and word n turns off the pins with level n. Set() only touches the
+ ** words of the old and the new level, so changing a level is cheap and
+ ** nothing has to run per frame. A new level takes effect within one
+ ** period.
+ **
+ ** The pattern takes 4 bytes per step, 16kB for 12 bits (4096 steps) or
+ ** 1kB for 8 bits. It has to be in memory the DMA can read, e.g. with
+ ** DMA_BUFFER_MEM_SECTION. The DMA writes freq * steps words per second
+ ** to the port, 2 million for 12 bits at 500Hz.
+ **
+ ** Each timer can drive one GpioPwm. The timer is used for nothing else
+ ** then, and neither are its PWM channels. TIM3, TIM4 and TIM5 use DMA2
+ ** streams 2, 3 and 4.
+ */
+class GpioPwm
+{
+  public:
+    struct Config
+    {
+        dsy_gpio_port                   port;   /**< Port of the pins */
+        TimerHandle::Config::Peripheral periph; /**< TIM3, TIM4 or TIM5 */
+        uint32_t                        freq;   /**< PWM frequency in Hz */
+
+        void Defaults()
+        {
+            port   = DSY_GPIOA;
+            periph = TimerHandle::Config::Peripheral::TIM_4;
+            freq   = 500;
+        }
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    GpioPwm() : pattern_(nullptr), steps_(0), pins_(0), inverted_(0) {}
+    ~GpioPwm() {}
+
+    /** Clears the pattern and sets up the timer.
+     ** \param config port, timer and frequency
+     ** \param pattern steps words, in memory the DMA can read
+     ** \param steps PWM levels per period, from 2 to 65535
+     ** \return ERR for an invalid config, or a frequency the timer can't
+     ** step fast enough for
+     */
+    Result Init(const Config &config, uint32_t *pattern, size_t steps);
+
+    /** Makes a pin of the port an output, with level 0.
+     ** \param pin pin number on the port, 0 to 15
+     ** \param invert low while on, for LEDs wired to the supply
+     */
+    Result InitPin(uint8_t pin, bool invert);
+
+    /** Sets the number of steps per period a pin is on for.
+     ** \param pin pin number on the port, set up with InitPin()
+     ** \param level 0 (off) to GetSteps() (on)
+     */
+    void Set(uint8_t pin, uint32_t level)
+    {
+        if(pin >= 16 || !(pins_ & (1u << pin)))
+            return;
+        level = level > steps_ ? steps_ : level;
+
+        // BSRR: low half sets pins, high half resets them
+        const uint32_t both = 0x10001u << pin;
+        const uint32_t on   = (inverted_ & (1u << pin)) ? both & 0xffff0000
+                                                        : both & 0x0000ffff;
+        const uint32_t off  = both ^ on;
+        const uint32_t old  = levels_[pin];
+        if(old > 0 && old < steps_)
+            pattern_[old] &= ~off;
+        pattern_[0] = (pattern_[0] & ~both) | (level > 0 ? on : off);
+        if(level > 0 && level < steps_)
+            pattern_[level] |= off;
+        levels_[pin] = level;
+    }
+
+    /** \return level of a pin, as last set */
+    uint32_t Get(uint8_t pin) const { return pin < 16 ? levels_[pin] : 0; }
+
+    /** \return PWM levels per period */
+    uint32_t GetSteps() const { return steps_; }
+
+    /** \return the pattern, GetSteps() words written to BSRR in turn */
+    const uint32_t *GetPattern() const { return pattern_; }
+
+    const Config &GetConfig() const { return config_; }
+
+    /** Starts the DMA and the timer */
+    Result Start();
+
+    /** Stops the timer and the DMA. The pins keep their current state. */
+    Result Stop();
+
+  private:
+    Config      config_;
+    TimerHandle tim_;
+    uint32_t *  pattern_;
+    uint32_t    steps_;
+    uint32_t    levels_[16];
+    uint16_t    pins_;     // set up with InitPin()
+    uint16_t    inverted_; // low while on
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
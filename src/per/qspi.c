@@ -21,6 +21,44 @@ static uint32_t quad_enable(QSPI_HandleTypeDef *hqspi);
 static uint32_t enable_memory_mapped_mode(QSPI_HandleTypeDef *hqspi);
 static uint32_t autopolling_mem_ready(QSPI_HandleTypeDef *hqspi,
                                       uint32_t            timeout);
+static uint32_t autopolling_mem_ready_it(QSPI_HandleTypeDef *hqspi);
+static uint32_t program_page_start(QSPI_HandleTypeDef *hqspi,
+                                   uint32_t            adr,
+                                   uint32_t            sz,
+                                   uint8_t *           buf);
+static uint32_t erase_start(QSPI_HandleTypeDef *hqspi,
+                            uint8_t             instruction,
+                            uint32_t            addr);
+static uint32_t exit_continuous_read(QSPI_HandleTypeDef *hqspi);
+static void     invalidate_mapped(uint32_t adr, uint32_t sz);
+static void     cycle_counter_init();
+static uint32_t send_instruction(QSPI_HandleTypeDef *hqspi,
+                                 uint8_t             instruction);
+static uint32_t
+read_register(QSPI_HandleTypeDef *hqspi, uint8_t instruction, uint8_t *reg);
+static uint32_t wait_status(QSPI_HandleTypeDef *hqspi,
+                            uint8_t             mask,
+                            uint8_t             match,
+                            uint32_t            timeout_us);
+static uint32_t us_to_cycles(uint32_t us);
+static uint32_t wait_flag(QSPI_HandleTypeDef *hqspi,
+                          uint32_t            flag,
+                          FlagStatus          state,
+                          uint32_t            start,
+                          uint32_t            cycles);
+static void     write_ccr(QSPI_HandleTypeDef *       hqspi,
+                          const QSPI_CommandTypeDef *cmd,
+                          uint32_t                   functional_mode);
+static uint32_t indirect_command(QSPI_HandleTypeDef *       hqspi,
+                                 const QSPI_CommandTypeDef *cmd,
+                                 uint8_t *                  data,
+                                 uint32_t                   functional_mode);
+static uint32_t abort_command(QSPI_HandleTypeDef *hqspi);
+static void     job_start_next_step();
+static void     job_finish(int result);
+static void     job_check_timeout();
+static void     job_lock();
+static void     job_unlock();
 
 // These functions are defined, but we haven't added the ability to switch to quad mode. So they're currently unused.
 static uint32_t enter_quad_mode(QSPI_HandleTypeDef *hqspi)
@@ -38,6 +76,73 @@ typedef struct
 } dsy_qspi;
 
 static dsy_qspi qspi_handle;
+
+// Bounds for the status polls, with some margin over the datasheet maximum
+#define WRITE_ENABLE_TIMEOUT_US 100
+#define PAGE_PROG_TIMEOUT_US (2 * IS25LP080D_PAGE_PROG_MAX_TIME_US)
+#define SUSPEND_TIMEOUT_US (2 * IS25LP080D_SUSPEND_MAX_TIME_US)
+#define SECTOR_ERASE_TIMEOUT_US (2000 * IS25LP080D_SECTOR_ERASE_MAX_TIME)
+// Bound for a single command on the bus, a whole page takes about 20us
+#define COMMAND_TIMEOUT_US 100
+
+// Functional modes of the CCR register, the HAL keeps its names to itself
+#define FMODE_INDIRECT_WRITE 0U
+#define FMODE_INDIRECT_READ QUADSPI_CCR_FMODE_0
+#define FMODE_AUTO_POLLING QUADSPI_CCR_FMODE_1
+#define FMODE_MEMORY_MAPPED QUADSPI_CCR_FMODE
+
+// Time an erase from memory mapped mode runs between two suspends,
+// with interrupts off.
+#define ERASE_SLICE_US 250
+
+typedef enum
+{
+    JOB_ERASE,
+    JOB_WRITE,
+} job_type;
+
+typedef struct
+{
+    job_type              type;
+    uint32_t              address;
+    uint32_t              size;
+    uint8_t *             buffer;
+    dsy_qspi_job_callback callback;
+    void *                context;
+} qspi_job;
+
+// Jobs are queued from the main loop, and consumed from the QUADSPI interrupt.
+typedef struct
+{
+    qspi_job                     queue[DSY_QSPI_JOB_QUEUE_SIZE];
+    volatile uint32_t            read_idx, write_idx;
+    volatile dsy_qspi_job_status status;
+    volatile uint32_t            done;  // bytes processed of the current job
+    uint32_t                     step;  // bytes processed by the current step
+    uint32_t                     total; // size of the current job
+    uint32_t                     step_start;   // HAL_GetTick() at its start
+    uint32_t                     step_timeout; // ms the current step may take
+} qspi_job_queue;
+
+static qspi_job_queue jobs;
+
+// Non-zero while the queue is worked on with the QUADSPI interrupt held
+// off, or from the interrupt itself. Callbacks run from there and may
+// queue new jobs, which must leave the interrupt alone.
+static volatile uint32_t job_nesting;
+
+// An erase from memory mapped mode. The window can't be gone for the whole
+// erase, so it runs in slices: each one takes the window away with
+// interrupts off, and suspends the erase before bringing it back. Pending
+// interrupts run between two slices, with the window readable.
+typedef struct
+{
+    uint32_t addr;
+    uint32_t slices;
+    int      running;
+} sliced_erase;
+
+static sliced_erase mapped_erase;
 //static QSPI_HandleTypeDef dsy_qspi_handle;
 
 
@@ -48,6 +153,12 @@ int dsy_qspi_init(dsy_qspi_handle *hqspi)
 
     //dsy_qspi_handle.board = board;
     qspi_handle.dsy_hqspi = hqspi;
+    jobs.read_idx         = 0;
+    jobs.write_idx        = 0;
+    jobs.status           = DSY_QSPI_JOB_IDLE;
+    job_nesting           = 0;
+    mapped_erase.running  = 0;
+    cycle_counter_init();
     uint8_t device, mode;
     device = hqspi->device;
     mode   = hqspi->mode;
@@ -121,34 +232,193 @@ int dsy_qspi_deinit()
     return DSY_MEMORY_OK;
 }
 
-int dsy_qspi_writepage(uint32_t adr, uint32_t sz, uint8_t *buf)
+int dsy_qspi_set_mode(dsy_qspi_mode mode)
 {
-    QSPI_CommandTypeDef s_command;
-    s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
-    s_command.Instruction       = PAGE_PROG_CMD;
-    s_command.AddressMode       = QSPI_ADDRESS_1_LINE;
-    s_command.AddressSize       = QSPI_ADDRESS_24_BITS;
-    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    s_command.DataMode          = QSPI_DATA_1_LINE;
-    s_command.DummyCycles       = 0;
-    s_command.NbData            = sz <= 256 ? sz : 256;
-    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
-    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
-    s_command.Address           = adr;
-    if(write_enable(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+    if(qspi_handle.dsy_hqspi == NULL || jobs.status == DSY_QSPI_JOB_BUSY)
     {
         return DSY_MEMORY_ERROR;
     }
-    if(HAL_QSPI_Command(
-           &qspi_handle.hqspi, &s_command, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != DSY_MEMORY_OK)
+    if(mode == qspi_handle.dsy_hqspi->mode)
+    {
+        return DSY_MEMORY_OK;
+    }
+    if(mode == DSY_QSPI_MODE_INDIRECT_POLLING)
+    {
+        // Mark the window unavailable before it actually goes away,
+        // so an interrupt checking the mode never reads from a dead window.
+        qspi_handle.dsy_hqspi->mode = mode;
+        // Aborting stops the memory mapped read, the chip still expects
+        // the next continuous read without an instruction.
+        if(abort_command(&qspi_handle.hqspi) != DSY_MEMORY_OK
+           || exit_continuous_read(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+        {
+            return DSY_MEMORY_ERROR;
+        }
+    }
+    else if(mode == DSY_QSPI_MODE_DSY_MEMORY_MAPPED)
+    {
+        // A command that timed out leaves the peripheral busy
+        if((qspi_handle.hqspi.State != HAL_QSPI_STATE_READY
+            && abort_command(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+           || enable_memory_mapped_mode(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+        {
+            return DSY_MEMORY_ERROR;
+        }
+        qspi_handle.dsy_hqspi->mode = mode;
+    }
+    else
     {
         return DSY_MEMORY_ERROR;
     }
-    if(HAL_QSPI_Transmit(
-           &qspi_handle.hqspi, (uint8_t *)buf, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != DSY_MEMORY_OK)
+    return DSY_MEMORY_OK;
+}
+
+dsy_qspi_mode dsy_qspi_get_mode()
+{
+    if(qspi_handle.dsy_hqspi == NULL)
+    {
+        return DSY_QSPI_MODE_LAST;
+    }
+    return qspi_handle.dsy_hqspi->mode;
+}
+
+// Programs a page from memory mapped mode. Interrupts are held off while the
+// window is gone, so readers are only paused for the program time of the page.
+// The mode switches and the commands go through the registers, with every wait
+// bounded by the cycle counter: HAL timeouts count HAL_GetTick(), which stands
+// still with interrupts off.
+static int writepage_mapped(uint32_t adr, uint32_t sz, uint8_t *buf)
+{
+    int      res     = DSY_MEMORY_OK;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(dsy_qspi_set_mode(DSY_QSPI_MODE_INDIRECT_POLLING) != DSY_MEMORY_OK
+       || program_page_start(&qspi_handle.hqspi, adr, sz, buf) != DSY_MEMORY_OK
+       || wait_status(&qspi_handle.hqspi,
+                      IS25LP080D_SR_WIP,
+                      0,
+                      PAGE_PROG_TIMEOUT_US)
+              != DSY_MEMORY_OK)
+    {
+        res = DSY_MEMORY_ERROR;
+    }
+    if(dsy_qspi_set_mode(DSY_QSPI_MODE_DSY_MEMORY_MAPPED) != DSY_MEMORY_OK)
+    {
+        res = DSY_MEMORY_ERROR;
+    }
+    __set_PRIMASK(primask);
+    invalidate_mapped(adr, sz);
+    return res;
+}
+
+typedef enum
+{
+    ERASE_DONE,
+    ERASE_SUSPENDED,
+    ERASE_FAILED,
+} erase_slice_result;
+
+// Starts or resumes the erase, and suspends it again if it isn't done
+// after ERASE_SLICE_US. Runs in indirect mode, with interrupts off.
+static erase_slice_result erase_slice(uint32_t addr, int resume)
+{
+    QSPI_HandleTypeDef *hqspi = &qspi_handle.hqspi;
+    uint8_t             function_reg;
+    uint32_t res = resume ? send_instruction(hqspi, PROG_ERASE_RESUME_CMD)
+                          : erase_start(hqspi, SECTOR_ERASE_CMD, addr);
+    if(res != DSY_MEMORY_OK)
+    {
+        return ERASE_FAILED;
+    }
+    if(wait_status(hqspi, IS25LP080D_SR_WIP, 0, ERASE_SLICE_US)
+       == DSY_MEMORY_OK)
+    {
+        return ERASE_DONE;
+    }
+    // The erase may still finish before the suspend,
+    // only the function register tells which one happened.
+    if(send_instruction(hqspi, PROG_ERASE_SUSPEND_CMD) != DSY_MEMORY_OK
+       || wait_status(hqspi, IS25LP080D_SR_WIP, 0, SUSPEND_TIMEOUT_US)
+              != DSY_MEMORY_OK
+       || read_register(hqspi, READ_FUNCTION_REGISTER, &function_reg)
+              != DSY_MEMORY_OK)
+    {
+        return ERASE_FAILED;
+    }
+    return (function_reg & IS25LP080D_FR_ESUS) ? ERASE_SUSPENDED : ERASE_DONE;
+}
+
+// Erases a sector from memory mapped mode, see dsy_qspi_erasesector_start.
+static int erasesector_mapped(uint32_t addr)
+{
+    dsy_qspi_job_status status;
+    if(dsy_qspi_erasesector_start(addr) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    do
+    {
+        status = dsy_qspi_erasesector_poll();
+    } while(status == DSY_QSPI_JOB_BUSY);
+    return status == DSY_QSPI_JOB_IDLE ? DSY_MEMORY_OK : DSY_MEMORY_ERROR;
+}
+
+int dsy_qspi_erasesector_start(uint32_t addr)
+{
+    if(dsy_qspi_get_mode() != DSY_QSPI_MODE_DSY_MEMORY_MAPPED
+       || mapped_erase.running)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    mapped_erase.addr    = addr - (addr % IS25LP080D_SECTOR_SIZE);
+    mapped_erase.slices  = 0;
+    mapped_erase.running = 1;
+    return DSY_MEMORY_OK;
+}
+
+dsy_qspi_job_status dsy_qspi_erasesector_poll()
+{
+    if(!mapped_erase.running)
+    {
+        return DSY_QSPI_JOB_IDLE;
+    }
+    erase_slice_result state = ERASE_FAILED;
+    // A chip that never finishes is left suspended.
+    if(mapped_erase.slices < SECTOR_ERASE_TIMEOUT_US / ERASE_SLICE_US)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if(dsy_qspi_set_mode(DSY_QSPI_MODE_INDIRECT_POLLING) == DSY_MEMORY_OK)
+        {
+            state = erase_slice(mapped_erase.addr, mapped_erase.slices > 0);
+        }
+        if(dsy_qspi_set_mode(DSY_QSPI_MODE_DSY_MEMORY_MAPPED) != DSY_MEMORY_OK)
+        {
+            state = ERASE_FAILED;
+        }
+        __set_PRIMASK(primask);
+        mapped_erase.slices++;
+    }
+    if(state == ERASE_SUSPENDED)
+    {
+        return DSY_QSPI_JOB_BUSY;
+    }
+    mapped_erase.running = 0;
+    invalidate_mapped(mapped_erase.addr, IS25LP080D_SECTOR_SIZE);
+    return state == ERASE_DONE ? DSY_QSPI_JOB_IDLE : DSY_QSPI_JOB_ERROR;
+}
+
+int dsy_qspi_writepage(uint32_t adr, uint32_t sz, uint8_t *buf)
+{
+    if(jobs.status == DSY_QSPI_JOB_BUSY)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    if(dsy_qspi_get_mode() == DSY_QSPI_MODE_DSY_MEMORY_MAPPED)
+    {
+        return writepage_mapped(adr, sz, buf);
+    }
+    if(program_page_start(&qspi_handle.hqspi, adr, sz, buf) != DSY_MEMORY_OK)
     {
         return DSY_MEMORY_ERROR;
     }
@@ -162,81 +432,24 @@ int dsy_qspi_writepage(uint32_t adr, uint32_t sz, uint8_t *buf)
 
 int dsy_qspi_write(uint32_t address, uint32_t size, uint8_t *buffer)
 {
-    uint32_t NumOfPage = 0, NumOfSingle = 0, Addr = 0, count = 0, temp = 0;
     uint32_t QSPI_DataNum    = 0;
     uint32_t flash_page_size = IS25LP080D_PAGE_SIZE;
     address                  = address & 0x0FFFFFFF;
-    Addr                     = address % flash_page_size;
-    count                    = flash_page_size - Addr;
-    NumOfPage                = size / flash_page_size;
-    NumOfSingle              = size % flash_page_size;
-
-    if(Addr == 0) /*!< Address is QSPI_PAGESIZE aligned  */
+    while(size > 0)
     {
-        if(NumOfPage == 0) /*!< NumByteToWrite < QSPI_PAGESIZE */
+        // Up to the next page boundary
+        QSPI_DataNum = flash_page_size - (address % flash_page_size);
+        if(QSPI_DataNum > size)
         {
             QSPI_DataNum = size;
-            dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-        }
-        else /*!< Size > QSPI_PAGESIZE */
-        {
-            while(NumOfPage--)
-            {
-                QSPI_DataNum = flash_page_size;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-                address += flash_page_size;
-                buffer += flash_page_size;
-            }
-
-            QSPI_DataNum = NumOfSingle;
-            if(QSPI_DataNum > 0)
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
         }
-    }
-    else /*!< Address is not QSPI_PAGESIZE aligned  */
-    {
-        if(NumOfPage == 0) /*!< Size < QSPI_PAGESIZE */
+        if(dsy_qspi_writepage(address, QSPI_DataNum, buffer) != DSY_MEMORY_OK)
         {
-            if(NumOfSingle > count) /*!< (Size + Address) > QSPI_PAGESIZE */
-            {
-                temp         = NumOfSingle - count;
-                QSPI_DataNum = count;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-                address += count;
-                buffer += count;
-                QSPI_DataNum = temp;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-            }
-            else
-            {
-                QSPI_DataNum = size;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-            }
-        }
-        else /*!< Size > QSPI_PAGESIZE */
-        {
-            size -= count;
-            NumOfPage    = size / flash_page_size;
-            NumOfSingle  = size % flash_page_size;
-            QSPI_DataNum = count;
-            dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-            address += count;
-            buffer += count;
-
-            while(NumOfPage--)
-            {
-                QSPI_DataNum = flash_page_size;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-                address += flash_page_size;
-                buffer += flash_page_size;
-            }
-
-            if(NumOfSingle != 0)
-            {
-                QSPI_DataNum = NumOfSingle;
-                dsy_qspi_writepage(address, QSPI_DataNum, buffer);
-            }
+            return DSY_MEMORY_ERROR;
         }
+        address += QSPI_DataNum;
+        buffer += QSPI_DataNum;
+        size -= QSPI_DataNum;
     }
     return DSY_MEMORY_OK;
 }
@@ -260,47 +473,276 @@ int dsy_qspi_erase(uint32_t start_adr, uint32_t end_adr)
 
 int dsy_qspi_erasesector(uint32_t addr)
 {
-    uint8_t             use_qpi = 0;
-    QSPI_CommandTypeDef s_command;
-    if(use_qpi)
+    if(jobs.status == DSY_QSPI_JOB_BUSY)
     {
-        s_command.InstructionMode = QSPI_INSTRUCTION_4_LINES;
-        s_command.Instruction     = SECTOR_ERASE_QPI_CMD;
-        s_command.AddressMode     = QSPI_ADDRESS_4_LINES;
+        return DSY_MEMORY_ERROR;
     }
-    else
+    if(dsy_qspi_get_mode() == DSY_QSPI_MODE_DSY_MEMORY_MAPPED)
     {
-        s_command.InstructionMode = QSPI_INSTRUCTION_1_LINE;
-        s_command.Instruction     = SECTOR_ERASE_CMD;
-        s_command.AddressMode     = QSPI_ADDRESS_1_LINE;
+        return erasesector_mapped(addr);
     }
-    s_command.AddressSize       = QSPI_ADDRESS_24_BITS;
-    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    s_command.DataMode          = QSPI_DATA_NONE;
-    s_command.DummyCycles       = 0;
-    s_command.NbData            = 0;
-    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
-    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
-    s_command.Address           = addr;
-    if(write_enable(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+    if(erase_start(&qspi_handle.hqspi, SECTOR_ERASE_CMD, addr)
+       != DSY_MEMORY_OK)
     {
         return DSY_MEMORY_ERROR;
     }
-    if(HAL_QSPI_Command(
-           &qspi_handle.hqspi, &s_command, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if(autopolling_mem_ready(&qspi_handle.hqspi, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
        != DSY_MEMORY_OK)
     {
         return DSY_MEMORY_ERROR;
     }
-    if(autopolling_mem_ready(&qspi_handle.hqspi, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != DSY_MEMORY_OK)
+    return DSY_MEMORY_OK;
+}
+
+static int job_push(job_type              type,
+                    uint32_t              address,
+                    uint32_t              size,
+                    uint8_t *             buffer,
+                    dsy_qspi_job_callback callback,
+                    void *                context)
+{
+    // The chip takes no other erase while one is suspended
+    if(qspi_handle.dsy_hqspi == NULL
+       || qspi_handle.dsy_hqspi->mode != DSY_QSPI_MODE_INDIRECT_POLLING
+       || mapped_erase.running)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    job_check_timeout();
+    uint32_t w    = jobs.write_idx;
+    uint32_t next = (w + 1) % DSY_QSPI_JOB_QUEUE_SIZE;
+    if(next == jobs.read_idx)
     {
         return DSY_MEMORY_ERROR;
     }
+    jobs.queue[w].type     = type;
+    jobs.queue[w].address  = address & 0x0FFFFFFF;
+    jobs.queue[w].size     = size;
+    jobs.queue[w].buffer   = buffer;
+    jobs.queue[w].callback = callback;
+    jobs.queue[w].context  = context;
+
+    // The interrupt only advances read_idx, and only while busy.
+    // Keep it from finishing the last job between the check and the start.
+    job_lock();
+    jobs.write_idx = next;
+    if(jobs.status != DSY_QSPI_JOB_BUSY)
+    {
+        jobs.status = DSY_QSPI_JOB_BUSY;
+        jobs.done   = 0;
+        jobs.total  = size;
+        job_start_next_step();
+    }
+    job_unlock();
     return DSY_MEMORY_OK;
 }
 
+int dsy_qspi_erase_async(uint32_t              start_adr,
+                         uint32_t              end_adr,
+                         dsy_qspi_job_callback callback,
+                         void *                context)
+{
+    uint32_t block_size = IS25LP080D_SECTOR_SIZE;
+    start_adr           = start_adr - (start_adr % block_size);
+    if(end_adr < start_adr)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    // Same range as dsy_qspi_erase: the sector containing end_adr is included
+    uint32_t size = end_adr - start_adr + 1;
+    size          = (size + block_size - 1) / block_size * block_size;
+    return job_push(JOB_ERASE, start_adr, size, NULL, callback, context);
+}
+
+int dsy_qspi_write_async(uint32_t              address,
+                         uint32_t              size,
+                         uint8_t *             buffer,
+                         dsy_qspi_job_callback callback,
+                         void *                context)
+{
+    if(size == 0 || buffer == NULL)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    return job_push(JOB_WRITE, address, size, buffer, callback, context);
+}
+
+dsy_qspi_job_status dsy_qspi_job_get_status()
+{
+    job_check_timeout();
+    return jobs.status;
+}
+
+uint32_t dsy_qspi_job_get_pending()
+{
+    job_check_timeout();
+    return (jobs.write_idx + DSY_QSPI_JOB_QUEUE_SIZE - jobs.read_idx)
+           % DSY_QSPI_JOB_QUEUE_SIZE;
+}
+
+void dsy_qspi_job_get_progress(uint32_t *done, uint32_t *total)
+{
+    job_check_timeout();
+    *done  = jobs.done;
+    *total = jobs.total;
+}
+
+// Issues the next erase or program command of the current job,
+// and arms the status-match interrupt that signals its end. Runs from that
+// interrupt too, where HAL_GetTick() stands still: every register wait in
+// here is bounded by the cycle counter.
+static void job_start_next_step()
+{
+    qspi_job *job    = &jobs.queue[jobs.read_idx];
+    uint32_t  adr    = job->address + jobs.done;
+    uint32_t  remain = job->size - jobs.done;
+    uint32_t  res;
+    if(job->type == JOB_ERASE)
+    {
+        if(adr % IS25LP080D_BLOCK_SIZE == 0 && remain >= IS25LP080D_BLOCK_SIZE)
+        {
+            jobs.step         = IS25LP080D_BLOCK_SIZE;
+            jobs.step_timeout = 2 * IS25LP080D_BLOCK_ERASE_MAX_TIME;
+            res = erase_start(&qspi_handle.hqspi, BLOCK_ERASE_CMD, adr);
+        }
+        else
+        {
+            jobs.step         = IS25LP080D_SECTOR_SIZE;
+            jobs.step_timeout = 2 * IS25LP080D_SECTOR_ERASE_MAX_TIME;
+            res = erase_start(&qspi_handle.hqspi, SECTOR_ERASE_CMD, adr);
+        }
+    }
+    else
+    {
+        // Up to the next page boundary
+        uint32_t page = IS25LP080D_PAGE_SIZE - (adr % IS25LP080D_PAGE_SIZE);
+        jobs.step         = remain < page ? remain : page;
+        jobs.step_timeout = PAGE_PROG_TIMEOUT_US / 1000 + 2;
+        res               = program_page_start(
+            &qspi_handle.hqspi, adr, jobs.step, job->buffer + jobs.done);
+    }
+    jobs.step_start = HAL_GetTick();
+    if(res != DSY_MEMORY_OK
+       || autopolling_mem_ready_it(&qspi_handle.hqspi) != DSY_MEMORY_OK)
+    {
+        job_finish(DSY_MEMORY_ERROR);
+    }
+}
+
+// Pops the current job, reports the result and moves on to the next one.
+static void job_finish(int result)
+{
+    if(result != DSY_MEMORY_OK)
+    {
+        // Later jobs likely depend on this one (e.g. erase before write), so
+        // they all fail. The queue is emptied before the callbacks run,
+        // as they may queue new jobs.
+        qspi_job failed[DSY_QSPI_JOB_QUEUE_SIZE];
+        uint32_t num_failed = 0;
+        while(jobs.read_idx != jobs.write_idx)
+        {
+            failed[num_failed++] = jobs.queue[jobs.read_idx];
+            jobs.read_idx = (jobs.read_idx + 1) % DSY_QSPI_JOB_QUEUE_SIZE;
+        }
+        jobs.status = DSY_QSPI_JOB_ERROR;
+        for(uint32_t i = 0; i < num_failed; i++)
+        {
+            if(failed[i].callback)
+            {
+                failed[i].callback(DSY_MEMORY_ERROR, failed[i].context);
+            }
+        }
+        return;
+    }
+    // The job is popped before its callback runs, which may queue more.
+    // With the queue empty, a job queued there starts right away,
+    // otherwise it waits for the ones already queued.
+    qspi_job job  = jobs.queue[jobs.read_idx];
+    jobs.read_idx = (jobs.read_idx + 1) % DSY_QSPI_JOB_QUEUE_SIZE;
+    int more      = jobs.read_idx != jobs.write_idx;
+    if(!more)
+    {
+        jobs.status = DSY_QSPI_JOB_IDLE;
+    }
+    if(job.callback)
+    {
+        job.callback(result, job.context);
+    }
+    if(more)
+    {
+        jobs.done  = 0;
+        jobs.total = jobs.queue[jobs.read_idx].size;
+        job_start_next_step();
+    }
+}
+
+// The status-match interrupt never comes if the chip doesn't finish a step.
+// This fails the job once the step has run past its maximum time, checked
+// whenever the queue is looked at from the main loop.
+static void job_check_timeout()
+{
+    // From a callback, the step that was timed has just ended
+    if(job_nesting)
+    {
+        return;
+    }
+    job_lock();
+    if(jobs.status == DSY_QSPI_JOB_BUSY
+       && HAL_GetTick() - jobs.step_start > jobs.step_timeout)
+    {
+        HAL_QSPI_Abort(&qspi_handle.hqspi);
+        job_finish(DSY_MEMORY_ERROR);
+    }
+    job_unlock();
+}
+
+// Holds off the QUADSPI interrupt. Nests, and does nothing to the
+// interrupt when called from it.
+static void job_lock()
+{
+    if(job_nesting++ == 0)
+    {
+        HAL_NVIC_DisableIRQ(QUADSPI_IRQn);
+    }
+}
+
+static void job_unlock()
+{
+    if(--job_nesting == 0)
+    {
+        HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
+    }
+}
+
+void HAL_QSPI_StatusMatchCallback(QSPI_HandleTypeDef *hqspi)
+{
+    if(jobs.status != DSY_QSPI_JOB_BUSY)
+    {
+        return;
+    }
+    job_nesting++;
+    jobs.done += jobs.step;
+    if(jobs.done >= jobs.total)
+    {
+        job_finish(DSY_MEMORY_OK);
+    }
+    else
+    {
+        job_start_next_step();
+    }
+    job_nesting--;
+}
+
+void HAL_QSPI_ErrorCallback(QSPI_HandleTypeDef *hqspi)
+{
+    if(jobs.status == DSY_QSPI_JOB_BUSY)
+    {
+        job_nesting++;
+        job_finish(DSY_MEMORY_ERROR);
+        job_nesting--;
+    }
+}
+
 /* Static Function Implementation */
 static uint32_t reset_memory(QSPI_HandleTypeDef *hqspi)
 {
@@ -422,8 +864,7 @@ static uint32_t dummy_cycles_cfg(QSPI_HandleTypeDef *hqspi, uint8_t device)
 }
 static uint32_t write_enable(QSPI_HandleTypeDef *hqspi)
 {
-    QSPI_CommandTypeDef     s_command;
-    QSPI_AutoPollingTypeDef s_config;
+    QSPI_CommandTypeDef s_command;
 
     /* Enable write operations */
     s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
@@ -436,32 +877,16 @@ static uint32_t write_enable(QSPI_HandleTypeDef *hqspi)
     s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
     s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
 
-    if(HAL_QSPI_Command(hqspi, &s_command, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != HAL_OK)
+    if(indirect_command(hqspi, &s_command, NULL, FMODE_INDIRECT_WRITE)
+       != DSY_MEMORY_OK)
     {
         return DSY_MEMORY_ERROR;
     }
 
-    /* Configure automatic polling mode to wait for write enabling */
-    //		s_config.Match           = IS25LP080D_SR_WREN | (IS25LP080D_SR_WREN << 8);
-    //		s_config.Mask            = IS25LP080D_SR_WREN | (IS25LP080D_SR_WREN << 8);
-    s_config.MatchMode       = QSPI_MATCH_MODE_AND;
-    s_config.Match           = IS25LP080D_SR_WREN;
-    s_config.Mask            = IS25LP080D_SR_WREN;
-    s_config.Interval        = 0x10;
-    s_config.StatusBytesSize = 1;
-    s_config.AutomaticStop   = QSPI_AUTOMATIC_STOP_ENABLE;
-
-    s_command.Instruction = READ_STATUS_REG_CMD;
-    s_command.DataMode    = QSPI_DATA_1_LINE;
-
-    if(HAL_QSPI_AutoPolling(
-           hqspi, &s_command, &s_config, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != HAL_OK)
-    {
-        return DSY_MEMORY_ERROR;
-    }
-    return DSY_MEMORY_OK;
+    /* Wait for write enabling. This also runs from the QUADSPI interrupt,
+       and with interrupts off, so it can't use a HAL timeout. */
+    return wait_status(
+        hqspi, IS25LP080D_SR_WREN, IS25LP080D_SR_WREN, WRITE_ENABLE_TIMEOUT_US);
 }
 static uint32_t quad_enable(QSPI_HandleTypeDef *hqspi)
 {
@@ -539,8 +964,7 @@ static uint32_t quad_enable(QSPI_HandleTypeDef *hqspi)
 }
 static uint32_t enable_memory_mapped_mode(QSPI_HandleTypeDef *hqspi)
 {
-    QSPI_CommandTypeDef      s_command;
-    QSPI_MemoryMappedTypeDef s_mem_mapped_cfg;
+    QSPI_CommandTypeDef s_command;
 
     /* Configure the command for the read instruction */
     s_command.InstructionMode = QSPI_INSTRUCTION_1_LINE;
@@ -559,16 +983,108 @@ static uint32_t enable_memory_mapped_mode(QSPI_HandleTypeDef *hqspi)
     s_command.SIOOMode = QSPI_SIOO_INST_ONLY_FIRST_CMD;
     s_command.DataMode = QSPI_DATA_4_LINES;
 
-    /* Configure the memory mapped mode */
-    s_mem_mapped_cfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
-    s_mem_mapped_cfg.TimeOutPeriod     = 0;
-
-    if(HAL_QSPI_MemoryMapped(hqspi, &s_command, &s_mem_mapped_cfg) != HAL_OK)
+    /* Same as HAL_QSPI_MemoryMapped without the timeout counter, but the
+       wait for the peripheral is bounded by the cycle counter. This runs
+       with interrupts off when switching modes around a write. */
+    if(hqspi->State != HAL_QSPI_STATE_READY
+       || wait_flag(hqspi,
+                    QSPI_FLAG_BUSY,
+                    RESET,
+                    DWT->CYCCNT,
+                    us_to_cycles(COMMAND_TIMEOUT_US))
+              != DSY_MEMORY_OK)
     {
         return DSY_MEMORY_ERROR;
     }
+    CLEAR_BIT(hqspi->Instance->CR, QUADSPI_CR_TCEN);
+    hqspi->State = HAL_QSPI_STATE_BUSY_MEM_MAPPED;
+    write_ccr(hqspi, &s_command, FMODE_MEMORY_MAPPED);
     return DSY_MEMORY_OK;
 }
+// Takes the chip out of the continuous read mode memory mapped mode leaves
+// it in, by reading a byte without instruction and with mode bits that end it.
+// If the chip wasn't in continuous read mode, it sees a plain READ (0x03)
+// of address 0 instead, which is harmless.
+static uint32_t exit_continuous_read(QSPI_HandleTypeDef *hqspi)
+{
+    QSPI_CommandTypeDef s_command;
+    uint8_t             dummy;
+
+    s_command.InstructionMode    = QSPI_INSTRUCTION_NONE;
+    s_command.Instruction        = 0;
+    s_command.AddressMode        = QSPI_ADDRESS_4_LINES;
+    s_command.AddressSize        = QSPI_ADDRESS_24_BITS;
+    s_command.Address            = 0;
+    s_command.AlternateByteMode  = QSPI_ALTERNATE_BYTES_4_LINES;
+    s_command.AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
+    s_command.AlternateBytes     = 0x000000FF;
+    s_command.DummyCycles        = 6;
+    s_command.DdrMode            = QSPI_DDR_MODE_DISABLE;
+    s_command.DdrHoldHalfCycle   = QSPI_DDR_HHC_ANALOG_DELAY;
+    s_command.SIOOMode           = QSPI_SIOO_INST_EVERY_CMD;
+    s_command.DataMode           = QSPI_DATA_4_LINES;
+    s_command.NbData             = 1;
+
+    return indirect_command(hqspi, &s_command, &dummy, FMODE_INDIRECT_READ);
+}
+
+// Drops cached lines of the memory mapped window after the flash changed.
+static void invalidate_mapped(uint32_t adr, uint32_t sz)
+{
+    uint32_t start = 0x90000000 + (adr & 0x0FFFFFFF);
+    uint32_t end   = start + sz;
+    start &= ~(uint32_t)31;
+    SCB_InvalidateDCache_by_Addr((uint32_t *)start, end - start);
+}
+
+static uint32_t program_page_start(QSPI_HandleTypeDef *hqspi,
+                                   uint32_t            adr,
+                                   uint32_t            sz,
+                                   uint8_t *           buf)
+{
+    QSPI_CommandTypeDef s_command;
+    s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    s_command.Instruction       = PAGE_PROG_CMD;
+    s_command.AddressMode       = QSPI_ADDRESS_1_LINE;
+    s_command.AddressSize       = QSPI_ADDRESS_24_BITS;
+    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    s_command.DataMode          = QSPI_DATA_1_LINE;
+    s_command.DummyCycles       = 0;
+    s_command.NbData            = sz <= 256 ? sz : 256;
+    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
+    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    s_command.Address           = adr;
+    if(write_enable(hqspi) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    return indirect_command(hqspi, &s_command, buf, FMODE_INDIRECT_WRITE);
+}
+
+static uint32_t
+erase_start(QSPI_HandleTypeDef *hqspi, uint8_t instruction, uint32_t addr)
+{
+    QSPI_CommandTypeDef s_command;
+    s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    s_command.Instruction       = instruction;
+    s_command.AddressMode       = QSPI_ADDRESS_1_LINE;
+    s_command.AddressSize       = QSPI_ADDRESS_24_BITS;
+    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    s_command.DataMode          = QSPI_DATA_NONE;
+    s_command.DummyCycles       = 0;
+    s_command.NbData            = 0;
+    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
+    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    s_command.Address           = addr;
+    if(write_enable(hqspi) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    return indirect_command(hqspi, &s_command, NULL, FMODE_INDIRECT_WRITE);
+}
+
 static uint32_t autopolling_mem_ready(QSPI_HandleTypeDef *hqspi,
                                       uint32_t            timeout)
 {
@@ -600,6 +1116,52 @@ static uint32_t autopolling_mem_ready(QSPI_HandleTypeDef *hqspi,
     }
     return DSY_MEMORY_OK;
 }
+// Same as autopolling_mem_ready, but returns immediately.
+// HAL_QSPI_StatusMatchCallback is called once the WIP bit has cleared.
+// Runs from the QUADSPI interrupt between the steps of a job, so it writes
+// the registers as HAL_QSPI_AutoPolling_IT does, with the wait for the
+// peripheral bounded by the cycle counter instead of HAL_GetTick().
+static uint32_t autopolling_mem_ready_it(QSPI_HandleTypeDef *hqspi)
+{
+    QSPI_CommandTypeDef s_command;
+
+    s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    s_command.Instruction       = READ_STATUS_REG_CMD;
+    s_command.AddressMode       = QSPI_ADDRESS_NONE;
+    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    s_command.DataMode          = QSPI_DATA_1_LINE;
+    s_command.DummyCycles       = 0;
+    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
+    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    s_command.NbData            = 1;
+
+    if(hqspi->State != HAL_QSPI_STATE_READY)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    hqspi->State     = HAL_QSPI_STATE_BUSY_AUTO_POLLING;
+    if(wait_flag(hqspi,
+                 QSPI_FLAG_BUSY,
+                 RESET,
+                 DWT->CYCCNT,
+                 us_to_cycles(COMMAND_TIMEOUT_US))
+       != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    WRITE_REG(hqspi->Instance->PSMAR, 0);
+    WRITE_REG(hqspi->Instance->PSMKR, IS25LP080D_SR_WIP);
+    WRITE_REG(hqspi->Instance->PIR, 0x10);
+    MODIFY_REG(hqspi->Instance->CR,
+               QUADSPI_CR_PMM | QUADSPI_CR_APMS,
+               QSPI_MATCH_MODE_AND | QSPI_AUTOMATIC_STOP_ENABLE);
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TE | QSPI_FLAG_SM);
+    write_ccr(hqspi, &s_command, FMODE_AUTO_POLLING);
+    __HAL_QSPI_ENABLE_IT(hqspi, QSPI_IT_SM | QSPI_IT_TE);
+    return DSY_MEMORY_OK;
+}
 static uint32_t enter_quad_mode(QSPI_HandleTypeDef *hqspi)
 {
     QSPI_CommandTypeDef s_command;
@@ -661,12 +1223,45 @@ static uint32_t exit_quad_mode(QSPI_HandleTypeDef *hqspi)
 }
 
 static uint8_t get_status_register(QSPI_HandleTypeDef *hqspi)
+{
+    uint8_t reg = 0x00;
+    read_register(hqspi, READ_STATUS_REG_CMD, &reg);
+    return reg;
+}
+
+// The cycle counter times the status polls. HAL_GetTick stands still with
+// interrupts off, and in the QUADSPI interrupt (SysTick has the lowest
+// priority), so a HAL timeout would never end the wait for a dead flash.
+static void cycle_counter_init()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static uint32_t send_instruction(QSPI_HandleTypeDef *hqspi,
+                                 uint8_t             instruction)
 {
     QSPI_CommandTypeDef s_command;
-    uint8_t             reg;
-    reg                         = 0x00;
     s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
-    s_command.Instruction       = READ_STATUS_REG_CMD;
+    s_command.Instruction       = instruction;
+    s_command.AddressMode       = QSPI_ADDRESS_NONE;
+    s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    s_command.DataMode          = QSPI_DATA_NONE;
+    s_command.DummyCycles       = 0;
+    s_command.NbData            = 0;
+    s_command.DdrMode           = QSPI_DDR_MODE_DISABLE;
+    s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    return indirect_command(hqspi, &s_command, NULL, FMODE_INDIRECT_WRITE);
+}
+
+static uint32_t
+read_register(QSPI_HandleTypeDef *hqspi, uint8_t instruction, uint8_t *reg)
+{
+    QSPI_CommandTypeDef s_command;
+    s_command.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    s_command.Instruction       = instruction;
     s_command.AddressMode       = QSPI_ADDRESS_NONE;
     s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
     s_command.DataMode          = QSPI_DATA_1_LINE;
@@ -676,18 +1271,160 @@ static uint8_t get_status_register(QSPI_HandleTypeDef *hqspi)
     s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
     s_command.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
 
-    if(HAL_QSPI_Command(hqspi, &s_command, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != HAL_OK)
+    return indirect_command(hqspi, &s_command, reg, FMODE_INDIRECT_READ);
+}
+
+// Reads the status register until (status & mask) == match, for at most
+// timeout_us. Each read takes a few clock cycles of the QSPI, whether or
+// not the chip answers, so this always returns.
+static uint32_t wait_status(QSPI_HandleTypeDef *hqspi,
+                            uint8_t             mask,
+                            uint8_t             match,
+                            uint32_t            timeout_us)
+{
+    uint32_t start   = DWT->CYCCNT;
+    uint32_t timeout = us_to_cycles(timeout_us);
+    uint8_t  reg;
+    do
+    {
+        if(read_register(hqspi, READ_STATUS_REG_CMD, &reg) != DSY_MEMORY_OK)
+        {
+            return DSY_MEMORY_ERROR;
+        }
+        if((reg & mask) == match)
+        {
+            return DSY_MEMORY_OK;
+        }
+    } while(DWT->CYCCNT - start < timeout);
+    return DSY_MEMORY_ERROR;
+}
+
+static uint32_t us_to_cycles(uint32_t us)
+{
+    return SystemCoreClock / 1000000 * us;
+}
+
+// Waits for a flag of the QUADSPI status register, for at most cycles
+// counted from start. Same as the wait in the HAL, but with the cycle counter.
+static uint32_t wait_flag(QSPI_HandleTypeDef *hqspi,
+                          uint32_t            flag,
+                          FlagStatus          state,
+                          uint32_t            start,
+                          uint32_t            cycles)
+{
+    while(__HAL_QSPI_GET_FLAG(hqspi, flag) != state)
     {
-        return 0x00;
+        if(DWT->CYCCNT - start >= cycles)
+        {
+            hqspi->State = HAL_QSPI_STATE_ERROR;
+            hqspi->ErrorCode |= HAL_QSPI_ERROR_TIMEOUT;
+            return DSY_MEMORY_ERROR;
+        }
     }
-    if(HAL_QSPI_Receive(
-           hqspi, (uint8_t *)(&reg), HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-       != HAL_OK)
+    return DSY_MEMORY_OK;
+}
+
+// Writes the command to the registers, as the HAL's QSPI_Config does.
+// Without an address phase, this starts the command.
+static void write_ccr(QSPI_HandleTypeDef *       hqspi,
+                      const QSPI_CommandTypeDef *cmd,
+                      uint32_t                   functional_mode)
+{
+    uint32_t ccr = cmd->DdrMode | cmd->DdrHoldHalfCycle | cmd->SIOOMode
+                   | cmd->DataMode | (cmd->DummyCycles << QUADSPI_CCR_DCYC_Pos)
+                   | cmd->AlternateByteMode | cmd->AddressMode
+                   | cmd->InstructionMode | functional_mode;
+    if(cmd->InstructionMode != QSPI_INSTRUCTION_NONE)
     {
-        return 0x00;
+        ccr |= cmd->Instruction;
     }
-    return reg;
+    if(cmd->AddressMode != QSPI_ADDRESS_NONE)
+    {
+        ccr |= cmd->AddressSize;
+    }
+    if(cmd->AlternateByteMode != QSPI_ALTERNATE_BYTES_NONE)
+    {
+        ccr |= cmd->AlternateBytesSize;
+        WRITE_REG(hqspi->Instance->ABR, cmd->AlternateBytes);
+    }
+    if(cmd->DataMode != QSPI_DATA_NONE
+       && functional_mode != FMODE_MEMORY_MAPPED)
+    {
+        WRITE_REG(hqspi->Instance->DLR, cmd->NbData - 1);
+    }
+    WRITE_REG(hqspi->Instance->CCR, ccr);
+    if(cmd->AddressMode != QSPI_ADDRESS_NONE
+       && functional_mode != FMODE_MEMORY_MAPPED)
+    {
+        WRITE_REG(hqspi->Instance->AR, cmd->Address);
+    }
+}
+
+// HAL_QSPI_Command followed by HAL_QSPI_Transmit or HAL_QSPI_Receive, in
+// indirect write or read mode. The whole command is bounded by the cycle
+// counter, so it can run with interrupts off and from the QUADSPI interrupt.
+static uint32_t indirect_command(QSPI_HandleTypeDef *       hqspi,
+                                 const QSPI_CommandTypeDef *cmd,
+                                 uint8_t *                  data,
+                                 uint32_t                   functional_mode)
+{
+    const uint32_t start    = DWT->CYCCNT;
+    const uint32_t cycles   = us_to_cycles(COMMAND_TIMEOUT_US);
+    const int      read     = functional_mode == FMODE_INDIRECT_READ;
+    __IO uint8_t * data_reg = (__IO uint8_t *)&hqspi->Instance->DR;
+    if(hqspi->State != HAL_QSPI_STATE_READY
+       || wait_flag(hqspi, QSPI_FLAG_BUSY, RESET, start, cycles)
+              != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    write_ccr(hqspi, cmd, functional_mode);
+    if(cmd->DataMode != QSPI_DATA_NONE)
+    {
+        for(uint32_t i = 0; i < cmd->NbData; i++)
+        {
+            uint32_t flag = read ? QSPI_FLAG_FT | QSPI_FLAG_TC : QSPI_FLAG_FT;
+            if(wait_flag(hqspi, flag, SET, start, cycles) != DSY_MEMORY_OK)
+            {
+                return DSY_MEMORY_ERROR;
+            }
+            if(read)
+            {
+                data[i] = *data_reg;
+            }
+            else
+            {
+                *data_reg = data[i];
+            }
+        }
+    }
+    if(wait_flag(hqspi, QSPI_FLAG_TC, SET, start, cycles) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+    return DSY_MEMORY_OK;
+}
+
+// HAL_QSPI_Abort without DMA, bounded by the cycle counter.
+// Ends memory mapped mode, or a command the peripheral is stuck in.
+static uint32_t abort_command(QSPI_HandleTypeDef *hqspi)
+{
+    const uint32_t start  = DWT->CYCCNT;
+    const uint32_t cycles = us_to_cycles(COMMAND_TIMEOUT_US);
+    SET_BIT(hqspi->Instance->CR, QUADSPI_CR_ABORT);
+    if(wait_flag(hqspi, QSPI_FLAG_TC, SET, start, cycles) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+    if(wait_flag(hqspi, QSPI_FLAG_BUSY, RESET, start, cycles) != DSY_MEMORY_OK)
+    {
+        return DSY_MEMORY_ERROR;
+    }
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return DSY_MEMORY_OK;
 }
 
 /* HAL Overwrite Implementation */
@@ -782,7 +1519,8 @@ void HAL_QSPI_MspInit(QSPI_HandleTypeDef *qspiHandle)
             HAL_GPIO_Init(port, &GPIO_InitStruct);
         }
         /* QUADSPI interrupt Init */
-        HAL_NVIC_SetPriority(QUADSPI_IRQn, 0, 0);
+        // Below the audio DMA, which a job step must never delay
+        HAL_NVIC_SetPriority(QUADSPI_IRQn, 1, 0);
         HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
     }
 }
@@ -91,9 +91,35 @@ extern "C"
     */
     int dsy_qspi_deinit();
 
+    /** 
+    Switches between memory mapped and indirect mode without reinitializing
+    the peripheral or the chip. This only takes a couple of commands, so it is
+    cheap enough to do around every write. \n 
+    While in indirect mode, nothing may be read from the memory mapped window
+    (including DSY_QSPI_DATA and code in DSY_QSPI_TEXT), that is a hard fault.
+    To write while other code reads from the flash, stay in memory mapped mode
+    and use dsy_qspi_writepage / dsy_qspi_erasesector.
+    \param mode mode to switch to
+    \return DSY_MEMORY_OK or DSY_MEMORY_ERROR (e.g. while async jobs are pending)
+    */
+    int dsy_qspi_set_mode(dsy_qspi_mode mode);
+
+    /** \return the mode the QSPI is currently in, or DSY_QSPI_MODE_LAST before init */
+    dsy_qspi_mode dsy_qspi_get_mode();
+
     /** 
     Writes a single page to to the specified address on the QSPI chip.
-    For IS25LP* page size is 256 bytes.
+    For IS25LP* page size is 256 bytes. \n 
+    Also works in memory mapped mode: the QSPI is switched to indirect mode
+    for the page, with interrupts disabled until it is programmed and the
+    window is back, so readers are paused for at most one page program time.
+    All interrupts are held off, the audio DMA included, as it has the same
+    priority as the other peripherals. That is the page program time of the
+    chip, 0.2ms typical and 0.8ms at most, plus a few microseconds for the
+    commands. A chip that doesn't finish in time gives DSY_MEMORY_ERROR after
+    at most about 2.5ms with interrupts off. Keep the audio block longer than
+    the stall, or write between blocks. buf must not point into the QSPI
+    flash in that case.
     \param adr Address to write to
     \param sz Buff size
     \param buf Buffer to write
@@ -102,11 +128,13 @@ extern "C"
     int dsy_qspi_writepage(uint32_t adr, uint32_t sz, uint8_t* buf);
 
     /** 
-    Writes data in buffer to to the QSPI. Starting at address to address+size 
+    Writes data in buffer to to the QSPI. Starting at address to address+size \n 
+    Works in either mode, page by page (see dsy_qspi_writepage).
     \param address Address to write to
     \param size Buffer size
     \param buffer Buffer to write
-    \return DSY_MEMORY_OK or DSY_MEMORY_ERROR
+    \return DSY_MEMORY_OK, or DSY_MEMORY_ERROR as soon as a page fails.
+    The pages before it are written.
      */
     int dsy_qspi_write(uint32_t address, uint32_t size, uint8_t* buffer);
 
@@ -121,13 +149,121 @@ extern "C"
     int dsy_qspi_erase(uint32_t start_adr, uint32_t end_adr);
 
     /**  
-      Erases a single sector of the chip.  
-      TODO: Document the size of this function. 
+      Erases a single sector of the chip. \n 
+      Also works in memory mapped mode. The erase then runs in slices of 250us
+      with interrupts disabled, and is suspended in between, with the window
+      back and interrupts enabled. A slice holds off every interrupt, the
+      audio DMA included, for the 250us of erasing plus the suspend latency,
+      0.35ms in all.
+      A chip that doesn't suspend within 200us gives DSY_MEMORY_ERROR, so no
+      slice takes longer than about 0.5ms. The rest of the flash stays
+      readable from interrupts throughout, the sector being erased reads
+      undefined data until this returns. See dsy_qspi_erasesector_start for a
+      version that doesn't wait for the erase.
       \param addr Address of sector to erase
       \return DSY_MEMORY_OK or DSY_MEMORY_ERROR
      */
     int dsy_qspi_erasesector(uint32_t addr);
 
+    /** Maximum number of asynchronous jobs that can be queued at once. */
+#define DSY_QSPI_JOB_QUEUE_SIZE 4
+
+    /** State of the asynchronous job queue */
+    typedef enum
+    {
+        DSY_QSPI_JOB_IDLE,  /**< No job queued, last job finished without error */
+        DSY_QSPI_JOB_BUSY,  /**< A job is being processed */
+        DSY_QSPI_JOB_ERROR, /**< A job failed, and all queued after it */
+    } dsy_qspi_job_status;
+
+    /** 
+    Called from the QUADSPI interrupt when an asynchronous job has finished.
+    Keep it short, it runs at the priority of the QUADSPI interrupt, one
+    below the audio DMA, which can interrupt it. Queue jobs and query the
+    queue from the main loop or from these callbacks, not from the audio
+    callback or other interrupts. \n 
+    When a job fails, the jobs queued after it are dropped, and every one of
+    them gets its callback with DSY_MEMORY_ERROR as well. A step the chip
+    doesn't finish within twice its maximum time (e.g. 800ms for a sector
+    erase) fails the job the next time the queue is looked at, i.e. from
+    dsy_qspi_job_get_status / _get_pending / _get_progress or a new job.
+    The callbacks are called from there in that case. \n 
+    A callback may queue new jobs. The finished job is off the queue by
+    then, so a job queued from the last callback starts right away.
+    \param result DSY_MEMORY_OK or DSY_MEMORY_ERROR
+    \param context pointer passed in when the job was submitted
+    */
+    typedef void (*dsy_qspi_job_callback)(int result, void* context);
+
+    /** 
+    Queues an erase of the area specified on the chip, and returns immediately. \n 
+    The erase runs in the background: each sector or block is erased, and the 
+    chip's status register is watched in automatic polling mode. The next step
+    is started from the status-match interrupt, so the CPU is free meanwhile. \n 
+    Aligned 64kB blocks are erased with a single block erase, the rest by 4kB sectors.
+    Only available in DSY_QSPI_MODE_INDIRECT_POLLING. While jobs are pending,
+    the blocking write/erase functions return DSY_MEMORY_ERROR.
+    \param start_adr Address to begin erasing from
+    \param end_adr  Address to stop erasing at
+    \param callback function to call when finished, may be NULL
+    \param context passed to the callback
+    \return DSY_MEMORY_OK if queued, DSY_MEMORY_ERROR if the queue is full or in memory mapped mode
+    */
+    int dsy_qspi_erase_async(uint32_t              start_adr,
+                             uint32_t              end_adr,
+                             dsy_qspi_job_callback callback,
+                             void*                 context);
+
+    /** 
+    Queues a write of the data in buffer to the QSPI, and returns immediately. \n 
+    Pages are programmed one by one from the QUADSPI interrupt, as the chip 
+    reports the previous page finished. The area should have been erased before.
+    Only available in DSY_QSPI_MODE_INDIRECT_POLLING.
+    \param address Address to write to
+    \param size Buffer size
+    \param buffer Buffer to write. Must stay valid until the job has finished.
+    \param callback function to call when finished, may be NULL
+    \param context passed to the callback
+    \return DSY_MEMORY_OK if queued, DSY_MEMORY_ERROR if the queue is full or in memory mapped mode
+    */
+    int dsy_qspi_write_async(uint32_t              address,
+                             uint32_t              size,
+                             uint8_t*              buffer,
+                             dsy_qspi_job_callback callback,
+                             void*                 context);
+
+    /** \return state of the asynchronous job queue */
+    dsy_qspi_job_status dsy_qspi_job_get_status();
+
+    /** \return number of jobs queued or in progress */
+    uint32_t dsy_qspi_job_get_pending();
+
+    /** 
+    Progress of the job currently in progress.
+    \param done number of bytes erased/written so far
+    \param total total number of bytes of the job
+    */
+    void dsy_qspi_job_get_progress(uint32_t* done, uint32_t* total);
+
+    /** 
+    Starts erasing a single sector from memory mapped mode, and returns
+    immediately. The erase runs in the same slices as dsy_qspi_erasesector,
+    one per call to dsy_qspi_erasesector_poll(), and stays suspended in
+    between. Meanwhile, pages outside the sector can still be written with
+    dsy_qspi_writepage, but no other erase can be started.
+    \param addr Address of sector to erase
+    \return DSY_MEMORY_OK, or DSY_MEMORY_ERROR if not in memory mapped mode or an erase is already running
+    */
+    int dsy_qspi_erasesector_start(uint32_t addr);
+
+    /** 
+    Runs the next slice of the erase started with dsy_qspi_erasesector_start,
+    with interrupts disabled for about 250us, see dsy_qspi_erasesector for
+    the worst case.
+    \return DSY_QSPI_JOB_BUSY while the erase is running, then DSY_QSPI_JOB_IDLE once it is done, or DSY_QSPI_JOB_ERROR
+    */
+    dsy_qspi_job_status dsy_qspi_erasesector_poll();
+
 
 #ifdef __cplusplus
 }
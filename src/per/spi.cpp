@@ -1,4 +1,5 @@
 #include "per/spi.h"
+#include "util/scopedirqblocker.h"
 extern "C"
 {
 #include "util/hal_map.h"
@@ -27,13 +28,29 @@ class SpiHandle::Impl
     Result BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout);
     Result BlockingReceive(uint8_t* buffer, uint16_t size, uint32_t timeout);
 
+    Result DmaTransmit(uint8_t*                       buff,
+                       size_t                         size,
+                       SpiHandle::CallbackFunctionPtr callback,
+                       void*                          callback_context);
+
+    void DmaTransferFinished(Result result);
+
     Result InitPins();
     Result DeInitPins();
 
     SpiHandle::Config config_;
     SPI_HandleTypeDef hspi_;
+    DMA_HandleTypeDef hdma_tx_;
+
+    SpiHandle::CallbackFunctionPtr next_callback_;
+    void*                          next_callback_context_;
+
+    // index of the peripheral that uses the DMA, or -1
+    static volatile int8_t dma_active_peripheral_;
 };
 
+volatile int8_t SpiHandle::Impl::dma_active_peripheral_ = -1;
+
 // ================================================================
 // Global references for the availabel SpiHandle::Impl(s)
 // ================================================================
@@ -227,6 +244,80 @@ SpiHandle::Result SpiHandle::Impl::BlockingReceive(uint8_t* buffer,
     return Result::OK;
 }
 
+SpiHandle::Result
+SpiHandle::Impl::DmaTransmit(uint8_t*                       buff,
+                             size_t                         size,
+                             SpiHandle::CallbackFunctionPtr callback,
+                             void*                          callback_context)
+{
+    // SPI6 is only served by the BDMA
+    static const uint32_t requests[5] = {DMA_REQUEST_SPI1_TX,
+                                         DMA_REQUEST_SPI2_TX,
+                                         DMA_REQUEST_SPI3_TX,
+                                         DMA_REQUEST_SPI4_TX,
+                                         DMA_REQUEST_SPI5_TX};
+    static const IRQn_Type spi_irqs[5]
+        = {SPI1_IRQn, SPI2_IRQn, SPI3_IRQn, SPI4_IRQn, SPI5_IRQn};
+    const int idx = int(config_.periph);
+    if(idx >= 5 || size == 0 || size > 0xffff)
+        return Result::ERR;
+
+    {
+        ScopedIrqBlocker block;
+        if(dma_active_peripheral_ >= 0)
+            return Result::ERR;
+        dma_active_peripheral_ = idx;
+    }
+
+    hdma_tx_.Instance                 = DMA2_Stream5;
+    hdma_tx_.Init.Request             = requests[idx];
+    hdma_tx_.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    hdma_tx_.Init.PeriphInc           = DMA_PINC_DISABLE;
+    hdma_tx_.Init.MemInc              = DMA_MINC_ENABLE;
+    hdma_tx_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_tx_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    hdma_tx_.Init.Mode                = DMA_NORMAL;
+    hdma_tx_.Init.Priority            = DMA_PRIORITY_LOW;
+    hdma_tx_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    hdma_tx_.Init.MemBurst            = DMA_MBURST_SINGLE;
+    hdma_tx_.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+    if(HAL_DMA_Init(&hdma_tx_) != HAL_OK)
+    {
+        dma_active_peripheral_ = -1;
+        return Result::ERR;
+    }
+    __HAL_LINKDMA(&hspi_, hdmatx, hdma_tx_);
+
+    // The DMA moves the data, the SPI interrupt reports the end of it
+    HAL_NVIC_SetPriority(DMA2_Stream5_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream5_IRQn);
+    HAL_NVIC_SetPriority(spi_irqs[idx], 0, 0);
+    HAL_NVIC_EnableIRQ(spi_irqs[idx]);
+
+    next_callback_         = callback;
+    next_callback_context_ = callback_context;
+    if(HAL_SPI_Transmit_DMA(&hspi_, buff, size) != HAL_OK)
+    {
+        next_callback_         = NULL;
+        next_callback_context_ = NULL;
+        dma_active_peripheral_ = -1;
+        return Result::ERR;
+    }
+    return Result::OK;
+}
+
+void SpiHandle::Impl::DmaTransferFinished(Result result)
+{
+    SpiHandle::CallbackFunctionPtr callback = next_callback_;
+    void*                          context  = next_callback_context_;
+    next_callback_                          = NULL;
+    next_callback_context_                  = NULL;
+    dma_active_peripheral_                  = -1;
+    // the callback may start the next transfer right away
+    if(callback != NULL)
+        callback(context, result);
+}
+
 typedef struct
 {
     dsy_gpio_pin pin;
@@ -561,6 +652,52 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
     }
 }
 
+extern "C" void DMA2_Stream5_IRQHandler(void)
+{
+    const int8_t idx = SpiHandle::Impl::dma_active_peripheral_;
+    if(idx >= 0)
+        HAL_DMA_IRQHandler(&spi_handles[idx].hdma_tx_);
+}
+
+extern "C" void SPI1_IRQHandler()
+{
+    HAL_SPI_IRQHandler(&spi_handles[0].hspi_);
+}
+
+extern "C" void SPI2_IRQHandler()
+{
+    HAL_SPI_IRQHandler(&spi_handles[1].hspi_);
+}
+
+extern "C" void SPI3_IRQHandler()
+{
+    HAL_SPI_IRQHandler(&spi_handles[2].hspi_);
+}
+
+extern "C" void SPI4_IRQHandler()
+{
+    HAL_SPI_IRQHandler(&spi_handles[3].hspi_);
+}
+
+extern "C" void SPI5_IRQHandler()
+{
+    HAL_SPI_IRQHandler(&spi_handles[4].hspi_);
+}
+
+extern "C" void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+    SpiHandle::Impl* handle = MapInstanceToHandle(hspi->Instance);
+    if(handle != NULL)
+        handle->DmaTransferFinished(SpiHandle::Result::OK);
+}
+
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+    SpiHandle::Impl* handle = MapInstanceToHandle(hspi->Instance);
+    if(handle != NULL)
+        handle->DmaTransferFinished(SpiHandle::Result::ERR);
+}
+
 // ======================================================================
 // SpiHandler > SpiHandlePimpl
 // ======================================================================
@@ -593,3 +730,11 @@ SpiHandle::BlockingReceive(uint8_t* buffer, uint16_t size, uint32_t timeout)
 {
     return pimpl_->BlockingReceive(buffer, size, timeout);
 }
+
+SpiHandle::Result SpiHandle::DmaTransmit(uint8_t*            buff,
+                                         size_t              size,
+                                         CallbackFunctionPtr callback,
+                                         void*               callback_context)
+{
+    return pimpl_->DmaTransmit(buff, size, callback, callback_context);
+}
@@ -8,7 +8,7 @@
 - Add documentation
 - Add reception
 - Add IT
-- Add DMA
+- Add DMA reception
 */
 
 namespace daisy
@@ -127,6 +127,31 @@ class SpiHandle
     */
     Result BlockingReceive(uint8_t* buffer, uint16_t size, uint32_t timeout);
 
+    /** A callback to be executed when a dma transfer is complete. */
+    typedef void (*CallbackFunctionPtr)(void* context, Result result);
+
+    /** Transmits data with a DMA and returns immediately.
+     *  The data must be in a DMA capable memory section, e.g. with the
+     *  `DMA_BUFFER_MEM_SECTION` attribute:
+     *      uint8_t DMA_BUFFER_MEM_SECTION my_buffer[100];
+     *  The Config must use a datasize of 8 bits.
+     *
+     *  A single DMA stream is shared across SPI1 to SPI5. SPI6 has no DMA
+     *  support (yet). If the DMA is busy with another transfer, an error
+     *  is returned and nothing is sent.
+     *
+     *  \param *buff   the data to send, at most 65535 bytes
+     *  \param size    buffer size
+     *  \param callback A callback to execute when the transfer finishes,
+     *                  or NULL. It's called from an interrupt.
+     *  \param callback_context A pointer that will be passed back to you in
+     *                  the callback.
+     */
+    Result DmaTransmit(uint8_t*            buff,
+                       size_t              size,
+                       CallbackFunctionPtr callback,
+                       void*               callback_context);
+
     /** \return the result of HAL_SPI_GetError() to the user. */
     int CheckError();
 
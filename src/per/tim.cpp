@@ -25,7 +25,12 @@ class TimerHandle::Impl
     TimerHandle::Result Start();
     TimerHandle::Result Stop();
     TimerHandle::Result SetPeriod(uint32_t ticks);
+    uint32_t            GetPeriod();
     TimerHandle::Result SetPrescaler(uint32_t val);
+    TimerHandle::Result InitPwm(TimerHandle::Channel chn,
+                                dsy_gpio_pin         pin,
+                                bool                 invert);
+    void                SetPwmCompare(TimerHandle::Channel chn, uint32_t val);
     uint32_t            GetFreq();
     uint32_t            GetTick();
     uint32_t            GetMs();
@@ -129,12 +134,57 @@ TimerHandle::Result TimerHandle::Impl::SetPeriod(uint32_t ticks)
     return Result::OK;
 }
 
+uint32_t TimerHandle::Impl::GetPeriod()
+{
+    return tim_hal_handle_.Instance->ARR;
+}
+
 TimerHandle::Result TimerHandle::Impl::SetPrescaler(uint32_t val)
 {
     tim_hal_handle_.Instance->PSC = val;
     return Result::OK;
 }
 
+TimerHandle::Result TimerHandle::Impl::InitPwm(TimerHandle::Channel chn,
+                                               dsy_gpio_pin         pin,
+                                               bool                 invert)
+{
+    TimerHandle::Config::Peripheral periph;
+    TimerHandle::Channel            pin_chn;
+    if(!GetPwmChannel(pin, periph, pin_chn) || periph != config_.periph
+       || pin_chn != chn)
+        return TimerHandle::Result::ERR;
+
+    // TIM3, TIM4 and TIM5 are all on alternate function 2
+    GPIO_InitTypeDef GPIO_InitStruct;
+    GPIO_InitStruct.Pin       = dsy_hal_map_get_pin(&pin);
+    GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull      = GPIO_NOPULL;
+    GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = GPIO_AF2_TIM3;
+    dsy_hal_map_gpio_clk_enable(pin.port);
+    HAL_GPIO_Init(dsy_hal_map_get_port(&pin), &GPIO_InitStruct);
+
+    // Output on while the count is below the compare value
+    TIM_OC_InitTypeDef sConfigOC = {0};
+    sConfigOC.OCMode             = TIM_OCMODE_PWM1;
+    sConfigOC.Pulse              = 0;
+    sConfigOC.OCPolarity = invert ? TIM_OCPOLARITY_LOW : TIM_OCPOLARITY_HIGH;
+    sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+    const uint32_t hal_chn = uint32_t(chn) * 4; // TIM_CHANNEL_1 to 4
+    if(HAL_TIM_PWM_ConfigChannel(&tim_hal_handle_, &sConfigOC, hal_chn)
+       != HAL_OK)
+        return TimerHandle::Result::ERR;
+    return HAL_TIM_PWM_Start(&tim_hal_handle_, hal_chn) == HAL_OK
+               ? TimerHandle::Result::OK
+               : TimerHandle::Result::ERR;
+}
+
+void TimerHandle::Impl::SetPwmCompare(TimerHandle::Channel chn, uint32_t val)
+{
+    __HAL_TIM_SET_COMPARE(&tim_hal_handle_, uint32_t(chn) * 4, val);
+}
+
 uint32_t TimerHandle::Impl::GetFreq()
 {
     // TIM ticks run at 2x PClk
@@ -258,11 +308,27 @@ TimerHandle::Result TimerHandle::SetPeriod(uint32_t ticks)
     return pimpl_->SetPeriod(ticks);
 }
 
+uint32_t TimerHandle::GetPeriod()
+{
+    return pimpl_->GetPeriod();
+}
+
 TimerHandle::Result TimerHandle::SetPrescaler(uint32_t val)
 {
     return pimpl_->SetPrescaler(val);
 }
 
+TimerHandle::Result
+TimerHandle::InitPwm(Channel chn, dsy_gpio_pin pin, bool invert)
+{
+    return pimpl_->InitPwm(chn, pin, invert);
+}
+
+void TimerHandle::SetPwmCompare(Channel chn, uint32_t val)
+{
+    pimpl_->SetPwmCompare(chn, val);
+}
+
 uint32_t TimerHandle::GetFreq()
 {
     return pimpl_->GetFreq();
@@ -3,6 +3,7 @@
 #define DSY_TIM_H
 
 #include <cstdint>
+#include "daisy_core.h"
 
 namespace daisy
 {
@@ -27,7 +28,6 @@ namespace daisy
  ** - Other General purpose timers
  ** - Non-internal clock sources
  ** - Use of the four-tim channels per tim
- **     - PWM, etc.
  **     - InputCapture/OutputCompare, etc.
  ** - HRTIM
  ** - Advanced timers (TIM1/TIM8)
@@ -60,6 +60,15 @@ class TimerHandle
         CounterDir dir;
     };
 
+    /** Capture/compare channels of a timer, used for PWM outputs */
+    enum class Channel
+    {
+        ONE = 0,
+        TWO,
+        THREE,
+        FOUR,
+    };
+
     /** Return values for TIM funcitons. */
     enum class Result
     {
@@ -86,6 +95,9 @@ class TimerHandle
      ** */
     Result SetPeriod(uint32_t ticks);
 
+    /** Returns the period in ticks, as set by SetPeriod() */
+    uint32_t GetPeriod();
+
     /** Sets the Prescalar applied to the TIM peripheral. 
      ** This can be any number up to 0xffff 
      ** This will adjust the rate of ticks:
@@ -125,6 +137,82 @@ class TimerHandle
      ***/
     uint32_t GetUs();
 
+    /** Finds the timer channel that can drive a pin as a PWM output.
+     ** TIM2 keeps the system time, so only TIM3, TIM4 and TIM5 are used.
+     ** \param pin pin to drive
+     ** \param periph set to the timer of the pin
+     ** \param chn set to the channel of the pin
+     ** \return false if none of the timers is connected to the pin
+     */
+    static bool GetPwmChannel(dsy_gpio_pin        pin,
+                              Config::Peripheral& periph,
+                              Channel&            chn)
+    {
+        struct PwmPin
+        {
+            dsy_gpio_port      port;
+            uint8_t            pin;
+            Config::Peripheral periph;
+            Channel            chn;
+        };
+        static constexpr PwmPin pins[] = {
+            {DSY_GPIOA, 6, Config::Peripheral::TIM_3, Channel::ONE},
+            {DSY_GPIOB, 4, Config::Peripheral::TIM_3, Channel::ONE},
+            {DSY_GPIOC, 6, Config::Peripheral::TIM_3, Channel::ONE},
+            {DSY_GPIOA, 7, Config::Peripheral::TIM_3, Channel::TWO},
+            {DSY_GPIOB, 5, Config::Peripheral::TIM_3, Channel::TWO},
+            {DSY_GPIOC, 7, Config::Peripheral::TIM_3, Channel::TWO},
+            {DSY_GPIOB, 0, Config::Peripheral::TIM_3, Channel::THREE},
+            {DSY_GPIOC, 8, Config::Peripheral::TIM_3, Channel::THREE},
+            {DSY_GPIOB, 1, Config::Peripheral::TIM_3, Channel::FOUR},
+            {DSY_GPIOC, 9, Config::Peripheral::TIM_3, Channel::FOUR},
+            {DSY_GPIOB, 6, Config::Peripheral::TIM_4, Channel::ONE},
+            {DSY_GPIOD, 12, Config::Peripheral::TIM_4, Channel::ONE},
+            {DSY_GPIOB, 7, Config::Peripheral::TIM_4, Channel::TWO},
+            {DSY_GPIOD, 13, Config::Peripheral::TIM_4, Channel::TWO},
+            {DSY_GPIOB, 8, Config::Peripheral::TIM_4, Channel::THREE},
+            {DSY_GPIOD, 14, Config::Peripheral::TIM_4, Channel::THREE},
+            {DSY_GPIOB, 9, Config::Peripheral::TIM_4, Channel::FOUR},
+            {DSY_GPIOD, 15, Config::Peripheral::TIM_4, Channel::FOUR},
+            {DSY_GPIOA, 0, Config::Peripheral::TIM_5, Channel::ONE},
+            {DSY_GPIOH, 10, Config::Peripheral::TIM_5, Channel::ONE},
+            {DSY_GPIOA, 1, Config::Peripheral::TIM_5, Channel::TWO},
+            {DSY_GPIOH, 11, Config::Peripheral::TIM_5, Channel::TWO},
+            {DSY_GPIOA, 2, Config::Peripheral::TIM_5, Channel::THREE},
+            {DSY_GPIOH, 12, Config::Peripheral::TIM_5, Channel::THREE},
+            {DSY_GPIOA, 3, Config::Peripheral::TIM_5, Channel::FOUR},
+            {DSY_GPIOI, 0, Config::Peripheral::TIM_5, Channel::FOUR},
+        };
+        for(const PwmPin& p : pins)
+        {
+            if(p.port == pin.port && p.pin == pin.pin)
+            {
+                periph = p.periph;
+                chn    = p.chn;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Sets up a channel as a PWM output on a pin and starts it.
+     ** The output is on for compare ticks of every period + 1 ticks, so a
+     ** compare value over the period keeps it on. Call Init() first, and
+     ** set the period and prescaler for the PWM frequency.
+     ** \param chn channel, as returned by GetPwmChannel()
+     ** \param pin pin of the channel
+     ** \param invert output low while on, for LEDs wired to the supply
+     ** \return ERR if the pin isn't connected to this channel
+     */
+    Result InitPwm(Channel chn, dsy_gpio_pin pin, bool invert);
+
+    /** Sets the number of ticks a PWM channel is on for. It takes effect
+     ** at the start of the next period, so there are no glitches.
+     ** The compare register of TIM_3 and TIM_4 has 16 bits, larger values
+     ** are truncated.
+     */
+    void SetPwmCompare(Channel chn, uint32_t val);
+
     /** Stay within this function for del ticks */
     void DelayTick(uint32_t del);
 
@@ -0,0 +1,122 @@
+#include "per/adc.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+#define DSY_ADC_MAX_MUX_CHANNELS 8
+#define DSY_ADC_MAX_RESOLUTION 65536.0f
+
+// Readings are what the DMA would have left in memory, set from the tests
+static uint16_t adc_values[DSY_ADC_MAX_CHANNELS];
+static uint16_t adc_mux_values[DSY_ADC_MAX_CHANNELS][DSY_ADC_MAX_MUX_CHANNELS];
+
+static size_t Clamp(uint8_t chn)
+{
+    return chn < DSY_ADC_MAX_CHANNELS ? chn : 0;
+}
+
+static size_t GetNumMuxPinsRequired(size_t num_mux_ch)
+{
+    return num_mux_ch > 4 ? 3 : num_mux_ch > 2 ? 2 : num_mux_ch > 1 ? 1 : 0;
+}
+
+void AdcChannelConfig::InitSingle(dsy_gpio_pin pin)
+{
+    pin_.pin      = pin;
+    mux_channels_ = 0;
+    pin_.mode     = DSY_GPIO_MODE_ANALOG;
+    pin_.pull     = DSY_GPIO_NOPULL;
+}
+
+void AdcChannelConfig::InitMux(dsy_gpio_pin adc_pin,
+                               size_t       mux_channels,
+                               dsy_gpio_pin mux_0,
+                               dsy_gpio_pin mux_1,
+                               dsy_gpio_pin mux_2)
+{
+    pin_.pin        = adc_pin;
+    pin_.mode       = DSY_GPIO_MODE_ANALOG;
+    pin_.pull       = DSY_GPIO_NOPULL;
+    mux_pin_[0].pin = mux_0;
+    mux_pin_[1].pin = mux_1;
+    mux_pin_[2].pin = mux_2;
+    mux_channels_   = mux_channels < 8 ? mux_channels : 8;
+    for(size_t i = 0; i < GetNumMuxPinsRequired(mux_channels_); i++)
+    {
+        mux_pin_[i].mode = DSY_GPIO_MODE_OUTPUT_PP;
+        mux_pin_[i].pull = DSY_GPIO_NOPULL;
+    }
+}
+
+void AdcHandle::Init(AdcChannelConfig* cfg,
+                     size_t            num_channels,
+                     OverSampling      ovs)
+{
+    oversampling_ = ovs;
+    num_channels_ = num_channels;
+    for(size_t i = 0; i < num_channels; i++)
+    {
+        dsy_gpio_init(&cfg[i].pin_);
+        size_t mux_pins = GetNumMuxPinsRequired(cfg[i].mux_channels_);
+        for(size_t j = 0; j < mux_pins; j++)
+            dsy_gpio_init(&cfg[i].mux_pin_[j]);
+    }
+}
+
+void AdcHandle::Start() {}
+
+void AdcHandle::Stop() {}
+
+uint16_t AdcHandle::Get(uint8_t chn) const
+{
+    return adc_values[Clamp(chn)];
+}
+
+uint16_t* AdcHandle::GetPtr(uint8_t chn) const
+{
+    return &adc_values[Clamp(chn)];
+}
+
+float AdcHandle::GetFloat(uint8_t chn) const
+{
+    return (float)adc_values[Clamp(chn)] / DSY_ADC_MAX_RESOLUTION;
+}
+
+uint16_t AdcHandle::GetMux(uint8_t chn, uint8_t idx) const
+{
+    return adc_mux_values[Clamp(chn)][idx];
+}
+
+uint16_t* AdcHandle::GetMuxPtr(uint8_t chn, uint8_t idx) const
+{
+    return &adc_mux_values[Clamp(chn)][idx];
+}
+
+float AdcHandle::GetMuxFloat(uint8_t chn, uint8_t idx) const
+{
+    return (float)adc_mux_values[Clamp(chn)][idx] / DSY_ADC_MAX_RESOLUTION;
+}
+
+namespace daisy
+{
+void sim::ResetAdc()
+{
+    for(size_t i = 0; i < DSY_ADC_MAX_CHANNELS; i++)
+    {
+        adc_values[i] = 0;
+        for(size_t j = 0; j < DSY_ADC_MAX_MUX_CHANNELS; j++)
+            adc_mux_values[i][j] = 0;
+    }
+}
+
+void sim::SetAdc(uint8_t chn, uint16_t value)
+{
+    adc_values[Clamp(chn)] = value;
+}
+
+void sim::SetAdcMux(uint8_t chn, uint8_t idx, uint16_t value)
+{
+    adc_mux_values[Clamp(chn)][idx % DSY_ADC_MAX_MUX_CHANNELS] = value;
+}
+
+} // namespace daisy
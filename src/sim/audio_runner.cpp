@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "sim/audio_runner.h"
+#include "util/WavHeader.h"
+
+namespace daisy
+{
+namespace sim
+{
+// The DMA buffers of AudioHandle hold 1024 samples, 2 blocks of 2 channels
+static const size_t kMaxBlockSize = 256;
+
+// Blocks between a block of input and its output
+static const size_t kLatencyBlocks = 2;
+
+// ================================================================
+// WAV files
+// ================================================================
+
+namespace
+{
+// The file backend WavHeader expects
+class StdioReader
+{
+  public:
+    explicit StdioReader(FILE *file) : file_(file) {}
+    size_t Read(void *data, size_t size)
+    {
+        return fread(data, 1, size, file_);
+    }
+    bool     Seek(uint32_t pos) { return fseek(file_, pos, SEEK_SET) == 0; }
+    uint32_t GetSize()
+    {
+        long pos = ftell(file_);
+        fseek(file_, 0, SEEK_END);
+        long size = ftell(file_);
+        fseek(file_, pos, SEEK_SET);
+        return size;
+    }
+
+  private:
+    FILE *file_;
+};
+
+void PutU16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+void PutU32(uint8_t *p, uint32_t v)
+{
+    PutU16(p, v);
+    PutU16(p + 2, v >> 16);
+}
+
+int32_t FloatToSample(float x)
+{
+    if(x >= 1.f)
+        return INT32_MAX;
+    if(x <= -1.f)
+        return INT32_MIN;
+    return (int32_t)(x * 2147483648.f);
+}
+
+} // namespace
+
+bool LoadWav(const char *path, WavAudio &audio)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        return false;
+    StdioReader reader(file);
+    WavHeader   header = {};
+    bool        ok     = header.Parse(reader, false);
+
+    const uint16_t format = header.format_tag;
+    const size_t   bytes  = header.bits_per_sample / 8;
+    const bool     flt    = format == WAVE_FORMAT_IEEE_FLOAT && bytes == 4;
+    const bool     pcm = format == WAVE_FORMAT_PCM && bytes >= 2 && bytes <= 4;
+    ok = ok && (pcm || flt) && header.channels > 0 && header.block_align > 0;
+    std::vector<uint8_t> data;
+    if(ok)
+    {
+        data.resize(header.data_size);
+        ok = reader.Read(data.data(), data.size()) == data.size();
+    }
+    fclose(file);
+    if(!ok)
+        return false;
+
+    audio.samplerate = header.samplerate;
+    audio.channels   = header.channels;
+    audio.bits       = flt ? 32 : header.bits_per_sample;
+    const size_t frames = data.size() / header.block_align;
+    audio.samples.resize(frames * header.channels);
+    for(size_t i = 0; i < audio.samples.size(); i++)
+    {
+        const uint8_t *p = &data[i * bytes];
+        uint32_t       v = 0;
+        for(size_t b = 0; b < bytes; b++)
+            v |= (uint32_t)p[b] << (8 * (4 - bytes + b));
+        if(flt)
+        {
+            float f;
+            memcpy(&f, &v, sizeof(f));
+            audio.samples[i] = FloatToSample(f);
+        }
+        else
+        {
+            audio.samples[i] = (int32_t)v;
+        }
+    }
+    return true;
+}
+
+bool SaveWav(const char *path, const WavAudio &audio)
+{
+    const size_t bytes = audio.bits / 8;
+    if(bytes < 2 || bytes > 4 || audio.channels == 0)
+        return false;
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return false;
+
+    const uint32_t data_size = audio.samples.size() * bytes;
+    uint8_t        header[44];
+    PutU32(header, kWavFileChunkId);
+    PutU32(header + 4, 36 + data_size);
+    PutU32(header + 8, kWavFileWaveId);
+    PutU32(header + 12, kWavFileSubChunk1Id);
+    PutU32(header + 16, 16);
+    PutU16(header + 20, WAVE_FORMAT_PCM);
+    PutU16(header + 22, audio.channels);
+    PutU32(header + 24, audio.samplerate);
+    PutU32(header + 28, audio.samplerate * audio.channels * bytes);
+    PutU16(header + 32, audio.channels * bytes);
+    PutU16(header + 34, audio.bits);
+    PutU32(header + 36, kWavFileSubChunk2Id);
+    PutU32(header + 40, data_size);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    std::vector<uint8_t> data(data_size);
+    for(size_t i = 0; i < audio.samples.size(); i++)
+    {
+        const uint32_t v = audio.samples[i];
+        for(size_t b = 0; b < bytes; b++)
+            data[i * bytes + b] = v >> (8 * (4 - bytes + b));
+    }
+    ok = ok && fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+// ================================================================
+// AudioRunner
+// ================================================================
+
+int32_t AudioRunner::ToWord(int32_t sample, SaiHandle::Config::BitDepth depth)
+{
+    switch(depth)
+    {
+        case SaiHandle::Config::BitDepth::SAI_16BIT: return sample >> 16;
+        case SaiHandle::Config::BitDepth::SAI_24BIT: return sample >> 8;
+        default: return sample;
+    }
+}
+
+int32_t AudioRunner::FromWord(int32_t word, SaiHandle::Config::BitDepth depth)
+{
+    switch(depth)
+    {
+        case SaiHandle::Config::BitDepth::SAI_16BIT:
+            return (int32_t)((uint32_t)word << 16);
+        case SaiHandle::Config::BitDepth::SAI_24BIT:
+            return (int32_t)((uint32_t)word << 8);
+        default: return word;
+    }
+}
+
+void AudioRunner::ToSai(const Config &        config,
+                        const WavAudio &      in,
+                        std::vector<int32_t> &words)
+{
+    const size_t frames = in.GetFrames();
+    words.assign(frames * config.channels, 0);
+    for(size_t f = 0; f < frames; f++)
+    {
+        const int32_t *src = &in.samples[f * in.channels];
+        int32_t *      dst = &words[f * config.channels];
+        for(size_t c = 0; c < config.channels; c++)
+        {
+            // Mono goes to both channels, missing channels are silent
+            size_t from = in.channels == 1 ? 0 : c;
+            if(from < in.channels)
+                dst[c] = ToWord(src[from], config.bit_depth);
+        }
+    }
+}
+
+void AudioRunner::FromSai(const Config &config, WavAudio &out)
+{
+    switch(config.bit_depth)
+    {
+        case SaiHandle::Config::BitDepth::SAI_16BIT: out.bits = 16; break;
+        case SaiHandle::Config::BitDepth::SAI_24BIT: out.bits = 24; break;
+        default: out.bits = 32; break;
+    }
+    for(size_t i = 0; i < out.samples.size(); i++)
+        out.samples[i] = FromWord(out.samples[i], config.bit_depth);
+}
+
+AudioRunner::Result AudioRunner::Run(const Config &             config,
+                                     AudioHandle::AudioCallback callback,
+                                     const int32_t *            in,
+                                     int32_t *                  out,
+                                     size_t                     frames)
+{
+    AudioHandle audio;
+    if(Start(config, in, out, frames, audio) != Result::OK)
+        return Result::ERR;
+    audio.Start(callback);
+    return Process(audio);
+}
+
+AudioRunner::Result
+AudioRunner::Run(const Config &                         config,
+                 AudioHandle::InterleavingAudioCallback callback,
+                 const int32_t *                        in,
+                 int32_t *                              out,
+                 size_t                                 frames)
+{
+    AudioHandle audio;
+    if(config.channels != 2
+       || Start(config, in, out, frames, audio) != Result::OK)
+        return Result::ERR;
+    audio.Start(callback);
+    return Process(audio);
+}
+
+AudioRunner::Result AudioRunner::Start(const Config & config,
+                                       const int32_t *in,
+                                       int32_t *      out,
+                                       size_t         frames,
+                                       AudioHandle &  audio)
+{
+    if((config.channels != 2 && config.channels != 4) || config.blocksize == 0
+       || config.blocksize > kMaxBlockSize)
+        return Result::ERR;
+    config_ = config;
+    in_     = in;
+    out_    = out;
+    frames_ = frames;
+    times_.clear();
+
+    Reset();
+    SaiHandle sai[2];
+    for(size_t i = 0; i < config.channels / 2; i++)
+    {
+        SaiHandle::Config cfg;
+        cfg.periph    = i == 0 ? SaiHandle::Config::Peripheral::SAI_1
+                               : SaiHandle::Config::Peripheral::SAI_2;
+        cfg.sr        = config.samplerate;
+        cfg.bit_depth = config.bit_depth;
+        cfg.a_sync    = SaiHandle::Config::Sync::MASTER;
+        cfg.b_sync    = SaiHandle::Config::Sync::SLAVE;
+        cfg.a_dir     = SaiHandle::Config::Direction::TRANSMIT;
+        cfg.b_dir     = SaiHandle::Config::Direction::RECEIVE;
+        sai[i].Init(cfg);
+        samplerate_ = sai[i].GetSampleRate();
+        ports_[i]   = {this, i * 2, 0, 0};
+        SetSaiInput(cfg.periph, Input, &ports_[i]);
+        SetSaiOutput(cfg.periph, Output, &ports_[i]);
+    }
+
+    AudioHandle::Config cfg;
+    cfg.blocksize  = config.blocksize;
+    cfg.samplerate = config.samplerate;
+    cfg.postgain   = config.postgain;
+    AudioHandle::Result result = config.channels == 4
+                                     ? audio.Init(cfg, sai[0], sai[1])
+                                     : audio.Init(cfg, sai[0]);
+    return result == AudioHandle::Result::OK ? Result::OK : Result::ERR;
+}
+
+AudioRunner::Result AudioRunner::Process(AudioHandle &audio)
+{
+    using namespace std::chrono;
+    const SaiHandle::Config::Peripheral sai1
+        = SaiHandle::Config::Peripheral::SAI_1;
+    const size_t bs     = config_.blocksize;
+    const size_t blocks = (frames_ + bs - 1) / bs + kLatencyBlocks;
+    times_.reserve(blocks);
+    // SAI2 has no callback, its events come first and only move samples
+    while(GetSaiBlocks(sai1) < blocks)
+    {
+        const uint32_t done  = GetSaiBlocks(sai1);
+        auto           start = steady_clock::now();
+        while(GetSaiBlocks(sai1) == done)
+            Step();
+        times_.push_back(
+            duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    }
+    audio.Stop();
+    return Result::OK;
+}
+
+AudioRunner::BlockTimes AudioRunner::GetBlockTimeStats() const
+{
+    BlockTimes stats = {};
+    stats.blocks     = times_.size();
+    stats.budget     = config_.blocksize * 1e9f / samplerate_;
+    if(times_.empty())
+        return stats;
+    stats.min    = times_[0];
+    uint64_t sum = 0;
+    for(uint64_t t : times_)
+    {
+        stats.min = t < stats.min ? t : stats.min;
+        stats.max = t > stats.max ? t : stats.max;
+        sum += t;
+        if(t > stats.budget)
+            stats.overruns++;
+    }
+    stats.mean = sum / times_.size();
+    return stats;
+}
+
+void AudioRunner::Input(int32_t *rx, size_t size, void *context)
+{
+    Port *             port   = static_cast<Port *>(context);
+    const AudioRunner *runner = port->runner;
+    const size_t       chns   = runner->config_.channels;
+    for(size_t i = 0; i < size / 2; i++, port->in_frame++)
+    {
+        rx[i * 2] = rx[i * 2 + 1] = 0;
+        if(port->in_frame < runner->frames_)
+        {
+            const int32_t *src
+                = &runner->in_[port->in_frame * chns + port->first_channel];
+            rx[i * 2]     = src[0];
+            rx[i * 2 + 1] = src[1];
+        }
+    }
+}
+
+void AudioRunner::Output(const int32_t *tx, size_t size, void *context)
+{
+    Port *             port   = static_cast<Port *>(context);
+    const AudioRunner *runner = port->runner;
+    const size_t       chns   = runner->config_.channels;
+    const size_t       block  = port->out_block++;
+    if(block < kLatencyBlocks)
+        return;
+    size_t frame = (block - kLatencyBlocks) * (size / 2);
+    for(size_t i = 0; i < size / 2 && frame < runner->frames_; i++, frame++)
+    {
+        int32_t *dst = &runner->out_[frame * chns + port->first_channel];
+        // The SAI sends 16 and 24 bit words without the bits above them
+        dst[0] = ToWord(FromWord(tx[i * 2], runner->config_.bit_depth),
+                        runner->config_.bit_depth);
+        dst[1] = ToWord(FromWord(tx[i * 2 + 1], runner->config_.bit_depth),
+                        runner->config_.bit_depth);
+    }
+}
+
+} // namespace sim
+} // namespace daisy
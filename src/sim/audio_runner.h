@@ -0,0 +1,191 @@
+#pragma once
+#ifndef DSY_SIM_AUDIO_RUNNER_H
+#define DSY_SIM_AUDIO_RUNNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "hid/audio.h"
+#include "sim/sim.h"
+
+namespace daisy
+{
+namespace sim
+{
+/** Audio loaded from or saved to a WAV file. Samples are interleaved and
+ ** left aligned in 32 bits, whatever the format of the file, so 16 and 24
+ ** bit files are converted without loss.
+ */
+struct WavAudio
+{
+    uint32_t             samplerate = 48000;
+    uint16_t             channels   = 2;
+    uint16_t             bits       = 24; /**< written with this many bits */
+    std::vector<int32_t> samples;
+
+    /** \return number of frames */
+    size_t GetFrames() const
+    {
+        return channels ? samples.size() / channels : 0;
+    }
+};
+
+/** Reads a PCM (16, 24 or 32 bit) or 32 bit float WAV file.
+ ** \return false if the file can't be read or has another format
+ */
+bool LoadWav(const char *path, WavAudio &audio);
+
+/** Writes a PCM WAV file with audio.bits per sample.
+ ** \return false if the file can't be written
+ */
+bool SaveWav(const char *path, const WavAudio &audio);
+
+/** Runs audio through AudioHandle, on the simulated SAI, the way the codec
+ ** would deliver it. The conversion to and from float, the postgain and
+ ** the (de)interleaving are the code that runs on the hardware. The host
+ ** compiler may still generate different float code than arm-none-eabi-gcc
+ ** for the Cortex-M7, so the output matches the device within float
+ ** rounding, not bit for bit.
+ **
+ ** 2 channels use SAI1, 4 channels use SAI1 and SAI2. The output is
+ ** aligned with the input: the two blocks of latency of the DMA buffers
+ ** are run with silence at the end and dropped at the start.
+ **
+ ** Each block is timed on the host clock, from the DMA half transfer to
+ ** the end of the callback.
+ */
+class AudioRunner
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    AudioRunner()
+    : in_(nullptr), out_(nullptr), frames_(0), samplerate_(48000.f)
+    {
+    }
+
+    struct Config
+    {
+        SaiHandle::Config::BitDepth   bit_depth;
+        SaiHandle::Config::SampleRate samplerate;
+        size_t                        blocksize;
+        float                         postgain;
+        size_t                        channels; /**< 2 or 4 */
+
+        Config()
+        : bit_depth(SaiHandle::Config::BitDepth::SAI_24BIT),
+          samplerate(SaiHandle::Config::SampleRate::SAI_48KHZ),
+          blocksize(48),
+          postgain(1.f),
+          channels(2)
+        {
+        }
+    };
+
+    /** Time taken by the blocks of the last run, in nanoseconds */
+    struct BlockTimes
+    {
+        size_t   blocks;
+        uint64_t min, mean, max;
+        uint64_t budget;   /**< duration of a block at the sample rate */
+        size_t   overruns; /**< blocks that took longer than budget */
+    };
+
+    /** Runs frames of samples through a callback.
+     ** \param in interleaved SAI words, config.channels per frame, in the
+     ** format of the bit depth: 16 and 24 bit samples right aligned
+     ** \param out same format and size as in
+     ** \param frames number of frames
+     ** \return ERR for an invalid config
+     */
+    Result Run(const Config &             config,
+               AudioHandle::AudioCallback callback,
+               const int32_t *            in,
+               int32_t *                  out,
+               size_t                     frames);
+
+    /** Same for an interleaving callback, which only works with 2 channels
+     */
+    Result Run(const Config &                         config,
+               AudioHandle::InterleavingAudioCallback callback,
+               const int32_t *                        in,
+               int32_t *                              out,
+               size_t                                 frames);
+
+    /** Runs a WAV file through a callback. The input is converted to the
+     ** bit depth first. Mono input is sent to both channels of SAI1, and
+     ** 3 or 4 channels use SAI2 as well, so config.channels is ignored.
+     ** The output has 2 or 4 channels, with as many bits as the bit depth.
+     */
+    template <typename Callback>
+    Result Run(const Config &  config,
+               Callback        callback,
+               const WavAudio &in,
+               WavAudio &      out)
+    {
+        Config cfg   = config;
+        cfg.channels = in.channels > 2 ? 4 : 2;
+        std::vector<int32_t> words;
+        ToSai(cfg, in, words);
+        out.samplerate = in.samplerate;
+        out.channels   = cfg.channels;
+        out.samples.assign(words.size(), 0);
+        Result result = Run(
+            cfg, callback, words.data(), out.samples.data(), in.GetFrames());
+        FromSai(cfg, out);
+        return result;
+    }
+
+    /** \return time taken by each block of the last run, in nanoseconds */
+    const std::vector<uint64_t> &GetBlockTimes() const { return times_; }
+
+    /** \return summary of the block times of the last run */
+    BlockTimes GetBlockTimeStats() const;
+
+    /** Converts a left aligned sample to a SAI word of a bit depth */
+    static int32_t ToWord(int32_t sample, SaiHandle::Config::BitDepth depth);
+
+    /** Converts a SAI word of a bit depth to a left aligned sample */
+    static int32_t FromWord(int32_t word, SaiHandle::Config::BitDepth depth);
+
+  private:
+    // Where a SAI is in the input and output
+    struct Port
+    {
+        AudioRunner *runner;
+        size_t       first_channel;
+        size_t       in_frame, out_block;
+    };
+
+    Result Start(const Config & config,
+                 const int32_t *in,
+                 int32_t *      out,
+                 size_t         frames,
+                 AudioHandle &  audio);
+    Result Process(AudioHandle &audio);
+
+    static void ToSai(const Config &        config,
+                      const WavAudio &      in,
+                      std::vector<int32_t> &words);
+    static void FromSai(const Config &config, WavAudio &out);
+
+    static void Input(int32_t *rx, size_t size, void *context);
+    static void Output(const int32_t *tx, size_t size, void *context);
+
+    Config                config_;
+    const int32_t *       in_;
+    int32_t *             out_;
+    size_t                frames_;
+    float                 samplerate_;
+    Port                  ports_[2];
+    std::vector<uint64_t> times_;
+};
+
+} // namespace sim
+} // namespace daisy
+
+#endif
@@ -0,0 +1,111 @@
+#include "per/gpio.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+namespace
+{
+struct PinState
+{
+    dsy_gpio_mode mode;
+    bool          level;
+    bool          driven; // level set from outside with SetPin()
+    uint32_t      writes;
+};
+
+PinState pins[DSY_GPIOX][16];
+
+PinState *GetState(dsy_gpio_pin pin)
+{
+    if(pin.port >= DSY_GPIOX || pin.pin >= 16)
+        return nullptr;
+    return &pins[pin.port][pin.pin];
+}
+
+} // namespace
+
+extern "C"
+{
+    void dsy_gpio_init(const dsy_gpio *p)
+    {
+        PinState *s = GetState(p->pin);
+        if(!s)
+            return;
+        s->mode = p->mode;
+        // An undriven input floats to its pull
+        if(p->mode == DSY_GPIO_MODE_INPUT && !s->driven)
+            s->level = p->pull == DSY_GPIO_PULLUP;
+    }
+
+    void dsy_gpio_deinit(const dsy_gpio *p)
+    {
+        PinState *s = GetState(p->pin);
+        if(s)
+            s->mode = DSY_GPIO_MODE_LAST;
+    }
+
+    uint8_t dsy_gpio_read(const dsy_gpio *p)
+    {
+        PinState *s = GetState(p->pin);
+        return s && s->level ? 1 : 0;
+    }
+
+    void dsy_gpio_write(const dsy_gpio *p, uint8_t state)
+    {
+        PinState *s = GetState(p->pin);
+        if(!s)
+            return;
+        s->level = state != 0;
+        s->writes++;
+    }
+
+    void dsy_gpio_toggle(const dsy_gpio *p)
+    {
+        PinState *s = GetState(p->pin);
+        if(!s)
+            return;
+        s->level = !s->level;
+        s->writes++;
+    }
+}
+
+namespace daisy
+{
+namespace sim
+{
+void ResetGpio()
+{
+    for(int port = 0; port < DSY_GPIOX; port++)
+        for(int i = 0; i < 16; i++)
+            pins[port][i] = {DSY_GPIO_MODE_LAST, false, false, 0};
+}
+
+void SetPin(dsy_gpio_pin pin, bool level)
+{
+    PinState *s = GetState(pin);
+    if(!s)
+        return;
+    s->level  = level;
+    s->driven = true;
+}
+
+bool GetPin(dsy_gpio_pin pin)
+{
+    PinState *s = GetState(pin);
+    return s && s->level;
+}
+
+dsy_gpio_mode GetPinMode(dsy_gpio_pin pin)
+{
+    PinState *s = GetState(pin);
+    return s ? s->mode : DSY_GPIO_MODE_LAST;
+}
+
+uint32_t GetPinWrites(dsy_gpio_pin pin)
+{
+    PinState *s = GetState(pin);
+    return s ? s->writes : 0;
+}
+
+} // namespace sim
+} // namespace daisy
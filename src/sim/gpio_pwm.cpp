@@ -0,0 +1,110 @@
+#include "per/gpio_pwm.h"
+#include "per/gpio.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+// The DMA isn't run step by step, GetPinDuty() replays the pattern instead
+static const GpioPwm *gpio_pwm_running[4];
+
+void sim::ResetGpioPwm()
+{
+    for(const GpioPwm *&pwm : gpio_pwm_running)
+        pwm = nullptr;
+}
+
+float sim::GetPinDuty(dsy_gpio_pin pin)
+{
+    for(const GpioPwm *pwm : gpio_pwm_running)
+    {
+        if(pwm == nullptr || pwm->GetConfig().port != pin.port
+           || pin.pin >= 16)
+            continue;
+        // Two periods, so the first one starts from the level of the last
+        const uint32_t *pattern = pwm->GetPattern();
+        const uint32_t  steps   = pwm->GetSteps();
+        bool            level   = GetPin(pin);
+        uint32_t        high    = 0;
+        for(uint32_t i = 0; i < 2 * steps; i++)
+        {
+            const uint32_t word = pattern[i % steps];
+            if(word & (1u << pin.pin))
+                level = true;
+            else if(word & (0x10000u << pin.pin))
+                level = false;
+            high += i >= steps && level ? 1 : 0;
+        }
+        return (float)high / steps;
+    }
+    return GetPin(pin) ? 1.f : 0.f;
+}
+
+GpioPwm::Result
+GpioPwm::Init(const Config &config, uint32_t *pattern, size_t steps)
+{
+    if(config.periph == TimerHandle::Config::Peripheral::TIM_2
+       || pattern == nullptr || steps < 2 || steps > 0xffff
+       || config.port >= DSY_GPIOX || config.freq == 0)
+        return Result::ERR;
+
+    TimerHandle::Config tim_cfg;
+    tim_cfg.periph = config.periph;
+    tim_cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    if(tim_.Init(tim_cfg) != TimerHandle::Result::OK)
+        return Result::ERR;
+    uint32_t ticks = tim_.GetFreq() / (config.freq * steps);
+    if(ticks < 2)
+        return Result::ERR;
+    tim_.SetPeriod(ticks - 1);
+
+    gpio_pwm_running[int(config.periph)] = nullptr;
+    config_                              = config;
+    pattern_                             = pattern;
+    steps_                               = steps;
+    pins_                                = 0;
+    inverted_                            = 0;
+    for(size_t i = 0; i < steps; i++)
+        pattern_[i] = 0;
+    for(size_t i = 0; i < 16; i++)
+        levels_[i] = 0;
+    return Result::OK;
+}
+
+GpioPwm::Result GpioPwm::InitPin(uint8_t pin, bool invert)
+{
+    if(pin >= 16 || pattern_ == nullptr)
+        return Result::ERR;
+    dsy_gpio gpio;
+    gpio.pin  = {config_.port, pin};
+    gpio.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    gpio.pull = DSY_GPIO_NOPULL;
+    dsy_gpio_init(&gpio);
+    dsy_gpio_write(&gpio, invert);
+
+    pins_ |= 1u << pin;
+    if(invert)
+        inverted_ |= 1u << pin;
+    else
+        inverted_ &= ~(1u << pin);
+    levels_[pin] = 0;
+    Set(pin, 0);
+    return Result::OK;
+}
+
+GpioPwm::Result GpioPwm::Start()
+{
+    if(pattern_ == nullptr)
+        return Result::ERR;
+    gpio_pwm_running[int(config_.periph)] = this;
+    return tim_.Start() == TimerHandle::Result::OK ? Result::OK
+                                                   : Result::ERR;
+}
+
+GpioPwm::Result GpioPwm::Stop()
+{
+    if(pattern_ == nullptr)
+        return Result::ERR;
+    gpio_pwm_running[int(config_.periph)] = nullptr;
+    tim_.Stop();
+    return Result::OK;
+}
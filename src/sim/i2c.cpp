@@ -0,0 +1,312 @@
+#include "per/i2c.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+namespace
+{
+// I2C1 to I2C3 share a DMA, I2C4 has none, as on the hardware
+constexpr int kNumI2CWithDma = 3;
+
+struct DmaJob
+{
+    int                            periph = -1;
+    uint16_t                       address;
+    uint8_t*                       data;
+    uint16_t                       size;
+    I2CHandle::Direction           direction;
+    I2CHandle::CallbackFunctionPtr callback;
+    void*                          callback_context;
+    bool IsValid() const { return periph >= 0; }
+};
+
+sim::I2cDevice*               devices[4][128];
+std::vector<sim::I2cTransfer> i2c_log;
+DmaJob                        dma_active;
+DmaJob                        dma_queue[kNumI2CWithDma];
+I2CHandle::Result             dma_result;
+std::vector<uint8_t>          dma_rx;
+
+} // namespace
+
+class I2CHandle::Impl
+{
+  public:
+    I2CHandle::Result Init(const I2CHandle::Config& config)
+    {
+        config_ = config;
+        return I2CHandle::Result::OK;
+    }
+
+    // Time a byte with its acknowledge bit takes, the 1MHz mode runs at
+    // 886kHz like the hardware
+    uint64_t GetByteNs() const
+    {
+        switch(config_.speed)
+        {
+            case Config::Speed::I2C_100KHZ: return 90000;
+            case Config::Speed::I2C_400KHZ: return 22500;
+            default: return 10158;
+        }
+    }
+
+    // Runs a transfer with the device at the address, the address byte
+    // included. NACKs end the transfer after the address.
+    bool Transfer(uint16_t address,
+                  uint8_t* data,
+                  uint16_t size,
+                  bool     read,
+                  bool     dma,
+                  uint64_t& duration)
+    {
+        sim::I2cTransfer t;
+        sim::I2cDevice*  device = devices[int(config_.periph)][address & 0x7F];
+        t.periph                = config_.periph;
+        t.address               = address;
+        t.read                  = read;
+        t.dma                   = dma;
+        t.start_ns              = sim::GetNowNs();
+        if(device && read)
+            t.ack = device->Read(data, size);
+        else if(device)
+            t.ack = device->Write(data, size);
+        else
+            t.ack = false;
+        if(t.ack)
+            t.data.assign(data, data + size);
+        duration = GetByteNs() * (t.ack ? size + 1 : 1);
+        t.end_ns = t.start_ns + duration;
+        i2c_log.push_back(t);
+        return t.ack;
+    }
+
+    I2CHandle::Result Blocking(uint16_t address,
+                               uint8_t* data,
+                               uint16_t size,
+                               bool     read)
+    {
+        if(config_.mode != Config::Mode::I2C_MASTER)
+            return I2CHandle::Result::ERR;
+        // wait for a DMA transfer of this peripheral to finish
+        const int idx = int(config_.periph);
+        sim::WaitUntil([idx] { return dma_active.periph != idx; });
+        uint64_t duration;
+        bool     ack = Transfer(address, data, size, read, false, duration);
+        sim::AdvanceNs(duration);
+        return ack ? I2CHandle::Result::OK : I2CHandle::Result::ERR;
+    }
+
+    I2CHandle::Result Dma(uint16_t                       address,
+                          uint8_t*                       data,
+                          uint16_t                       size,
+                          I2CHandle::Direction           direction,
+                          I2CHandle::CallbackFunctionPtr callback,
+                          void*                          callback_context)
+    {
+        if(config_.periph == Config::Peripheral::I2C_4
+           || config_.mode != Config::Mode::I2C_MASTER)
+            return I2CHandle::Result::ERR;
+        DmaJob job;
+        job.periph           = int(config_.periph);
+        job.address          = address;
+        job.data             = data;
+        job.size             = size;
+        job.direction        = direction;
+        job.callback         = callback;
+        job.callback_context = callback_context;
+        if(dma_active.IsValid())
+        {
+            // blocks until the queue position is free
+            const int idx = job.periph;
+            sim::WaitUntil([idx] { return !dma_queue[idx].IsValid(); });
+            if(dma_active.IsValid())
+            {
+                dma_queue[idx] = job;
+                return I2CHandle::Result::OK;
+            }
+        }
+        StartDma(job);
+        return I2CHandle::Result::OK;
+    }
+
+    // The data is taken from the buffer when the transfer starts, and
+    // received data is written when it ends
+    static void StartDma(const DmaJob& job)
+    {
+        const bool read = job.direction == I2CHandle::Direction::RECEIVE;
+        uint64_t   duration;
+        dma_rx.resize(job.size);
+        uint8_t* data = read ? dma_rx.data() : job.data;
+        bool     ack  = i2c_handles_[job.periph].Transfer(
+            job.address, data, job.size, read, true, duration);
+        dma_active = job;
+        dma_result = ack ? I2CHandle::Result::OK : I2CHandle::Result::ERR;
+        sim::Schedule(sim::GetNowNs() + duration, DmaFinished, nullptr);
+    }
+
+    static void DmaFinished(void*)
+    {
+        DmaJob job = dma_active;
+        dma_active = DmaJob();
+        if(job.direction == I2CHandle::Direction::RECEIVE
+           && dma_result == I2CHandle::Result::OK)
+        {
+            for(size_t i = 0; i < job.size; i++)
+                job.data[i] = dma_rx[i];
+        }
+        if(job.callback)
+            job.callback(job.callback_context, dma_result);
+        // the callback could have started a new transmission right away
+        if(dma_active.IsValid())
+            return;
+        for(int per = 0; per < kNumI2CWithDma; per++)
+        {
+            if(dma_queue[per].IsValid())
+            {
+                DmaJob next    = dma_queue[per];
+                dma_queue[per] = DmaJob();
+                StartDma(next);
+                return;
+            }
+        }
+    }
+
+    I2CHandle::Config      config_;
+    static I2CHandle::Impl i2c_handles_[4];
+};
+
+I2CHandle::Impl I2CHandle::Impl::i2c_handles_[4];
+
+namespace daisy
+{
+void sim::ResetI2c()
+{
+    for(int per = 0; per < 4; per++)
+        for(int address = 0; address < 128; address++)
+            devices[per][address] = nullptr;
+    i2c_log.clear();
+    dma_active = DmaJob();
+    for(int per = 0; per < kNumI2CWithDma; per++)
+        dma_queue[per] = DmaJob();
+}
+
+void sim::AttachI2cDevice(I2CHandle::Config::Peripheral periph,
+                          uint16_t                      address,
+                          I2cDevice*                    device)
+{
+    devices[int(periph)][address & 0x7F] = device;
+}
+
+const std::vector<sim::I2cTransfer>& sim::GetI2cLog()
+{
+    return i2c_log;
+}
+
+void sim::ClearI2cLog()
+{
+    i2c_log.clear();
+}
+
+bool sim::IsI2cBusy(I2CHandle::Config::Peripheral periph)
+{
+    const int idx = int(periph);
+    return dma_active.periph == idx
+           || (idx < kNumI2CWithDma && dma_queue[idx].IsValid());
+}
+
+// ================================================================
+// I2CHandle -> I2CHandle::Impl
+// ================================================================
+
+I2CHandle::Result I2CHandle::Init(const Config& config)
+{
+    const int i2cIdx = int(config.periph);
+    if(i2cIdx >= 4)
+        return Result::ERR;
+    pimpl_ = &I2CHandle::Impl::i2c_handles_[i2cIdx];
+    return pimpl_->Init(config);
+}
+
+const I2CHandle::Config& I2CHandle::GetConfig() const
+{
+    return pimpl_->config_;
+}
+
+I2CHandle::Result I2CHandle::TransmitBlocking(uint16_t address,
+                                              uint8_t* data,
+                                              uint16_t size,
+                                              uint32_t timeout)
+{
+    (void)timeout;
+    return pimpl_->Blocking(address, data, size, false);
+}
+
+I2CHandle::Result I2CHandle::ReceiveBlocking(uint16_t address,
+                                             uint8_t* data,
+                                             uint16_t size,
+                                             uint32_t timeout)
+{
+    (void)timeout;
+    return pimpl_->Blocking(address, data, size, true);
+}
+
+I2CHandle::Result I2CHandle::TransmitDma(uint16_t            address,
+                                         uint8_t*            data,
+                                         uint16_t            size,
+                                         CallbackFunctionPtr callback,
+                                         void*               callback_context)
+{
+    return pimpl_->Dma(
+        address, data, size, Direction::TRANSMIT, callback, callback_context);
+}
+
+I2CHandle::Result I2CHandle::ReceiveDma(uint16_t            address,
+                                        uint8_t*            data,
+                                        uint16_t            size,
+                                        CallbackFunctionPtr callback,
+                                        void*               callback_context)
+{
+    return pimpl_->Dma(
+        address, data, size, Direction::RECEIVE, callback, callback_context);
+}
+
+I2CHandle::Result I2CHandle::ReadDataAtAddress(uint16_t address,
+                                               uint16_t mem_address,
+                                               uint16_t mem_address_size,
+                                               uint8_t* data,
+                                               uint16_t data_size,
+                                               uint32_t timeout)
+{
+    // The memory address goes out first, most significant byte first
+    uint8_t mem[2] = {uint8_t(mem_address >> 8), uint8_t(mem_address)};
+    uint8_t* start = mem_address_size == 1 ? mem + 1 : mem;
+    if(mem_address_size > 2
+       || TransmitBlocking(address, start, mem_address_size, timeout)
+              != Result::OK)
+        return Result::ERR;
+    return ReceiveBlocking(address, data, data_size, timeout);
+}
+
+I2CHandle::Result I2CHandle::WriteDataAtAddress(uint16_t address,
+                                                uint16_t mem_address,
+                                                uint16_t mem_address_size,
+                                                uint8_t* data,
+                                                uint16_t data_size,
+                                                uint32_t timeout)
+{
+    if(mem_address_size > 2)
+        return Result::ERR;
+    std::vector<uint8_t> buf;
+    if(mem_address_size == 2)
+        buf.push_back(mem_address >> 8);
+    buf.push_back(mem_address);
+    buf.insert(buf.end(), data, data + data_size);
+    return TransmitBlocking(address, buf.data(), buf.size(), timeout);
+}
+
+extern "C"
+{
+    void dsy_i2c_global_init() {}
+}
+
+} // namespace daisy
@@ -0,0 +1,210 @@
+#include "per/sai.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+// The DMA runs over the buffers in halves. When a half is done, the codec
+// has sent the input for it and taken the output that was there, and the
+// callback gets to refill it while the other half is transferred.
+class SaiHandle::Impl
+{
+  public:
+    SaiHandle::Result Init(const SaiHandle::Config& config)
+    {
+        config_ = config;
+        return SaiHandle::Result::OK;
+    }
+
+    SaiHandle::Result StartDmaTransfer(int32_t*                       buffer_rx,
+                                       int32_t*                       buffer_tx,
+                                       size_t                         size,
+                                       SaiHandle::CallbackFunctionPtr callback)
+    {
+        StopDma();
+        buff_rx_    = buffer_rx;
+        buff_tx_    = buffer_tx;
+        buff_size_  = size;
+        callback_   = callback;
+        dma_offset  = 0;
+        generation_ = ++next_generation_;
+        running_    = true;
+        start_ns_   = sim::GetNowNs();
+        halves_     = 0;
+        ScheduleNext();
+        return SaiHandle::Result::OK;
+    }
+
+    SaiHandle::Result StopDma()
+    {
+        running_ = false;
+        return SaiHandle::Result::OK;
+    }
+
+    float GetSampleRate()
+    {
+        switch(config_.sr)
+        {
+            case Config::SampleRate::SAI_8KHZ: return 8000.f;
+            case Config::SampleRate::SAI_16KHZ: return 16000.f;
+            case Config::SampleRate::SAI_32KHZ: return 32000.f;
+            case Config::SampleRate::SAI_48KHZ: return 48000.f;
+            case Config::SampleRate::SAI_96KHZ: return 96000.f;
+            default: return 48000.f;
+        }
+    }
+
+    // Buffer handled in halves, 2 samples per frame (1 per channel)
+    size_t GetBlockSize() { return buff_size_ / 2 / 2; }
+    float  GetBlockRate() { return GetSampleRate() / GetBlockSize(); }
+
+    // Times are counted from the start, so they don't drift when a block
+    // doesn't take a whole number of nanoseconds
+    void ScheduleNext()
+    {
+        uint64_t frames = (uint64_t)(halves_ + 1) * GetBlockSize();
+        uint64_t at     = start_ns_ + frames * 1000000000 / GetSampleRate();
+        sim::Schedule(at, HalfDone, this);
+        pending_ = generation_;
+    }
+
+    static void HalfDone(void* context)
+    {
+        Impl* sai = static_cast<Impl*>(context);
+        // Events of a stopped or restarted transfer are stale
+        if(!sai->running_ || sai->pending_ != sai->generation_)
+            return;
+        const size_t half   = sai->buff_size_ / 2;
+        const size_t offset = (sai->halves_ & 1) ? half : 0;
+        sai->dma_offset     = offset;
+        if(sai->output_)
+            sai->output_(sai->buff_tx_ + offset, half, sai->output_context_);
+        int32_t* rx = sai->buff_rx_ + offset;
+        if(sai->input_)
+            sai->input_(rx, half, sai->input_context_);
+        else
+            for(size_t i = 0; i < half; i++)
+                rx[i] = 0;
+        // 24 bit slots arrive right aligned, without the sign extension
+        if(sai->config_.bit_depth == Config::BitDepth::SAI_24BIT)
+            for(size_t i = 0; i < half; i++)
+                rx[i] &= 0xffffff;
+        sai->halves_++;
+        sai->blocks_++;
+        if(sai->callback_)
+            sai->callback_(
+                sai->buff_rx_ + offset, sai->buff_tx_ + offset, half);
+        if(sai->running_ && sai->pending_ == sai->generation_)
+            sai->ScheduleNext();
+    }
+
+    SaiHandle::Config              config_;
+    int32_t *                      buff_rx_, *buff_tx_;
+    size_t                         buff_size_;
+    SaiHandle::CallbackFunctionPtr callback_;
+    size_t                         dma_offset;
+    bool                           running_;
+    uint64_t                       start_ns_;
+    uint32_t                       halves_, blocks_;
+    uint32_t                       generation_, pending_;
+    static uint32_t                next_generation_;
+
+    sim::SaiInputCallback  input_;
+    void*                  input_context_;
+    sim::SaiOutputCallback output_;
+    void*                  output_context_;
+};
+
+uint32_t SaiHandle::Impl::next_generation_ = 0;
+
+static SaiHandle::Impl sai_handles[2];
+
+namespace daisy
+{
+void sim::ResetSai()
+{
+    for(int i = 0; i < 2; i++)
+    {
+        SaiHandle::Impl& sai = sai_handles[i];
+        sai.running_         = false;
+        sai.buff_size_       = 0;
+        sai.callback_        = nullptr;
+        sai.dma_offset       = 0;
+        sai.blocks_          = 0;
+        sai.input_           = nullptr;
+        sai.output_          = nullptr;
+    }
+}
+
+void sim::SetSaiInput(SaiHandle::Config::Peripheral periph,
+                      SaiInputCallback              callback,
+                      void*                         context)
+{
+    sai_handles[int(periph)].input_         = callback;
+    sai_handles[int(periph)].input_context_ = context;
+}
+
+void sim::SetSaiOutput(SaiHandle::Config::Peripheral periph,
+                       SaiOutputCallback             callback,
+                       void*                         context)
+{
+    sai_handles[int(periph)].output_         = callback;
+    sai_handles[int(periph)].output_context_ = context;
+}
+
+uint32_t sim::GetSaiBlocks(SaiHandle::Config::Peripheral periph)
+{
+    return sai_handles[int(periph)].blocks_;
+}
+
+// ================================================================
+// SaiHandle -> SaiHandle::Impl
+// ================================================================
+
+SaiHandle::Result SaiHandle::Init(const Config& config)
+{
+    const int sai_idx = int(config.periph);
+    if(sai_idx >= 2)
+        return Result::ERR;
+    pimpl_ = &sai_handles[sai_idx];
+    return pimpl_->Init(config);
+}
+
+const SaiHandle::Config& SaiHandle::GetConfig() const
+{
+    return pimpl_->config_;
+}
+
+SaiHandle::Result SaiHandle::StartDma(int32_t*            buffer_rx,
+                                      int32_t*            buffer_tx,
+                                      size_t              size,
+                                      CallbackFunctionPtr callback)
+{
+    return pimpl_->StartDmaTransfer(buffer_rx, buffer_tx, size, callback);
+}
+
+SaiHandle::Result SaiHandle::StopDma()
+{
+    return pimpl_->StopDma();
+}
+
+float SaiHandle::GetSampleRate()
+{
+    return pimpl_->GetSampleRate();
+}
+
+size_t SaiHandle::GetBlockSize()
+{
+    return pimpl_->GetBlockSize();
+}
+
+float SaiHandle::GetBlockRate()
+{
+    return pimpl_->GetBlockRate();
+}
+
+size_t SaiHandle::GetOffset() const
+{
+    return pimpl_->dma_offset;
+}
+
+} // namespace daisy
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include "sim/sim.h"
+#include "sim/sim_impl.h"
+
+namespace daisy
+{
+namespace sim
+{
+namespace
+{
+struct Event
+{
+    uint64_t      at;
+    uint64_t      seq;
+    EventCallback callback;
+    void *        context;
+};
+
+// Orders the heap so the earliest event, and the first scheduled of events
+// due at the same time, is at the front
+bool Later(const Event &a, const Event &b)
+{
+    return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+}
+
+std::vector<Event> events;
+uint64_t           now_ns   = 0;
+uint64_t           next_seq = 0;
+
+Event PopEvent()
+{
+    std::pop_heap(events.begin(), events.end(), Later);
+    Event e = events.back();
+    events.pop_back();
+    return e;
+}
+
+} // namespace
+
+void Reset()
+{
+    events.clear();
+    now_ns   = 0;
+    next_seq = 0;
+    ResetGpio();
+    ResetI2c();
+    ResetSpi();
+    ResetUart();
+    ResetSai();
+    ResetAdc();
+    ResetTim();
+    ResetGpioPwm();
+    ResetSystem();
+}
+
+uint64_t GetNowNs()
+{
+    return now_ns;
+}
+
+uint32_t GetNowUs()
+{
+    return now_ns / 1000;
+}
+
+void Advance(uint32_t us)
+{
+    AdvanceNs((uint64_t)us * 1000);
+}
+
+void AdvanceNs(uint64_t ns)
+{
+    // An event may wait itself (a delay in a callback), which moves the
+    // time past the target already
+    const uint64_t target = now_ns + ns;
+    while(!events.empty() && events.front().at <= target)
+    {
+        Event e = PopEvent();
+        if(e.at > now_ns)
+            now_ns = e.at;
+        e.callback(e.context);
+    }
+    if(target > now_ns)
+        now_ns = target;
+}
+
+bool Step()
+{
+    if(events.empty())
+        return false;
+    Event e = PopEvent();
+    if(e.at > now_ns)
+        now_ns = e.at;
+    e.callback(e.context);
+    return true;
+}
+
+void Schedule(uint64_t at_ns, EventCallback callback, void *context)
+{
+    Event e;
+    e.at       = at_ns > now_ns ? at_ns : now_ns;
+    e.seq      = next_seq++;
+    e.callback = callback;
+    e.context  = context;
+    events.push_back(e);
+    std::push_heap(events.begin(), events.end(), Later);
+}
+
+} // namespace sim
+} // namespace daisy
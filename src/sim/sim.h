@@ -0,0 +1,310 @@
+#pragma once
+#ifndef DSY_SIM_H
+#define DSY_SIM_H
+
+#ifndef UNIT_TEST
+#error "The peripheral simulation is only built for the host (UNIT_TEST)"
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "per/gpio.h"
+#include "per/i2c.h"
+#include "per/spi.h"
+#include "per/uart.h"
+#include "per/sai.h"
+#include "per/tim.h"
+
+namespace daisy
+{
+/** Host side simulation of the peripherals, used in place of the STM32 HAL
+ ** when libDaisy is built with UNIT_TEST.
+ **
+ ** The sources in src/sim implement the classes declared in per/ and
+ ** sys/system.h, so everything above them (hid/, dev/, util/) is built
+ ** from the same sources as on the hardware. Tests script the outside
+ ** world through the functions in this namespace: devices on the I2C
+ ** buses, bytes arriving at a UART, samples arriving at a codec, levels
+ ** of input pins and ADC readings.
+ **
+ ** Time is virtual. It starts at 0 and only moves forward when the code
+ ** waits: System::Delay(), blocking transfers (by the time the bytes take
+ ** on the wire), or a call to Advance(). Work done by the code itself takes
+ ** no time. Things the hardware does in the background, like DMA transfers
+ ** completing, audio blocks or received bytes, are events that run in
+ ** order while time moves past them. Callbacks that run from interrupts on
+ ** the hardware run from Advance() here.
+ ** */
+namespace sim
+{
+/** Puts every peripheral back to its reset state, forgets all devices,
+ ** logs and pending events, and sets the time back to 0.
+ ** Call this at the start of each test.
+ */
+void Reset();
+
+/** \return virtual time since Reset(), in nanoseconds */
+uint64_t GetNowNs();
+
+/** \return virtual time since Reset(), in microseconds */
+uint32_t GetNowUs();
+
+/** Moves time forward, running the events that fall due on the way.
+ ** \param us time to advance, in microseconds
+ */
+void Advance(uint32_t us);
+
+/** Moves time forward, in nanoseconds */
+void AdvanceNs(uint64_t ns);
+
+/** Moves time to the next pending event and runs it.
+ ** \return false if there was no pending event
+ */
+bool Step();
+
+/** Callback of an event */
+typedef void (*EventCallback)(void *context);
+
+/** Schedules a callback to run when time reaches a point.
+ ** Events due at the same time run in the order they were scheduled.
+ ** \param at_ns time to run at, not earlier than GetNowNs()
+ ** \param callback function to run
+ ** \param context passed back to the callback
+ */
+void Schedule(uint64_t at_ns, EventCallback callback, void *context);
+
+// ================================================================
+// GPIO
+// ================================================================
+
+/** Drives an input pin from outside
+ ** \param pin pin to drive
+ ** \param level true for high
+ */
+void SetPin(dsy_gpio_pin pin, bool level);
+
+/** \return level of a pin, as last written or driven */
+bool GetPin(dsy_gpio_pin pin);
+
+/** \return mode the pin was initialized with, or DSY_GPIO_MODE_LAST */
+dsy_gpio_mode GetPinMode(dsy_gpio_pin pin);
+
+/** \return number of writes to a pin since Reset(), changing or not */
+uint32_t GetPinWrites(dsy_gpio_pin pin);
+
+// ================================================================
+// I2C
+// ================================================================
+
+/** Model of a device on a simulated I2C bus */
+class I2cDevice
+{
+  public:
+    virtual ~I2cDevice() {}
+
+    /** Called when the master writes to the device.
+     ** \return false to NACK the transfer
+     */
+    virtual bool Write(const uint8_t *data, size_t size) = 0;
+
+    /** Called when the master reads from the device.
+     ** \return false to NACK the transfer
+     */
+    virtual bool Read(uint8_t *data, size_t size) = 0;
+};
+
+/** Device with 256 byte registers. The first byte of a write selects the
+ ** register, the rest are written from there on. Reads start at the
+ ** selected register. The address increments after each byte, like on
+ ** most sensors, codecs and LED drivers.
+ ** */
+class I2cRegisterDevice : public I2cDevice
+{
+  public:
+    I2cRegisterDevice() : pointer_(0), writes_(0)
+    {
+        for(size_t i = 0; i < sizeof(regs); i++)
+            regs[i] = 0;
+    }
+
+    bool Write(const uint8_t *data, size_t size) override
+    {
+        if(size == 0)
+            return true;
+        pointer_ = data[0];
+        for(size_t i = 1; i < size; i++)
+            regs[pointer_++] = data[i];
+        writes_++;
+        return true;
+    }
+
+    bool Read(uint8_t *data, size_t size) override
+    {
+        for(size_t i = 0; i < size; i++)
+            data[i] = regs[pointer_++];
+        return true;
+    }
+
+    /** \return number of writes to the device */
+    uint32_t GetWrites() const { return writes_; }
+
+    uint8_t regs[256]; /**< Register contents, to inspect or preset */
+
+  private:
+    uint8_t  pointer_;
+    uint32_t writes_;
+};
+
+/** A transfer seen on a simulated I2C bus */
+struct I2cTransfer
+{
+    I2CHandle::Config::Peripheral periph;  /**< & */
+    uint16_t                      address; /**< 7 bit device address */
+    bool                          read;    /**< Reception from the device */
+    bool                          dma;     /**< Started with the DMA */
+    bool                          ack;     /**< False if the device NACKed */
+    std::vector<uint8_t>          data;    /**< Bytes on the bus */
+    uint64_t                      start_ns; /**< & */
+    uint64_t                      end_ns;   /**< & */
+};
+
+/** Puts a device on a bus. Transfers to addresses without a device are
+ ** NACKed and return an error.
+ ** \param periph bus
+ ** \param address 7 bit address
+ ** \param device model, or nullptr to remove the device
+ */
+void AttachI2cDevice(I2CHandle::Config::Peripheral periph,
+                     uint16_t                      address,
+                     I2cDevice *                   device);
+
+/** \return all transfers since Reset() or ClearI2cLog(), oldest first */
+const std::vector<I2cTransfer> &GetI2cLog();
+
+/** Forgets the logged transfers */
+void ClearI2cLog();
+
+/** \return true while a DMA transfer on the bus runs or waits */
+bool IsI2cBusy(I2CHandle::Config::Peripheral periph);
+
+// ================================================================
+// SPI
+// ================================================================
+
+/** A transfer seen on a simulated SPI bus */
+struct SpiTransfer
+{
+    SpiHandle::Config::Peripheral periph;  /**< & */
+    std::vector<uint8_t>          data;    /**< Bytes sent */
+    uint64_t                      time_ns; /**< Start of the transfer */
+};
+
+/** \return all transmissions since Reset() or ClearSpiLog(), oldest first */
+const std::vector<SpiTransfer> &GetSpiLog();
+
+/** Forgets the logged transmissions */
+void ClearSpiLog();
+
+/** Queues bytes that the next receptions on a bus read.
+ ** When the queue is empty, 0xFF is read.
+ */
+void SetSpiInput(SpiHandle::Config::Peripheral periph,
+                 const uint8_t *               data,
+                 size_t                        size);
+
+// ================================================================
+// UART
+// ================================================================
+
+/** Sends bytes to the receiver of a UART, starting now and spaced by the
+ ** time a frame takes at the configured baud rate. Bytes that arrive
+ ** while reception isn't started are lost. When the receive queue is
+ ** full, an overrun stops the reception, as on the hardware.
+ */
+void UartReceive(UartHandler::Config::Peripheral periph,
+                 const uint8_t *                 data,
+                 size_t                          size);
+
+/** \return bytes transmitted by a UART since Reset() */
+const std::vector<uint8_t> &
+GetUartOutput(UartHandler::Config::Peripheral periph);
+
+/** Forgets the bytes transmitted by a UART */
+void ClearUartOutput(UartHandler::Config::Peripheral periph);
+
+// ================================================================
+// SAI
+// ================================================================
+
+/** Fills half of the receive buffer with what the codec sends.
+ ** \param rx interleaved samples, in the format of the bit depth. 24 bit
+ **        samples can be signed, the SAI keeps the low 24 bits.
+ ** \param size number of samples
+ ** \param context as passed to SetSaiInput()
+ */
+typedef void (*SaiInputCallback)(int32_t *rx, size_t size, void *context);
+
+/** Gets half of the transmit buffer once it was sent to the codec */
+typedef void (*SaiOutputCallback)(const int32_t *tx,
+                                  size_t         size,
+                                  void *         context);
+
+/** Sets what the codec on a SAI sends. Silence is sent without one. */
+void SetSaiInput(SaiHandle::Config::Peripheral periph,
+                 SaiInputCallback              callback,
+                 void *                        context);
+
+/** Sets where the samples sent to the codec on a SAI go. What the audio
+ ** callback writes arrives here once the DMA has sent it, at the end of the
+ ** block after the next one, as the other half of the buffer goes first.
+ */
+void SetSaiOutput(SaiHandle::Config::Peripheral periph,
+                  SaiOutputCallback             callback,
+                  void *                        context);
+
+/** \return number of halves of the DMA buffer transferred since Reset() */
+uint32_t GetSaiBlocks(SaiHandle::Config::Peripheral periph);
+
+// ================================================================
+// ADC
+// ================================================================
+
+/** Sets the reading of an ADC channel
+ ** \param chn channel, in the order passed to AdcHandle::Init()
+ ** \param value 16 bit reading
+ */
+void SetAdc(uint8_t chn, uint16_t value);
+
+/** Sets the reading of an input of a multiplexer on an ADC channel */
+void SetAdcMux(uint8_t chn, uint8_t idx, uint16_t value);
+
+// ================================================================
+// Timers
+// ================================================================
+
+/** State of a PWM channel of a timer */
+struct TimPwm
+{
+    bool         enabled; /**< Set up with TimerHandle::InitPwm() */
+    bool         invert;  /**< & */
+    uint32_t     compare; /**< Ticks per period the output is on */
+    dsy_gpio_pin pin;     /**< & */
+};
+
+/** \return state of a PWM channel */
+TimPwm GetTimPwm(TimerHandle::Config::Peripheral periph,
+                 TimerHandle::Channel            chn);
+
+/** \return value of the auto reload register, the period - 1 */
+uint32_t GetTimPeriod(TimerHandle::Config::Peripheral periph);
+
+/** \return fraction of a period a pin is high for, while a running
+ ** GpioPwm drives its port. Otherwise 0 or 1 for the level of the pin.
+ */
+float GetPinDuty(dsy_gpio_pin pin);
+
+} // namespace sim
+} // namespace daisy
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef DSY_SIM_IMPL_H
+#define DSY_SIM_IMPL_H
+
+#include "sim/sim.h"
+
+namespace daisy
+{
+namespace sim
+{
+/** Reset of the state of each simulated peripheral, called by Reset() */
+void ResetGpio();
+void ResetI2c();
+void ResetSpi();
+void ResetUart();
+void ResetSai();
+void ResetAdc();
+void ResetTim();
+void ResetGpioPwm();
+void ResetSystem();
+
+/** Runs events until a condition holds, the way the hardware drivers spin
+ ** on a flag that an interrupt clears.
+ ** \return false if there were no events left before the condition held
+ */
+template <typename Condition>
+bool WaitUntil(Condition done)
+{
+    while(!done())
+    {
+        if(!Step())
+            return false;
+    }
+    return true;
+}
+
+} // namespace sim
+} // namespace daisy
+
+#endif
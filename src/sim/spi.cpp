@@ -0,0 +1,172 @@
+#include <deque>
+#include "per/spi.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+namespace
+{
+std::vector<sim::SpiTransfer> spi_log;
+std::deque<uint8_t>           spi_input[6];
+
+// SPI1 to SPI5 share a DMA stream, SPI6 has none, as on the hardware
+int                            dma_active = -1;
+SpiHandle::CallbackFunctionPtr dma_callback;
+void*                          dma_callback_context;
+
+} // namespace
+
+class SpiHandle::Impl
+{
+  public:
+    SpiHandle::Result Init(const SpiHandle::Config& config)
+    {
+        config_ = config;
+        return SpiHandle::Result::OK;
+    }
+
+    // The kernel clock of SPI1 to SPI3 is PLL2P, 25MHz
+    uint64_t GetByteNs() const
+    {
+        return 8 * 40 * (2u << int(config_.baud_prescaler));
+    }
+
+    SpiHandle::Result BlockingTransmit(uint8_t* buff, size_t size)
+    {
+        // wait for a DMA transfer of this peripheral to finish
+        const int idx = int(config_.periph);
+        sim::WaitUntil([idx] { return dma_active != idx; });
+        Log(buff, size);
+        sim::AdvanceNs(GetByteNs() * size);
+        return SpiHandle::Result::OK;
+    }
+
+    // The data is taken from the buffer when the transfer starts
+    SpiHandle::Result DmaTransmit(uint8_t*                       buff,
+                                  size_t                         size,
+                                  SpiHandle::CallbackFunctionPtr callback,
+                                  void*                          context)
+    {
+        if(config_.periph == Config::Peripheral::SPI_6 || size == 0
+           || size > 0xffff || dma_active >= 0)
+            return SpiHandle::Result::ERR;
+        Log(buff, size);
+        dma_active           = int(config_.periph);
+        dma_callback         = callback;
+        dma_callback_context = context;
+        sim::Schedule(
+            sim::GetNowNs() + GetByteNs() * size, DmaFinished, nullptr);
+        return SpiHandle::Result::OK;
+    }
+
+    static void DmaFinished(void*)
+    {
+        SpiHandle::CallbackFunctionPtr callback = dma_callback;
+        dma_active                              = -1;
+        dma_callback                            = nullptr;
+        if(callback)
+            callback(dma_callback_context, SpiHandle::Result::OK);
+    }
+
+    void Log(const uint8_t* buff, size_t size)
+    {
+        sim::SpiTransfer t;
+        t.periph  = config_.periph;
+        t.time_ns = sim::GetNowNs();
+        t.data.assign(buff, buff + size);
+        spi_log.push_back(t);
+    }
+
+    SpiHandle::Result BlockingReceive(uint8_t* buffer, uint16_t size)
+    {
+        std::deque<uint8_t>& in = spi_input[int(config_.periph)];
+        for(size_t i = 0; i < size; i++)
+        {
+            buffer[i] = in.empty() ? 0xFF : in.front();
+            if(!in.empty())
+                in.pop_front();
+        }
+        sim::AdvanceNs(GetByteNs() * size);
+        return SpiHandle::Result::OK;
+    }
+
+    SpiHandle::Config config_;
+};
+
+static SpiHandle::Impl spi_handles[6];
+
+namespace daisy
+{
+void sim::ResetSpi()
+{
+    spi_log.clear();
+    for(int i = 0; i < 6; i++)
+        spi_input[i].clear();
+    dma_active   = -1;
+    dma_callback = nullptr;
+}
+
+const std::vector<sim::SpiTransfer>& sim::GetSpiLog()
+{
+    return spi_log;
+}
+
+void sim::ClearSpiLog()
+{
+    spi_log.clear();
+}
+
+void sim::SetSpiInput(SpiHandle::Config::Peripheral periph,
+                      const uint8_t*                data,
+                      size_t                        size)
+{
+    spi_input[int(periph)].insert(
+        spi_input[int(periph)].end(), data, data + size);
+}
+
+// ================================================================
+// SpiHandle -> SpiHandle::Impl
+// ================================================================
+
+SpiHandle::Result SpiHandle::Init(const Config& config)
+{
+    const int spi_idx = int(config.periph);
+    if(spi_idx >= 6)
+        return Result::ERR;
+    pimpl_ = &spi_handles[spi_idx];
+    return pimpl_->Init(config);
+}
+
+const SpiHandle::Config& SpiHandle::GetConfig() const
+{
+    return pimpl_->config_;
+}
+
+SpiHandle::Result
+SpiHandle::BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout)
+{
+    (void)timeout;
+    return pimpl_->BlockingTransmit(buff, size);
+}
+
+SpiHandle::Result
+SpiHandle::BlockingReceive(uint8_t* buffer, uint16_t size, uint32_t timeout)
+{
+    (void)timeout;
+    return pimpl_->BlockingReceive(buffer, size);
+}
+
+SpiHandle::Result SpiHandle::DmaTransmit(uint8_t*            buff,
+                                         size_t              size,
+                                         CallbackFunctionPtr callback,
+                                         void*               callback_context)
+{
+    return pimpl_->DmaTransmit(buff, size, callback, callback_context);
+}
+
+int SpiHandle::CheckError()
+{
+    return 0;
+}
+
+} // namespace daisy
@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include "sys/system.h"
+#include "sys/dma.h"
+#include "per/gpio.h"
+#include "per/i2c.h"
+#include "sim/sim_impl.h"
+
+namespace daisy
+{
+// The clocks of the hardware after System::Init(), so code that derives
+// rates from them gets the same numbers. The time functions read the
+// virtual clock, and work without Init() too, as if TIM2 ran from Reset().
+static uint32_t sysclk_freq = 400000000;
+
+TimerHandle System::tim_;
+
+void sim::ResetSystem()
+{
+    sysclk_freq = 400000000;
+}
+
+void System::Init()
+{
+    System::Config cfg;
+    cfg.Defaults();
+    Init(cfg);
+}
+
+void System::Init(const System::Config& config)
+{
+    cfg_        = config;
+    sysclk_freq = config.cpu_freq == Config::SysClkFreq::FREQ_480MHZ
+                      ? 480000000
+                      : 400000000;
+    dsy_dma_init();
+    dsy_i2c_global_init();
+}
+
+void System::JumpToQspi() {}
+
+uint32_t System::GetNow()
+{
+    return sim::GetNowNs() / 1000000;
+}
+
+uint32_t System::GetUs()
+{
+    return sim::GetNowUs();
+}
+
+uint32_t System::GetTick()
+{
+    return sim::GetNowNs() * (GetPClk1Freq() * 2) / 1000000000;
+}
+
+void System::Delay(uint32_t delay_ms)
+{
+    sim::AdvanceNs((uint64_t)delay_ms * 1000000);
+}
+
+void System::DelayUs(uint32_t delay_us)
+{
+    sim::Advance(delay_us);
+}
+
+void System::DelayTicks(uint32_t delay_ticks)
+{
+    const uint64_t freq = GetPClk1Freq() * 2;
+    sim::AdvanceNs(((uint64_t)delay_ticks * 1000000000 + freq - 1) / freq);
+}
+
+void System::ResetToBootloader()
+{
+    // Only the boot pin, there is nothing to reset to
+    dsy_gpio pin;
+    pin.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    pin.pin  = {DSY_GPIOG, 3};
+    dsy_gpio_init(&pin);
+    dsy_gpio_write(&pin, 1);
+}
+
+uint32_t System::GetSysClkFreq()
+{
+    return sysclk_freq;
+}
+
+uint32_t System::GetHClkFreq()
+{
+    return sysclk_freq / 2;
+}
+
+uint32_t System::GetPClk1Freq()
+{
+    return sysclk_freq / 4;
+}
+
+uint32_t System::GetPClk2Freq()
+{
+    return sysclk_freq / 4;
+}
+
+void System::ConfigureClocks() {}
+
+void System::ConfigureMpu() {}
+
+} // namespace daisy
+
+// There is no cache to keep coherent on the host
+extern "C" void dsy_dma_init(void) {}
+
+extern "C" void dsy_dma_clear_cache_for_buffer(uint8_t* buffer, size_t size)
+{
+    (void)buffer;
+    (void)size;
+}
+
+extern "C" void dsy_dma_invalidate_cache_for_buffer(uint8_t* buffer,
+                                                    size_t   size)
+{
+    (void)buffer;
+    (void)size;
+}
@@ -0,0 +1,227 @@
+#include "per/tim.h"
+#include "sys/system.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+// The counter runs from virtual time, at the rate the prescaler gives
+class TimerHandle::Impl
+{
+  public:
+    TimerHandle::Result Init(const TimerHandle::Config& config)
+    {
+        config_    = config;
+        prescaler_ = 0;
+        period_    = config.periph == Config::Peripheral::TIM_2
+                          || config.periph == Config::Peripheral::TIM_5
+                      ? 0xffffffff
+                      : 0xffff;
+        running_   = false;
+        count_     = 0;
+        return TimerHandle::Result::OK;
+    }
+
+    TimerHandle::Result
+    InitPwm(TimerHandle::Channel chn, dsy_gpio_pin pin, bool invert)
+    {
+        TimerHandle::Config::Peripheral periph;
+        TimerHandle::Channel            pin_chn;
+        if(!GetPwmChannel(pin, periph, pin_chn) || periph != config_.periph
+           || pin_chn != chn)
+            return TimerHandle::Result::ERR;
+        pwm_[int(chn)] = {true, invert, 0, pin};
+        return Start();
+    }
+
+    TimerHandle::Result Start()
+    {
+        if(!running_)
+        {
+            start_ns_ = sim::GetNowNs();
+            running_  = true;
+        }
+        return TimerHandle::Result::OK;
+    }
+
+    TimerHandle::Result Stop()
+    {
+        count_   = GetTick();
+        running_ = false;
+        return TimerHandle::Result::OK;
+    }
+
+    TimerHandle::Result SetPeriod(uint32_t ticks)
+    {
+        Restart();
+        period_ = ticks;
+        return TimerHandle::Result::OK;
+    }
+
+    TimerHandle::Result SetPrescaler(uint32_t val)
+    {
+        Restart();
+        prescaler_ = val;
+        return TimerHandle::Result::OK;
+    }
+
+    uint32_t GetFreq()
+    {
+        return (System::GetPClk1Freq() * 2) / (prescaler_ + 1);
+    }
+
+    uint32_t GetTick()
+    {
+        if(!running_)
+            return count_;
+        uint64_t ticks
+            = (sim::GetNowNs() - start_ns_) * GetFreq() / 1000000000 + count_;
+        return period_ == 0xffffffff ? ticks : ticks % ((uint64_t)period_ + 1);
+    }
+
+    // Same arithmetic as per/tim.cpp, so the results match the hardware
+    uint32_t GetMs() { return GetTick() / (GetFreq() / 100000000); }
+    uint32_t GetUs() { return GetTick() / (GetFreq() / 1000000); }
+
+    void DelayTick(uint32_t del)
+    {
+        sim::AdvanceNs(((uint64_t)del * 1000000000 + GetFreq() - 1)
+                       / GetFreq());
+    }
+
+    void DelayMs(uint32_t del) { DelayTick(del * (GetFreq() / 100000000)); }
+    void DelayUs(uint32_t del) { DelayTick(del * (GetFreq() / 1000000)); }
+
+    // Keeps the count when the rate changes
+    void Restart()
+    {
+        count_ = GetTick();
+        if(running_)
+            start_ns_ = sim::GetNowNs();
+    }
+
+    TimerHandle::Config config_;
+    uint32_t            prescaler_, period_, count_;
+    uint64_t            start_ns_;
+    bool                running_;
+    sim::TimPwm         pwm_[4];
+};
+
+static TimerHandle::Impl tim_handles[4];
+
+void sim::ResetTim()
+{
+    TimerHandle::Config cfg;
+    cfg.dir = TimerHandle::Config::CounterDir::UP;
+    for(int i = 0; i < 4; i++)
+    {
+        cfg.periph = static_cast<TimerHandle::Config::Peripheral>(i);
+        tim_handles[i].Init(cfg);
+        for(sim::TimPwm& pwm : tim_handles[i].pwm_)
+            pwm = {false, false, 0, {DSY_GPIOX, 0}};
+    }
+}
+
+sim::TimPwm sim::GetTimPwm(TimerHandle::Config::Peripheral periph,
+                           TimerHandle::Channel            chn)
+{
+    return tim_handles[int(periph)].pwm_[int(chn)];
+}
+
+uint32_t sim::GetTimPeriod(TimerHandle::Config::Peripheral periph)
+{
+    return tim_handles[int(periph)].period_;
+}
+
+// ================================================================
+// TimerHandle -> TimerHandle::Impl
+// ================================================================
+
+TimerHandle::Result TimerHandle::Init(const Config& config)
+{
+    const int tim_idx = int(config.periph);
+    if(tim_idx >= 4)
+        return Result::ERR;
+    pimpl_ = &tim_handles[tim_idx];
+    return pimpl_->Init(config);
+}
+
+const TimerHandle::Config& TimerHandle::GetConfig() const
+{
+    return pimpl_->config_;
+}
+
+TimerHandle::Result TimerHandle::SetPeriod(uint32_t ticks)
+{
+    return pimpl_->SetPeriod(ticks);
+}
+
+uint32_t TimerHandle::GetPeriod()
+{
+    return pimpl_->period_;
+}
+
+TimerHandle::Result TimerHandle::SetPrescaler(uint32_t val)
+{
+    return pimpl_->SetPrescaler(val);
+}
+
+TimerHandle::Result
+TimerHandle::InitPwm(Channel chn, dsy_gpio_pin pin, bool invert)
+{
+    return pimpl_->InitPwm(chn, pin, invert);
+}
+
+void TimerHandle::SetPwmCompare(Channel chn, uint32_t val)
+{
+    // CCR of the 16-bit timers drops the upper bits, like the hardware
+    const Config::Peripheral periph = pimpl_->config_.periph;
+    if(periph == Config::Peripheral::TIM_3
+       || periph == Config::Peripheral::TIM_4)
+        val &= 0xffff;
+    pimpl_->pwm_[int(chn)].compare = val;
+}
+
+TimerHandle::Result TimerHandle::Start()
+{
+    return pimpl_->Start();
+}
+
+TimerHandle::Result TimerHandle::Stop()
+{
+    return pimpl_->Stop();
+}
+
+uint32_t TimerHandle::GetFreq()
+{
+    return pimpl_->GetFreq();
+}
+
+uint32_t TimerHandle::GetTick()
+{
+    return pimpl_->GetTick();
+}
+
+uint32_t TimerHandle::GetMs()
+{
+    return pimpl_->GetMs();
+}
+
+uint32_t TimerHandle::GetUs()
+{
+    return pimpl_->GetUs();
+}
+
+void TimerHandle::DelayTick(uint32_t del)
+{
+    pimpl_->DelayTick(del);
+}
+
+void TimerHandle::DelayMs(uint32_t del)
+{
+    pimpl_->DelayMs(del);
+}
+
+void TimerHandle::DelayUs(uint32_t del)
+{
+    pimpl_->DelayUs(del);
+}
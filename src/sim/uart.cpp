@@ -0,0 +1,210 @@
+#include <deque>
+#include "per/uart.h"
+#include "util/ringbuffer.h"
+#include "sim/sim_impl.h"
+
+using namespace daisy;
+
+#define UART_RX_BUFF_SIZE 256
+
+// Error flags, as HAL_UART_GetError() returns them
+#define UART_ERROR_NONE 0x00
+#define UART_ERROR_ORE 0x08
+
+typedef RingBuffer<uint8_t, UART_RX_BUFF_SIZE> UartRingBuffer;
+
+class UartHandler::Impl
+{
+  public:
+    UartHandler::Result Init(const UartHandler::Config& config)
+    {
+        config_    = config;
+        rx_active_ = false;
+        error_     = UART_ERROR_NONE;
+        poll_buff_ = nullptr;
+        queue_rx_.Init();
+        return UartHandler::Result::OK;
+    }
+
+    // Start bit, data bits, parity and stop bits, at the baud rate
+    uint64_t GetFrameNs() const
+    {
+        uint32_t bits = 1 + 8 + (config_.parity != Config::Parity::NONE);
+        bits += config_.stopbits >= Config::StopBits::BITS_1_5 ? 2 : 1;
+        if(config_.wordlength == Config::WordLength::BITS_7)
+            bits--;
+        else if(config_.wordlength == Config::WordLength::BITS_9)
+            bits++;
+        uint32_t baud = config_.baudrate ? config_.baudrate : 1;
+        return (uint64_t)bits * 1000000000 / baud;
+    }
+
+    int PollReceive(uint8_t* buff, size_t size, uint32_t timeout)
+    {
+        poll_buff_  = buff;
+        poll_size_  = size;
+        poll_count_ = 0;
+        const uint64_t deadline = sim::GetNowNs() + timeout * 1000000ull;
+        sim::Schedule(deadline, Timeout, nullptr);
+        sim::WaitUntil([this, deadline] {
+            return poll_count_ == poll_size_ || sim::GetNowNs() >= deadline;
+        });
+        poll_buff_ = nullptr;
+        // HAL_OK or HAL_TIMEOUT
+        return poll_count_ == poll_size_ ? 0 : 3;
+    }
+
+    UartHandler::Result PollTx(uint8_t* buff, size_t size)
+    {
+        output_.insert(output_.end(), buff, buff + size);
+        sim::AdvanceNs(GetFrameNs() * size);
+        return UartHandler::Result::OK;
+    }
+
+    void Receive(const uint8_t* data, size_t size)
+    {
+        uint64_t t = line_free_ns_ > sim::GetNowNs() ? line_free_ns_
+                                                     : sim::GetNowNs();
+        for(size_t i = 0; i < size; i++)
+        {
+            t += GetFrameNs();
+            incoming_.push_back(data[i]);
+            sim::Schedule(t, ByteArrived, this);
+        }
+        line_free_ns_ = t;
+    }
+
+    static void Timeout(void*) {}
+
+    static void ByteArrived(void* context)
+    {
+        Impl*   uart = static_cast<Impl*>(context);
+        uint8_t byte = uart->incoming_.front();
+        uart->incoming_.pop_front();
+        if(uart->poll_buff_ && uart->poll_count_ < uart->poll_size_)
+        {
+            uart->poll_buff_[uart->poll_count_++] = byte;
+        }
+        else if(uart->rx_active_)
+        {
+            if(uart->queue_rx_.writable())
+            {
+                uart->queue_rx_.Write(byte);
+            }
+            else
+            {
+                // The UART disables itself on an overrun
+                uart->error_ |= UART_ERROR_ORE;
+                uart->rx_active_ = false;
+            }
+        }
+    }
+
+    UartHandler::Config  config_;
+    bool                 rx_active_;
+    int                  error_;
+    UartRingBuffer       queue_rx_;
+    uint8_t*             poll_buff_;
+    size_t               poll_size_, poll_count_;
+    std::deque<uint8_t>  incoming_;
+    uint64_t             line_free_ns_;
+    std::vector<uint8_t> output_;
+};
+
+static UartHandler::Impl uart_handles[9];
+
+namespace daisy
+{
+void sim::ResetUart()
+{
+    for(int i = 0; i < 9; i++)
+    {
+        UartHandler::Impl& uart = uart_handles[i];
+        uart.config_.baudrate   = 0;
+        uart.rx_active_         = false;
+        uart.error_             = UART_ERROR_NONE;
+        uart.poll_buff_         = nullptr;
+        uart.line_free_ns_      = 0;
+        uart.queue_rx_.Init();
+        uart.incoming_.clear();
+        uart.output_.clear();
+    }
+}
+
+void sim::UartReceive(UartHandler::Config::Peripheral periph,
+                      const uint8_t*                  data,
+                      size_t                          size)
+{
+    uart_handles[int(periph)].Receive(data, size);
+}
+
+const std::vector<uint8_t>&
+sim::GetUartOutput(UartHandler::Config::Peripheral periph)
+{
+    return uart_handles[int(periph)].output_;
+}
+
+void sim::ClearUartOutput(UartHandler::Config::Peripheral periph)
+{
+    uart_handles[int(periph)].output_.clear();
+}
+
+// ================================================================
+// UartHandler -> UartHandler::Impl
+// ================================================================
+
+UartHandler::Result UartHandler::Init(const Config& config)
+{
+    pimpl_ = &uart_handles[int(config.periph)];
+    return pimpl_->Init(config);
+}
+
+const UartHandler::Config& UartHandler::GetConfig() const
+{
+    return pimpl_->config_;
+}
+
+int UartHandler::PollReceive(uint8_t* buff, size_t size, uint32_t timeout)
+{
+    return pimpl_->PollReceive(buff, size, timeout);
+}
+
+UartHandler::Result UartHandler::StartRx()
+{
+    pimpl_->rx_active_ = true;
+    pimpl_->error_     = UART_ERROR_NONE;
+    return Result::OK;
+}
+
+bool UartHandler::RxActive()
+{
+    return pimpl_->rx_active_;
+}
+
+UartHandler::Result UartHandler::FlushRx()
+{
+    pimpl_->queue_rx_.Flush();
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::PollTx(uint8_t* buff, size_t size)
+{
+    return pimpl_->PollTx(buff, size);
+}
+
+uint8_t UartHandler::PopRx()
+{
+    return pimpl_->queue_rx_.Read();
+}
+
+size_t UartHandler::Readable()
+{
+    return pimpl_->queue_rx_.readable();
+}
+
+int UartHandler::CheckError()
+{
+    return pimpl_->error_;
+}
+
+} // namespace daisy
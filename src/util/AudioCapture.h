@@ -0,0 +1,429 @@
+#pragma once
+#ifndef DSY_AUDIOCAPTURE_H
+#define DSY_AUDIOCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "daisy_core.h"
+#include "util/wav_format.h"
+#include "util/FatFileWriter.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Multichannel recorder with a large ring buffer, e.g. in SDRAM, that
+ ** holds minutes of audio, drained to one or more WAV files.
+ **
+ ** The audio callback hands whole blocks to Capture(), which only converts
+ ** them into the ring. Process(), from the main loop, writes the ring to
+ ** the files in chunks of Config::chunk_size bytes, at sector aligned file
+ ** positions (the header is padded to 512 bytes). With a ring that holds
+ ** seconds or minutes, stalls of the SD Card don't lose audio. If the ring
+ ** does fill up, whole blocks are dropped and counted, for all files alike,
+ ** so the files stay consistent and in sync.
+ **
+ ** The input channels are split into files in order, Config::channels_per_file
+ ** at a time, e.g. 8 channels into 4 stereo files. The ring memory is split
+ ** evenly between the files.
+ **
+ ** For instrumentation, the fill level of the ring (current and highest)
+ ** and the longest write to a file are kept.
+ **
+ ** Usage:
+ ** \code{.cpp}
+ ** DSY_SDRAM_BSS uint8_t ring[32 * 1024 * 1024];
+ ** AudioCapture<>          capture;
+ ** // ...
+ ** AudioCapture<>::Config cfg;
+ ** cfg.num_files         = 4;
+ ** cfg.channels_per_file = 2;
+ ** cfg.get_us            = System::GetUs;
+ ** capture.Init(cfg, ring, sizeof(ring));
+ ** const char *paths[] = {"1.wav", "2.wav", "3.wav", "4.wav"};
+ ** capture.Start(paths);
+ ** // In the audio callback: capture.Capture(in, size);
+ ** // In the main loop: capture.Process();
+ ** // When done: capture.Stop();
+ ** \endcode
+ **
+ ** FileWriter is the file backend, FatFileWriter by default (see WavWriter).
+ ** */
+template <typename FileWriter = FatFileWriter>
+class AudioCapture
+{
+  public:
+    /** Most files recorded at once */
+    static constexpr size_t kMaxFiles = 8;
+
+    AudioCapture() : capturing_(false), open_(false) {}
+    ~AudioCapture() {}
+
+    /** Return values */
+    enum class Result
+    {
+        OK,
+        ERR_CONFIG, /**< the settings or the ring don't fit */
+        ERR_FILE,   /**< a file couldn't be opened */
+        ERR_WRITE,  /**< writing to a file failed */
+    };
+
+    /** Settings */
+    struct Config
+    {
+        float    samplerate        = 48000.f;
+        size_t   num_files         = 1;
+        size_t   channels_per_file = 2;
+        int32_t  bitspersample     = 24; /**< 16, 24, or 32 for float */
+        size_t   chunk_size        = 32768; /**< multiple of 512 bytes */
+        float    preallocate       = 0.f; /**< seconds to reserve per file */
+        uint32_t (*get_us)()       = nullptr; /**< clock to time the writes */
+    };
+
+    /** Sets up the ring. A sector of it holds the WAV headers, which go to
+     ** the card by DMA like the audio, so the ring has to be in memory the
+     ** SDMMC can read (SRAM or SDRAM, not DTCM).
+     ** \param cfg settings
+     ** \param ring memory for the ring, e.g. in SDRAM
+     ** \param ring_size size of the ring in bytes
+     */
+    Result Init(const Config &cfg, uint8_t *ring, size_t ring_size)
+    {
+        cfg_       = cfg;
+        capturing_ = false;
+        if(cfg_.num_files == 0 || cfg_.num_files > kMaxFiles
+           || cfg_.channels_per_file == 0 || cfg_.chunk_size == 0
+           || cfg_.chunk_size % kSectorSize != 0)
+            return Result::ERR_CONFIG;
+        switch(cfg_.bitspersample)
+        {
+            case 16:
+            case 24:
+            case 32: break;
+            default: return Result::ERR_CONFIG;
+        }
+        sample_bytes_ = cfg_.bitspersample / 8;
+        frame_bytes_  = cfg_.channels_per_file * sample_bytes_;
+
+        // The header sector, 32 byte aligned for the cache maintenance
+        size_t skew = (32 - reinterpret_cast<uintptr_t>(ring) % 32) % 32;
+        if(ring_size < skew + kSectorSize)
+            return Result::ERR_CONFIG;
+        header_ = ring + skew;
+        ring += skew + kSectorSize;
+        ring_size -= skew + kSectorSize;
+
+        // Chunks and frames both end at the end of a region
+        size_t a = cfg_.chunk_size, b = frame_bytes_;
+        while(b != 0)
+        {
+            size_t t = a % b;
+            a        = b;
+            b        = t;
+        }
+        size_t unit  = cfg_.chunk_size / a * frame_bytes_;
+        region_size_ = ring_size / cfg_.num_files / unit * unit;
+        if(region_size_ == 0)
+            return Result::ERR_CONFIG;
+        ring_ = ring;
+        return Result::OK;
+    }
+
+    /** Creates the files, and starts capturing
+     ** \param paths a path for each file
+     */
+    Result Start(const char *const *paths)
+    {
+        Stop();
+        for(size_t f = 0; f < cfg_.num_files; f++)
+        {
+            if(!files_[f].Open(paths[f]))
+            {
+                for(size_t i = 0; i < f; i++)
+                    files_[i].Close();
+                return Result::ERR_FILE;
+            }
+            if(cfg_.preallocate > 0.f)
+            {
+                uint32_t bytes = cfg_.preallocate * cfg_.samplerate;
+                bytes *= frame_bytes_;
+                files_[f].Preallocate(kSectorSize + bytes);
+            }
+        }
+        num_frames_     = 0;
+        head_           = 0;
+        wpos_           = 0;
+        max_fill_       = 0;
+        max_drain_us_   = 0;
+        overruns_       = 0;
+        dropped_frames_ = 0;
+        write_errors_   = 0;
+        for(size_t f = 0; f < cfg_.num_files; f++)
+        {
+            tail_[f] = 0;
+            rpos_[f] = 0;
+        }
+        open_       = true;
+        bool header = WriteHeaders();
+        capturing_  = header;
+        if(!header)
+            CloseFiles();
+        return header ? Result::OK : Result::ERR_WRITE;
+    }
+
+    /** Adds a block of audio. Call from the audio callback.
+     ** \param in separate channels, num_files * channels_per_file of them
+     ** \param frames number of frames
+     */
+    void Capture(const float *const *in, size_t frames)
+    {
+        if(!capturing_)
+            return;
+        size_t bytes = frames * frame_bytes_;
+        size_t used  = GetFill();
+        if(used + bytes > region_size_)
+        {
+            overruns_++;
+            dropped_frames_ += frames;
+            return;
+        }
+        size_t done = 0;
+        while(done < frames)
+        {
+            size_t n = (region_size_ - wpos_) / frame_bytes_;
+            if(n > frames - done)
+                n = frames - done;
+            for(size_t f = 0; f < cfg_.num_files; f++)
+            {
+                uint8_t *dst = ring_ + f * region_size_ + wpos_;
+                for(size_t c = 0; c < cfg_.channels_per_file; c++)
+                {
+                    const float *src = in[f * cfg_.channels_per_file + c];
+                    Convert(src + done, n, dst + c * sample_bytes_);
+                }
+            }
+            wpos_ += n * frame_bytes_;
+            if(wpos_ == region_size_)
+                wpos_ = 0;
+            done += n;
+        }
+        // Publish the frames to Process() only once they are in the ring
+        head_ += bytes;
+        num_frames_ += frames;
+        if(used + bytes > max_fill_)
+            max_fill_ = used + bytes;
+    }
+
+    /** Writes the complete chunks in the ring to the files. Audio captured
+     ** meanwhile is left for the next call, so it always returns.
+     ** Call from the main loop. */
+    Result Process()
+    {
+        if(!open_)
+            return Result::OK;
+        const uint32_t head = head_;
+        bool           more = true, ok = true;
+        while(more)
+        {
+            // A chunk per file at a time, so the files drain evenly
+            more = false;
+            for(size_t f = 0; f < cfg_.num_files; f++)
+            {
+                if(head - tail_[f] >= cfg_.chunk_size)
+                {
+                    ok &= WriteChunk(f, cfg_.chunk_size);
+                    more = true;
+                }
+            }
+        }
+        return ok ? Result::OK : Result::ERR_WRITE;
+    }
+
+    /** Stops capturing, writes what is left in the ring, and finalizes and
+     ** closes the files. */
+    Result Stop()
+    {
+        capturing_ = false;
+        if(!open_)
+            return Result::OK;
+        bool ok = Process() == Result::OK;
+        for(size_t f = 0; f < cfg_.num_files; f++)
+        {
+            while(head_ != tail_[f])
+            {
+                // The rest may wrap around the end of the region
+                size_t n = head_ - tail_[f];
+                if(n > region_size_ - rpos_[f])
+                    n = region_size_ - rpos_[f];
+                ok &= WriteChunk(f, n);
+            }
+        }
+        ok &= WriteHeaders();
+        CloseFiles();
+        return ok ? Result::OK : Result::ERR_WRITE;
+    }
+
+    /** \return true while Capture() adds to the ring */
+    bool IsCapturing() const { return capturing_; }
+
+    /** \return frames captured since Start() */
+    uint32_t GetLengthFrames() const { return num_frames_; }
+
+    /** \return ring size of each file in bytes */
+    size_t GetRingSize() const { return region_size_; }
+
+    /** \return seconds of audio the ring holds */
+    float GetRingSeconds() const
+    {
+        return region_size_ / (frame_bytes_ * cfg_.samplerate);
+    }
+
+    /** \return bytes in the ring waiting to be written, for the file that
+     ** is furthest behind */
+    size_t GetFill() const
+    {
+        size_t used = 0;
+        for(size_t f = 0; f < cfg_.num_files; f++)
+        {
+            size_t n = head_ - tail_[f];
+            if(n > used)
+                used = n;
+        }
+        return used;
+    }
+
+    /** \return highest fill level since Start(), in bytes */
+    size_t GetMaxFill() const { return max_fill_; }
+
+    /** \return longest single write to a file since Start(), in us.
+     ** Needs Config::get_us. */
+    uint32_t GetMaxDrainUs() const { return max_drain_us_; }
+
+    /** \return number of blocks dropped because the ring was full */
+    uint32_t GetOverruns() const { return overruns_; }
+
+    /** \return number of frames dropped because the ring was full */
+    uint32_t GetDroppedFrames() const { return dropped_frames_; }
+
+    /** \return number of failed writes */
+    uint32_t GetWriteErrors() const { return write_errors_; }
+
+  private:
+    static constexpr size_t kSectorSize = 512;
+
+    void Convert(const float *src, size_t frames, uint8_t *dst)
+    {
+        const size_t stride = frame_bytes_;
+        switch(cfg_.bitspersample)
+        {
+            case 16:
+                for(size_t i = 0; i < frames; i++, dst += stride)
+                {
+                    int16_t s = f2s16(src[i]);
+                    memcpy(dst, &s, 2);
+                }
+                break;
+            case 24:
+                for(size_t i = 0; i < frames; i++, dst += stride)
+                {
+                    int32_t s = f2s24(src[i]);
+                    dst[0]    = s;
+                    dst[1]    = s >> 8;
+                    dst[2]    = s >> 16;
+                }
+                break;
+            default:
+                for(size_t i = 0; i < frames; i++, dst += stride)
+                    memcpy(dst, &src[i], 4);
+                break;
+        }
+    }
+
+    bool WriteChunk(size_t f, size_t size)
+    {
+        const uint8_t *src   = &ring_[f * region_size_ + rpos_[f]];
+        uint32_t       start = cfg_.get_us ? cfg_.get_us() : 0;
+        bool           ok    = files_[f].Write(src, size) == size;
+        if(cfg_.get_us)
+        {
+            uint32_t t = cfg_.get_us() - start;
+            if(t > max_drain_us_)
+                max_drain_us_ = t;
+        }
+        if(!ok)
+            write_errors_++;
+        rpos_[f] += size;
+        if(rpos_[f] == region_size_)
+            rpos_[f] = 0;
+        tail_[f] += size;
+        return ok;
+    }
+
+    /** Writes the headers at the start of the files, padded to a sector by
+     ** a JUNK chunk, and leaves the files at their end. */
+    bool WriteHeaders()
+    {
+        WAV_FormatTypeDef h;
+        const size_t      fmt_end = offsetof(WAV_FormatTypeDef, SubChunk2ID);
+        const bool        is_float = cfg_.bitspersample == 32;
+        uint32_t          data     = num_frames_ * frame_bytes_;
+        h.ChunkId                  = kWavFileChunkId;
+        h.FileSize                 = kSectorSize - 8 + data;
+        h.FileFormat               = kWavFileWaveId;
+        h.SubChunk1ID              = kWavFileSubChunk1Id;
+        h.SubChunk1Size            = 16;
+        h.AudioFormat   = is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+        h.NbrChannels   = cfg_.channels_per_file;
+        h.SampleRate    = static_cast<uint32_t>(cfg_.samplerate);
+        h.ByteRate      = h.SampleRate * frame_bytes_;
+        h.BlockAlign    = frame_bytes_;
+        h.BitPerSample  = cfg_.bitspersample;
+        h.SubChunk2ID   = kWavFileSubChunk2Id;
+        h.SubCHunk2Size = data;
+
+        uint32_t junk[2] = {kWavFileJunkId, kSectorSize - fmt_end - 16};
+        memset(header_, 0, kSectorSize);
+        memcpy(header_, &h, fmt_end);
+        memcpy(&header_[fmt_end], junk, sizeof(junk));
+        memcpy(&header_[kSectorSize - 8], &h.SubChunk2ID, 8);
+        bool ok = true;
+        for(size_t f = 0; f < cfg_.num_files; f++)
+        {
+            ok &= files_[f].Seek(0)
+                  && files_[f].Write(header_, kSectorSize) == kSectorSize
+                  && files_[f].Seek(kSectorSize + data);
+        }
+        return ok;
+    }
+
+    void CloseFiles()
+    {
+        for(size_t f = 0; f < cfg_.num_files; f++)
+            files_[f].Close();
+        open_ = false;
+    }
+
+    Config     cfg_;
+    FileWriter files_[kMaxFiles];
+    uint8_t *  ring_;
+    uint8_t *  header_;
+    size_t     region_size_, sample_bytes_, frame_bytes_;
+    // Written by the audio callback
+    size_t            wpos_;
+    volatile uint32_t head_;
+    volatile bool     capturing_;
+    uint32_t          num_frames_, max_fill_, overruns_, dropped_frames_;
+    // Written by the main loop
+    volatile uint32_t tail_[kMaxFiles];
+    size_t            rpos_[kMaxFiles];
+    bool              open_;
+    uint32_t          max_drain_us_, write_errors_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef DSY_BRIGHTNESSCURVE_H
+#define DSY_BRIGHTNESSCURVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Curves from a brightness setting to the light output of an LED, both
+ ** from 0 to 1, for BrightnessTable. The eye is far more sensitive to
+ ** changes of dim light, so a linear PWM duty looks too bright at the
+ ** bottom and hardly changes at the top.
+ **
+ ** Everything here is constexpr, for tables built by the compiler.
+ */
+struct BrightnessCurve
+{
+    /** x^gamma, with gamma in tenths: Gamma<28> for 2.8. Gamma<30> is the
+     ** cube of Led.
+     */
+    template <unsigned gamma_x10>
+    struct Gamma
+    {
+        static constexpr double Apply(double x)
+        {
+            return Pow(x, gamma_x10 / 10.0);
+        }
+    };
+
+    /** CIE 1931 lightness (L*): the luminance that looks x of the way
+     ** from off to full, by the CIELAB model of perception.
+     */
+    struct Cie
+    {
+        static constexpr double Apply(double x)
+        {
+            const double l = x * 100.0;
+            if(l <= 8.0)
+                return l / 903.3;
+            const double f = (l + 16.0) / 116.0;
+            return f * f * f;
+        }
+    };
+
+    /** \return x^y for x >= 0, to double precision */
+    static constexpr double Pow(double x, double y)
+    {
+        return x > 0.0 ? Exp(y * Log(x)) : 0.0;
+    }
+
+    /** \return e^x, by range reduction to |x| <= ln(2)/2 and a series */
+    static constexpr double Exp(double x)
+    {
+        const double ln2 = 0.69314718055994530942;
+        const int    k   = (int)(x / ln2 + (x < 0.0 ? -0.5 : 0.5));
+        const double r   = x - k * ln2;
+        double       sum = 1.0, term = 1.0;
+        for(int n = 1; n < 20; n++)
+        {
+            term *= r / n;
+            sum += term;
+        }
+        for(int i = 0; i < k; i++)
+            sum *= 2.0;
+        for(int i = 0; i > k; i--)
+            sum *= 0.5;
+        return sum;
+    }
+
+    /** \return ln(x) for x > 0, from the series of 2 atanh((m-1)/(m+1))
+     ** for the mantissa m in [1, 2)
+     */
+    static constexpr double Log(double x)
+    {
+        const double ln2 = 0.69314718055994530942;
+        int          k   = 0;
+        for(; x >= 2.0; k++)
+            x *= 0.5;
+        for(; x < 1.0; k--)
+            x *= 2.0;
+        const double t = (x - 1.0) / (x + 1.0), t2 = t * t;
+        double       sum = 0.0, term = t;
+        for(int n = 1; n < 60; n += 2)
+        {
+            sum += term / n;
+            term *= t2;
+        }
+        return 2.0 * sum + k * ln2;
+    }
+};
+
+/** Lookup table of a BrightnessCurve, generated by the compiler and kept
+ ** in flash. There is one table per curve and bit depth, shared by
+ ** everything that uses it.
+ **
+ ** Entries are rounded to the nearest output step, except that inputs
+ ** above 0 give at least 1, so the dimmest settings still light the LED.
+ ** Interpolate() maps a float between the entries. With 8 bits in and 12
+ ** out, a gamma of 3 stays within one output step of the exact curve.
+ **
+ ** \tparam Curve e.g. BrightnessCurve::Gamma<28> or BrightnessCurve::Cie
+ ** \tparam in_bits size of the table, 2^in_bits entries (at most 12)
+ ** \tparam out_bits output range, 0 to 2^out_bits - 1 (at most 16)
+ */
+template <typename Curve, unsigned in_bits, unsigned out_bits>
+class BrightnessTable
+{
+  public:
+    static_assert(in_bits >= 1 && in_bits <= 12, "in_bits from 1 to 12");
+    static_assert(out_bits >= 1 && out_bits <= 16, "out_bits from 1 to 16");
+
+    static constexpr size_t   kSize = size_t(1) << in_bits;
+    static constexpr uint32_t kMax  = (uint32_t(1) << out_bits) - 1;
+
+    /** \return output for an input from 0 to kSize - 1 */
+    static constexpr uint16_t Get(uint32_t in)
+    {
+        return table_.values[in < kSize ? in : kSize - 1];
+    }
+
+    /** \return output for an input from 0 to 1, interpolated between the
+     ** entries. Inputs out of range are clamped.
+     */
+    static uint16_t Interpolate(float x)
+    {
+        if(!(x > 0.f)) // and NaN
+            return 0;
+        if(x >= 1.f)
+            return kMax;
+        const float pos = x * (kSize - 1);
+        uint32_t    i   = (uint32_t)pos;
+        i               = i < kSize - 1 ? i : kSize - 2; // rounded up to 1
+        const float    frac = pos - (float)i;
+        const uint16_t a    = table_.values[i];
+        const uint16_t b    = table_.values[i + 1];
+        return a + (uint16_t)((b - a) * frac + 0.5f);
+    }
+
+  private:
+    struct Table
+    {
+        uint16_t values[kSize];
+    };
+
+    static constexpr Table Generate()
+    {
+        Table t{};
+        for(size_t i = 0; i < kSize; i++)
+        {
+            const double y = Curve::Apply((double)i / (kSize - 1));
+            uint32_t     v = (uint32_t)(y * kMax + 0.5);
+            v              = v > kMax ? kMax : v;
+            t.values[i]    = (uint16_t)(i > 0 && v == 0 ? 1 : v);
+        }
+        return t;
+    }
+
+    static constexpr Table table_ = Generate();
+};
+
+template <typename Curve, unsigned in_bits, unsigned out_bits>
+constexpr size_t BrightnessTable<Curve, in_bits, out_bits>::kSize;
+
+template <typename Curve, unsigned in_bits, unsigned out_bits>
+constexpr uint32_t BrightnessTable<Curve, in_bits, out_bits>::kMax;
+
+template <typename Curve, unsigned in_bits, unsigned out_bits>
+constexpr typename BrightnessTable<Curve, in_bits, out_bits>::Table
+    BrightnessTable<Curve, in_bits, out_bits>::table_;
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,452 @@
+#pragma once
+#ifndef DSY_DISKSAMPLER_H
+#define DSY_DISKSAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "util/WavStreamer.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Direct-from-disk sampler
+ **
+ ** Plays one-shot samples of any length from a file system (e.g. an SD Card),
+ ** with up to num_voices at once. The first head_ms of every sample is loaded
+ ** into RAM (the "head"), and the rest is streamed from the file as needed.
+ **
+ ** Trigger() starts a voice right away from the head, and can be called from
+ ** the audio callback. The file is opened by the next Prepare() in the main
+ ** loop, which then reads ahead into the voice's buffer of buffer_bytes. The
+ ** head has to last until the stream has caught up: with N voices triggered at
+ ** once, that is N file opens and first reads, plus any stalls of the card.
+ ** GetMinHeadMargin() tells how close that was, and GetUnderruns() counts the
+ ** times a voice ran dry.
+ **
+ ** Prepare() serves the voice closest to running out first, counting the
+ ** unplayed head and the buffered data.
+ **
+ ** The head memory is passed to Init(), and is best placed in SDRAM, e.g.:
+ ** uint8_t DSY_SDRAM_BSS heads[16 * 1024 * 1024];
+ ** The voice buffers are part of the object, which can go there too.
+ **
+ ** See WavStreamFormat for the supported formats, and WavStreamVoice for the
+ ** FileReader backend.
+ ** */
+template <size_t num_voices,
+          size_t buffer_bytes,
+          typename FileReader,
+          size_t max_samples = 64>
+class DiskSampler
+{
+  public:
+    DiskSampler() {}
+    ~DiskSampler() {}
+
+    /** Longest path of a sample file, including the terminator */
+    static constexpr size_t kMaxPathLength = 128;
+
+    /** Configuration for the sampler */
+    struct Config
+    {
+        /** Length of the part of each sample kept in RAM, in milliseconds */
+        float head_ms;
+        /** Size of a single read from the file system in bytes */
+        size_t read_size;
+        /** Largest number of file operations done by a single call to Prepare() */
+        size_t max_reads;
+
+        /** Sets 100ms heads, 4kB reads, and 2 file operations per voice and Prepare() */
+        void Defaults()
+        {
+            head_ms   = 100.f;
+            read_size = 4096;
+            max_reads = 2 * num_voices;
+        }
+    };
+
+    /** Initializes the sampler
+     ** \param cfg configuration
+     ** \param head_memory memory for the sample heads
+     ** \param head_memory_size size of head_memory in bytes
+     */
+    void Init(const Config &cfg, uint8_t *head_memory, size_t head_memory_size)
+    {
+        cfg_ = cfg;
+        if(cfg_.read_size == 0)
+            cfg_.read_size = 4096;
+        head_memory_      = head_memory;
+        head_memory_size_ = head_memory_size;
+        head_memory_used_ = 0;
+        num_samples_      = 0;
+        num_started_      = 0;
+        min_head_margin_  = 0xFFFFFFFF;
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            Voice &v      = voices_[i];
+            v.playing     = false;
+            v.sample      = nullptr;
+            v.trigger_seq = 0;
+            v.ready_seq   = 0;
+            v.open_seq    = 0;
+            v.start_order = 0;
+            v.underruns   = 0;
+        }
+    }
+
+    /** Loads the header and head of a sample. Call from the main loop.
+     ** \param path path of the WAV file
+     ** \return index of the sample for Trigger(), or -1 if it couldn't be
+     ** loaded, or there is no memory left for it.
+     */
+    int LoadSample(const char *path)
+    {
+        if(num_samples_ >= max_samples || strlen(path) >= kMaxPathLength)
+            return -1;
+        Sample &s = samples_[num_samples_];
+        if(!loader_.Open(path))
+            return -1;
+        bool ok = s.format.Parse(loader_, buffer_bytes / 2);
+        if(ok)
+        {
+            uint32_t frames = static_cast<uint32_t>(
+                cfg_.head_ms * 0.001f * s.format.samplerate);
+            uint32_t size = s.format.data_end - s.format.data_start;
+            uint32_t head = (frames > 0 ? frames : 1) * s.format.block_align;
+            s.head_bytes  = head < size ? head : size;
+            size_t start  = (head_memory_used_ + 3) & ~size_t(3);
+            ok            = start + s.head_bytes <= head_memory_size_;
+            if(ok)
+            {
+                s.head = head_memory_ + start;
+                ok     = loader_.Read(head_memory_ + start, s.head_bytes)
+                     == s.head_bytes;
+                head_memory_used_ = start + s.head_bytes;
+            }
+        }
+        loader_.Close();
+        if(!ok)
+            return -1;
+        strcpy(s.path, path);
+        return num_samples_++;
+    }
+
+    /** Stops all voices and unloads all samples */
+    void ClearSamples()
+    {
+        StopAll();
+        num_samples_      = 0;
+        head_memory_used_ = 0;
+    }
+
+    /** Starts a sample on a free voice, or on the voice that was started first.
+     ** Plays from RAM right away, so it can be called from the audio callback.
+     ** \param sample index returned by LoadSample()
+     ** \param gain linear gain of the voice
+     ** \return the voice playing the sample, or -1 for an invalid sample
+     */
+    int Trigger(size_t sample, float gain = 1.f)
+    {
+        if(sample >= num_samples_)
+            return -1;
+        size_t voice = 0;
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            if(!voices_[i].playing)
+            {
+                voice = i;
+                break;
+            }
+            if(voices_[i].start_order < voices_[voice].start_order)
+                voice = i;
+        }
+        Voice &v  = voices_[voice];
+        v.playing = false;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        v.sample   = &samples_[sample];
+        v.head_pos = 0;
+        v.gain     = gain;
+        // The stream buffer belongs to the previous trigger until the main
+        // loop has reopened the file for this one.
+        v.trigger_seq = v.trigger_seq + 1;
+        v.start_order = ++num_started_;
+        // The voice is set up before the mixer or Prepare() see it playing
+        std::atomic_signal_fence(std::memory_order_release);
+        v.playing = true;
+        return static_cast<int>(voice);
+    }
+
+    /** Stops a voice. Can be called from the audio callback. */
+    void Stop(size_t voice)
+    {
+        if(voice < num_voices)
+            voices_[voice].playing = false;
+    }
+
+    /** Stops all voices */
+    void StopAll()
+    {
+        for(size_t i = 0; i < num_voices; i++)
+            voices_[i].playing = false;
+    }
+
+    /** Opens the files of newly triggered voices, reads ahead for the
+     ** voices that need it and closes the files of finished voices.
+     ** Opens and reads are done in order of urgency. Call from the main loop. */
+    void Prepare()
+    {
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            if(!voices_[i].playing && voices_[i].reader.IsOpen())
+                voices_[i].reader.Close();
+        }
+        for(size_t n = 0; n < cfg_.max_reads; n++)
+        {
+            int      next  = -1;
+            uint32_t least = 0;
+            for(size_t i = 0; i < num_voices; i++)
+            {
+                Voice &v = voices_[i];
+                if(!v.playing)
+                    continue;
+                std::atomic_signal_fence(std::memory_order_acquire);
+                if(v.open_seq == v.trigger_seq && !NeedsData(v))
+                    continue;
+                uint32_t frames = GetFramesLeft(v);
+                if(next < 0 || frames < least)
+                {
+                    next  = i;
+                    least = frames;
+                }
+            }
+            if(next < 0)
+                break;
+            Voice &v = voices_[next];
+            if(v.open_seq != v.trigger_seq)
+                OpenStream(v);
+            else
+                Fill(v);
+        }
+    }
+
+    /** Mixes the next frames of all playing voices. Call from the audio callback.
+     ** \param out interleaved stereo output, 2 * frames values
+     ** \param frames number of frames
+     */
+    void Read(float *out, size_t frames)
+    {
+        memset(out, 0, frames * 2 * sizeof(float));
+        for(size_t i = 0; i < num_voices; i++)
+            ReadVoice(voices_[i], out, frames);
+    }
+
+    /** \return number of loaded samples */
+    size_t GetNumSamples() const { return num_samples_; }
+
+    /** \return format of a loaded sample */
+    const WavStreamFormat &GetFormat(size_t sample) const
+    {
+        return samples_[sample].format;
+    }
+
+    /** \return number of bytes of head memory in use */
+    size_t GetHeadMemoryUsed() const { return head_memory_used_; }
+
+    /** \return number of voices currently playing */
+    size_t GetNumPlaying() const
+    {
+        size_t n = 0;
+        for(size_t i = 0; i < num_voices; i++)
+            n += voices_[i].playing ? 1 : 0;
+        return n;
+    }
+
+    /** \return total number of times a voice ran out of data, in the
+     ** head or in the stream, before the end of its sample. */
+    uint32_t GetUnderruns() const
+    {
+        uint32_t n = 0;
+        for(size_t i = 0; i < num_voices; i++)
+            n += voices_[i].underruns;
+        return n;
+    }
+
+    /** \return the smallest number of head frames that were still unplayed
+     ** when a stream delivered its first data, 0 if a stream was late,
+     ** or 0xFFFFFFFF if nothing was streamed yet. */
+    uint32_t GetMinHeadMargin() const { return min_head_margin_; }
+
+  private:
+    struct Sample
+    {
+        char            path[kMaxPathLength];
+        WavStreamFormat format;
+        const uint8_t * head;
+        uint32_t        head_bytes;
+    };
+
+    struct Voice
+    {
+        WavStreamBuffer<buffer_bytes> buffer;
+        FileReader                    reader;
+        // Set by Trigger()
+        const Sample *volatile sample;
+        volatile uint32_t      trigger_seq;
+        volatile uint32_t      head_pos;
+        volatile bool          playing;
+        float                  gain;
+        uint32_t               start_order;
+        uint32_t               underruns;
+        // Set by the main loop. The buffer is valid for the audio callback
+        // while ready_seq matches trigger_seq.
+        volatile uint32_t ready_seq;
+        volatile bool     eof;
+        uint32_t          open_seq;
+        const Sample *    stream;
+        uint32_t          file_pos;
+        bool              first_fill;
+    };
+
+    static bool IsInRam(const Sample *s)
+    {
+        return s->head_bytes >= s->format.data_end - s->format.data_start;
+    }
+
+    /** Frames the voice can play before it runs dry */
+    uint32_t GetFramesLeft(const Voice &v) const
+    {
+        const Sample *s    = v.sample;
+        uint32_t      hp   = v.head_pos;
+        uint32_t      left = hp < s->head_bytes ? s->head_bytes - hp : 0;
+        if(v.open_seq == v.trigger_seq)
+            left += v.buffer.GetReadable();
+        return left / s->format.block_align;
+    }
+
+    bool NeedsData(const Voice &v) const
+    {
+        if(v.eof || v.ready_seq != v.trigger_seq)
+            return false;
+        size_t   min    = cfg_.read_size;
+        uint32_t remain = v.stream->format.data_end - v.file_pos;
+        if(remain < min)
+            min = remain;
+        if(min > v.buffer.GetCapacity() / 2)
+            min = v.buffer.GetCapacity() / 2;
+        return v.buffer.GetWritable() >= min
+               && v.buffer.GetWritable() >= v.stream->format.block_align;
+    }
+
+    void OpenStream(Voice &v)
+    {
+        uint32_t seq = v.trigger_seq;
+        // Read after the sequence number, so it is at least as new.
+        const Sample *s = v.sample;
+        v.open_seq      = seq;
+        v.reader.Close();
+        if(IsInRam(s))
+            return;
+        v.stream = s;
+        v.buffer.Reset(s->format.block_align);
+        v.file_pos   = s->format.data_start + s->head_bytes;
+        v.eof        = !v.reader.Open(s->path) || !v.reader.Seek(v.file_pos);
+        v.first_fill = true;
+        v.ready_seq  = seq;
+    }
+
+    void Fill(Voice &v)
+    {
+        const WavStreamFormat &fmt = v.stream->format;
+        size_t                 n;
+        uint8_t *              dst    = v.buffer.GetWritePtr(&n);
+        uint32_t               remain = fmt.data_end - v.file_pos;
+        if(n > cfg_.read_size)
+            n = cfg_.read_size;
+        if(n > remain)
+            n = remain;
+        n -= n % fmt.block_align;
+        if(n == 0)
+            return;
+        size_t got = v.reader.Read(dst, n);
+        got -= got % fmt.block_align;
+        v.file_pos += got;
+        v.buffer.CommitWrite(got);
+        if(v.first_fill)
+        {
+            v.first_fill = false;
+            uint32_t hp  = v.head_pos;
+            uint32_t margin
+                = hp < v.stream->head_bytes
+                      ? (v.stream->head_bytes - hp) / fmt.block_align
+                      : 0;
+            if(margin < min_head_margin_)
+                min_head_margin_ = margin;
+        }
+        if(got < n || v.file_pos == fmt.data_end)
+        {
+            v.eof = true;
+            v.reader.Close();
+        }
+    }
+
+    void ReadVoice(Voice &v, float *out, size_t frames)
+    {
+        if(!v.playing)
+            return;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        const Sample *         s    = v.sample;
+        const WavStreamFormat &fmt  = s->format;
+        size_t                 done = 0;
+        uint32_t               hp   = v.head_pos;
+        if(hp < s->head_bytes)
+        {
+            done = (s->head_bytes - hp) / fmt.block_align;
+            if(done > frames)
+                done = frames;
+            fmt.Decode(s->head + hp, done, out, v.gain, true);
+            v.head_pos = hp + done * fmt.block_align;
+        }
+        if(done == frames)
+            return;
+        if(IsInRam(s))
+        {
+            v.playing = false;
+            return;
+        }
+        if(v.ready_seq != v.trigger_seq)
+        {
+            // The file isn't open yet
+            v.underruns++;
+            return;
+        }
+        done += v.buffer.Read(
+            fmt, out + done * 2, frames - done, v.gain, true);
+        if(done < frames)
+        {
+            if(v.eof)
+                v.playing = false;
+            else
+                v.underruns++;
+        }
+    }
+
+    Voice           voices_[num_voices];
+    Sample          samples_[max_samples];
+    FileReader      loader_;
+    Config          cfg_;
+    uint8_t *       head_memory_;
+    size_t          head_memory_size_, head_memory_used_;
+    volatile size_t num_samples_;
+    uint32_t        num_started_;
+    uint32_t        min_head_margin_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef DSY_FATDIRECTORY_H
+#define DSY_FATDIRECTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fatfs.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Lists a directory with FatFs, and renames and removes files. Used as the
+ ** directory backend of WavFileIndex.
+ **
+ ** The filesystem has to be mounted first (e.g. with dsy_fatfs_init() and
+ ** f_mount()).
+ ** */
+class FatDirectory
+{
+  public:
+    /** A directory entry, filled by Read(). It holds the long file name, so
+     ** it can be shared by the directories of a walk through a tree. */
+    class Entry
+    {
+      public:
+        /** \return name of the file or directory, without its path */
+        const char *GetName() const { return fno_.fname; }
+
+        /** \return size of the file in bytes */
+        uint32_t GetSize() const { return fno_.fsize; }
+
+        /** \return FatFs date (upper 16 bits) and time of the last change */
+        uint32_t GetTime() const
+        {
+            return ((uint32_t)fno_.fdate << 16) | fno_.ftime;
+        }
+
+        /** \return true for a directory */
+        bool IsDir() const { return fno_.fattrib & AM_DIR; }
+
+        /** \return true for hidden and system entries */
+        bool IsHidden() const { return fno_.fattrib & (AM_HID | AM_SYS); }
+
+      private:
+        friend class FatDirectory;
+        FILINFO fno_;
+    };
+
+    FatDirectory() : open_(false) {}
+    ~FatDirectory() { Close(); }
+
+    /** Opens a directory for reading its entries
+     ** \param path path of the directory on the mounted volume
+     ** \return true on success
+     */
+    bool Open(const char *path)
+    {
+        Close();
+        open_ = f_opendir(&dir_, path) == FR_OK;
+        return open_;
+    }
+
+    /** Closes the directory, if open */
+    void Close()
+    {
+        if(open_)
+            f_closedir(&dir_);
+        open_ = false;
+    }
+
+    /** Reads the next entry
+     ** \param entry is filled with the entry
+     ** \return false after the last entry, or on errors
+     */
+    bool Read(Entry *entry)
+    {
+        return open_ && f_readdir(&dir_, &entry->fno_) == FR_OK
+               && entry->fno_.fname[0] != 0;
+    }
+
+    /** Removes a file
+     ** \return true on success */
+    static bool Remove(const char *path) { return f_unlink(path) == FR_OK; }
+
+    /** Renames a file, replacing an existing file by the new name
+     ** \return true on success */
+    static bool Rename(const char *from, const char *to)
+    {
+        f_unlink(to);
+        return f_rename(from, to) == FR_OK;
+    }
+
+  private:
+    DIR  dir_;
+    bool open_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef DSY_FATFILEREADER_H
+#define DSY_FATFILEREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fatfs.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Reads a file with FatFs. Used as the file backend for the streaming
+ ** audio classes (e.g. WavStreamer), which keep one reader per open file.
+ **
+ ** The filesystem has to be mounted before opening files (e.g. with
+ ** dsy_fatfs_init() and f_mount()).
+ ** */
+class FatFileReader
+{
+  public:
+    FatFileReader() : open_(false) {}
+    ~FatFileReader() {}
+
+    /** Opens a file for reading
+     ** \param path path of the file on the mounted volume
+     ** \return true on success
+     */
+    bool Open(const char *path)
+    {
+        Close();
+        open_ = f_open(&fp_, path, FA_OPEN_EXISTING | FA_READ) == FR_OK;
+        return open_;
+    }
+
+    /** Closes the file, if open */
+    void Close()
+    {
+        if(open_)
+            f_close(&fp_);
+        open_ = false;
+    }
+
+    /** Reads from the current position
+     ** \param dst destination
+     ** \param size number of bytes to read
+     ** \return number of bytes read, less than size at the end of the file or on errors
+     */
+    size_t Read(void *dst, size_t size)
+    {
+        UINT br = 0;
+        if(!open_ || f_read(&fp_, dst, size, &br) != FR_OK)
+            return 0;
+        return br;
+    }
+
+    /** Moves the read position
+     ** \param pos position in bytes from the start of the file
+     ** \return true on success
+     */
+    bool Seek(uint32_t pos) { return open_ && f_lseek(&fp_, pos) == FR_OK; }
+
+    /** \return size of the open file in bytes */
+    uint32_t GetSize() const { return open_ ? f_size(&fp_) : 0; }
+
+    /** \return true if a file is open */
+    bool IsOpen() const { return open_; }
+
+  private:
+    FIL  fp_;
+    bool open_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef DSY_FATFILEWRITER_H
+#define DSY_FATFILEWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef UNIT_TEST
+// The host build has no FatFs. The recorders still name FatFileWriter as
+// their default backend, the tests bring their own.
+namespace daisy
+{
+class FatFileWriter;
+} // namespace daisy
+#else
+#include "fatfs.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Writes a file with FatFs. Used as the file backend for recording
+ ** (e.g. WavWriter).
+ **
+ ** The filesystem has to be mounted before opening files (e.g. with
+ ** dsy_fatfs_init() and f_mount()).
+ **
+ ** Growing a file makes FatFs allocate clusters and update the FAT while
+ ** writing, which causes latency spikes on the SD Card. With Preallocate()
+ ** a contiguous area is reserved up front (f_expand), and whole sectors are
+ ** then written directly to the card with multi-block transfers, bypassing
+ ** FatFs until the file is closed.
+ ** */
+class FatFileWriter
+{
+  public:
+    FatFileWriter() : open_(false), raw_(false) {}
+    ~FatFileWriter() {}
+
+    /** Creates a file for writing, replacing an existing file
+     ** \param path path of the file on the mounted volume
+     ** \return true on success
+     */
+    bool Open(const char *path)
+    {
+        Close();
+        open_     = f_open(&fp_, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+        raw_      = false;
+        reserved_ = 0;
+        pos_      = 0;
+        end_      = 0;
+        return open_;
+    }
+
+    /** Closes the file, if open. A preallocated file is truncated to the
+     ** data that was written.
+     ** \return false if the last data couldn't be written to the card
+     */
+    bool Close()
+    {
+        if(!open_)
+            return true;
+        if(reserved_ > 0 && f_lseek(&fp_, end_) == FR_OK)
+            f_truncate(&fp_);
+        bool ok = f_close(&fp_) == FR_OK;
+        open_   = false;
+        raw_    = false;
+        return ok;
+    }
+
+    /** Reserves a contiguous area on the card for the file. Writes of whole
+     ** sectors at sector aligned positions within the area go directly to
+     ** the card. Other writes, and writes beyond the area, go through FatFs
+     ** from then on.
+     ** Call right after Open().
+     ** \param size number of bytes to reserve
+     ** \return true on success. Otherwise the file grows as usual.
+     */
+    bool Preallocate(uint32_t size)
+    {
+        if(!open_ || end_ > 0 || f_expand(&fp_, size, 1) != FR_OK)
+            return false;
+        // Commits the allocation to the directory entry
+        f_sync(&fp_);
+        FATFS *fs = fp_.obj.fs;
+        sector_   = fs->database + fs->csize * (fp_.obj.sclust - 2);
+        drive_    = fs->drv;
+        reserved_ = size;
+        raw_      = true;
+        return true;
+    }
+
+    /** Writes at the current position
+     ** \param src data to write
+     ** \param size number of bytes to write
+     ** \return number of bytes written, less than size if the disk is full or on errors
+     */
+    size_t Write(const void *src, size_t size)
+    {
+        if(!open_)
+            return 0;
+        if(raw_)
+        {
+            if(pos_ % kSectorSize == 0 && size % kSectorSize == 0
+               && pos_ + size <= reserved_)
+            {
+                if(disk_write(drive_,
+                              static_cast<const BYTE *>(src),
+                              sector_ + pos_ / kSectorSize,
+                              size / kSectorSize)
+                   != RES_OK)
+                    return 0;
+                Advance(size);
+                return size;
+            }
+            raw_ = false;
+            if(f_lseek(&fp_, pos_) != FR_OK)
+                return 0;
+        }
+        UINT bw = 0;
+        if(f_write(&fp_, src, size, &bw) != FR_OK)
+            return 0;
+        Advance(bw);
+        return bw;
+    }
+
+    /** Moves the write position
+     ** \param pos position in bytes from the start of the file
+     ** \return true on success
+     */
+    bool Seek(uint32_t pos)
+    {
+        if(!open_ || (!raw_ && f_lseek(&fp_, pos) != FR_OK))
+            return false;
+        pos_ = pos;
+        return true;
+    }
+
+    /** \return true if a file is open */
+    bool IsOpen() const { return open_; }
+
+    /** \return true while writes go directly to the preallocated sectors */
+    bool IsRaw() const { return raw_; }
+
+  private:
+    static constexpr uint32_t kSectorSize = _MIN_SS;
+
+    void Advance(uint32_t size)
+    {
+        pos_ += size;
+        if(pos_ > end_)
+            end_ = pos_;
+    }
+
+    FIL      fp_;
+    bool     open_, raw_;
+    BYTE     drive_;
+    DWORD    sector_;
+    uint32_t reserved_, pos_, end_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif // UNIT_TEST
+#endif
@@ -0,0 +1,426 @@
+#pragma once
+#ifndef DSY_IMAADPCM_H
+#define DSY_IMAADPCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "util/WavHeader.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** IMA ADPCM (WAVE_FORMAT_IMA_ADPCM) blocks, as in WAV files.
+ **
+ ** Samples are stored as 4 bit codes, a quarter of the size of 16 bit PCM.
+ ** The data is framed into blocks of block_align bytes. Each block starts
+ ** with the first sample and the decoder state for every channel, so any
+ ** block can be decoded on its own, which makes the data seekable by block.
+ ** Files can also be made with common tools (e.g. sox or ffmpeg).
+ **
+ ** A block holds GetFramesPerBlock() frames: the one in the block header,
+ ** followed by groups of 4 bytes (8 samples) per channel.
+ ** */
+struct ImaAdpcm
+{
+    /** Most channels of a file */
+    static constexpr size_t kMaxChannels = 8;
+
+    /** \return frames in a block
+     ** \param block_align size of a block in bytes
+     ** \param channels number of channels
+     */
+    static size_t GetFramesPerBlock(size_t block_align, size_t channels)
+    {
+        return (block_align - 4 * channels) * 2 / channels + 1;
+    }
+
+    /** \return true if blocks of this size can be decoded
+     ** \param block_align size of a block in bytes
+     ** \param channels number of channels
+     */
+    static bool IsValidBlock(size_t block_align, size_t channels)
+    {
+        return channels > 0 && channels <= kMaxChannels
+               && block_align > 4 * channels
+               && (block_align - 4 * channels) % (4 * channels) == 0;
+    }
+
+    /** Decodes a whole block to interleaved float
+     ** \param block the block
+     ** \param block_align size of the block in bytes
+     ** \param channels number of channels
+     ** \param out output, GetFramesPerBlock() * channels values
+     */
+    static void DecodeBlock(const uint8_t *block,
+                            size_t         block_align,
+                            size_t         channels,
+                            float *        out)
+    {
+        const size_t   groups = (block_align - 4 * channels) / (4 * channels);
+        const uint8_t *data   = block + 4 * channels;
+        for(size_t c = 0; c < channels; c++)
+        {
+            int32_t pred  = static_cast<int16_t>(block[4 * c]
+                                                | (block[4 * c + 1] << 8));
+            int32_t index = block[4 * c + 2] > 88 ? 88 : block[4 * c + 2];
+            float * dst   = out + c;
+            *dst          = pred * kScale;
+            dst += channels;
+            const uint8_t *src = data + 4 * c;
+            for(size_t g = 0; g < groups; g++)
+            {
+                // 8 codes, low nibble first
+                uint32_t codes = src[0] | (src[1] << 8) | (src[2] << 16)
+                                 | ((uint32_t)src[3] << 24);
+                for(size_t k = 0; k < 8; k++)
+                {
+                    Decode(codes & 0xF, pred, index);
+                    *dst = pred * kScale;
+                    dst += channels;
+                    codes >>= 4;
+                }
+                src += 4 * channels;
+            }
+        }
+    }
+
+    /** Reconstructs a sample from a code, updating the decoder state */
+    static inline void Decode(uint32_t code, int32_t &pred, int32_t &index)
+    {
+        int32_t step = GetStep(index);
+        int32_t diff = step >> 3;
+        if(code & 4)
+            diff += step;
+        if(code & 2)
+            diff += step >> 1;
+        if(code & 1)
+            diff += step >> 2;
+        pred += code & 8 ? -diff : diff;
+        pred = pred > 32767 ? 32767 : (pred < -32768 ? -32768 : pred);
+        index += GetIndexAdjust(code);
+        index = index > 88 ? 88 : (index < 0 ? 0 : index);
+    }
+
+    /** Finds the code for a sample, updating the state like Decode() */
+    static inline uint32_t Encode(int32_t sample, int32_t &pred, int32_t &index)
+    {
+        int32_t  step = GetStep(index);
+        int32_t  diff = sample - pred;
+        uint32_t code = 0;
+        if(diff < 0)
+        {
+            code = 8;
+            diff = -diff;
+        }
+        if(diff >= step)
+        {
+            code |= 4;
+            diff -= step;
+        }
+        if(diff >= step >> 1)
+        {
+            code |= 2;
+            diff -= step >> 1;
+        }
+        if(diff >= step >> 2)
+            code |= 1;
+        Decode(code, pred, index);
+        return code;
+    }
+
+    /** \return quantizer step size for a step index, 0 to 88 */
+    static inline int32_t GetStep(int32_t index)
+    {
+        static const int16_t kSteps[89]
+            = {7,     8,     9,     10,    11,    12,    13,    14,    16,
+               17,    19,    21,    23,    25,    28,    31,    34,    37,
+               41,    45,    50,    55,    60,    66,    73,    80,    88,
+               97,    107,   118,   130,   143,   157,   173,   190,   209,
+               230,   253,   279,   307,   337,   371,   408,   449,   494,
+               544,   598,   658,   724,   796,   876,   963,   1060,  1166,
+               1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,
+               3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
+               7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899, 15289,
+               16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+        return kSteps[index];
+    }
+
+    /** \return change of the step index after a code */
+    static inline int32_t GetIndexAdjust(uint32_t code)
+    {
+        static const int8_t kAdjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+        return kAdjust[code & 7];
+    }
+
+  private:
+    static constexpr float kScale = 1.f / 32768.f;
+};
+
+/** Encodes 16 bit audio to IMA ADPCM blocks, e.g. on the host to build
+ ** compressed sample libraries, or on the device.
+ **
+ ** The step index carries over from block to block, so the quantizer
+ ** doesn't have to adapt again at the start of every block.
+ ** */
+class ImaAdpcmEncoder
+{
+  public:
+    ImaAdpcmEncoder() {}
+    ~ImaAdpcmEncoder() {}
+
+    /** Starts a new stream
+     ** \param channels number of channels, up to ImaAdpcm::kMaxChannels
+     ** \param block_align size of a block in bytes (ImaAdpcm::IsValidBlock())
+     ** \return false if the block size doesn't fit the channels
+     */
+    bool Init(size_t channels, size_t block_align)
+    {
+        if(!ImaAdpcm::IsValidBlock(block_align, channels))
+            return false;
+        channels_    = channels;
+        block_align_ = block_align;
+        for(size_t c = 0; c < channels; c++)
+            index_[c] = 0;
+        return true;
+    }
+
+    /** \return frames in a block */
+    size_t GetFramesPerBlock() const
+    {
+        return ImaAdpcm::GetFramesPerBlock(block_align_, channels_);
+    }
+
+    /** Encodes a block
+     ** \param in interleaved samples
+     ** \param frames frames in, up to GetFramesPerBlock(). The last block of
+     ** a stream may be short; the rest of it is filled with silence.
+     ** \param block output, block_align bytes
+     */
+    void EncodeBlock(const int16_t *in, size_t frames, uint8_t *block)
+    {
+        const size_t fpb = GetFramesPerBlock();
+        for(size_t c = 0; c < channels_; c++)
+        {
+            int32_t  pred    = frames > 0 ? in[c] : 0;
+            int32_t  index   = index_[c];
+            uint8_t *dst     = block + 4 * channels_ + 4 * c;
+            block[4 * c]     = pred & 0xFF;
+            block[4 * c + 1] = (pred >> 8) & 0xFF;
+            block[4 * c + 2] = index;
+            block[4 * c + 3] = 0;
+            for(size_t i = 1; i < fpb; i += 8)
+            {
+                uint32_t codes = 0;
+                for(size_t k = 0; k < 8; k++)
+                {
+                    size_t  frame  = i + k;
+                    int32_t sample = frame < frames ? in[frame * channels_ + c]
+                                                    : 0;
+                    codes |= ImaAdpcm::Encode(sample, pred, index) << (4 * k);
+                }
+                dst[0] = codes & 0xFF;
+                dst[1] = (codes >> 8) & 0xFF;
+                dst[2] = (codes >> 16) & 0xFF;
+                dst[3] = codes >> 24;
+                dst += 4 * channels_;
+            }
+            index_[c] = index;
+        }
+    }
+
+    /** Size of the header written by WriteWavHeader() */
+    static constexpr size_t kWavHeaderSize = 60;
+
+    /** Writes the header of an IMA ADPCM WAV file, followed by the blocks
+     ** \param dst output, kWavHeaderSize bytes
+     ** \param samplerate sample rate in Hz
+     ** \param frames length of the stream
+     */
+    void
+    WriteWavHeader(uint8_t *dst, uint32_t samplerate, uint32_t frames) const
+    {
+        const size_t   fpb    = GetFramesPerBlock();
+        const uint32_t blocks = (frames + fpb - 1) / fpb;
+        const uint32_t data   = blocks * block_align_;
+        uint8_t *      p      = dst;
+        auto put16 = [&p](uint32_t v) {
+            *p++ = v & 0xFF;
+            *p++ = (v >> 8) & 0xFF;
+        };
+        auto put32 = [&put16](uint32_t v) {
+            put16(v & 0xFFFF);
+            put16(v >> 16);
+        };
+        put32(kWavFileChunkId);
+        put32(kWavHeaderSize - 8 + data);
+        put32(kWavFileWaveId);
+        put32(kWavFileSubChunk1Id);
+        put32(20);
+        put16(WAVE_FORMAT_IMA_ADPCM);
+        put16(channels_);
+        put32(samplerate);
+        put32(samplerate * block_align_ / fpb);
+        put16(block_align_);
+        put16(4);
+        put16(2); // extra format bytes: frames per block
+        put16(fpb);
+        put32(0x74636166); // "fact"
+        put32(4);
+        put32(frames);
+        put32(kWavFileSubChunk2Id);
+        put32(data);
+    }
+
+  private:
+    size_t  channels_, block_align_;
+    int32_t index_[ImaAdpcm::kMaxChannels];
+};
+
+/** Reads an IMA ADPCM WAV file that is in memory, e.g. in memory-mapped
+ ** QSPI flash, decoding a whole block at a time.
+ **
+ ** Reads of whole blocks at block boundaries are decoded straight to the
+ ** output, otherwise a block is decoded into an internal buffer of
+ ** 2 * max_block_align floats.
+ ** \tparam max_block_align largest block size in bytes
+ ** */
+template <size_t max_block_align = 1024>
+class ImaAdpcmReader
+{
+  public:
+    ImaAdpcmReader() : data_(nullptr) {}
+    ~ImaAdpcmReader() {}
+
+    /** Parses the file, and moves to its start
+     ** \param file the whole file
+     ** \param size size of the file in bytes
+     ** \return false if it isn't an IMA ADPCM file that can be read
+     */
+    bool Init(const uint8_t *file, uint32_t size)
+    {
+        BufferReader reader = {file, size, 0};
+        WavHeader    header;
+        data_ = nullptr;
+        if(!header.Parse(reader, false)
+           || header.format_tag != WAVE_FORMAT_IMA_ADPCM
+           || header.block_align > max_block_align
+           || !ImaAdpcm::IsValidBlock(header.block_align, header.channels))
+            return false;
+        channels_    = header.channels;
+        block_align_ = header.block_align;
+        samplerate_  = header.samplerate;
+        fpb_         = ImaAdpcm::GetFramesPerBlock(block_align_, channels_);
+        num_blocks_  = header.data_size / block_align_;
+        length_      = num_blocks_ * fpb_;
+        if(header.fact_frames > 0 && header.fact_frames < length_)
+            length_ = header.fact_frames;
+        data_ = file + header.data_start;
+        Seek(0);
+        return true;
+    }
+
+    /** Reads frames from the current position
+     ** \param out interleaved output, frames * GetChannels() values
+     ** \param frames number of frames
+     ** \return frames read, less than frames at the end of the file
+     */
+    size_t Read(float *out, size_t frames)
+    {
+        size_t done = 0;
+        while(done < frames && pos_ < length_)
+        {
+            size_t block  = pos_ / fpb_;
+            size_t offset = pos_ - block * fpb_;
+            size_t n      = fpb_ - offset;
+            if(n > frames - done)
+                n = frames - done;
+            if(n > length_ - pos_)
+                n = length_ - pos_;
+            float *dst = out + done * channels_;
+            if(offset == 0 && n == fpb_)
+            {
+                ImaAdpcm::DecodeBlock(
+                    data_ + block * block_align_, block_align_, channels_, dst);
+            }
+            else
+            {
+                if(block != cached_)
+                {
+                    ImaAdpcm::DecodeBlock(data_ + block * block_align_,
+                                          block_align_,
+                                          channels_,
+                                          cache_);
+                    cached_ = block;
+                }
+                memcpy(dst,
+                       &cache_[offset * channels_],
+                       n * channels_ * sizeof(float));
+            }
+            done += n;
+            pos_ += n;
+        }
+        return done;
+    }
+
+    /** Moves the read position
+     ** \param frame position in frames
+     ** \return false beyond the end of the file
+     */
+    bool Seek(uint32_t frame)
+    {
+        if(frame > length_)
+            return false;
+        pos_    = frame;
+        cached_ = SIZE_MAX;
+        return true;
+    }
+
+    /** \return length of the file in frames */
+    uint32_t GetLengthFrames() const { return length_; }
+
+    /** \return read position in frames */
+    uint32_t GetPosition() const { return pos_; }
+
+    /** \return number of channels */
+    size_t GetChannels() const { return channels_; }
+
+    /** \return sample rate in Hz */
+    uint32_t GetSampleRate() const { return samplerate_; }
+
+  private:
+    /** FileReader backend for the file in memory, for WavHeader */
+    struct BufferReader
+    {
+        const uint8_t *data;
+        uint32_t       size, pos;
+
+        size_t Read(void *dst, size_t n)
+        {
+            if(n > size - pos)
+                n = size - pos;
+            memcpy(dst, data + pos, n);
+            pos += n;
+            return n;
+        }
+        bool Seek(uint32_t p)
+        {
+            pos = p < size ? p : size;
+            return p <= size;
+        }
+        uint32_t GetSize() const { return size; }
+    };
+
+    const uint8_t *data_;
+    size_t         channels_, block_align_, fpb_, num_blocks_, cached_;
+    uint32_t       samplerate_, length_, pos_;
+    float          cache_[2 * max_block_align];
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,693 @@
+#pragma once
+#ifndef DSY_LOGSTORE_H
+#define DSY_LOGSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Log-structured, wear-leveled key/value store for NOR flash.
+ **
+ ** Values are appended to a log that spans a region of flash sectors. Saving
+ ** a value never erases anything: the new record is appended, and the old one
+ ** becomes garbage. Sectors are filled in a ring, and the oldest sector is
+ ** compacted (live records copied to the head, then erased) when free space
+ ** runs low, so all sectors in the region wear evenly.
+ **
+ ** Every record carries a CRC32. A power loss while writing or compacting
+ ** leaves the previous value of every key intact; the interrupted record is
+ ** discarded the next time the store is mounted.
+ **
+ ** An in-RAM index maps each key to the address of its latest record, so
+ ** lookups are O(1). If the flash is memory mapped, Get() returns a pointer
+ ** straight into flash (zero-copy).
+ **
+ ** The FlashType backend must provide:
+ ** - uint32_t GetSize() const : size of the region in bytes
+ ** - uint32_t GetSectorSize() const : erase granularity in bytes
+ ** - const uint8_t* GetReadPtr(uint32_t address) const : pointer to readable data
+ ** - bool Write(uint32_t address, const uint8_t* data, uint32_t size) : programs data (1 -> 0 bits only)
+ ** - bool StartEraseSector(uint32_t address) : starts setting the sector at address to 0xFF, without waiting
+ ** - bool PollErase() : continues the erase, returns true while it is still running
+ **
+ ** Addresses are relative to the start of the region. See QspiFlashRegion for
+ ** the QSPI backend.
+ **
+ ** To use:
+ ** 1. Create the backend, and a LogStore<Backend, max_keys>
+ ** 2. Init() the store with the backend. This scans the region and rebuilds the index.
+ ** 3. Write(), Get()/Read() and Delete() values by key (0 to max_keys-1)
+ ** 4. Call Process() from the main loop to compact in the background, so that
+ **    writes don't have to wait for a sector erase. Process() copies the live
+ **    records of the oldest sector, and then polls the erase of that sector
+ **    until it is done, one PollErase() per call.
+ **
+ ** Write() and Delete() only compact as a last resort, when the head sector
+ ** is full and the spare sectors are used up because Process() wasn't called
+ ** often enough. They then wait for the erase.
+ **
+ ** \tparam FlashType backend providing access to the flash region
+ ** \tparam max_keys number of keys, determines the size of the RAM index (4 bytes per key)
+ ** */
+template <typename FlashType, size_t max_keys = 64>
+class LogStore
+{
+    static_assert(max_keys > 0 && max_keys < 0x8000,
+                  "keys must fit in 15 bits");
+
+  public:
+    LogStore() {}
+    ~LogStore() {}
+
+    /** Return values for LogStore functions */
+    enum class Result
+    {
+        OK,
+        ERR_INVALID_ARGUMENT,
+        ERR_NOT_FOUND,
+        ERR_FULL,
+        ERR_FLASH,
+    };
+
+    /** Configuration for the store */
+    struct Config
+    {
+        /** Process() compacts the oldest sector while fewer sectors than this
+         ** are free. At least 2 are always kept. */
+        uint32_t min_free_sectors;
+
+        void Defaults() { min_free_sectors = 2; }
+    };
+
+    /** Initializes the store with default settings, and mounts the region. */
+    Result Init(FlashType *flash)
+    {
+        Config cfg;
+        cfg.Defaults();
+        return Init(flash, cfg);
+    }
+
+    /** Initializes the store, and mounts the region.
+     ** Blank or foreign data in the region is erased as sectors are needed.
+     ** \param flash backend for the flash region
+     ** \param cfg configuration
+     ** \return ERR_INVALID_ARGUMENT if the region has fewer than 3 sectors.
+     */
+    Result Init(FlashType *flash, const Config &cfg)
+    {
+        flash_       = flash;
+        cfg_         = cfg;
+        sector_size_ = flash_->GetSectorSize();
+        num_sectors_ = flash_->GetSize() / sector_size_;
+        if(cfg_.min_free_sectors < 2)
+            cfg_.min_free_sectors = 2;
+        if(num_sectors_ < 3 || sector_size_ < kSectorHeaderSize * 4)
+            return Result::ERR_INVALID_ARGUMENT;
+        return Mount();
+    }
+
+    /** Writes a value. The previous value for the key is replaced.
+     ** \param key 0 to max_keys-1
+     ** \param data value to store
+     ** \param size size of the value in bytes, up to GetMaxValueSize()
+     */
+    Result Write(uint16_t key, const void *data, uint16_t size)
+    {
+        if(key >= max_keys || size > GetMaxValueSize()
+           || (size > 0 && data == nullptr))
+            return Result::ERR_INVALID_ARGUMENT;
+
+        uint32_t new_size = RecordSize(size);
+        uint32_t old_size = 0;
+        if(index_[key] != kNoRecord)
+            old_size = RecordSize(ReadU16(index_[key] + 2));
+        if(live_bytes_ - old_size + new_size > GetCapacity())
+            return Result::ERR_FULL;
+
+        Result res = Reserve(new_size);
+        if(res != Result::OK)
+            return res;
+
+        uint8_t header[kRecordHeaderSize];
+        PutU16(header, key);
+        PutU16(header + 2, size);
+        uint32_t crc = Crc32(0, header, 4);
+        crc          = Crc32(crc, static_cast<const uint8_t *>(data), size);
+        PutU32(header + 4, crc);
+
+        uint32_t addr = head_ * sector_size_ + write_pos_;
+        write_pos_ += new_size;
+        if(!flash_->Write(addr, header, kRecordHeaderSize)
+           || (size > 0
+               && !flash_->Write(addr + kRecordHeaderSize,
+                                 static_cast<const uint8_t *>(data),
+                                 size)))
+            return CloseHead();
+
+        UpdateIndex(key, addr, new_size);
+        return Result::OK;
+    }
+
+    /** Removes a key from the store */
+    Result Delete(uint16_t key)
+    {
+        if(key >= max_keys)
+            return Result::ERR_INVALID_ARGUMENT;
+        if(index_[key] == kNoRecord)
+            return Result::ERR_NOT_FOUND;
+
+        Result res = Reserve(kRecordHeaderSize);
+        if(res != Result::OK)
+            return res;
+
+        uint8_t header[kRecordHeaderSize];
+        PutU16(header, key | kTombstone);
+        PutU16(header + 2, 0);
+        PutU32(header + 4, Crc32(0, header, 4));
+
+        uint32_t addr = head_ * sector_size_ + write_pos_;
+        write_pos_ += kRecordHeaderSize;
+        if(!flash_->Write(addr, header, kRecordHeaderSize))
+            return CloseHead();
+
+        UpdateIndex(key, kNoRecord, 0);
+        return Result::OK;
+    }
+
+    /** Zero-copy access to a stored value.
+     ** The pointer stays valid until the key is written, deleted, or
+     ** the sector is compacted (i.e. until the next Write(), Delete() or Process()).
+     ** \param key key to look up
+     ** \param size set to the size of the value in bytes, may be nullptr
+     ** \return pointer to the value, or nullptr if the key isn't stored.
+     */
+    const uint8_t *Get(uint16_t key, uint16_t *size = nullptr) const
+    {
+        if(key >= max_keys || index_[key] == kNoRecord)
+            return nullptr;
+        if(size)
+            *size = ReadU16(index_[key] + 2);
+        return flash_->GetReadPtr(index_[key] + kRecordHeaderSize);
+    }
+
+    /** Copies a stored value.
+     ** \param key key to look up
+     ** \param dest buffer to copy to
+     ** \param size number of bytes to copy at most
+     ** \return number of bytes copied, 0 if the key isn't stored.
+     */
+    size_t Read(uint16_t key, void *dest, size_t size) const
+    {
+        uint16_t       stored;
+        const uint8_t *src = Get(key, &stored);
+        if(src == nullptr)
+            return 0;
+        size_t   n   = stored < size ? stored : size;
+        uint8_t *dst = static_cast<uint8_t *>(dest);
+        for(size_t i = 0; i < n; i++)
+            dst[i] = src[i];
+        return n;
+    }
+
+    /** \return true if a value is stored for the key */
+    bool Contains(uint16_t key) const
+    {
+        return key < max_keys && index_[key] != kNoRecord;
+    }
+
+    /** Background maintenance, call from the main loop.
+     ** Compacts the oldest sector if fewer than min_free_sectors are free:
+     ** one call copies its live records and starts the erase, the calls
+     ** after that continue the erase until it is done. None of them waits
+     ** for the erase.
+     ** \return true when the compaction of a sector has finished.
+     */
+    bool Process()
+    {
+        if(erasing_ != kNoSector)
+        {
+            if(flash_->PollErase())
+                return false;
+            return EraseDone() == Result::OK;
+        }
+        if(GetFreeSectors() >= cfg_.min_free_sectors || tail_ == head_)
+            return false;
+        Compact();
+        return false;
+    }
+
+    /** \return largest value that fits into one record */
+    uint32_t GetMaxValueSize() const
+    {
+        uint32_t max = sector_size_ - kSectorHeaderSize - kRecordHeaderSize;
+        return max > 0xFFFF ? 0xFFFF : max;
+    }
+
+    /** \return bytes available for live records, including record headers.
+     ** Two sectors are held back for compaction. */
+    uint32_t GetCapacity() const
+    {
+        return (num_sectors_ - 2) * (sector_size_ - kSectorHeaderSize);
+    }
+
+    /** \return bytes used by live records, including record headers */
+    uint32_t GetUsedBytes() const { return live_bytes_; }
+
+    /** \return number of erased sectors ready to be written */
+    uint32_t GetFreeSectors() const
+    {
+        return num_sectors_ - ((head_ + num_sectors_ - tail_) % num_sectors_)
+               - 1;
+    }
+
+    /** \return number of erase cycles of a sector, as recorded in its header */
+    uint32_t GetEraseCount(uint32_t sector) const
+    {
+        SectorState state = Classify(sector);
+        if(state == SectorState::BLANK || !HasHeader(sector * sector_size_))
+            return 0;
+        return ReadU32(sector * sector_size_ + 4);
+    }
+
+    /** \return number of sectors in the region */
+    uint32_t GetNumSectors() const { return num_sectors_; }
+
+  private:
+    static constexpr uint32_t kMagic            = 0x474F4C44; // "DLOG"
+    static constexpr uint32_t kSectorHeaderSize = 20;
+    static constexpr uint32_t kRecordHeaderSize = 8;
+    static constexpr uint32_t kNoRecord         = 0xFFFFFFFF;
+    static constexpr uint32_t kUnset            = 0xFFFFFFFF;
+    static constexpr uint16_t kTombstone        = 0x8000;
+    static constexpr uint32_t kNoSector         = 0xFFFFFFFF;
+
+    // Sector header:
+    //  0: magic
+    //  4: erase count
+    //  8: crc of magic and erase count
+    // 12: sequence number, programmed when the sector becomes the head
+    // 16: inverted sequence number
+    // Record:
+    //  0: key (bit 15 marks a deleted key)
+    //  2: size of the value
+    //  4: crc of key, size and value
+    //  8: value, padded to 4 bytes
+    enum class SectorState
+    {
+        BLANK, // fully erased, without a header
+        FREE,  // erased and formatted, ready to be used
+        USED,  // part of the log
+        DIRTY, // anything else, needs an erase
+    };
+
+    enum class RecordState
+    {
+        VALID,
+        EMPTY, // erased, end of the log in this sector
+        INVALID,
+    };
+
+    static uint32_t RecordSize(uint32_t size)
+    {
+        return kRecordHeaderSize + ((size + 3) & ~3u);
+    }
+
+    Result Mount()
+    {
+        for(size_t i = 0; i < max_keys; i++)
+            index_[i] = kNoRecord;
+        live_bytes_ = 0;
+        gc_active_  = false;
+        erasing_    = kNoSector;
+        // An erase left running by a previous store on the region
+        while(flash_->PollErase()) {}
+
+        // The head is the sector with the highest sequence number
+        bool found = false;
+        for(uint32_t s = 0; s < num_sectors_; s++)
+        {
+            if(Classify(s) == SectorState::USED
+               && (!found || GetSeq(s) > head_seq_))
+            {
+                head_     = s;
+                head_seq_ = GetSeq(s);
+                found     = true;
+            }
+        }
+        if(!found)
+        {
+            head_seq_ = 0;
+            return OpenSector(0, true);
+        }
+
+        // The log continues backwards as long as the sequence numbers do.
+        tail_ = head_;
+        while(true)
+        {
+            uint32_t prev = (tail_ + num_sectors_ - 1) % num_sectors_;
+            if(prev == head_ || Classify(prev) != SectorState::USED
+               || GetSeq(prev) != GetSeq(tail_) - 1)
+                break;
+            tail_ = prev;
+        }
+
+        // Replay oldest to newest, so the index ends up with the latest records
+        for(uint32_t s = tail_;; s = (s + 1) % num_sectors_)
+        {
+            uint32_t end = ScanSector(s, true);
+            if(s == head_)
+            {
+                write_pos_ = end;
+                break;
+            }
+        }
+        return Result::OK;
+    }
+
+    /** Walks the records of a sector, optionally adding them to the index.
+     ** \return offset to append at, or sector_size_ if the sector can't take more records */
+    uint32_t ScanSector(uint32_t sector, bool build_index)
+    {
+        uint32_t base = sector * sector_size_;
+        uint32_t pos  = kSectorHeaderSize;
+        while(true)
+        {
+            RecordState state = CheckRecord(base, pos);
+            if(state == RecordState::EMPTY)
+                return IsErased(base + pos, sector_size_ - pos) ? pos
+                                                                : sector_size_;
+            if(state == RecordState::INVALID)
+                return sector_size_;
+
+            uint16_t key  = ReadU16(base + pos);
+            uint16_t size = ReadU16(base + pos + 2);
+            if(build_index && (key & ~kTombstone) < max_keys)
+            {
+                if(key & kTombstone)
+                    UpdateIndex(key & ~kTombstone, kNoRecord, 0);
+                else
+                    UpdateIndex(key, base + pos, RecordSize(size));
+            }
+            pos += RecordSize(size);
+        }
+    }
+
+    RecordState CheckRecord(uint32_t base, uint32_t pos) const
+    {
+        if(pos + kRecordHeaderSize > sector_size_)
+            return RecordState::EMPTY;
+        uint16_t key  = ReadU16(base + pos);
+        uint16_t size = ReadU16(base + pos + 2);
+        uint32_t crc  = ReadU32(base + pos + 4);
+        if(key == 0xFFFF && size == 0xFFFF && crc == kUnset)
+            return RecordState::EMPTY;
+        if(pos + RecordSize(size) > sector_size_)
+            return RecordState::INVALID;
+        const uint8_t *p     = flash_->GetReadPtr(base + pos);
+        uint32_t       check = Crc32(0, p, 4);
+        check                = Crc32(check, p + kRecordHeaderSize, size);
+        return check == crc ? RecordState::VALID : RecordState::INVALID;
+    }
+
+    void UpdateIndex(uint16_t key, uint32_t addr, uint32_t size)
+    {
+        if(index_[key] != kNoRecord)
+            live_bytes_ -= RecordSize(ReadU16(index_[key] + 2));
+        index_[key] = addr;
+        live_bytes_ += size;
+    }
+
+    /** Makes sure the head sector has room for a record of the given size */
+    Result Reserve(uint32_t size)
+    {
+        if(write_pos_ + size <= sector_size_)
+            return Result::OK;
+
+        // Keep a spare sector for compaction. Compaction itself may use it.
+        for(uint32_t tries = 0;
+            !gc_active_ && GetFreeSectors() < 2 && tries < num_sectors_;
+            tries++)
+        {
+            Result res = Compact();
+            if(res != Result::OK)
+                return res;
+            // Copied records may have ended up in a new head with room to spare
+            if(write_pos_ + size <= sector_size_)
+                return Result::OK;
+        }
+        if(GetFreeSectors() < (gc_active_ ? 1u : 2u))
+            return Result::ERR_FULL;
+        return OpenSector((head_ + 1) % num_sectors_, false);
+    }
+
+    /** Moves the live records of the oldest sector to the head, and starts
+     ** erasing it. EraseDone() formats the sector once the erase is done. */
+    Result Compact()
+    {
+        if(tail_ == head_)
+            return Result::ERR_FULL;
+        // One erase at a time
+        Result res = FinishErase();
+        if(res != Result::OK)
+            return res;
+
+        uint32_t base = tail_ * sector_size_;
+        uint32_t pos  = kSectorHeaderSize;
+        gc_active_    = true;
+        while(CheckRecord(base, pos) == RecordState::VALID)
+        {
+            uint16_t key  = ReadU16(base + pos);
+            uint32_t size = RecordSize(ReadU16(base + pos + 2));
+            // Deleted keys and old values are dropped. A deleted key can't have
+            // older values anywhere else, as this is the oldest sector.
+            if(key < max_keys && index_[key] == base + pos)
+            {
+                Result res = CopyRecord(base + pos, size);
+                if(res != Result::OK)
+                {
+                    gc_active_ = false;
+                    return res;
+                }
+            }
+            pos += size;
+        }
+        gc_active_ = false;
+
+        // Take the sector out of the log before erasing. An interrupted erase
+        // could leave old records readable, and some of them superseded by
+        // records in this sector that no longer are.
+        uint8_t zeros[8] = {};
+        erase_count_     = ReadU32(base + 4) + 1;
+        tail_            = (tail_ + 1) % num_sectors_;
+        if(!flash_->Write(base + 12, zeros, 8)
+           || !flash_->StartEraseSector(base))
+            return Result::ERR_FLASH;
+        erasing_ = base / sector_size_;
+        return Result::OK;
+    }
+
+    /** Waits for the erase started by Compact(), if there is one */
+    Result FinishErase()
+    {
+        if(erasing_ == kNoSector)
+            return Result::OK;
+        while(flash_->PollErase()) {}
+        return EraseDone();
+    }
+
+    /** Formats the sector erased by Compact() */
+    Result EraseDone()
+    {
+        uint32_t base = erasing_ * sector_size_;
+        erasing_      = kNoSector;
+        // The backend doesn't report failed erases, the result does
+        if(!IsErased(base, sector_size_))
+            return Result::ERR_FLASH;
+        return Format(base, erase_count_);
+    }
+
+    /** Erases a sector, and waits for it */
+    bool EraseSector(uint32_t base)
+    {
+        if(!flash_->StartEraseSector(base))
+            return false;
+        while(flash_->PollErase()) {}
+        return IsErased(base, sector_size_);
+    }
+
+    /** Copies a record byte for byte to the head, through RAM since the
+     ** flash may not be readable while it's being programmed. */
+    Result CopyRecord(uint32_t src, uint32_t size)
+    {
+        Result res = Reserve(size);
+        if(res != Result::OK)
+            return res;
+        uint32_t dst = head_ * sector_size_ + write_pos_;
+        write_pos_ += size;
+        uint8_t buf[64];
+        for(uint32_t done = 0; done < size; done += sizeof(buf))
+        {
+            uint32_t n = size - done;
+            if(n > sizeof(buf))
+                n = sizeof(buf);
+            const uint8_t *p = flash_->GetReadPtr(src + done);
+            for(uint32_t i = 0; i < n; i++)
+                buf[i] = p[i];
+            if(!flash_->Write(dst + done, buf, n))
+                return CloseHead();
+        }
+        index_[ReadU16(src)] = dst;
+        return Result::OK;
+    }
+
+    /** Erases the sector if needed, and makes it the new head. */
+    Result OpenSector(uint32_t sector, bool first)
+    {
+        // The sector may be the one being compacted
+        Result res = FinishErase();
+        if(res != Result::OK)
+            return res;
+        uint32_t    base  = sector * sector_size_;
+        SectorState state = Classify(sector);
+        if(state != SectorState::FREE)
+        {
+            uint32_t erase_count = 0;
+            if(state != SectorState::BLANK)
+            {
+                if(HasHeader(base))
+                    erase_count = ReadU32(base + 4) + 1;
+                if(!EraseSector(base))
+                    return Result::ERR_FLASH;
+            }
+            res = Format(base, erase_count);
+            if(res != Result::OK)
+                return res;
+        }
+
+        uint32_t seq = head_seq_ + 1;
+        uint8_t  buf[8];
+        PutU32(buf, seq);
+        PutU32(buf + 4, ~seq);
+        head_     = sector;
+        head_seq_ = seq;
+        if(first)
+            tail_ = sector;
+        if(!flash_->Write(base + 12, buf, 8))
+            return CloseHead();
+        write_pos_ = kSectorHeaderSize;
+        return Result::OK;
+    }
+
+    /** Stops appending to the head after a failed write. Whatever follows a
+     ** broken record would be lost on the next mount. */
+    Result CloseHead()
+    {
+        write_pos_ = sector_size_;
+        return Result::ERR_FLASH;
+    }
+
+    Result Format(uint32_t base, uint32_t erase_count)
+    {
+        uint8_t buf[12];
+        PutU32(buf, kMagic);
+        PutU32(buf + 4, erase_count);
+        PutU32(buf + 8, Crc32(0, buf, 8));
+        return flash_->Write(base, buf, 12) ? Result::OK : Result::ERR_FLASH;
+    }
+
+    bool HasHeader(uint32_t base) const
+    {
+        return ReadU32(base) == kMagic
+               && ReadU32(base + 8) == Crc32(0, flash_->GetReadPtr(base), 8);
+    }
+
+    SectorState Classify(uint32_t sector) const
+    {
+        uint32_t base = sector * sector_size_;
+        if(!HasHeader(base))
+            return IsErased(base, sector_size_) ? SectorState::BLANK
+                                                : SectorState::DIRTY;
+        uint32_t seq = ReadU32(base + 12), inv = ReadU32(base + 16);
+        if(seq == kUnset && inv == kUnset)
+            return IsErased(base + kSectorHeaderSize,
+                            sector_size_ - kSectorHeaderSize)
+                       ? SectorState::FREE
+                       : SectorState::DIRTY;
+        return seq == ~inv ? SectorState::USED : SectorState::DIRTY;
+    }
+
+    uint32_t GetSeq(uint32_t sector) const
+    {
+        return ReadU32(sector * sector_size_ + 12);
+    }
+
+    bool IsErased(uint32_t addr, uint32_t size) const
+    {
+        const uint8_t *p = flash_->GetReadPtr(addr);
+        for(uint32_t i = 0; i < size; i++)
+            if(p[i] != 0xFF)
+                return false;
+        return true;
+    }
+
+    uint16_t ReadU16(uint32_t addr) const
+    {
+        const uint8_t *p = flash_->GetReadPtr(addr);
+        return p[0] | (p[1] << 8);
+    }
+
+    uint32_t ReadU32(uint32_t addr) const
+    {
+        const uint8_t *p = flash_->GetReadPtr(addr);
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static void PutU16(uint8_t *p, uint16_t v)
+    {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+    }
+
+    static void PutU32(uint8_t *p, uint32_t v)
+    {
+        for(int i = 0; i < 4; i++)
+            p[i] = (v >> (i * 8)) & 0xFF;
+    }
+
+    /** CRC-32 (IEEE 802.3), 4 bits at a time with a 16 entry table */
+    static uint32_t Crc32(uint32_t crc, const uint8_t *data, uint32_t size)
+    {
+        static constexpr uint32_t kTable[16]
+            = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+               0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+               0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+               0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+        crc = ~crc;
+        for(uint32_t i = 0; i < size; i++)
+        {
+            crc = kTable[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+            crc = kTable[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+        }
+        return ~crc;
+    }
+
+    FlashType *flash_;
+    Config     cfg_;
+    uint32_t   sector_size_, num_sectors_;
+    uint32_t   head_, tail_, head_seq_;
+    uint32_t   write_pos_;
+    uint32_t   live_bytes_;
+    bool       gc_active_;
+    uint32_t   erasing_, erase_count_;
+    uint32_t   index_[max_keys];
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
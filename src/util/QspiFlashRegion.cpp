@@ -0,0 +1,29 @@
+#include "util/QspiFlashRegion.h"
+
+using namespace daisy;
+
+bool QspiFlashRegion::Write(uint32_t       address,
+                            const uint8_t *data,
+                            uint32_t       size)
+{
+    if(address + size > size_
+       || dsy_qspi_get_mode() != DSY_QSPI_MODE_DSY_MEMORY_MAPPED)
+        return false;
+    // Goes page by page, so the memory mapped window is only gone for one
+    // page at a time.
+    return dsy_qspi_write(offset_ + address, size, const_cast<uint8_t *>(data))
+           == DSY_MEMORY_OK;
+}
+
+bool QspiFlashRegion::StartEraseSector(uint32_t address)
+{
+    address -= address % kSectorSize;
+    if(address >= size_)
+        return false;
+    return dsy_qspi_erasesector_start(offset_ + address) == DSY_MEMORY_OK;
+}
+
+bool QspiFlashRegion::PollErase()
+{
+    return dsy_qspi_erasesector_poll() == DSY_QSPI_JOB_BUSY;
+}
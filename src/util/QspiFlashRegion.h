@@ -0,0 +1,87 @@
+#pragma once
+#ifndef DSY_QSPIFLASHREGION_H
+#define DSY_QSPIFLASHREGION_H
+
+#include <stdint.h>
+#include "per/qspi.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** A region of the external QSPI flash, accessed as a flash backend for LogStore.
+ **
+ ** Reads go through the memory mapped window at 0x90000000, so the QSPI must be
+ ** initialized in DSY_QSPI_MODE_DSY_MEMORY_MAPPED. Writes and erases briefly
+ ** switch the QSPI to indirect mode (see dsy_qspi_writepage and
+ ** dsy_qspi_erasesector): readers are paused for one page program at a time,
+ ** and erases run in short slices in between reads, one per PollErase(), so
+ ** they are spread over the main loop.
+ **
+ ** The region should not overlap with the program or any DSY_QSPI_DATA.
+ ** */
+class QspiFlashRegion
+{
+  public:
+    QspiFlashRegion() {}
+    ~QspiFlashRegion() {}
+
+    /** Start of the memory mapped QSPI window */
+    static constexpr uint32_t kBaseAddress = 0x90000000;
+
+    /** Initializes the region
+     ** \param offset start of the region in flash, aligned to a sector
+     ** \param size size of the region, a multiple of the sector size
+     */
+    void Init(uint32_t offset, uint32_t size)
+    {
+        offset_ = offset;
+        size_   = size;
+    }
+
+    /** \return size of the region in bytes */
+    uint32_t GetSize() const { return size_; }
+
+    /** \return size of the smallest erasable unit (4kB) */
+    uint32_t GetSectorSize() const { return kSectorSize; }
+
+    /** \return pointer into the memory mapped flash */
+    const uint8_t *GetReadPtr(uint32_t address) const
+    {
+        return reinterpret_cast<const uint8_t *>(kBaseAddress + offset_
+                                                 + address);
+    }
+
+    /** Programs data into the region. Only 1 bits can be changed to 0.
+     ** \param address relative to the start of the region
+     ** \param data data to program. Must not point into the QSPI flash itself.
+     ** \param size number of bytes
+     */
+    bool Write(uint32_t address, const uint8_t *data, uint32_t size);
+
+    /** Starts erasing the sector containing the address, and returns
+     ** immediately. PollErase() runs the erase, in slices.
+     ** \return false if the erase can't be started, e.g. while another one
+     **         is still running
+     */
+    bool StartEraseSector(uint32_t address);
+
+    /** Runs the next slice of the erase started with StartEraseSector(),
+     ** see dsy_qspi_erasesector_poll.
+     ** \return true while the erase is still running
+     */
+    bool PollErase();
+
+  private:
+    static constexpr uint32_t kSectorSize = 4096;
+
+    uint32_t offset_;
+    uint32_t size_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
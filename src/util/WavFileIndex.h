@@ -0,0 +1,420 @@
+#pragma once
+#ifndef DSY_WAVFILEINDEX_H
+#define DSY_WAVFILEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "util/wav_format.h"
+#include "util/WavStreamer.h"
+
+#define WAV_FILENAME_MAX \
+    256 /**< Maximum LFN (set to same in FatFs (ffconf.h) */
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Struct containing details of Wav File. */
+struct WavFileInfo
+{
+    WAV_FormatTypeDef raw_data;               /**< Format, as a plain header */
+    char              name[WAV_FILENAME_MAX]; /**< Path of the file */
+    uint32_t          data_offset; /**< File position of the first sample */
+    uint32_t          file_size;   /**< Size of the file, to detect changes */
+    uint32_t          file_time;   /**< FatFs date and time of last change */
+    uint32_t          loop_start;  /**< First frame of the first loop */
+    uint32_t          loop_end;    /**< Frame after it, 0 without a loop */
+};
+
+/** Index of the WAV files on an SD Card, kept in a file on the card.
+ **
+ ** Opening every file to read its header makes startup slow with hundreds
+ ** of files. The index holds the parsed header of every WAV file found in
+ ** the directory tree. On Init() the tree is walked and compared with the
+ ** index, which only needs the directory entries (name, size and date).
+ ** Only if something changed is the index rewritten, and only headers of
+ ** new or changed files are read. The entries are read from the index file
+ ** when needed, so there is no limit on the number of files.
+ **
+ ** If the index can't be written (e.g. the card is write protected or
+ ** full), the first max_fallback files found are kept in memory instead.
+ **
+ ** Files with an unsupported format (see WavStreamFormat) are left out.
+ ** Headers are read with WavHeader, so files with extra chunks, RF64 files
+ ** and loops from a "smpl" chunk are picked up.
+ **
+ ** The backends are FatFileReader, FatFileWriter and FatDirectory on the
+ ** hardware. FileReader and FileWriter are as for WavStreamer and WavWriter,
+ ** with bool Close() for the writer. Directory needs a class Entry with
+ ** GetName(), GetSize(), GetTime(), IsDir() and IsHidden(), and the
+ ** functions bool Open(const char *path), bool Read(Entry *entry),
+ ** void Close(), static bool Remove(const char *path) and
+ ** static bool Rename(const char *from, const char *to).
+ **
+ ** The filesystem has to be mounted before Init().
+ ** */
+template <typename FileReader,
+          typename FileWriter,
+          typename Directory,
+          size_t max_fallback = 8>
+class WavFileIndex
+{
+  public:
+    /** Return values */
+    enum class Result
+    {
+        OK,
+        ERR_DIR,   /**< the directory couldn't be opened */
+        ERR_INDEX, /**< the index file couldn't be written, the files found
+                        are kept in memory */
+    };
+
+    WavFileIndex()
+    : count_(0),
+      num_parsed_(0),
+      rebuilt_(false),
+      open_(false),
+      in_memory_(false)
+    {
+    }
+    ~WavFileIndex() {}
+
+    /** Loads the index, and brings it up to date with the files on the card
+     ** \param root directory to search, including its subdirectories
+     ** \param index_path path of the index file
+     ** \param verify false to trust an existing index without walking the
+     ** directories. Changes on the card are then only picked up by Init()
+     ** with verify set.
+     */
+    Result Init(const char *root, const char *index_path, bool verify = true)
+    {
+        char tmp_path[WAV_FILENAME_MAX];
+        num_parsed_ = 0;
+        rebuilt_    = false;
+        in_memory_  = false;
+        error_      = false;
+        size_t len  = strlen(root);
+        if(len >= sizeof(path_)
+           || snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path)
+                  >= (int)sizeof(tmp_path))
+            return Result::ERR_DIR;
+
+        // Pass 1: compare the files with the index, until the first change
+        changed_ = !OpenIndex(index_path);
+        if(!changed_ && !verify)
+            return Result::OK;
+        if(!changed_)
+        {
+            mode_   = Mode::COMPARE;
+            cursor_ = 0;
+            strcpy(path_, root);
+            Walk(len, 0);
+            if(error_)
+                return Result::ERR_DIR;
+            if(!changed_ && cursor_ == count_)
+                return Result::OK;
+        }
+
+        // Pass 2: write a new index, reusing the entries of unchanged files
+        if(new_index_.Open(tmp_path))
+        {
+            Header header = {kMagic, kVersion, sizeof(WavFileInfo), 0};
+            size_t bw     = new_index_.Write(&header, sizeof(header));
+            error_        = bw != sizeof(header);
+            mode_         = Mode::WRITE;
+            cursor_       = 0;
+            new_count_    = 0;
+            strcpy(path_, root);
+            if(!error_)
+                Walk(len, 0);
+            header.count = new_count_;
+            if(!new_index_.Seek(0)
+               || new_index_.Write(&header, sizeof(header)) != sizeof(header))
+                error_ = true;
+            error_ |= !new_index_.Close();
+            if(!error_)
+            {
+                CloseIndex();
+                if(Directory::Rename(tmp_path, index_path)
+                   && OpenIndex(index_path))
+                {
+                    rebuilt_ = true;
+                    return Result::OK;
+                }
+            }
+            Directory::Remove(tmp_path);
+        }
+
+        // Pass 3: the card can't be written, find the files again and keep
+        // them in memory, still reusing the entries of the old index
+        error_     = false;
+        mode_      = Mode::MEMORY;
+        cursor_    = 0;
+        new_count_ = 0;
+        strcpy(path_, root);
+        Walk(len, 0);
+        CloseIndex();
+        count_     = new_count_;
+        in_memory_ = true;
+        return error_ ? Result::ERR_DIR : Result::ERR_INDEX;
+    }
+
+    /** \return number of WAV files in the index */
+    size_t GetNumFiles() const { return count_; }
+
+    /** Reads an entry of the index
+     ** \param idx entry, 0 to GetNumFiles() - 1
+     ** \param info is filled with the entry
+     ** \return true on success
+     */
+    bool GetFileInfo(size_t idx, WavFileInfo *info)
+    {
+        if(idx >= count_)
+            return false;
+        if(in_memory_)
+        {
+            *info = memory_[idx];
+            return true;
+        }
+        return ReadEntry(idx, info);
+    }
+
+    /** \return number of file headers read by the last Init() */
+    size_t GetNumParsed() const { return num_parsed_; }
+
+    /** \return true if the last Init() rewrote the index file */
+    bool WasRebuilt() const { return rebuilt_; }
+
+    /** \return true if the last Init() couldn't write the index file, and
+     ** the entries are kept in memory */
+    bool IsInMemory() const { return in_memory_; }
+
+  private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t count;
+    };
+
+    /** What the walk does with each file */
+    enum class Mode
+    {
+        COMPARE, /**< compare with the index, stop at the first change */
+        WRITE,   /**< write the entry to the new index */
+        MEMORY,  /**< keep the entry in memory */
+    };
+
+    static constexpr uint32_t kMagic    = 0x58495744; /**< "DWIX" */
+    static constexpr uint32_t kVersion  = 2;
+    static constexpr size_t   kMaxDepth = 8;
+    /** Entries of the old index searched for a file before it counts as
+     ** new */
+    static constexpr size_t kMaxSearch = 32;
+    /** Largest frame of a file in the index (16 channels of 32 bits) */
+    static constexpr size_t kMaxBlockAlign = 64;
+
+    static bool IsWavFile(const char *name)
+    {
+        size_t len = strlen(name);
+        if(len < 4 || name[0] == '.')
+            return false;
+        const char *ext = name + len - 4;
+        return ext[0] == '.' && (ext[1] | 0x20) == 'w'
+               && (ext[2] | 0x20) == 'a' && (ext[3] | 0x20) == 'v';
+    }
+
+    /** Opens the index file, and reads the number of entries */
+    bool OpenIndex(const char *path)
+    {
+        Header header;
+        CloseIndex();
+        open_ = index_.Open(path);
+        if(!open_)
+            return false;
+        if(index_.Read(&header, sizeof(header)) != sizeof(header)
+           || header.magic != kMagic || header.version != kVersion
+           || header.record_size != sizeof(WavFileInfo)
+           || index_.GetSize()
+                  < sizeof(header) + header.count * sizeof(WavFileInfo))
+        {
+            CloseIndex();
+            return false;
+        }
+        count_ = header.count;
+        return true;
+    }
+
+    void CloseIndex()
+    {
+        if(open_)
+            index_.Close();
+        open_  = false;
+        count_ = 0;
+    }
+
+    /** Reads entry idx of the index file */
+    bool ReadEntry(size_t idx, WavFileInfo *info)
+    {
+        return open_
+               && index_.Seek(sizeof(Header) + idx * sizeof(WavFileInfo))
+               && index_.Read(info, sizeof(WavFileInfo))
+                      == sizeof(WavFileInfo);
+    }
+
+    /** Walks the directory in path_, and its subdirectories */
+    bool Walk(size_t len, size_t depth)
+    {
+        Directory dir;
+        bool      go_on = true;
+        if(!dir.Open(path_))
+        {
+            // Subdirectories that can't be read are skipped
+            if(depth == 0)
+                error_ = true;
+            return depth > 0;
+        }
+        while(go_on && dir.Read(&fno_))
+        {
+            const char *name     = fno_.GetName();
+            bool        is_dir   = fno_.IsDir();
+            size_t      name_len = strlen(name);
+            size_t      sep = len > 0 && path_[len - 1] != '/' ? 1 : 0;
+            if(fno_.IsHidden() || name[0] == '.'
+               || (!is_dir && !IsWavFile(name))
+               || len + sep + name_len >= sizeof(path_))
+                continue;
+            if(sep)
+                path_[len] = '/';
+            memcpy(&path_[len + sep], name, name_len + 1);
+            if(!is_dir)
+                go_on = VisitFile();
+            else if(depth + 1 < kMaxDepth)
+                go_on = Walk(len + sep + name_len, depth + 1);
+            path_[len] = '\0';
+        }
+        dir.Close();
+        return go_on;
+    }
+
+    /** Compares a file with the index, or adds it to the new index.
+     ** \return false to stop the walk */
+    bool VisitFile()
+    {
+        uint32_t size = fno_.GetSize();
+        uint32_t time = fno_.GetTime();
+        if(mode_ == Mode::COMPARE)
+        {
+            if(cursor_ < count_ && ReadEntry(cursor_, &cached_)
+               && strcmp(cached_.name, path_) == 0
+               && cached_.file_size == size && cached_.file_time == time)
+            {
+                cursor_++;
+                return true;
+            }
+            changed_ = true;
+            return false;
+        }
+
+        // Files are mostly found in the same order as in the old index
+        bool found = false;
+        for(size_t i = cursor_; i < count_ && i < cursor_ + kMaxSearch; i++)
+        {
+            if(ReadEntry(i, &cached_) && strcmp(cached_.name, path_) == 0)
+            {
+                found   = true;
+                cursor_ = i + 1;
+                break;
+            }
+        }
+        WavFileInfo &entry
+            = mode_ == Mode::MEMORY ? memory_[new_count_] : entry_;
+        if(found && cached_.file_size == size && cached_.file_time == time)
+        {
+            entry = cached_;
+        }
+        else
+        {
+            memset(&entry, 0, sizeof(entry));
+            strcpy(entry.name, path_);
+            entry.file_size = size;
+            entry.file_time = time;
+            if(!ParseFile(entry))
+                return true; // not a supported WAV file
+        }
+        if(mode_ == Mode::MEMORY)
+            return ++new_count_ < max_fallback;
+        if(new_index_.Write(&entry, sizeof(entry)) != sizeof(entry))
+        {
+            error_ = true;
+            return false;
+        }
+        new_count_++;
+        return true;
+    }
+
+    /** Reads the header of the file in entry */
+    bool ParseFile(WavFileInfo &entry)
+    {
+        FileReader      reader;
+        WavHeader       header;
+        WavStreamFormat format;
+        num_parsed_++;
+        bool ok = reader.Open(entry.name) && header.Parse(reader)
+                  && format.SetFormat(header, kMaxBlockAlign);
+        reader.Close();
+        if(!ok)
+            return false;
+        if(header.num_loops > 0)
+        {
+            entry.loop_start = header.loops[0].start;
+            entry.loop_end   = header.loops[0].end;
+        }
+
+        uint16_t bits = 32;
+        if(format.encoding == WavStreamFormat::Encoding::PCM16)
+            bits = 16;
+        else if(format.encoding == WavStreamFormat::Encoding::PCM24)
+            bits = 24;
+        WAV_FormatTypeDef &h = entry.raw_data;
+        h.ChunkId            = kWavFileChunkId;
+        h.FileSize           = entry.file_size - 8;
+        h.FileFormat         = kWavFileWaveId;
+        h.SubChunk1ID        = kWavFileSubChunk1Id;
+        h.SubChunk1Size      = 16;
+        h.AudioFormat
+            = format.encoding == WavStreamFormat::Encoding::FLOAT32
+                  ? WAVE_FORMAT_IEEE_FLOAT
+                  : WAVE_FORMAT_PCM;
+        h.NbrChannels      = format.channels;
+        h.SampleRate       = format.samplerate;
+        h.ByteRate         = format.samplerate * format.block_align;
+        h.BlockAlign       = format.block_align;
+        h.BitPerSample     = bits;
+        h.SubChunk2ID      = kWavFileSubChunk2Id;
+        h.SubCHunk2Size    = format.data_end - format.data_start;
+        entry.data_offset  = format.data_start;
+        return true;
+    }
+
+    FileReader              index_;
+    FileWriter              new_index_;
+    typename Directory::Entry fno_; // Shared by all levels of the walk
+    WavFileInfo entry_, cached_;    // New and existing entry of a file
+    WavFileInfo memory_[max_fallback];
+    char        path_[WAV_FILENAME_MAX];
+    size_t      count_, num_parsed_;
+    bool        rebuilt_, open_, in_memory_, changed_, error_;
+    Mode        mode_;
+    size_t      cursor_, new_count_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
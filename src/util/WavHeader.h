@@ -0,0 +1,212 @@
+#pragma once
+#ifndef DSY_WAVHEADER_H
+#define DSY_WAVHEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "util/wav_format.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Loop of a sampler chunk ("smpl") */
+struct WavLoop
+{
+    uint32_t start;      /**< First frame of the loop */
+    uint32_t end;        /**< Frame after the last frame of the loop */
+    uint32_t type;       /**< 0 forward, 1 alternating, 2 backward */
+    uint32_t play_count; /**< 0 for infinite */
+};
+
+/** Header of a RIFF WAVE or RF64 file, read by walking its chunks.
+ **
+ ** Unlike WAV_FormatTypeDef, which is only the canonical 44 byte header,
+ ** chunks like LIST, bext, cue or JUNK may come anywhere, as they do in
+ ** files exported from most DAWs. Only the 8 bytes of each chunk header are
+ ** read, chunk bodies are skipped with a seek, except for "fmt ", "ds64",
+ ** "fact" and "smpl".
+ **
+ ** For WAVE_FORMAT_EXTENSIBLE files, format_tag holds the SubFormat, so
+ ** PCM and IEEE float data are told apart the same way for both.
+ **
+ ** The FileReader is a file backend with Read(), Seek() and GetSize(), see
+ ** FatFileReader.
+ ** */
+struct WavHeader
+{
+    /** Loops kept from the "smpl" chunk */
+    static constexpr size_t kMaxLoops = 4;
+
+    uint16_t format_tag;       /**< Format code, resolved for extensible */
+    bool     extensible;       /**< WAVE_FORMAT_EXTENSIBLE format chunk */
+    bool     rf64;             /**< RF64 (or BW64) file */
+    uint16_t channels;         /**< & */
+    uint32_t samplerate;       /**< & */
+    uint16_t block_align;      /**< Size of a frame in bytes */
+    uint16_t bits_per_sample;  /**< Container size of a sample */
+    uint16_t valid_bits;       /**< Bits used of the container */
+    uint32_t channel_mask;     /**< Speaker positions, 0 if not given */
+    uint32_t data_start;       /**< File position of the first frame */
+    uint32_t data_size;        /**< Data bytes, limited to the file size */
+    uint32_t fact_frames;      /**< Length from "fact", 0 if not given */
+    uint8_t  unity_note;       /**< MIDI note of the recording, or 60 */
+    size_t   num_loops;        /**< Number of valid loops */
+    WavLoop  loops[kMaxLoops]; /**< & */
+
+    /** Walks the chunks of a file. On success, the reader is left at the
+     ** first frame.
+     ** \param reader file backend with the file open at the start
+     ** \param find_loops false to stop at the "data" chunk, which saves
+     ** seeking over the sample data. Loops are only found in chunks before
+     ** "data" then.
+     ** \return true if the file has a format and a data chunk
+     */
+    template <typename FileReader>
+    bool Parse(FileReader &reader, bool find_loops = true)
+    {
+        uint8_t riff[12];
+        if(reader.Read(riff, sizeof(riff)) != sizeof(riff)
+           || GetU32(riff + 8) != kWavFileWaveId)
+            return false;
+        uint32_t id = GetU32(riff);
+        rf64        = id == kRf64Id || id == kBw64Id;
+        if(!rf64 && id != kWavFileChunkId)
+            return false;
+
+        const uint32_t file      = reader.GetSize();
+        uint64_t       ds64_data = 0;
+        uint32_t       pos       = sizeof(riff);
+        bool           have_fmt  = false;
+        bool           have_data = false;
+        num_loops                = 0;
+        fact_frames              = 0;
+        unity_note               = 60;
+        while(pos + 8 <= file)
+        {
+            uint8_t chunk[8];
+            if(reader.Read(chunk, sizeof(chunk)) != sizeof(chunk))
+                break;
+            uint32_t body = pos + sizeof(chunk);
+            uint64_t size = GetU32(chunk + 4);
+            id            = GetU32(chunk);
+            if(id == kDs64Id && rf64 && size >= 16)
+            {
+                // riffSize, then dataSize, as 64 bit values
+                uint8_t ds64[16];
+                if(reader.Read(ds64, sizeof(ds64)) != sizeof(ds64))
+                    return false;
+                ds64_data = GetU32(ds64 + 8)
+                            | ((uint64_t)GetU32(ds64 + 12) << 32);
+            }
+            else if(id == kWavFileSubChunk1Id)
+            {
+                uint8_t fmt[40];
+                size_t  n = size < sizeof(fmt) ? size : sizeof(fmt);
+                if(n < 16 || reader.Read(fmt, n) != n)
+                    return false;
+                ParseFormat(fmt, n);
+                have_fmt = true;
+            }
+            else if(id == kFactId && size >= 4)
+            {
+                // Compressed formats give their length in frames here
+                uint8_t fact[4];
+                if(reader.Read(fact, sizeof(fact)) != sizeof(fact))
+                    return false;
+                fact_frames = GetU32(fact);
+            }
+            else if(id == kWavFileSubChunk2Id)
+            {
+                if(!have_fmt)
+                    return false;
+                if(rf64 && size == 0xFFFFFFFF)
+                    size = ds64_data;
+                // Unfinished recordings may have a bogus size
+                uint32_t avail = file - body;
+                data_start     = body;
+                data_size      = size < avail ? size : avail;
+                have_data      = true;
+                if(!find_loops)
+                    return true;
+            }
+            else if(id == kSmplId && find_loops)
+            {
+                ParseSampler(reader, size);
+            }
+            uint64_t next = body + size + (size & 1);
+            if(next >= file || !reader.Seek(next))
+                break;
+            pos = next;
+        }
+        return have_data && reader.Seek(data_start);
+    }
+
+  private:
+    static constexpr uint32_t kRf64Id = 0x34364652; /**< "RF64" */
+    static constexpr uint32_t kBw64Id = 0x34365742; /**< "BW64" */
+    static constexpr uint32_t kDs64Id = 0x34367364; /**< "ds64" */
+    static constexpr uint32_t kSmplId = 0x6c706d73; /**< "smpl" */
+    static constexpr uint32_t kFactId = 0x74636166; /**< "fact" */
+
+    static uint16_t GetU16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+    static uint32_t GetU32(const uint8_t *p)
+    {
+        return GetU16(p) | ((uint32_t)GetU16(p + 2) << 16);
+    }
+
+    void ParseFormat(const uint8_t *fmt, size_t size)
+    {
+        format_tag      = GetU16(fmt);
+        channels        = GetU16(fmt + 2);
+        samplerate      = GetU32(fmt + 4);
+        block_align     = GetU16(fmt + 12);
+        bits_per_sample = GetU16(fmt + 14);
+        valid_bits      = bits_per_sample;
+        channel_mask    = 0;
+        extensible      = format_tag == WAVE_FORMAT_EXTENSIBLE && size >= 26;
+        if(extensible)
+        {
+            // The first two bytes of the SubFormat GUID are the format code
+            valid_bits   = GetU16(fmt + 18);
+            channel_mask = GetU32(fmt + 20);
+            format_tag   = GetU16(fmt + 24);
+        }
+    }
+
+    template <typename FileReader>
+    void ParseSampler(FileReader &reader, uint64_t size)
+    {
+        // Manufacturer, product, period, unity note, pitch fraction, SMPTE
+        // format and offset, number of loops, sampler data size
+        uint8_t smpl[36];
+        if(size < sizeof(smpl)
+           || reader.Read(smpl, sizeof(smpl)) != sizeof(smpl))
+            return;
+        unity_note = GetU32(smpl + 12) & 0x7F;
+        uint32_t n = GetU32(smpl + 28);
+        if(n > (size - sizeof(smpl)) / 24)
+            n = (size - sizeof(smpl)) / 24;
+        for(uint32_t i = 0; i < n && num_loops < kMaxLoops; i++)
+        {
+            // Cue id, type, start, end (inclusive), fraction, play count
+            uint8_t loop[24];
+            if(reader.Read(loop, sizeof(loop)) != sizeof(loop))
+                return;
+            WavLoop &l   = loops[num_loops];
+            l.type       = GetU32(loop + 4);
+            l.start      = GetU32(loop + 8);
+            l.end        = GetU32(loop + 12) + 1;
+            l.play_count = GetU32(loop + 20);
+            if(l.end > l.start)
+                num_loops++;
+        }
+    }
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -0,0 +1,798 @@
+#pragma once
+#ifndef DSY_WAVSTREAMER_H
+#define DSY_WAVSTREAMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "util/WavHeader.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Format of the sample data of a WAV file, and its conversion to float.
+ **
+ ** Supported are 16, 24 and 32 bit integer PCM and 32 bit float data, mono
+ ** or stereo (more channels play the first two), also in
+ ** WAVE_FORMAT_EXTENSIBLE and RF64 files. The header is read with WavHeader,
+ ** which skips other chunks before the data chunk.
+ ** */
+struct WavStreamFormat
+{
+    /** Sample encodings that can be decoded */
+    enum class Encoding
+    {
+        PCM16,
+        PCM24,
+        PCM32,
+        FLOAT32,
+    };
+
+    Encoding encoding;     /**< & */
+    uint16_t channels;     /**< & */
+    uint32_t samplerate;   /**< & */
+    size_t   block_align;  /**< Size of a frame in bytes */
+    size_t   right_offset; /**< Offset of the right channel in a frame */
+    uint32_t data_start;   /**< File position of the first frame */
+    uint32_t data_end;     /**< File position after the last whole frame */
+
+    /** Reads the header of a WAV file, walking the chunks up to "data".
+     ** On success, the reader is left at the first frame.
+     ** \param reader file backend with the file open at the start (see WavStreamVoice)
+     ** \param max_block_align largest frame size the caller can handle
+     ** \return true if the file can be played
+     */
+    template <typename FileReader>
+    bool Parse(FileReader &reader, size_t max_block_align)
+    {
+        WavHeader header;
+        return header.Parse(reader, false)
+               && SetFormat(header, max_block_align);
+    }
+
+    /** Takes the format from a parsed header
+     ** \param header header of the file
+     ** \param max_block_align largest frame size the caller can handle
+     ** \return true if the file can be played
+     */
+    bool SetFormat(const WavHeader &header, size_t max_block_align)
+    {
+        channels    = header.channels;
+        samplerate  = header.samplerate;
+        block_align = header.block_align;
+        if(channels == 0 || block_align == 0 || block_align % channels
+           || block_align > max_block_align)
+            return false;
+        size_t container = block_align / channels;
+        if(header.format_tag == WAVE_FORMAT_PCM && container == 2)
+            encoding = Encoding::PCM16;
+        else if(header.format_tag == WAVE_FORMAT_PCM && container == 3)
+            encoding = Encoding::PCM24;
+        else if(header.format_tag == WAVE_FORMAT_PCM && container == 4)
+            encoding = Encoding::PCM32;
+        else if(header.format_tag == WAVE_FORMAT_IEEE_FLOAT && container == 4)
+            encoding = Encoding::FLOAT32;
+        else
+            return false;
+        uint32_t size = header.data_size - header.data_size % block_align;
+        right_offset  = channels > 1 ? container : 0;
+        data_start    = header.data_start;
+        data_end      = data_start + size;
+        return data_end > data_start;
+    }
+
+    /** \return length of the data in frames */
+    uint32_t GetLengthFrames() const
+    {
+        return (data_end - data_start) / block_align;
+    }
+
+    /** Converts frames to interleaved stereo float. Mono data goes to both channels.
+     ** \param src first frame
+     ** \param frames number of frames
+     ** \param out interleaved stereo output, 2 * frames values
+     ** \param gain linear gain
+     ** \param accumulate add to the output instead of overwriting it
+     */
+    void Decode(const uint8_t *src,
+                size_t         frames,
+                float *        out,
+                float          gain,
+                bool           accumulate) const
+    {
+        if(accumulate)
+            DecodeAs<true>(src, frames, out, gain);
+        else
+            DecodeAs<false>(src, frames, out, gain);
+    }
+
+    /** Converts samples to float as they are, without regard to channels.
+     ** The source may overlap the end of the output, so data read into the
+     ** back of a float buffer can be converted in place.
+     ** \param src first sample
+     ** \param samples number of samples
+     ** \param out output, samples values
+     */
+    void ToFloat(const uint8_t *src, size_t samples, float *out) const
+    {
+        switch(encoding)
+        {
+            case Encoding::PCM16:
+                ConvertSamples<Pcm16>(src, samples, out);
+                break;
+            case Encoding::PCM24:
+                ConvertSamples<Pcm24>(src, samples, out);
+                break;
+            case Encoding::PCM32:
+                ConvertSamples<Pcm32>(src, samples, out);
+                break;
+            case Encoding::FLOAT32:
+                ConvertSamples<Float32>(src, samples, out);
+                break;
+        }
+    }
+
+  private:
+    struct Pcm16
+    {
+        static constexpr size_t kBytes = 2;
+        static float Get(const uint8_t *p)
+        {
+            int16_t v;
+            memcpy(&v, p, sizeof(v));
+            return v * 3.0517578125e-05f;
+        }
+    };
+    struct Pcm24
+    {
+        static constexpr size_t kBytes = 3;
+        static float Get(const uint8_t *p)
+        {
+            uint32_t v = (p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24);
+            return static_cast<int32_t>(v) * 4.6566129e-10f;
+        }
+    };
+    struct Pcm32
+    {
+        static constexpr size_t kBytes = 4;
+        static float Get(const uint8_t *p)
+        {
+            int32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v * 4.6566129e-10f;
+        }
+    };
+    struct Float32
+    {
+        static constexpr size_t kBytes = 4;
+        static float Get(const uint8_t *p)
+        {
+            float v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+    };
+
+    template <bool accumulate>
+    void
+    DecodeAs(const uint8_t *src, size_t frames, float *out, float gain) const
+    {
+        switch(encoding)
+        {
+            case Encoding::PCM16:
+                DecodeFrames<Pcm16, accumulate>(src, frames, out, gain);
+                break;
+            case Encoding::PCM24:
+                DecodeFrames<Pcm24, accumulate>(src, frames, out, gain);
+                break;
+            case Encoding::PCM32:
+                DecodeFrames<Pcm32, accumulate>(src, frames, out, gain);
+                break;
+            case Encoding::FLOAT32:
+                DecodeFrames<Float32, accumulate>(src, frames, out, gain);
+                break;
+        }
+    }
+
+    template <typename SampleFormat, bool accumulate>
+    void DecodeFrames(const uint8_t *src,
+                      size_t         frames,
+                      float *        out,
+                      float          gain) const
+    {
+        const size_t stride = block_align;
+        const size_t right  = right_offset;
+        for(size_t i = 0; i < frames; i++)
+        {
+            float l = SampleFormat::Get(src) * gain;
+            float r = SampleFormat::Get(src + right) * gain;
+            if(accumulate)
+            {
+                out[0] += l;
+                out[1] += r;
+            }
+            else
+            {
+                out[0] = l;
+                out[1] = r;
+            }
+            out += 2;
+            src += stride;
+        }
+    }
+
+    template <typename SampleFormat>
+    static void ConvertSamples(const uint8_t *src, size_t samples, float *out)
+    {
+        // Each group is read before it's written, which keeps the in place
+        // conversion safe, and leaves the loads free to be scheduled
+        const size_t b = SampleFormat::kBytes;
+        size_t       i = 0;
+        for(; i + 4 <= samples; i += 4)
+        {
+            float s0 = SampleFormat::Get(src);
+            float s1 = SampleFormat::Get(src + b);
+            float s2 = SampleFormat::Get(src + 2 * b);
+            float s3 = SampleFormat::Get(src + 3 * b);
+            out[0]   = s0;
+            out[1]   = s1;
+            out[2]   = s2;
+            out[3]   = s3;
+            out += 4;
+            src += 4 * b;
+        }
+        for(; i < samples; i++)
+        {
+            *out++ = SampleFormat::Get(src);
+            src += b;
+        }
+    }
+};
+
+/** Single producer, single consumer ring buffer of WAV file data.
+ **
+ ** The file data is kept as it is in the file, and converted to float while
+ ** reading, so the buffer holds as much audio as the file format allows.
+ ** The capacity is rounded down to whole frames, so a frame never wraps
+ ** around the end of the buffer.
+ **
+ ** One context writes (the main loop), the other reads (the audio callback).
+ ** Reset() may only be called while the reader doesn't use the buffer.
+ ** */
+template <size_t size>
+class WavStreamBuffer
+{
+  public:
+    WavStreamBuffer() {}
+    ~WavStreamBuffer() {}
+
+    /** Empties the buffer, and sets the frame size of the data */
+    void Reset(size_t block_align)
+    {
+        capacity_  = (size / block_align) * block_align;
+        read_pos_  = 0;
+        write_pos_ = 0;
+    }
+
+    /** \return capacity in bytes */
+    size_t GetCapacity() const { return capacity_; }
+
+    /** \return number of bytes ready to be read */
+    size_t GetReadable() const
+    {
+        size_t w = write_pos_, r = read_pos_;
+        return w >= r ? w - r : w + 2 * capacity_ - r;
+    }
+
+    /** \return number of bytes that can be written */
+    size_t GetWritable() const { return capacity_ - GetReadable(); }
+
+    /** \return where to write next
+     ** \param contiguous is set to the number of bytes that can be written there
+     */
+    uint8_t *GetWritePtr(size_t *contiguous)
+    {
+        size_t off  = Offset(write_pos_);
+        size_t free = GetWritable();
+        *contiguous = capacity_ - off < free ? capacity_ - off : free;
+        return data_ + off;
+    }
+
+    /** Makes n bytes written at GetWritePtr() readable */
+    void CommitWrite(size_t n)
+    {
+        // The data is in place before the reader sees it
+        std::atomic_signal_fence(std::memory_order_release);
+        write_pos_ = Advance(write_pos_, n);
+    }
+
+    /** Reads and converts up to frames frames
+     ** \param fmt format of the data
+     ** \param out interleaved stereo output, 2 * frames values
+     ** \param frames largest number of frames to read
+     ** \param gain linear gain
+     ** \param accumulate add to the output instead of overwriting it
+     ** \return number of frames read
+     */
+    size_t Read(const WavStreamFormat &fmt,
+                float *                out,
+                size_t                 frames,
+                float                  gain,
+                bool                   accumulate)
+    {
+        size_t n = GetReadable() / fmt.block_align;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        if(n > frames)
+            n = frames;
+        size_t off   = Offset(read_pos_);
+        size_t first = (capacity_ - off) / fmt.block_align;
+        if(first > n)
+            first = n;
+        fmt.Decode(data_ + off, first, out, gain, accumulate);
+        fmt.Decode(data_, n - first, out + first * 2, gain, accumulate);
+        read_pos_ = Advance(read_pos_, n * fmt.block_align);
+        return n;
+    }
+
+  private:
+    // Positions run from 0 to 2 * capacity_, so a full buffer
+    // can be told apart from an empty one.
+    size_t Offset(size_t pos) const
+    {
+        return pos < capacity_ ? pos : pos - capacity_;
+    }
+    size_t Advance(size_t pos, size_t n) const
+    {
+        pos += n;
+        return pos < 2 * capacity_ ? pos : pos - 2 * capacity_;
+    }
+
+    uint8_t         data_[size];
+    size_t          capacity_;
+    volatile size_t read_pos_, write_pos_;
+};
+
+/** A single voice of the WavStreamer.
+ **
+ ** Streams a WAV file through a WavStreamBuffer of buffer_bytes.
+ ** See WavStreamFormat for the supported formats.
+ **
+ ** Open(), Fill() and Close() do file access, and should be called from the
+ ** main loop. Start(), Stop() and Read() only touch the buffer, and can be
+ ** called from the audio callback.
+ **
+ ** FileReader is the file backend (e.g. FatFileReader), with the functions:
+ ** - bool Open(const char *path)
+ ** - void Close()
+ ** - size_t Read(void *dst, size_t size)
+ ** - bool Seek(uint32_t pos)
+ ** - uint32_t GetSize() const
+ ** - bool IsOpen() const
+ ** */
+template <size_t buffer_bytes, typename FileReader>
+class WavStreamVoice
+{
+  public:
+    WavStreamVoice() {}
+    ~WavStreamVoice() {}
+
+    /** Return values for Open() */
+    enum class Result
+    {
+        OK,
+        ERR_FILE,
+        ERR_FORMAT,
+    };
+
+    /** Initializes the voice. Nothing is played until a file is opened and started. */
+    void Init()
+    {
+        playing_   = false;
+        done_      = true;
+        eof_       = true;
+        gain_      = 1.f;
+        underruns_ = 0;
+        memset(&format_, 0, sizeof(format_));
+        buffer_.Reset(1);
+    }
+
+    /** Opens a file and gets ready to stream it.
+     ** Stops the voice first if it is playing.
+     ** The voice doesn't play until Start() is called. Call Fill() in between,
+     ** so there is something to play.
+     ** \param path path of the file
+     ** \param loop play the file in a loop until stopped
+     */
+    Result Open(const char *path, bool loop)
+    {
+        playing_ = false;
+        done_    = true;
+        // Read() stops using the voice before it is changed below
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        reader_.Close();
+        if(!reader_.Open(path))
+            return Result::ERR_FILE;
+        if(!format_.Parse(reader_, buffer_bytes / 2))
+        {
+            reader_.Close();
+            return Result::ERR_FORMAT;
+        }
+        buffer_.Reset(format_.block_align);
+        file_pos_ = format_.data_start;
+        loop_     = loop;
+        eof_      = false;
+        done_     = false;
+        return Result::OK;
+    }
+
+    /** Closes the file. Stops the voice if it is playing. */
+    void Close()
+    {
+        playing_ = false;
+        done_    = true;
+        reader_.Close();
+    }
+
+    /** Reads more data from the file into the buffer.
+     ** \param max_bytes largest read to do, in bytes
+     ** \return number of bytes read. 0 if the buffer is full, or the file was read completely.
+     */
+    size_t Fill(size_t max_bytes)
+    {
+        if(done_ || eof_)
+            return 0;
+        size_t   n;
+        uint8_t *dst    = buffer_.GetWritePtr(&n);
+        uint32_t remain = format_.data_end - file_pos_;
+        if(n > max_bytes)
+            n = max_bytes;
+        if(n > remain)
+            n = remain;
+        n -= n % format_.block_align;
+        if(n == 0)
+            return 0;
+
+        size_t got = reader_.Read(dst, n);
+        got -= got % format_.block_align;
+        file_pos_ += got;
+        buffer_.CommitWrite(got);
+        if(got < n)
+        {
+            // Read error, or the file is shorter than the header claims
+            eof_ = true;
+        }
+        else if(file_pos_ == format_.data_end)
+        {
+            if(loop_ && reader_.Seek(format_.data_start))
+                file_pos_ = format_.data_start;
+            else
+                eof_ = true;
+        }
+        return got;
+    }
+
+    /** \return true if the voice has room for a read of min_bytes,
+     ** or for the rest of the file if that is smaller. */
+    bool NeedsData(size_t min_bytes) const
+    {
+        if(done_ || eof_)
+            return false;
+        size_t   free   = buffer_.GetWritable();
+        uint32_t remain = format_.data_end - file_pos_;
+        if(!loop_ && remain < min_bytes)
+            min_bytes = remain;
+        if(min_bytes > buffer_.GetCapacity() / 2)
+            min_bytes = buffer_.GetCapacity() / 2;
+        return free >= min_bytes && free >= format_.block_align;
+    }
+
+    /** Starts playback of the opened file
+     ** \param gain linear gain of the voice
+     */
+    void Start(float gain = 1.f)
+    {
+        if(done_)
+            return;
+        gain_ = gain;
+        // The file, the buffer and the gain are set before Read() sees them
+        std::atomic_signal_fence(std::memory_order_release);
+        playing_ = true;
+    }
+
+    /** Stops playback. The file is closed by the next Close() or Open(). */
+    void Stop()
+    {
+        playing_ = false;
+        done_    = true;
+    }
+
+    /** Reads and converts the next frames.
+     ** Missing frames are left silent. If the file hasn't ended, that is
+     ** counted as an underrun.
+     ** \param out interleaved stereo output, 2 * frames values
+     ** \param frames number of frames to read
+     ** \param accumulate add to the output instead of overwriting it
+     ** \return number of frames read
+     */
+    size_t Read(float *out, size_t frames, bool accumulate = false)
+    {
+        size_t n = 0;
+        if(playing_)
+        {
+            std::atomic_signal_fence(std::memory_order_acquire);
+            n = buffer_.Read(format_, out, frames, gain_, accumulate);
+            if(n < frames)
+            {
+                if(eof_)
+                {
+                    playing_ = false;
+                    done_    = true;
+                }
+                else
+                {
+                    underruns_++;
+                }
+            }
+        }
+        if(!accumulate && n < frames)
+            memset(out + n * 2, 0, (frames - n) * 2 * sizeof(float));
+        return n;
+    }
+
+    /** Sets the gain of the voice */
+    void SetGain(float gain) { gain_ = gain; }
+
+    /** \return true while the voice is playing */
+    bool IsPlaying() const { return playing_; }
+
+    /** \return true once the voice has finished or was stopped. The file can be closed then. */
+    bool IsDone() const { return done_; }
+
+    /** \return true if a file is open */
+    bool IsOpen() const { return reader_.IsOpen(); }
+
+    /** \return number of frames in the buffer, ready to be played */
+    size_t GetBufferedFrames() const
+    {
+        return format_.block_align ? buffer_.GetReadable() / format_.block_align
+                                   : 0;
+    }
+
+    /** \return number of frames the buffer can hold with the current file */
+    size_t GetCapacityFrames() const
+    {
+        return format_.block_align ? buffer_.GetCapacity() / format_.block_align
+                                   : 0;
+    }
+
+    /** \return number of times Read() ran out of data before the end of the file */
+    uint32_t GetUnderruns() const { return underruns_; }
+
+    /** \return format of the current file */
+    const WavStreamFormat &GetFormat() const { return format_; }
+
+  private:
+    WavStreamBuffer<buffer_bytes> buffer_;
+    WavStreamFormat               format_;
+    FileReader                    reader_;
+    uint32_t                      file_pos_;
+    volatile bool                 playing_, done_, eof_;
+    bool                          loop_;
+    volatile float                gain_; // SetGain() while playing
+    uint32_t                      underruns_;
+};
+
+/** Streaming multi-voice WAV player
+ **
+ ** Plays up to num_voices WAV files at once, streamed from a file system
+ ** (e.g. an SD Card) through a read-ahead buffer of buffer_bytes per voice.
+ ** See WavStreamFormat for the supported formats.
+ **
+ ** The buffers are part of the object. Larger buffers ride out longer file
+ ** system stalls, and the object can be placed in SDRAM for that, e.g.:
+ ** WavStreamer<8, 65536, FatFileReader> DSY_SDRAM_BSS streamer;
+ **
+ ** Prepare() in the main loop does the reading. It always serves the voice
+ ** with the least buffered audio first, so the voice closest to running
+ ** out gets the next read. Read() in the audio callback mixes all voices.
+ **
+ ** To use:
+ ** 1. Mount the file system, and Init() the streamer
+ ** 2. Play files from the main loop with Play(). If all voices are busy,
+ **    the one playing the longest is replaced.
+ ** 3. Call Prepare() from the main loop as often as possible
+ ** 4. Call Read() from the audio callback
+ ** */
+template <size_t num_voices, size_t buffer_bytes, typename FileReader>
+class WavStreamer
+{
+  public:
+    using Voice  = WavStreamVoice<buffer_bytes, FileReader>;
+    using Result = typename Voice::Result;
+
+    WavStreamer() {}
+    ~WavStreamer() {}
+
+    /** Configuration for the streamer */
+    struct Config
+    {
+        /** Size of a single read from the file system in bytes.
+         ** Larger reads are more efficient on SD Cards. */
+        size_t read_size;
+        /** Largest number of reads done by a single call to Prepare() */
+        size_t max_reads;
+        /** Part of the voice buffer to fill before a voice starts (0-1) */
+        float prefill;
+
+        /** Sets 4kB reads, 2 reads per voice and Prepare(), and a half full buffer to start with */
+        void Defaults()
+        {
+            read_size = 4096;
+            max_reads = 2 * num_voices;
+            prefill   = 0.5f;
+        }
+    };
+
+    /** Initializes the streamer with default settings */
+    void Init()
+    {
+        Config cfg;
+        cfg.Defaults();
+        Init(cfg);
+    }
+
+    /** Initializes the streamer
+     ** \param cfg configuration
+     */
+    void Init(const Config &cfg)
+    {
+        cfg_ = cfg;
+        if(cfg_.read_size == 0)
+            cfg_.read_size = 4096;
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            voices_[i].Init();
+            start_order_[i] = 0;
+        }
+        num_started_ = 0;
+    }
+
+    /** Plays a file on a free voice, or replaces the voice that was started first.
+     ** Call from the main loop.
+     ** \param path path of the file
+     ** \param gain linear gain of the voice
+     ** \param loop play the file in a loop until stopped
+     ** \return the voice playing the file, or -1 if the file couldn't be opened
+     */
+    int Play(const char *path, float gain = 1.f, bool loop = false)
+    {
+        size_t voice = 0;
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            if(voices_[i].IsDone())
+            {
+                voice = i;
+                break;
+            }
+            if(start_order_[i] < start_order_[voice])
+                voice = i;
+        }
+        return Play(voice, path, gain, loop) == Result::OK
+                   ? static_cast<int>(voice)
+                   : -1;
+    }
+
+    /** Plays a file on the given voice. Call from the main loop.
+     ** \param voice voice to use
+     ** \param path path of the file
+     ** \param gain linear gain of the voice
+     ** \param loop play the file in a loop until stopped
+     */
+    Result Play(size_t voice, const char *path, float gain, bool loop)
+    {
+        if(voice >= num_voices)
+            return Result::ERR_FILE;
+        Voice &v   = voices_[voice];
+        Result res = v.Open(path, loop);
+        if(res != Result::OK)
+            return res;
+        size_t target
+            = static_cast<size_t>(v.GetCapacityFrames() * cfg_.prefill);
+        while(v.GetBufferedFrames() < target && v.Fill(cfg_.read_size) > 0) {}
+        start_order_[voice] = ++num_started_;
+        v.Start(gain);
+        return Result::OK;
+    }
+
+    /** Stops a voice. Can be called from the audio callback. */
+    void Stop(size_t voice)
+    {
+        if(voice < num_voices)
+            voices_[voice].Stop();
+    }
+
+    /** Stops all voices */
+    void StopAll()
+    {
+        for(size_t i = 0; i < num_voices; i++)
+            voices_[i].Stop();
+    }
+
+    /** Reads ahead for the voices that need it, the one with the least
+     ** buffered audio first, and closes the files of finished voices.
+     ** Call from the main loop. */
+    void Prepare()
+    {
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            if(voices_[i].IsDone() && voices_[i].IsOpen())
+                voices_[i].Close();
+        }
+        for(size_t n = 0; n < cfg_.max_reads; n++)
+        {
+            int    next  = -1;
+            size_t least = 0;
+            for(size_t i = 0; i < num_voices; i++)
+            {
+                if(!voices_[i].NeedsData(cfg_.read_size))
+                    continue;
+                size_t buffered = voices_[i].GetBufferedFrames();
+                if(next < 0 || buffered < least)
+                {
+                    next  = i;
+                    least = buffered;
+                }
+            }
+            if(next < 0)
+                break;
+            voices_[next].Fill(cfg_.read_size);
+        }
+    }
+
+    /** Mixes the next frames of all playing voices. Call from the audio callback.
+     ** \param out interleaved stereo output, 2 * frames values
+     ** \param frames number of frames
+     */
+    void Read(float *out, size_t frames)
+    {
+        memset(out, 0, frames * 2 * sizeof(float));
+        for(size_t i = 0; i < num_voices; i++)
+            voices_[i].Read(out, frames, true);
+    }
+
+    /** \return the voice, for direct control */
+    Voice &GetVoice(size_t voice) { return voices_[voice]; }
+
+    /** \return number of voices currently playing */
+    size_t GetNumPlaying() const
+    {
+        size_t n = 0;
+        for(size_t i = 0; i < num_voices; i++)
+            n += voices_[i].IsPlaying() ? 1 : 0;
+        return n;
+    }
+
+    /** \return total number of underruns of all voices */
+    uint32_t GetUnderruns() const
+    {
+        uint32_t n = 0;
+        for(size_t i = 0; i < num_voices; i++)
+            n += voices_[i].GetUnderruns();
+        return n;
+    }
+
+  private:
+    Voice    voices_[num_voices];
+    uint32_t start_order_[num_voices];
+    uint32_t num_started_;
+    Config   cfg_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -1,39 +1,73 @@
 #pragma once
-#pragma once
-#include "fatfs.h"
+#ifndef DSY_WAVWRITER_H
+#define DSY_WAVWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "daisy_core.h"
+#include "util/wav_format.h"
+#include "util/FatFileWriter.h"
 
 namespace daisy
 {
+/** @addtogroup utility
+    @{
+*/
+
 /** Audio Recording Module
- ** 
- ** Record audio into a working buffer that is gradually written to a WAV file on an SD Card. 
  **
- ** Recordings are made with floating point input, and will be converted to the 
- ** specified bits per sample internally 
+ ** Record audio into a working buffer that is gradually written to a WAV file on an SD Card.
+ **
+ ** Recordings are made with floating point input, and will be converted to the
+ ** specified format internally: 16, 24 (packed) or 32-bit signed int, or 32-bit float.
+ **
+ ** The working buffer is a ring of num_buffers blocks of transfer_size bytes.
+ ** The audio callback fills the blocks, and Write() writes each complete block
+ ** to the file. While the SD Card is busy (cards can stall for 100ms and more
+ ** when they erase internally) the audio callback keeps filling the free blocks.
+ ** If the ring is full, incoming frames are dropped and counted, rather than
+ ** overwriting data that wasn't written yet, so the file stays consistent.
+ **
+ ** Memory use is (num_buffers * transfer_size) bytes.
+ ** Performance optimal with transfer sizes: 16384, 32768.
+ ** The ring should hold the longest expected stall plus one block, e.g. for
+ ** 8 channels of 24-bit audio at 48kHz (1152 bytes per ms), 100ms need
+ ** 115kB: WavWriter<16384, 9>.
  **
- ** For now only 16-bit and 32-bit (signed int) formats are supported
- ** f32 and s24 formats will be added next
+ ** Config::preallocate reserves a contiguous area on the card for the given
+ ** length when the file is opened. Blocks are then written directly to their
+ ** sectors, without FatFs allocating clusters and updating the FAT during the
+ ** recording. For this, transfer_size has to be a multiple of 512 bytes, and
+ ** the header is padded to 512 bytes (with a JUNK chunk). Recording longer
+ ** than reserved continues through FatFs.
+ **
+ ** The blocks, and the padded header, go to the card by DMA straight from
+ ** the object. It has to live in memory the SDMMC can read: a global in
+ ** SRAM (the default .bss) or SDRAM (DSY_SDRAM_BSS), not on the stack or
+ ** in DTCM (DTCM_MEM_SECTION).
  **
- ** The transfer size determines the amount of internal memory used, and can have an
- ** effect on the performance of the streaming behavior of the WavWriter.
- ** Memory use can be calculated as: (2 * transfer_size) bytes
- ** Performance optimal with sizes: 16384, 32768
- ** 
  ** To use:
- ** 1. Create a WavWriter<size> object (e.g. WavWriter<32768> writer)
- ** 2. Configure the settings as desired by creating a WavWriter<32768>::Config struct and setting the settings.
+ ** 1. Create a WavWriter<size, num_buffers> object (e.g. WavWriter<32768, 4> writer)
+ ** 2. Configure the settings as desired by creating a WavWriter<32768, 4>::Config struct and setting the settings.
  ** 3. Initialize the object with the configuration struct.
  ** 4. Open a new file for writing with: writer.OpenFile("FileName.wav")
- ** 5. Write to it within your audio callback using: writer.Sample(value)
+ ** 5. Write to it within your audio callback using: writer.Sample(in, size)
  ** 6. Fill the Wav File on the SD Card with data from your main loop by running: writer.Write()
  ** 7. When finished with the recording finalize, and close the file with: writer.SaveFile();
- ** 
+ **
+ ** FileWriter is the file backend, FatFileWriter by default. It needs the
+ ** functions:
+ ** bool Open(const char *path), size_t Write(const void *src, size_t size),
+ ** bool Seek(uint32_t pos), bool Preallocate(uint32_t size) and void Close().
  ** */
-template <size_t transfer_size>
+template <size_t transfer_size,
+          size_t num_buffers  = 2,
+          typename FileWriter = FatFileWriter>
 class WavWriter
 {
   public:
-    WavWriter() {}
+    WavWriter() : recording_(false) {}
     ~WavWriter() {}
 
     /** Return values for write related functions */
@@ -47,38 +81,47 @@ class WavWriter
 	 ** */
     struct Config
     {
-        float   samplerate;
-        int32_t channels;
-        int32_t bitspersample;
-    };
-
-    /** State of the internal Writing mechanism. 
-	 ** When the buffer is a certain amount full one section will write its contents
-	 ** while the other is still being written to. This is performed circularly
-	 ** so that audio will be uninterrupted during writing. */
-    enum class BufferState
-    {
-        IDLE,
-        FLUSH0,
-        FLUSH1,
+        float   samplerate    = 48000.f;
+        int32_t channels      = 2;
+        int32_t bitspersample = 16; /**< 16, 24 or 32 */
+        bool    float_samples = false; /**< 32-bit IEEE float instead of int */
+        float   preallocate   = 0.f; /**< seconds to reserve, 0 to grow */
     };
 
     /**  Initializes the WavFile header, and prepares the object for recording. */
     void Init(const Config &cfg)
     {
-        cfg_       = cfg;
-        num_samps_ = 0;
+        cfg_         = cfg;
+        num_samps_   = 0;
+        recording_   = false;
+        header_size_ = sizeof(wavheader_);
+        switch(cfg_.bitspersample)
+        {
+            case 24: encoding_ = Encoding::PCM24; break;
+            case 32:
+                encoding_ = cfg_.float_samples ? Encoding::FLOAT32
+                                               : Encoding::PCM32;
+                break;
+            default:
+                cfg_.bitspersample = 16;
+                encoding_          = Encoding::PCM16;
+                break;
+        }
+        sample_bytes_ = cfg_.bitspersample / 8;
+        frame_bytes_  = cfg_.channels * sample_bytes_;
         // Prep the wav header according to config.
         // Certain things (i.e. Size, etc. will have to wait until the finalization of the file, or be updated while streaming).
         wavheader_.ChunkId       = kWavFileChunkId;     /** "RIFF" */
         wavheader_.FileFormat    = kWavFileWaveId;      /** "WAVE" */
         wavheader_.SubChunk1ID   = kWavFileSubChunk1Id; /** "fmt " */
         wavheader_.SubChunk1Size = 16;                  // for PCM
-        wavheader_.AudioFormat   = WAVE_FORMAT_PCM;
-        wavheader_.NbrChannels   = cfg.channels;
-        wavheader_.SampleRate    = static_cast<int>(cfg.samplerate);
+        wavheader_.AudioFormat   = encoding_ == Encoding::FLOAT32
+                                       ? WAVE_FORMAT_IEEE_FLOAT
+                                       : WAVE_FORMAT_PCM;
+        wavheader_.NbrChannels   = cfg_.channels;
+        wavheader_.SampleRate    = static_cast<int>(cfg_.samplerate);
         wavheader_.ByteRate      = CalcByteRate();
-        wavheader_.BlockAlign    = cfg_.channels * cfg_.bitspersample / 8;
+        wavheader_.BlockAlign    = frame_bytes_;
         wavheader_.BitPerSample  = cfg_.bitspersample;
         wavheader_.SubChunk2ID   = kWavFileSubChunk2Id; /** "data" */
         /** Also calcs SubChunk2Size */
@@ -86,121 +129,296 @@ class WavWriter
         // This is calculated as part of the subchunk size
     }
 
-    /** Records the current sample into the working buffer,
-     ** queues writes to media when necessary. 
-     ** 
-     ** \param in should be a pointer to an array of samples */
-    void Sample(const float *in)
+    /** Records a block of frames into the working buffer.
+     ** Call from the audio callback.
+     **
+     ** \param in one array of samples per channel (e.g. the audio callback's input)
+     ** \param frames number of samples per channel
+     ** */
+    void Sample(const float *const *in, size_t frames)
     {
-        for(size_t i = 0; i < cfg_.channels; i++)
-        {
-            switch(cfg_.bitspersample)
-            {
-                case 16:
-                {
-                    int16_t *tp;
-                    tp            = (int16_t *)transfer_buff;
-                    tp[wptr_ + i] = f2s16(in[i]);
-                }
-                break;
-                case 32: transfer_buff[wptr_ + i] = f2s32(in[i]); break;
-                default: break;
-            }
-        }
-        num_samps_++;
-        wptr_ += cfg_.channels;
-        size_t cap_point
-            = cfg_.bitspersample == 16 ? kTransferSamps * 2 : kTransferSamps;
-        if(wptr_ == cap_point)
-        {
-            bstate_ = BufferState::FLUSH0;
-        }
-        if(wptr_ >= cap_point * 2)
-        {
-            wptr_   = 0;
-            bstate_ = BufferState::FLUSH1;
-        }
+        Push(in, nullptr, frames);
     }
 
-    /** Check buffer state and write */
-    void Write()
+    /** Records a single frame into the working buffer.
+     **
+     ** \param in should be a pointer to an array of samples, one per channel */
+    void Sample(const float *in) { Push(nullptr, in, 1); }
+
+    /** Writes all complete blocks to the file. Call from the main loop.
+     ** \return ERROR if a block could not be written completely */
+    Result Write()
     {
-        if(bstate_ != BufferState::IDLE && IsRecording())
+        Result res = Result::OK;
+        while(written_ - flushed_ >= transfer_size)
         {
-            uint32_t     offset;
-            unsigned int bw = 0;
-            //offset          = bstate_ == BufferState::FLUSH0 ? 0 : transfer_size;
-            offset  = bstate_ == BufferState::FLUSH0 ? 0 : kTransferSamps;
-            bstate_ = BufferState::IDLE;
-            f_write(&fp_, &transfer_buff[offset], transfer_size, &bw);
+            if(!WriteBlock(transfer_size))
+                res = Result::ERROR;
         }
+        return res;
     }
 
     /** Finalizes the writing of the WAV file.
-	 ** This overwrites the WAV Header with the correct
-	 ** final size, and closes the fptr. */
-    void SaveFile()
-    {
-        unsigned int bw = 0;
-        recording_      = false;
-        // We _should_ flush whatever's left in the transfer buff
-        // TODO: that.
+	 ** This writes the rest of the buffered audio, overwrites the
+	 ** WAV Header with the correct final size, and closes the file. */
+    Result SaveFile()
+    {
+        if(!recording_)
+            return Result::ERROR;
+        recording_ = false;
+        Result res = Write();
+        if(written_ != flushed_ && !WriteBlock(written_ - flushed_))
+            res = Result::ERROR;
+        num_samps_          = written_ / frame_bytes_;
         wavheader_.FileSize = CalcFileSize();
-        f_lseek(&fp_, 0);
-        f_write(&fp_, &wavheader_, sizeof(wavheader_), &bw);
-        f_close(&fp_);
+        if(!file_.Seek(0) || !WriteHeader())
+            res = Result::ERROR;
+        file_.Close();
+        return res;
     }
 
     /** Opens a file for writing. Writes the initial WAV Header, and gets ready for stream-based recording. */
-    void OpenFile(const char *name)
+    Result OpenFile(const char *name)
     {
-        if(f_open(&fp_, name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK)
+        if(recording_ || !file_.Open(name))
+            return Result::ERROR;
+        header_size_ = sizeof(wavheader_);
+        if(cfg_.preallocate > 0.f)
         {
-            unsigned int bw = 0;
-            if(f_write(&fp_, &wavheader_, sizeof(wavheader_), &bw) == FR_OK)
-            {
-                recording_ = true;
-                num_samps_ = 0;
-            }
+            uint32_t size = kSectorSize + cfg_.preallocate * CalcByteRate();
+            if(file_.Preallocate(size))
+                header_size_ = kSectorSize;
+        }
+        wavheader_.FileSize = CalcFileSize();
+        if(!WriteHeader())
+        {
+            file_.Close();
+            return Result::ERROR;
         }
+        num_samps_      = 0;
+        wptr_           = 0;
+        rptr_           = 0;
+        written_        = 0;
+        flushed_        = 0;
+        max_buffered_   = 0;
+        overruns_       = 0;
+        dropped_frames_ = 0;
+        write_errors_   = 0;
+        recording_      = true;
+        return Result::OK;
     }
 
     /** Returns whether recording is currently active or not. */
     inline bool IsRecording() const { return recording_; }
 
     /** Returns the current length in samples of the recording. */
-    inline uint32_t GetLengthSamps() { return num_samps_; }
+    inline uint32_t GetLengthSamps()
+    {
+        return recording_ ? written_ / frame_bytes_ : num_samps_;
+    }
 
     /** Returns the current length of the recording in seconds. */
     inline float GetLengthSeconds()
     {
-        return (float)num_samps_ / (float)cfg_.samplerate;
+        return (float)GetLengthSamps() / (float)cfg_.samplerate;
     }
 
+    /** \return number of times Sample() found the buffer full, and dropped audio */
+    inline uint32_t GetOverruns() const { return overruns_; }
+
+    /** \return number of frames that were dropped because the buffer was full */
+    inline uint32_t GetDroppedFrames() const { return dropped_frames_; }
+
+    /** \return number of blocks that could not be written completely */
+    inline uint32_t GetWriteErrors() const { return write_errors_; }
+
+    /** \return the most bytes that were waiting to be written, to help size the buffer */
+    inline size_t GetMaxBuffered() const { return max_buffered_; }
+
+    /** \return size of the working buffer in bytes */
+    static constexpr size_t GetBufferSize() { return kBufferBytes; }
+
   private:
+    enum class Encoding
+    {
+        PCM16,
+        PCM24,
+        PCM32,
+        FLOAT32,
+    };
+
+    static constexpr size_t kBufferBytes = transfer_size * num_buffers;
+    static constexpr size_t kSectorSize  = 512;
+
+    /** Writes the header at the current position. When padded to a sector,
+     ** a JUNK chunk fills the space between "fmt " and "data". */
+    bool WriteHeader()
+    {
+        if(header_size_ == sizeof(wavheader_))
+            return file_.Write(&wavheader_, sizeof(wavheader_))
+                   == sizeof(wavheader_);
+        const size_t fmt_end = offsetof(WAV_FormatTypeDef, SubChunk2ID);
+        uint32_t     junk[2] = {kWavFileJunkId, kSectorSize - fmt_end - 16};
+        memset(sector_, 0, sizeof(sector_));
+        memcpy(sector_, &wavheader_, fmt_end);
+        memcpy(&sector_[fmt_end], junk, sizeof(junk));
+        memcpy(&sector_[kSectorSize - 8], &wavheader_.SubChunk2ID, 8);
+        return file_.Write(sector_, kSectorSize) == kSectorSize;
+    }
+
+    /** Appends whole frames, from either separate channels or interleaved
+     ** samples. Frames that don't fit are dropped. */
+    void Push(const float *const *in, const float *interleaved, size_t frames)
+    {
+        if(!recording_)
+            return;
+        size_t used = written_ - flushed_;
+        size_t fit  = (kBufferBytes - used) / frame_bytes_;
+        if(frames > fit)
+        {
+            overruns_++;
+            dropped_frames_ += frames - fit;
+            frames = fit;
+        }
+        size_t done = 0;
+        while(done < frames)
+        {
+            size_t contiguous = (kBufferBytes - wptr_) / frame_bytes_;
+            if(contiguous == 0)
+            {
+                // A frame wrapping around the end of the buffer
+                PushWrappedFrame(in, interleaved, done);
+                done++;
+                continue;
+            }
+            size_t n = frames - done < contiguous ? frames - done : contiguous;
+            for(int32_t c = 0; c < cfg_.channels; c++)
+            {
+                const float *src
+                    = in ? in[c] + done
+                         : interleaved + done * cfg_.channels + c;
+                size_t stride = in ? 1 : cfg_.channels;
+                Convert(src, stride, n, &buff_[wptr_ + c * sample_bytes_]);
+            }
+            wptr_ += n * frame_bytes_;
+            if(wptr_ == kBufferBytes)
+                wptr_ = 0;
+            done += n;
+        }
+        // Publish the frames to Write() only once they are in the buffer
+        written_ += frames * frame_bytes_;
+        used += frames * frame_bytes_;
+        if(used > max_buffered_)
+            max_buffered_ = used;
+    }
+
+    void PushWrappedFrame(const float *const *in,
+                          const float        *interleaved,
+                          size_t              frame)
+    {
+        for(int32_t c = 0; c < cfg_.channels; c++)
+        {
+            uint8_t      tmp[4];
+            const float *src = in ? in[c] + frame
+                                  : interleaved + frame * cfg_.channels + c;
+            Convert(src, 1, 1, tmp);
+            for(size_t i = 0; i < sample_bytes_; i++)
+            {
+                buff_[wptr_++] = tmp[i];
+                if(wptr_ == kBufferBytes)
+                    wptr_ = 0;
+            }
+        }
+    }
+
+    /** Converts the samples of one channel. The format is chosen once per
+     ** block, so the inner loops are free of branches. The stride is kept
+     ** in a local: stores through dst could alias frame_bytes_, which would
+     ** otherwise be loaded again for every sample. */
+    void Convert(const float *src, size_t stride, size_t frames, uint8_t *dst)
+    {
+        const size_t step = frame_bytes_;
+        switch(encoding_)
+        {
+            case Encoding::PCM16:
+                for(size_t i = 0; i < frames; i++, dst += step)
+                {
+                    int16_t s = f2s16(src[i * stride]);
+                    memcpy(dst, &s, 2);
+                }
+                break;
+            case Encoding::PCM24:
+                for(size_t i = 0; i < frames; i++, dst += step)
+                {
+                    int32_t s = f2s24(src[i * stride]);
+                    dst[0]    = s;
+                    dst[1]    = s >> 8;
+                    dst[2]    = s >> 16;
+                }
+                break;
+            case Encoding::PCM32:
+                for(size_t i = 0; i < frames; i++, dst += step)
+                {
+                    int32_t s = f2s32(src[i * stride]);
+                    memcpy(dst, &s, 4);
+                }
+                break;
+            case Encoding::FLOAT32:
+                for(size_t i = 0; i < frames; i++, dst += step)
+                    memcpy(dst, &src[i * stride], 4);
+                break;
+        }
+    }
+
+    /** Writes the next size bytes of the buffer, at most up to the end of a block */
+    bool WriteBlock(size_t size)
+    {
+        bool ok = file_.Write(&buff_[rptr_], size) == size;
+        if(!ok)
+            write_errors_++;
+        rptr_ += size;
+        if(rptr_ == kBufferBytes)
+            rptr_ = 0;
+        flushed_ += size;
+        return ok;
+    }
+
     /** Calculate the file size based on current recording */
     inline uint32_t CalcFileSize()
     {
-        wavheader_.SubCHunk2Size
-            = num_samps_ * cfg_.channels * cfg_.bitspersample / 8;
-        return 36 + wavheader_.SubCHunk2Size;
+        wavheader_.SubCHunk2Size = num_samps_ * frame_bytes_;
+        return header_size_ - 8 + wavheader_.SubCHunk2Size;
     }
 
     /** Compute the byte rate given the user settings. */
     inline uint32_t CalcByteRate()
     {
-        return cfg_.samplerate * cfg_.channels * cfg_.bitspersample / 8;
+        return cfg_.samplerate * frame_bytes_;
     }
 
-    static constexpr int kTransferSamps = transfer_size / sizeof(int32_t);
-
     WAV_FormatTypeDef wavheader_;
-    uint32_t          num_samps_, wptr_;
+    uint32_t          num_samps_;
     Config            cfg_;
-    int32_t           transfer_buff[kTransferSamps * 2];
-    BufferState       bstate_;
-    bool              recording_;
-    FIL               fp_;
+    Encoding          encoding_;
+    size_t            sample_bytes_, frame_bytes_, header_size_;
+    // Written by the audio callback
+    size_t            wptr_;
+    volatile uint32_t written_;
+    size_t            max_buffered_;
+    uint32_t          overruns_, dropped_frames_;
+    // Written by the main loop
+    size_t            rptr_;
+    volatile uint32_t flushed_;
+    uint32_t          write_errors_;
+    volatile bool     recording_;
+    FileWriter        file_;
+    // 32 byte aligned for DMA and cache maintenance
+    uint8_t buff_[kBufferBytes] __attribute__((aligned(32)));
+    // The padded header, written straight to the card like the blocks
+    uint8_t sector_[kSectorSize] __attribute__((aligned(32)));
 };
 
+/** @} */
 } // namespace daisy
+
+#endif
@@ -1,75 +1,104 @@
+#include <string.h>
 #include "WaveTableLoader.h"
-#include "daisy_core.h"
+#include "util/WaveTableMipmap.h"
+#include "sys/system.h"
 namespace daisy
 {
+/** Largest frame of a file that can be loaded (16 channels of 32 bits) */
+static constexpr size_t kMaxBlockAlign = 64;
+
 void WaveTableLoader::Init(float *mem, size_t mem_size)
 {
     buf_             = mem;
     buf_size_        = mem_size;
     samps_per_table_ = 256;
     num_tables_      = 1;
+    num_levels_      = 1;
+    memset(&stats_, 0, sizeof(stats_));
 }
 
-WaveTableLoader::Result WaveTableLoader::SetWaveTableInfo(size_t samps,
-                                                          size_t count)
+WaveTableLoader::Result
+WaveTableLoader::SetWaveTableInfo(size_t samps, size_t count, size_t levels)
 {
-    if(samps * count > buf_size_)
+    if(levels == 0 || levels > 16)
+        return Result::ERR_TABLE_INFO_OVERFLOW;
+    size_t top = samps >> (levels - 1);
+    if((top << (levels - 1)) != samps || (levels > 1 && top < 2)
+       || WaveTableMipmap::GetBankSize(samps, count, levels) > buf_size_)
         return Result::ERR_TABLE_INFO_OVERFLOW;
     samps_per_table_ = samps;
     num_tables_      = count;
+    num_levels_      = levels;
     return Result::OK;
 }
 
 WaveTableLoader::Result WaveTableLoader::Import(const char *filename)
 {
-    if(f_open(&fp_, filename, FA_READ | FA_OPEN_EXISTING) == FR_OK)
+    memset(&stats_, 0, sizeof(stats_));
+    if(!reader_.Open(filename))
+        return Result::ERR_FILE_READ;
+    if(!format_.Parse(reader_, kMaxBlockAlign))
     {
-        // First Grab the Wave header info
-        unsigned int br;
-        f_read(&fp_, &header_, sizeof(header_), &br);
-        uint32_t wptr = 0;
-        do
-        {
-            f_read(&fp_, workspace, kWorkspaceSize * sizeof(workspace[0]), &br);
-            // Fill mem
-            switch(header_.BitPerSample)
-            {
-                case 16:
-                {
-                    int16_t *wsp;
-                    wsp = (int16_t *)workspace;
-                    for(size_t i = 0; i < kWorkspaceSize * 2; i++)
-                    {
-                        buf_[wptr] = s162f(wsp[i]);
-                        wptr++;
-                    }
-                }
-                break;
-                case 32:
-                {
-                    float *wsp;
-                    wsp = (float *)workspace;
-                    for(size_t i = 0; i < kWorkspaceSize; i++)
-                    {
-                        buf_[wptr] = wsp[i];
-                    }
-                }
-                break;
-                default: break;
-            }
-        } while(!f_eof(&fp_) || wptr <= buf_size_ - 1);
-        f_close(&fp_);
+        reader_.Close();
+        return Result::ERR_FILE_FORMAT;
     }
-    else
-    {
+    size_t capacity = num_levels_ > 1 ? samps_per_table_ * num_tables_
+                                      : buf_size_;
+    size_t samples = (format_.data_end - format_.data_start)
+                     / (format_.block_align / format_.channels);
+    if(samples > capacity)
+        samples = capacity;
+    bool ok = LoadSamples(samples);
+    reader_.Close();
+    if(!ok)
         return Result::ERR_FILE_READ;
+
+    if(num_levels_ > 1)
+    {
+        memset(&buf_[samples], 0, (capacity - samples) * sizeof(float));
+        uint32_t        start = System::GetUs();
+        WaveTableMipmap mipmap;
+        mipmap.Build(buf_, samps_per_table_, num_tables_, num_levels_);
+        stats_.mipmap_us = System::GetUs() - start;
     }
     return Result::OK;
 }
 
+bool WaveTableLoader::LoadSamples(size_t samples)
+{
+    // Reading the data to the back of the space the floats take lets the
+    // conversion run forward in place. The bulk is a multiple of 4 samples,
+    // which keeps the read 4 byte aligned for the DMA.
+    const size_t b    = format_.block_align / format_.channels;
+    const size_t bulk = samples - samples % 4;
+    uint8_t *    back = reinterpret_cast<uint8_t *>(buf_);
+    uint8_t      tail[3 * 4];
+    size_t       tail_bytes = (samples - bulk) * b;
+    back += (sizeof(float) - b) * bulk;
+
+    uint32_t start = System::GetUs();
+    size_t   got   = reader_.Read(back, bulk * b);
+    if(got == bulk * b && tail_bytes > 0)
+        got += reader_.Read(tail, tail_bytes);
+    uint32_t read_end = System::GetUs();
+    stats_.bytes      = got;
+    stats_.read_us    = read_end - start;
+    if(got != bulk * b + tail_bytes)
+        return false;
+
+    format_.ToFloat(back, bulk, buf_);
+    format_.ToFloat(tail, samples - bulk, &buf_[bulk]);
+    stats_.convert_us = System::GetUs() - read_end;
+    return true;
+}
+
 /** Returns pointer to specific table start or nullptr if invalid idx */
-float *WaveTableLoader::GetTable(size_t idx)
+float *WaveTableLoader::GetTable(size_t idx, size_t level)
 {
-    return idx < num_tables_ ? &buf_[idx * samps_per_table_] : nullptr;
+    if(idx >= num_tables_ || level >= num_levels_)
+        return nullptr;
+    size_t offset
+        = WaveTableMipmap::GetOffset(samps_per_table_, num_tables_, level);
+    return &buf_[offset + idx * (samps_per_table_ >> level)];
 }
 } // namespace daisy
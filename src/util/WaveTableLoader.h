@@ -1,14 +1,20 @@
 #pragma once
-#include "fatfs.h"
-#include "util/wav_format.h"
+#include "util/FatFileReader.h"
+#include "util/WavStreamer.h"
 namespace daisy
 {
-/** Loads a bank of wavetables into memory. 
- ** Pointers to the start of each waveform will be provided, 
+/** Loads a bank of wavetables into memory.
+ ** Pointers to the start of each waveform will be provided,
  ** but the user can do whatever they want with the data once
- ** it's imported. 
+ ** it's imported.
  **
- ** A internal 4kB workspace is used for reading from the file, and conveting to the correct memory location. 
+ ** The sample data is read from the file straight into the user-provided
+ ** buffer with large multi-sector reads, and converted to float in place.
+ ** The buffer should be in memory the SD Card DMA can reach (e.g. SDRAM).
+ **
+ ** Optionally, band-limited versions of each table are built an octave
+ ** apart at load time (see WaveTableMipmap), so oscillators can read
+ ** alias-free tables without computing anything at runtime.
  ** */
 class WaveTableLoader
 {
@@ -19,39 +25,86 @@ class WaveTableLoader
         ERR_TABLE_INFO_OVERFLOW,
         ERR_FILE_READ,
         ERR_GENERIC,
+        ERR_FILE_FORMAT,
+    };
+
+    /** Time taken by the last Import() */
+    struct LoadStats
+    {
+        uint32_t bytes;      /**< Sample data read from the file */
+        uint32_t read_us;    /**< Time spent reading the sample data */
+        uint32_t convert_us; /**< Time spent converting to float */
+        uint32_t mipmap_us;  /**< Time spent building the mipmap levels */
+
+        /** \return read throughput in bytes per second */
+        float GetReadBytesPerSecond() const
+        {
+            return read_us > 0 ? bytes * 1e6f / read_us : 0.f;
+        }
     };
+
     WaveTableLoader() {}
     ~WaveTableLoader() {}
 
     /** Initializes the Loader */
     void Init(float *mem, size_t mem_size);
 
-    /** Sets the size of the tables to allow access to the specific waveforms */
-    Result SetWaveTableInfo(size_t samps, size_t count);
+    /** Sets the size of the tables to allow access to the specific waveforms
+     ** \param samps length of a table
+     ** \param count number of tables
+     ** \param levels number of band-limited levels to build, including the
+     ** tables as they are in the file. Level n is samps / 2^n long, so samps
+     ** has to be divisible by 2^(levels - 1). All levels together take
+     ** twice the memory of the tables at most.
+     */
+    Result SetWaveTableInfo(size_t samps, size_t count, size_t levels = 1);
 
-    /** Opens and loads the file 
+    /** Opens and loads the file
      ** The data will be converted from its original type to float
-     ** And the wavheader data will be stored internally to the class, 
+     ** And the format of the file will be stored internally to the class,
      ** but will not be stored in the user-provided buffer.
      **
-     ** Currently only 16-bit and 32-bit data is supported.
-     ** The importer also assumes data is mono so stereo data will be loaded as-is 
+     ** 16, 24 and 32-bit integer and 32-bit float data is supported.
+     ** The importer also assumes data is mono so stereo data will be loaded as-is
      ** (i.e. interleaved)
+     **
+     ** With a single level, as much of the file as fits the buffer is
+     ** loaded. With mipmap levels, samps * count samples are loaded, and
+     ** missing data is filled with silence.
      ** */
     Result Import(const char *filename);
 
-    /** Returns pointer to specific table start or nullptr if invalid idx */
-    float *GetTable(size_t idx);
+    /** Returns pointer to specific table start or nullptr if invalid idx
+     ** \param idx table
+     ** \param level band-limited level, 0 for the table as in the file
+     */
+    float *GetTable(size_t idx, size_t level = 0);
+
+    /** \return length of the tables at a level */
+    size_t GetTableSize(size_t level = 0) const
+    {
+        return samps_per_table_ >> level;
+    }
+
+    /** \return number of levels set with SetWaveTableInfo() */
+    size_t GetNumLevels() const { return num_levels_; }
+
+    /** \return timing of the last Import() */
+    const LoadStats &GetLoadStats() const { return stats_; }
 
   private:
-    static constexpr int kWorkspaceSize = 1024;
-    float *              buf_;
-    size_t               buf_size_;
-    WAV_FormatTypeDef    header_;
-    size_t               samps_per_table_;
-    size_t               num_tables_;
-    int32_t              workspace[kWorkspaceSize];
-    FIL                  fp_;
+    /** Reads samples into the back of the buffer, and converts them to the
+     ** front. The samples before the last few are read with a single read. */
+    bool LoadSamples(size_t samples);
+
+    float *         buf_;
+    size_t          buf_size_;
+    WavStreamFormat format_;
+    size_t          samps_per_table_;
+    size_t          num_tables_;
+    size_t          num_levels_;
+    LoadStats       stats_;
+    FatFileReader   reader_;
 };
 
 } // namespace daisy
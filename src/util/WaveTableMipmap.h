@@ -0,0 +1,134 @@
+#pragma once
+#ifndef DSY_WAVETABLEMIPMAP_H
+#define DSY_WAVETABLEMIPMAP_H
+
+#include <stddef.h>
+#include <math.h>
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/** Builds band-limited versions of single cycle waveforms, an octave apart.
+ **
+ ** Each level is half the length of the one before, and holds half the
+ ** harmonics, so an oscillator can pick the level for its pitch and read it
+ ** without aliasing, and without filtering anything at runtime.
+ ** A level is made from the previous one with a circular low-pass FIR
+ ** (Blackman windowed sinc) and decimation by two, so no FFT is needed.
+ ** Harmonics up to about 80% of the new Nyquist frequency pass flat, and
+ ** the ones that would alias are attenuated by more than 70dB.
+ **
+ ** The levels of a bank of tables are stored level by level: first all
+ ** tables at full length, then all tables at half length, and so on.
+ ** A table of 2048 samples with all its levels takes 4096 samples.
+ ** */
+class WaveTableMipmap
+{
+  public:
+    /** Half the number of taps of the filter, beyond the center tap */
+    static constexpr size_t kHalfTaps = 63;
+
+    /** Designs the filter */
+    WaveTableMipmap()
+    {
+        const float kPi = 3.14159265358979f;
+        const float fc  = 0.22f; // cutoff, relative to the source rate
+        float       sum = 0.f;
+        for(size_t j = 0; j <= kHalfTaps; j++)
+        {
+            float x = kPi * j / (kHalfTaps + 1);
+            float w = 0.42f + 0.5f * cosf(x) + 0.08f * cosf(2.f * x);
+            float s = j == 0 ? 2.f * fc : sinf(2.f * kPi * fc * j) / (kPi * j);
+            h_[j]   = s * w;
+            sum += j == 0 ? h_[j] : 2.f * h_[j];
+        }
+        // Unity gain at DC
+        for(size_t j = 0; j <= kHalfTaps; j++)
+            h_[j] /= sum;
+    }
+    ~WaveTableMipmap() {}
+
+    /** Fills the levels above the first of a bank of tables.
+     ** \param tables bank, with all tables at full length at the start
+     ** \param size length of a table at full length. Has to be divisible by
+     ** 2 to the power of levels - 1.
+     ** \param count number of tables
+     ** \param levels number of levels, including the full length tables
+     */
+    void Build(float *tables, size_t size, size_t count, size_t levels) const
+    {
+        for(size_t level = 1; level < levels; level++)
+        {
+            size_t       src_size = size >> (level - 1);
+            const float *src      = tables + GetOffset(size, count, level - 1);
+            float *      dst      = tables + GetOffset(size, count, level);
+            for(size_t i = 0; i < count; i++)
+            {
+                Downsample(src, src_size, dst);
+                src += src_size;
+                dst += src_size / 2;
+            }
+        }
+    }
+
+    /** Makes the next level of a single table
+     ** \param src table, one cycle of the waveform
+     ** \param size length of the table, even
+     ** \param dst output, size / 2 samples
+     */
+    void Downsample(const float *src, size_t size, float *dst) const
+    {
+        for(size_t n = 0; n < size / 2; n++)
+        {
+            size_t c   = 2 * n;
+            float  acc = h_[0] * src[c];
+            if(c >= kHalfTaps && c + kHalfTaps < size)
+            {
+                for(size_t j = 1; j <= kHalfTaps; j++)
+                    acc += h_[j] * (src[c - j] + src[c + j]);
+            }
+            else
+            {
+                // Near the ends, the table repeats
+                for(size_t j = 1; j <= kHalfTaps; j++)
+                {
+                    size_t k = j % size;
+                    acc += h_[j]
+                           * (src[(c + size - k) % size] + src[(c + k) % size]);
+                }
+            }
+            dst[n] = acc;
+        }
+    }
+
+    /** \return position of the first table of a level in the bank
+     ** \param size length of a table at full length
+     ** \param count number of tables
+     ** \param level 0 for the full length tables
+     */
+    static size_t GetOffset(size_t size, size_t count, size_t level)
+    {
+        return count * (2 * size - 2 * (size >> level));
+    }
+
+    /** \return number of samples a bank takes with all its levels
+     ** \param size length of a table at full length
+     ** \param count number of tables
+     ** \param levels number of levels, including the full length tables
+     */
+    static size_t GetBankSize(size_t size, size_t count, size_t levels)
+    {
+        return GetOffset(size, count, levels);
+    }
+
+  private:
+    float h_[kHalfTaps + 1];
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
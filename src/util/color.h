@@ -11,6 +11,7 @@ TODO:
 #ifndef DSY_COLOR_H
 #define DSY_COLOR_H
 #include <stdint.h>
+#include <stddef.h>
 
 
 namespace daisy
@@ -65,6 +66,182 @@ class Color
     static const float standard_colors[LAST][3];
     float              red_, green_, blue_;
 };
+
+/** 8 bit RGB color packed into a word as 0x00RRGGBB, for animating many
+ ** LEDs without floats.
+ **
+ ** Everything is integer arithmetic. Lerp() and Scale() work on red and
+ ** blue with one multiply, as they sit 16 bits apart in the word, and on
+ ** green with another. Hues are 16 bit, a full turn from 0 to 65536, so
+ ** they wrap around on overflow. The 8 bit channels go straight into the
+ ** gamma table of LedDriverPca9685::SetColor().
+ */
+class PackedColor
+{
+  public:
+    PackedColor() : rgb_(0) {}
+    constexpr explicit PackedColor(uint32_t rgb) : rgb_(rgb & 0xffffff) {}
+    constexpr PackedColor(uint8_t red, uint8_t green, uint8_t blue)
+    : rgb_((uint32_t)red << 16 | (uint32_t)green << 8 | blue)
+    {
+    }
+
+    /** Converts a Color, rounding each 0-1 channel to 8 bits */
+    static PackedColor FromColor(const Color &c)
+    {
+        return PackedColor(
+            ToByte(c.Red()), ToByte(c.Green()), ToByte(c.Blue()));
+    }
+
+    /** Converts from hue, saturation and value
+     ** \param hue 0 to 65535 for a full turn: 0 red, 21845 green,
+     ** 43690 blue
+     ** \param sat saturation, 0 for grey
+     ** \param val value, the brightest of the channels
+     */
+    static PackedColor FromHsv(uint16_t hue, uint8_t sat, uint8_t val)
+    {
+        // 6 sectors of 8 bits, the position in the sector ramps a channel
+        const uint32_t h      = (uint32_t)hue * 6;
+        const uint8_t  sector = h >> 16;
+        const uint8_t  f      = (h >> 8) & 0xff;
+        const uint8_t  p      = Mul8(val, 255 - sat);
+        const uint8_t  q      = Mul8(val, 255 - Mul8(sat, f));
+        const uint8_t  t      = Mul8(val, 255 - Mul8(sat, 255 - f));
+        switch(sector)
+        {
+            case 0: return PackedColor(val, t, p);
+            case 1: return PackedColor(q, val, p);
+            case 2: return PackedColor(p, val, t);
+            case 3: return PackedColor(p, q, val);
+            case 4: return PackedColor(t, p, val);
+            default: return PackedColor(val, p, q);
+        }
+    }
+
+    /** Converts from hue, saturation and lightness, with lightness 255
+     ** white and 128 the full color.
+     */
+    static PackedColor FromHsl(uint16_t hue, uint8_t sat, uint8_t light)
+    {
+        const uint8_t v = light + Mul8(sat, light < 128 ? light : 255 - light);
+        const uint8_t s = v ? (uint32_t)(v - light) * 510 / v : 0;
+        return FromHsv(hue, s, v);
+    }
+
+    /** Looks up a position in a palette that wraps around, blending the
+     ** neighbouring entries.
+     ** \param palette N colors, evenly spread
+     ** \param pos 0 to 65535 for the whole palette, back to the first
+     */
+    template <size_t N>
+    static PackedColor FromPalette(const PackedColor (&palette)[N],
+                                   uint16_t pos)
+    {
+        const uint32_t scaled = (uint32_t)pos * N;
+        const size_t   i      = scaled >> 16;
+        return Lerp(palette[i], palette[(i + 1) % N], (scaled >> 8) & 0xff);
+    }
+
+    /** \return a + (b - a) * t / 255, rounded down */
+    static PackedColor Lerp(PackedColor a, PackedColor b, uint8_t t)
+    {
+        // 0 to 256, so that 255 gives b
+        const uint32_t wb = t + (t >> 7), wa = 256 - wb;
+        const uint32_t rb
+            = (((a.rgb_ & 0xff00ff) * wa + (b.rgb_ & 0xff00ff) * wb) >> 8)
+              & 0xff00ff;
+        const uint32_t g
+            = (((a.rgb_ & 0x00ff00) * wa + (b.rgb_ & 0x00ff00) * wb) >> 8)
+              & 0x00ff00;
+        return PackedColor(rb | g);
+    }
+
+    /** \return the color dimmed by amount / 255, rounded down */
+    PackedColor Scale(uint8_t amount) const
+    {
+        const uint32_t w  = amount + (amount >> 7);
+        const uint32_t rb = ((rgb_ & 0xff00ff) * w >> 8) & 0xff00ff;
+        const uint32_t g  = ((rgb_ & 0x00ff00) * w >> 8) & 0x00ff00;
+        return PackedColor(rb | g);
+    }
+
+    /** \return the product of the channels (multiply blend), rounded */
+    static PackedColor Multiply(PackedColor a, PackedColor b)
+    {
+        return PackedColor(Mul8(a.Red(), b.Red()),
+                           Mul8(a.Green(), b.Green()),
+                           Mul8(a.Blue(), b.Blue()));
+    }
+
+    /** Fills LEDs with one color */
+    static void Fill(PackedColor *leds, size_t size, PackedColor c)
+    {
+        for(size_t i = 0; i < size; i++)
+            leds[i] = c;
+    }
+
+    /** Fills LEDs with a rainbow, stepping the hue from one to the next */
+    static void FillRainbow(PackedColor *leds,
+                            size_t       size,
+                            uint16_t     hue,
+                            uint16_t     step,
+                            uint8_t      sat,
+                            uint8_t      val)
+    {
+        for(size_t i = 0; i < size; i++, hue += step)
+            leds[i] = FromHsv(hue, sat, val);
+    }
+
+    /** Blends two arrays of LEDs into out, which can be one of them */
+    static void Lerp(const PackedColor *a,
+                     const PackedColor *b,
+                     PackedColor *      out,
+                     size_t             size,
+                     uint8_t            t)
+    {
+        for(size_t i = 0; i < size; i++)
+            out[i] = Lerp(a[i], b[i], t);
+    }
+
+    /** Dims LEDs in place, e.g. for a global brightness or a fade out */
+    static void Scale(PackedColor *leds, size_t size, uint8_t amount)
+    {
+        for(size_t i = 0; i < size; i++)
+            leds[i] = leds[i].Scale(amount);
+    }
+
+    inline uint8_t  Red() const { return rgb_ >> 16; }
+    inline uint8_t  Green() const { return rgb_ >> 8; }
+    inline uint8_t  Blue() const { return rgb_; }
+    inline uint32_t Packed() const { return rgb_; }
+
+    /** \return the same color as floats */
+    Color ToColor() const
+    {
+        Color c;
+        c.Init(Red() / 255.f, Green() / 255.f, Blue() / 255.f);
+        return c;
+    }
+
+    bool operator==(PackedColor other) const { return rgb_ == other.rgb_; }
+    bool operator!=(PackedColor other) const { return rgb_ != other.rgb_; }
+
+    /** \return a * b / 255, rounded */
+    static uint8_t Mul8(uint8_t a, uint8_t b)
+    {
+        const uint32_t x = (uint32_t)a * b + 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+  private:
+    static uint8_t ToByte(float x)
+    {
+        return x <= 0.f ? 0 : x >= 1.f ? 255 : (uint8_t)(x * 255.f + 0.5f);
+    }
+
+    uint32_t rgb_;
+};
 /** @} */
 } // namespace daisy
 
@@ -0,0 +1,226 @@
+#include <string.h>
+#include "util/sd_cache.h"
+
+/* Sector cache for the disk I/O layer, see dsy_sd_cache_init().
+ * The card is reached through dsy_sd_cache_read_card(), so this file
+ * doesn't depend on the HAL, and is tested on the host. */
+
+#define SECTOR_SIZE 512
+#define CACHE_EMPTY 0xFFFFFFFF
+
+typedef struct
+{
+    uint32_t line;     /* sector / line_sectors, or CACHE_EMPTY */
+    uint32_t last_use; /* 0 for empty lines */
+} CacheTag;
+
+static struct
+{
+    uint8_t *          data;
+    CacheTag *         tags;
+    uint32_t           num_lines;
+    uint32_t           line_sectors;
+    uint32_t           readahead_lines;
+    uint32_t           clock;
+    uint32_t           last_fill;    /* last line read by a miss */
+    uint32_t           card_sectors; /* 0 until looked up */
+    dsy_sd_cache_stats stats;
+} Cache;
+
+uint32_t dsy_sd_cache_init(void *   memory,
+                           uint32_t size,
+                           uint32_t line_sectors,
+                           uint32_t readahead_lines)
+{
+    /* 32 byte aligned lines for the cache maintenance around the DMA */
+    uintptr_t start = ((uintptr_t)memory + 31) & ~(uintptr_t)0x1F;
+    uint32_t  skip  = start - (uintptr_t)memory;
+    uint32_t  line_bytes;
+
+    Cache.num_lines = 0;
+    if(line_sectors == 0 || (line_sectors & (line_sectors - 1)) != 0
+       || size <= skip)
+        return 0;
+    line_bytes            = line_sectors * SECTOR_SIZE;
+    Cache.data            = (uint8_t *)start;
+    Cache.line_sectors    = line_sectors;
+    Cache.readahead_lines = readahead_lines > 0 ? readahead_lines : 1;
+    Cache.num_lines       = (size - skip) / (line_bytes + sizeof(CacheTag));
+    Cache.tags = (CacheTag *)(Cache.data + Cache.num_lines * line_bytes);
+    if(Cache.readahead_lines > Cache.num_lines)
+        Cache.readahead_lines = Cache.num_lines;
+    dsy_sd_cache_invalidate();
+    dsy_sd_cache_reset_stats();
+    return Cache.num_lines;
+}
+
+void dsy_sd_cache_disable(void)
+{
+    Cache.num_lines = 0;
+}
+
+void dsy_sd_cache_invalidate(void)
+{
+    for(uint32_t i = 0; i < Cache.num_lines; i++)
+    {
+        Cache.tags[i].line     = CACHE_EMPTY;
+        Cache.tags[i].last_use = 0;
+    }
+    Cache.clock        = 0;
+    Cache.last_fill    = CACHE_EMPTY;
+    Cache.card_sectors = 0;
+}
+
+void dsy_sd_cache_get_stats(dsy_sd_cache_stats *stats)
+{
+    *stats = Cache.stats;
+}
+
+void dsy_sd_cache_reset_stats(void)
+{
+    memset(&Cache.stats, 0, sizeof(Cache.stats));
+}
+
+/** \return slot holding the line, or -1 */
+static int32_t FindLine(uint32_t line)
+{
+    for(uint32_t i = 0; i < Cache.num_lines; i++)
+    {
+        if(Cache.tags[i].line == line)
+            return i;
+    }
+    return -1;
+}
+
+/** Reads the line, and following lines if the misses are sequential,
+ ** with a single transfer into adjacent slots.
+ ** \return slot holding the line, or -1 on errors */
+static int32_t FillLine(uint32_t line)
+{
+    uint32_t n = 1, slot = 0, oldest = 0xFFFFFFFF;
+
+    if(Cache.card_sectors == 0)
+        Cache.card_sectors = dsy_sd_cache_card_sectors();
+    if((uint64_t)(line + 1) * Cache.line_sectors > Cache.card_sectors)
+        return -1;
+    if(Cache.last_fill != CACHE_EMPTY && line == Cache.last_fill + 1)
+    {
+        /* Read ahead up to the end of the card or the next cached line */
+        while(n < Cache.readahead_lines
+              && (uint64_t)(line + n + 1) * Cache.line_sectors
+                     <= Cache.card_sectors
+              && FindLine(line + n) < 0)
+            n++;
+    }
+
+    /* Least recently used run of n slots */
+    for(uint32_t i = 0; i + n <= Cache.num_lines; i++)
+    {
+        uint32_t newest = 0;
+        for(uint32_t k = i; k < i + n; k++)
+        {
+            if(Cache.tags[k].last_use > newest)
+                newest = Cache.tags[k].last_use;
+        }
+        if(newest < oldest)
+        {
+            oldest = newest;
+            slot   = i;
+        }
+    }
+
+    for(uint32_t k = slot; k < slot + n; k++)
+        Cache.tags[k].line = CACHE_EMPTY;
+    if(dsy_sd_cache_read_card(
+           Cache.data + slot * Cache.line_sectors * SECTOR_SIZE,
+           line * Cache.line_sectors,
+           n * Cache.line_sectors)
+       != 0)
+        return -1;
+    Cache.clock++;
+    for(uint32_t k = 0; k < n; k++)
+    {
+        Cache.tags[slot + k].line     = line + k;
+        Cache.tags[slot + k].last_use = Cache.clock;
+    }
+    Cache.last_fill = line + n - 1;
+    Cache.stats.readahead += (n - 1) * Cache.line_sectors;
+    return slot;
+}
+
+int dsy_sd_cache_read(uint8_t *buff, uint32_t sector, uint32_t count)
+{
+    /* Large reads (e.g. streaming audio) go directly to the buffer */
+    if(Cache.num_lines == 0 || count >= Cache.line_sectors)
+    {
+        Cache.stats.direct += count;
+        return dsy_sd_cache_read_card(buff, sector, count);
+    }
+    while(count > 0)
+    {
+        uint32_t line   = sector / Cache.line_sectors;
+        uint32_t offset = sector % Cache.line_sectors;
+        uint32_t n      = Cache.line_sectors - offset;
+        int32_t  slot   = FindLine(line);
+
+        if(n > count)
+            n = count;
+        if(slot >= 0)
+        {
+            Cache.stats.hits += n;
+        }
+        else if((slot = FillLine(line)) >= 0)
+        {
+            Cache.stats.misses += n;
+        }
+        else
+        {
+            /* e.g. the last sectors of the card */
+            Cache.stats.direct += n;
+            if(dsy_sd_cache_read_card(buff, sector, n) != 0)
+                return -1;
+        }
+        if(slot >= 0)
+        {
+            Cache.tags[slot].last_use = ++Cache.clock;
+            memcpy(buff,
+                   Cache.data
+                       + (slot * Cache.line_sectors + offset) * SECTOR_SIZE,
+                   n * SECTOR_SIZE);
+        }
+        buff += n * SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+    return 0;
+}
+
+void dsy_sd_cache_write(const uint8_t *buff, uint32_t sector, uint32_t count)
+{
+    for(uint32_t i = 0; i < Cache.num_lines; i++)
+    {
+        uint32_t first, last, line_start;
+        if(Cache.tags[i].line == CACHE_EMPTY)
+            continue;
+        line_start = Cache.tags[i].line * Cache.line_sectors;
+        first      = line_start;
+        last       = line_start + Cache.line_sectors;
+        if(first < sector)
+            first = sector;
+        if(last > sector + count)
+            last = sector + count;
+        if(first >= last)
+            continue;
+        if(buff == NULL)
+        {
+            Cache.tags[i].line     = CACHE_EMPTY;
+            Cache.tags[i].last_use = 0;
+            continue;
+        }
+        memcpy(Cache.data
+                   + (i * Cache.line_sectors + first - line_start)
+                         * SECTOR_SIZE,
+               buff + (first - sector) * SECTOR_SIZE,
+               (last - first) * SECTOR_SIZE);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef DSY_SD_CACHE_H
+#define DSY_SD_CACHE_H
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /** Statistics of the sector cache, in sectors */
+    typedef struct
+    {
+        uint32_t hits;      /**< read from the cache */
+        uint32_t misses;    /**< read from the card, along with their line */
+        uint32_t readahead; /**< read ahead for sequential misses */
+        uint32_t direct;    /**< read from the card without the cache */
+    } dsy_sd_cache_stats;
+
+    /** Enables a read cache beneath FatFs for small reads, like directory
+    scans, FAT lookups and file headers, which otherwise each pay the full
+    command latency of the SD Card.
+
+    A miss reads the whole line of sectors around it with one transfer. When
+    misses are sequential, up to readahead_lines lines are read at once.
+    Lines are replaced least recently used first. Reads of a line or more
+    (e.g. streaming audio with f_read) bypass the cache. Writes go to the
+    card and update cached lines.
+
+    \param memory for the lines and their tags, e.g. in SDRAM. Has to be
+    reachable by the SDMMC DMA, so not DTCM.
+    \param size of memory in bytes
+    \param line_sectors sectors per line, a power of 2, e.g. 8 (4kB)
+    \param readahead_lines most lines to read at once, e.g. 4
+    \return number of lines, 0 if the cache couldn't be enabled
+    */
+    uint32_t dsy_sd_cache_init(void *   memory,
+                               uint32_t size,
+                               uint32_t line_sectors,
+                               uint32_t readahead_lines);
+
+    /** Stops using the cache, e.g. before reusing its memory */
+    void dsy_sd_cache_disable(void);
+
+    /** Drops all cached lines, e.g. after writing to the card without
+    FatFs. The size of the card is looked up again, so this is also done
+    when a card is initialized. */
+    void dsy_sd_cache_invalidate(void);
+
+    /** \param stats is filled with the statistics since the last reset */
+    void dsy_sd_cache_get_stats(dsy_sd_cache_stats *stats);
+
+    /** Sets the statistics to 0 */
+    void dsy_sd_cache_reset_stats(void);
+
+    /** Reads sectors through the cache. Used by the disk I/O layer.
+    \return 0 on success */
+    int dsy_sd_cache_read(uint8_t *buff, uint32_t sector, uint32_t count);
+
+    /** Keeps the cached lines in sync after a write. Used by the disk I/O
+    layer.
+    \param buff written data, or NULL to drop the lines after a failed write
+    */
+    void
+    dsy_sd_cache_write(const uint8_t *buff, uint32_t sector, uint32_t count);
+
+    /** Reads sectors from the card, bypassing the cache. Provided by the
+    disk I/O layer (sd_diskio.c).
+    \return 0 on success */
+    int dsy_sd_cache_read_card(uint8_t *buff, uint32_t sector, uint32_t count);
+
+    /** \return number of sectors on the card. Provided by the disk I/O
+    layer (sd_diskio.c). */
+    uint32_t dsy_sd_cache_card_sectors(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
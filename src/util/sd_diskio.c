@@ -59,8 +59,10 @@ static volatile DSTATUS Stat = STA_NOINIT;
 //static volatile  UINT  WriteStatus = 0, ReadStatus = 0;
 static uint32_t WriteStatus = 0;
 static uint32_t ReadStatus  = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun);
+static DRESULT SD_ReadBlocks(BYTE *buff, DWORD sector, UINT count);
 DSTATUS        SD_initialize(BYTE);
 DSTATUS        SD_status(BYTE);
 DRESULT        SD_read(BYTE, BYTE *, DWORD, UINT);
@@ -104,6 +106,8 @@ static DSTATUS SD_CheckStatus(BYTE lun)
   */
 DSTATUS SD_initialize(BYTE lun)
 {
+    /* The card may have changed */
+    dsy_sd_cache_invalidate();
 #if !defined(DISABLE_SD_INIT)
 
     if(BSP_SD_Init() == MSD_OK)
@@ -136,6 +140,11 @@ DSTATUS SD_status(BYTE lun)
   * @retval DRESULT: Operation result
   */
 DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+    return dsy_sd_cache_read(buff, sector, count) == 0 ? RES_OK : RES_ERROR;
+}
+
+static DRESULT SD_ReadBlocks(BYTE *buff, DWORD sector, UINT count)
 {
     DRESULT res = RES_ERROR;
     HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, 1);
@@ -246,6 +255,7 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
             }
         }
     }
+    dsy_sd_cache_write(res == RES_OK ? buff : NULL, sector, count);
 
     return res;
 }
@@ -326,4 +336,18 @@ void BSP_SD_ReadCpltCallback(void)
 
 // Interrupts -- Not sure these belong here or elsewhere yet.
 
+/* Sector cache, see util/sd_cache.c ----------------------------------------*/
+
+int dsy_sd_cache_read_card(uint8_t *buff, uint32_t sector, uint32_t count)
+{
+    return SD_ReadBlocks(buff, sector, count) == RES_OK ? 0 : -1;
+}
+
+uint32_t dsy_sd_cache_card_sectors(void)
+{
+    BSP_SD_CardInfo info;
+    BSP_SD_GetCardInfo(&info);
+    return info.LogBlockNbr;
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -7,6 +7,7 @@ extern "C"
 #endif
 
 #include "util/bsp_sd_diskio.h"
+#include "util/sd_cache.h"
 
     extern const Diskio_drvTypeDef SD_Driver; /**< & */
 
@@ -16,6 +16,7 @@ const uint32_t kWavFileChunkId     = 0x46464952; /**< "RIFF" */
 const uint32_t kWavFileWaveId      = 0x45564157; /**< "WAVE" */
 const uint32_t kWavFileSubChunk1Id = 0x20746d66; /**< "fmt " */
 const uint32_t kWavFileSubChunk2Id = 0x61746164; /**< "data" */
+const uint32_t kWavFileJunkId      = 0x4b4e554a; /**< "JUNK" */
 
 /** Standard Format codes for the waveform data.
  ** 
@@ -31,10 +32,15 @@ enum WavFileFormatCode
     WAVE_FORMAT_IEEE_FLOAT = 0x0003,
     WAVE_FORMAT_ALAW       = 0x0006,
     WAVE_FORMAT_ULAW       = 0x0007,
+    WAVE_FORMAT_IMA_ADPCM  = 0x0011,
     WAVE_FORMAT_EXTENSIBLE = 0xFFFE,
 };
 
-/** Helper struct for handling the WAV file format */
+/** Helper struct for handling the WAV file format
+ ** This is the canonical 44 byte header, with "fmt " directly followed by
+ ** "data", as written by WavWriter. Files from elsewhere often have other
+ ** chunks in between; read those with WavHeader.
+ ** */
 typedef struct
 {
     uint32_t ChunkId;       /**< & */
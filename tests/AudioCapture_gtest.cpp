@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/AudioCapture.h"
+#include "util/WavHeader.h"
+#include "MemoryFileSystem.h"
+#include "AudioTestSignals.h"
+
+using namespace daisy;
+
+namespace
+{
+using Capture = AudioCapture<MemoryFileWriter>;
+
+uint32_t VirtualUs()
+{
+    return static_cast<uint32_t>(SdCardModel::Active()->now_us);
+}
+} // namespace
+
+TEST(util_AudioCapture, a_multipleFiles)
+{
+    // 6 channels into 3 stereo files of 16 bit audio
+    MemoryFileSystem::Clear();
+    std::vector<uint8_t> ring(256 * 1024);
+    Capture              capture;
+    Capture::Config      cfg;
+    cfg.num_files         = 3;
+    cfg.channels_per_file = 2;
+    cfg.bitspersample     = 16;
+    cfg.chunk_size        = 4096;
+    ASSERT_EQ(capture.Init(cfg, ring.data(), ring.size()), Capture::Result::OK);
+    EXPECT_EQ(capture.GetRingSize() % 4096, 0u);
+    EXPECT_LE(capture.GetRingSize() * 3, ring.size());
+
+    const char* paths[] = {"a.wav", "b.wav", "c.wav"};
+    ASSERT_EQ(capture.Start(paths), Capture::Result::OK);
+    // The headers are written from the first sector of the ring
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(ring.data());
+    const uintptr_t skew = (32 - addr % 32) % 32;
+    EXPECT_EQ(memcmp(ring.data() + skew, "RIFF", 4), 0);
+    const size_t frames = 10000;
+    auto         input  = MakeChannels(6, frames);
+    for(size_t pos = 0; pos < frames; pos += kBlockSize)
+    {
+        const float* in[6];
+        for(size_t c = 0; c < 6; c++)
+            in[c] = &input[c][pos];
+        capture.Capture(in, std::min(kBlockSize, frames - pos));
+        // Only whole chunks are written until Stop()
+        EXPECT_EQ(capture.Process(), Capture::Result::OK);
+        EXPECT_LT(capture.GetFill(), 4096u);
+    }
+    EXPECT_EQ(capture.Stop(), Capture::Result::OK);
+    EXPECT_EQ(capture.GetLengthFrames(), frames);
+    EXPECT_EQ(capture.GetOverruns(), 0u);
+
+    for(size_t f = 0; f < 3; f++)
+    {
+        const auto&      file = MemoryFileSystem::Files()[paths[f]];
+        MemoryFileReader reader;
+        WavHeader        header;
+        ASSERT_TRUE(reader.Open(paths[f]));
+        ASSERT_TRUE(header.Parse(reader));
+        EXPECT_EQ(header.channels, 2);
+        EXPECT_EQ(header.bits_per_sample, 16);
+        EXPECT_EQ(header.data_start, 512u);
+        EXPECT_EQ(header.data_size, frames * 4);
+        ASSERT_EQ(file.size(), 512 + frames * 4);
+        for(size_t i = 0; i < frames; i++)
+        {
+            for(size_t c = 0; c < 2; c++)
+            {
+                int16_t s;
+                std::memcpy(&s, &file[512 + i * 4 + c * 2], 2);
+                ASSERT_EQ(s, f2s16(input[f * 2 + c][i])) << f << " " << i;
+            }
+        }
+    }
+}
+
+TEST(util_AudioCapture, b_stalls)
+{
+    // 8 channels of 24 bit audio into one file, with the SD Card stalling
+    // for up to 1.5 seconds. 4MB hold 3.6 seconds.
+    MemoryFileSystem::Clear();
+    std::vector<uint8_t> ring(4 * 1024 * 1024);
+    Capture              capture;
+    Capture::Config      cfg;
+    cfg.channels_per_file = 8;
+    cfg.preallocate       = 11.f;
+    cfg.get_us            = VirtualUs;
+    ASSERT_EQ(capture.Init(cfg, ring.data(), ring.size()), Capture::Result::OK);
+    EXPECT_GT(capture.GetRingSeconds(), 3.5f);
+
+    SdCardModel sd;
+    sd.stall_chance = 0.02;
+    sd.max_stall_us = 1500000.;
+    auto         input = MakeChannels(8, kBlockSize);
+    const float* in[8];
+    for(size_t c = 0; c < 8; c++)
+        in[c] = input[c].data();
+    uint32_t blocks   = 0;
+    sd.audio_callback = [&]() {
+        if(capture.IsCapturing())
+        {
+            capture.Capture(in, kBlockSize);
+            blocks++;
+        }
+    };
+    SdCardModel::Active() = &sd;
+
+    const char* path = "rec.wav";
+    ASSERT_EQ(capture.Start(&path), Capture::Result::OK);
+    while(sd.now_us < 10e6)
+    {
+        capture.Process();
+        sd.Advance(100.);
+    }
+    EXPECT_EQ(capture.Stop(), Capture::Result::OK);
+    SdCardModel::Active() = nullptr;
+
+    EXPECT_EQ(capture.GetOverruns(), 0u);
+    EXPECT_EQ(capture.GetWriteErrors(), 0u);
+    EXPECT_GT(capture.GetMaxDrainUs(), 500000u);
+    EXPECT_GT(capture.GetMaxFill(), 1152u * 500);
+    EXPECT_EQ(MemoryFileSystem::Files()["rec.wav"].size(),
+              512 + capture.GetLengthFrames() * 24);
+    EXPECT_EQ(capture.GetLengthFrames(), blocks * kBlockSize);
+}
+
+TEST(util_AudioCapture, c_config)
+{
+    std::vector<uint8_t> ring(64 * 1024);
+    Capture              capture;
+    Capture::Config      cfg;
+    cfg.chunk_size = 1000;
+    EXPECT_EQ(capture.Init(cfg, ring.data(), ring.size()),
+              Capture::Result::ERR_CONFIG);
+    cfg.chunk_size = 512;
+    EXPECT_EQ(capture.Init(cfg, ring.data(), 512),
+              Capture::Result::ERR_CONFIG);
+    cfg.chunk_size    = 32768;
+    cfg.bitspersample = 8;
+    EXPECT_EQ(capture.Init(cfg, ring.data(), ring.size()),
+              Capture::Result::ERR_CONFIG);
+
+    // 3 byte samples: a region has to be a multiple of 3 chunks
+    cfg.bitspersample = 24;
+    EXPECT_EQ(capture.Init(cfg, ring.data(), ring.size()),
+              Capture::Result::ERR_CONFIG);
+    std::vector<uint8_t> big(200 * 1024);
+    EXPECT_EQ(capture.Init(cfg, big.data(), big.size()), Capture::Result::OK);
+    EXPECT_EQ(capture.GetRingSize(), 6u * 32768);
+}
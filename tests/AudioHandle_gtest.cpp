@@ -0,0 +1,302 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cmath>
+#include "hid/audio.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+const size_t kBlockSize = 48;
+
+// Both sides of a codec: sends a known sequence and keeps what it gets
+struct Codec
+{
+    int32_t              range;
+    uint32_t             sent = 0;
+    std::vector<int32_t> in, out;
+
+    static void Input(int32_t* rx, size_t size, void* context)
+    {
+        Codec* c = static_cast<Codec*>(context);
+        for(size_t i = 0; i < size; i++)
+        {
+            rx[i] = (int32_t)((c->sent++ * 7919u) % (2u * c->range))
+                    - c->range;
+            c->in.push_back(rx[i]);
+        }
+    }
+
+    static void Output(const int32_t* tx, size_t size, void* context)
+    {
+        Codec* c = static_cast<Codec*>(context);
+        c->out.insert(c->out.end(), tx, tx + size);
+    }
+};
+
+SaiHandle InitSai(SaiHandle::Config::Peripheral periph,
+                  SaiHandle::Config::BitDepth   bit_depth,
+                  Codec&                        codec)
+{
+    SaiHandle::Config cfg;
+    cfg.periph    = periph;
+    cfg.sr        = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.bit_depth = bit_depth;
+    cfg.a_sync    = SaiHandle::Config::Sync::MASTER;
+    cfg.b_sync    = SaiHandle::Config::Sync::SLAVE;
+    cfg.a_dir     = SaiHandle::Config::Direction::TRANSMIT;
+    cfg.b_dir     = SaiHandle::Config::Direction::RECEIVE;
+    SaiHandle sai;
+    sai.Init(cfg);
+    sim::SetSaiInput(periph, Codec::Input, &codec);
+    sim::SetSaiOutput(periph, Codec::Output, &codec);
+    return sai;
+}
+
+void Passthrough(const float* in, float* out, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        out[i] = in[i];
+}
+
+// Swaps the channels of the first codec with the ones of the second
+void Swap(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        out[0][i] = in[2][i];
+        out[1][i] = in[3][i];
+        out[2][i] = in[0][i];
+        out[3][i] = in[1][i];
+    }
+}
+
+// Checks what came out against what went in, two blocks earlier. The
+// first two blocks are whatever the DMA buffers held before.
+void ExpectDelayed(const Codec& from, const Codec& to, int32_t tolerance)
+{
+    const size_t delay = 2 * kBlockSize * 2;
+    ASSERT_GT(to.out.size(), delay);
+    for(size_t i = delay; i < to.out.size(); i++)
+        ASSERT_NEAR(to.out[i], from.in[i - delay], tolerance) << i;
+}
+
+} // namespace
+
+TEST(hid_AudioHandle, a_bitDepths)
+{
+    const SaiHandle::Config::BitDepth depths[3]
+        = {SaiHandle::Config::BitDepth::SAI_16BIT,
+           SaiHandle::Config::BitDepth::SAI_24BIT,
+           SaiHandle::Config::BitDepth::SAI_32BIT};
+    // 16 bit scales by 1/32768 in and 32767 out, so it loses an LSB
+    const int32_t range[3]     = {30000, 8000000, 2000000000};
+    const int32_t tolerance[3] = {1, 0, 128};
+    for(int d = 0; d < 3; d++)
+    {
+        sim::Reset();
+        Codec codec;
+        codec.range = range[d];
+        SaiHandle sai
+            = InitSai(SaiHandle::Config::Peripheral::SAI_1, depths[d], codec);
+        AudioHandle::Config cfg;
+        cfg.blocksize  = kBlockSize;
+        cfg.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+        cfg.postgain   = 1.f;
+        AudioHandle audio;
+        ASSERT_EQ(audio.Init(cfg, sai), AudioHandle::Result::OK);
+        audio.Start(Passthrough);
+
+        // 100ms is 100 blocks
+        sim::Advance(100000);
+        EXPECT_EQ(sim::GetSaiBlocks(SaiHandle::Config::Peripheral::SAI_1),
+                  100u);
+        audio.Stop();
+        sim::Advance(10000);
+        EXPECT_EQ(codec.out.size(), 100 * kBlockSize * 2);
+        ExpectDelayed(codec, codec, tolerance[d]);
+    }
+}
+
+TEST(hid_AudioHandle, b_fourChannels)
+{
+    sim::Reset();
+    Codec codec1, codec2;
+    codec1.range = 8000000;
+    codec2.range = 4000000;
+    SaiHandle sai1 = InitSai(SaiHandle::Config::Peripheral::SAI_1,
+                             SaiHandle::Config::BitDepth::SAI_24BIT,
+                             codec1);
+    SaiHandle sai2 = InitSai(SaiHandle::Config::Peripheral::SAI_2,
+                             SaiHandle::Config::BitDepth::SAI_24BIT,
+                             codec2);
+    AudioHandle::Config cfg;
+    cfg.blocksize  = kBlockSize;
+    cfg.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.postgain   = 1.f;
+    AudioHandle audio;
+    audio.Init(cfg, sai1, sai2);
+    EXPECT_EQ(audio.GetChannels(), 4u);
+    audio.Start(Swap);
+    sim::Advance(20000);
+    audio.Stop();
+    ExpectDelayed(codec1, codec2, 0);
+    ExpectDelayed(codec2, codec1, 0);
+}
+
+TEST(hid_AudioHandle, c_postGain)
+{
+    sim::Reset();
+    Codec codec;
+    codec.range   = 4000000;
+    SaiHandle sai = InitSai(SaiHandle::Config::Peripheral::SAI_1,
+                            SaiHandle::Config::BitDepth::SAI_24BIT,
+                            codec);
+    AudioHandle::Config cfg;
+    cfg.blocksize  = kBlockSize;
+    cfg.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.postgain   = 0.5f;
+    AudioHandle audio;
+    audio.Init(cfg, sai);
+    audio.Start(Passthrough);
+    sim::Advance(10000);
+    audio.Stop();
+    // gain applies on the way in and out again, powers of two are exact
+    ExpectDelayed(codec, codec, 0);
+}
+
+namespace
+{
+// Left is a constant, right a square wave at the Nyquist frequency
+struct LevelSource
+{
+    float    left, right;
+    uint32_t sent = 0;
+
+    static void Input(int32_t* rx, size_t size, void* context)
+    {
+        LevelSource* src = static_cast<LevelSource*>(context);
+        for(size_t i = 0; i < size; i += 2)
+        {
+            float right = src->sent++ % 2 ? -src->right : src->right;
+            rx[i]       = f2s24(src->left) & 0xffffff;
+            rx[i + 1]   = f2s24(right) & 0xffffff;
+        }
+    }
+};
+
+void Gain(AudioHandle::InputBuffer  in,
+          AudioHandle::OutputBuffer out,
+          size_t                    size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[0][i] = in[0][i] * 4.f;
+        out[1][i] = in[1][i] * 2.f;
+    }
+}
+
+AudioHandle StartLevels(LevelSource& src, float postgain)
+{
+    sim::Reset();
+    Codec     codec;
+    SaiHandle sai = InitSai(SaiHandle::Config::Peripheral::SAI_1,
+                            SaiHandle::Config::BitDepth::SAI_24BIT,
+                            codec);
+    sim::SetSaiInput(
+        SaiHandle::Config::Peripheral::SAI_1, LevelSource::Input, &src);
+    sim::SetSaiOutput(SaiHandle::Config::Peripheral::SAI_1, nullptr, nullptr);
+    AudioHandle::Config cfg;
+    cfg.blocksize  = kBlockSize;
+    cfg.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.postgain   = postgain;
+    AudioHandle audio;
+    audio.Init(cfg, sai);
+    return audio;
+}
+
+} // namespace
+
+TEST(hid_AudioHandle, d_metering)
+{
+    LevelSource src;
+    src.left          = 0.5f;
+    src.right         = 0.25f;
+    AudioHandle audio = StartLevels(src, 1.f);
+    AudioHandle::MeterConfig meter_cfg;
+    meter_cfg.Defaults();
+    ASSERT_EQ(audio.StartMetering(meter_cfg), AudioHandle::Result::OK);
+    audio.Start(Gain);
+    // long enough for the 1s DC average to settle
+    sim::Advance(6000000);
+
+    AudioHandle::MeterLevel in_l = audio.GetInputLevel(0);
+    AudioHandle::MeterLevel in_r = audio.GetInputLevel(1);
+    EXPECT_NEAR(in_l.peak, 0.5f, 1e-5f);
+    EXPECT_NEAR(in_l.rms, 0.5f, 1e-3f);
+    EXPECT_NEAR(in_l.dc, 0.5f, 2e-3f);
+    EXPECT_NEAR(in_r.peak, 0.25f, 1e-5f);
+    EXPECT_NEAR(in_r.rms, 0.25f, 1e-3f);
+    EXPECT_NEAR(in_r.dc, 0.f, 1e-5f);
+    EXPECT_EQ(in_l.clips + in_r.clips, 0u);
+
+    // the left output clips on every sample
+    AudioHandle::MeterLevel out_l = audio.GetOutputLevel(0);
+    AudioHandle::MeterLevel out_r = audio.GetOutputLevel(1);
+    EXPECT_NEAR(out_l.peak, 2.f, 1e-4f);
+    EXPECT_NEAR(out_l.rms, 2.f, 4e-3f);
+    EXPECT_EQ(out_l.clips, 6000u * kBlockSize);
+    EXPECT_NEAR(out_r.peak, 0.5f, 1e-5f);
+    EXPECT_EQ(out_r.clips, 0u);
+
+    audio.ResetClipCounts();
+    sim::Advance(1000);
+    EXPECT_EQ(audio.GetOutputLevel(0).clips, kBlockSize);
+
+    // the peak falls by 20dB in the release time, the mean square by 1/e
+    // in the rms time
+    src.left  = 0.f;
+    src.right = 0.f;
+    sim::Advance(1500000);
+    EXPECT_NEAR(audio.GetInputLevel(0).peak, 0.05f, 1e-3f);
+    EXPECT_NEAR(audio.GetInputLevel(0).rms, 0.5f * expf(-2.5f), 1e-3f);
+
+    // the levels stay put once metering stops
+    audio.StopMetering();
+    AudioHandle::MeterLevel stopped = audio.GetInputLevel(0);
+    sim::Advance(100000);
+    EXPECT_EQ(audio.GetInputLevel(0).peak, stopped.peak);
+    EXPECT_EQ(audio.GetInputLevel(2).peak, 0.f);
+    audio.Stop();
+
+    meter_cfg.rms_time = 0.f;
+    EXPECT_EQ(audio.StartMetering(meter_cfg), AudioHandle::Result::ERR);
+}
+
+TEST(hid_AudioHandle, e_meteringPostGain)
+{
+    // Levels are relative to the codec, whatever the postgain
+    LevelSource src;
+    src.left          = 0.4f;
+    src.right         = 0.2f;
+    AudioHandle audio = StartLevels(src, 0.5f);
+    AudioHandle::MeterConfig meter_cfg;
+    meter_cfg.Defaults();
+    meter_cfg.dc_time = 0.1f;
+    audio.StartMetering(meter_cfg);
+    audio.Start(Passthrough);
+    sim::Advance(2000000);
+    audio.Stop();
+    for(size_t c = 0; c < 2; c++)
+    {
+        float                   expected = c ? 0.2f : 0.4f;
+        AudioHandle::MeterLevel in       = audio.GetInputLevel(c);
+        AudioHandle::MeterLevel out      = audio.GetOutputLevel(c);
+        EXPECT_NEAR(in.peak, expected, 1e-5f);
+        EXPECT_NEAR(in.rms, expected, 1e-3f);
+        EXPECT_NEAR(out.peak, expected, 1e-5f);
+        EXPECT_NEAR(out.rms, expected, 1e-3f);
+        EXPECT_NEAR(out.dc, c ? 0.f : 0.4f, 1e-3f);
+    }
+}
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "sim/audio_runner.h"
+
+using namespace daisy;
+
+namespace
+{
+void Passthrough(AudioHandle::InputBuffer  in,
+                 AudioHandle::OutputBuffer out,
+                 size_t                    size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[0][i] = in[0][i];
+        out[1][i] = in[1][i];
+    }
+}
+
+// Reverses the order of the 4 channels
+void Reverse(AudioHandle::InputBuffer  in,
+             AudioHandle::OutputBuffer out,
+             size_t                    size)
+{
+    for(size_t c = 0; c < 4; c++)
+        for(size_t i = 0; i < size; i++)
+            out[c][i] = in[3 - c][i];
+}
+
+void Interleaved(const float* in, float* out, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        out[i] = in[i];
+}
+
+std::vector<int32_t> Ramp(size_t size, int32_t step, int32_t range)
+{
+    std::vector<int32_t> v(size);
+    for(size_t i = 0; i < size; i++)
+        v[i] = (int32_t)((i * step) % (2 * range)) - range;
+    return v;
+}
+
+} // namespace
+
+TEST(sim_AudioRunner, a_alignedPassthrough)
+{
+    // not a whole number of blocks
+    const size_t               frames = 1000;
+    std::vector<int32_t>       in     = Ramp(frames * 2, 4099, 8000000);
+    std::vector<int32_t>       out(in.size(), 1);
+    sim::AudioRunner           runner;
+    sim::AudioRunner::Config   cfg;
+    EXPECT_EQ(runner.Run(cfg, Passthrough, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::OK);
+    EXPECT_EQ(out, in);
+    // 21 blocks, and 2 more to get the last one out
+    EXPECT_EQ(runner.GetBlockTimes().size(), 23u);
+    sim::AudioRunner::BlockTimes times = runner.GetBlockTimeStats();
+    EXPECT_EQ(times.budget, 1000000u);
+    EXPECT_LE(times.min, times.mean);
+    EXPECT_LE(times.mean, times.max);
+
+    std::fill(out.begin(), out.end(), 1);
+    EXPECT_EQ(runner.Run(cfg, Interleaved, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::OK);
+    EXPECT_EQ(out, in);
+}
+
+TEST(sim_AudioRunner, b_fourChannels)
+{
+    const size_t             frames = 300;
+    std::vector<int32_t>     in     = Ramp(frames * 4, 7919, 4000000);
+    std::vector<int32_t>     out(in.size());
+    sim::AudioRunner         runner;
+    sim::AudioRunner::Config cfg;
+    cfg.channels  = 4;
+    cfg.blocksize = 32;
+    ASSERT_EQ(runner.Run(cfg, Reverse, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::OK);
+    for(size_t f = 0; f < frames; f++)
+        for(size_t c = 0; c < 4; c++)
+            ASSERT_EQ(out[f * 4 + c], in[f * 4 + 3 - c]) << f;
+
+    // interleaving callbacks only get 2 channels
+    EXPECT_EQ(runner.Run(cfg, Interleaved, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::ERR);
+    cfg.channels  = 2;
+    cfg.blocksize = 257;
+    EXPECT_EQ(runner.Run(cfg, Passthrough, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::ERR);
+}
+
+TEST(sim_AudioRunner, c_bitDepths)
+{
+    const size_t         frames = 200;
+    std::vector<int32_t> in     = Ramp(frames * 2, 997, 30000);
+    std::vector<int32_t> out(in.size());
+    sim::AudioRunner         runner;
+    sim::AudioRunner::Config cfg;
+    cfg.bit_depth = SaiHandle::Config::BitDepth::SAI_16BIT;
+    ASSERT_EQ(runner.Run(cfg, Passthrough, in.data(), out.data(), frames),
+              sim::AudioRunner::Result::OK);
+    // in by 1/32768 and out by 32767, as on the device
+    for(size_t i = 0; i < in.size(); i++)
+        ASSERT_EQ(out[i], (int32_t)(in[i] / 32768.f * 32767.f)) << i;
+
+    EXPECT_EQ(sim::AudioRunner::ToWord(INT32_MIN,
+                                       SaiHandle::Config::BitDepth::SAI_24BIT),
+              -8388608);
+    EXPECT_EQ(sim::AudioRunner::FromWord(
+                  -1, SaiHandle::Config::BitDepth::SAI_16BIT),
+              -65536);
+}
+
+TEST(sim_AudioRunner, d_wavFiles)
+{
+    const std::string path = testing::TempDir() + "AudioRunner_gtest.wav";
+    sim::WavAudio     mono;
+    mono.channels   = 1;
+    mono.bits       = 16;
+    mono.samplerate = 32000;
+    for(int i = 0; i < 500; i++)
+        mono.samples.push_back((int32_t)((uint32_t)(i * 64 - 16000) << 16));
+    ASSERT_TRUE(sim::SaveWav(path.c_str(), mono));
+
+    sim::WavAudio loaded;
+    ASSERT_TRUE(sim::LoadWav(path.c_str(), loaded));
+    EXPECT_EQ(loaded.channels, 1u);
+    EXPECT_EQ(loaded.bits, 16u);
+    EXPECT_EQ(loaded.samplerate, 32000u);
+    EXPECT_EQ(loaded.samples, mono.samples);
+
+    // mono plays on both channels, and 16 bits fit into 24 without loss.
+    // The postgain undoes itself below half scale, where nothing clips.
+    sim::AudioRunner         runner;
+    sim::AudioRunner::Config cfg;
+    cfg.samplerate = SaiHandle::Config::SampleRate::SAI_32KHZ;
+    cfg.postgain   = 0.5f;
+    sim::WavAudio out;
+    ASSERT_EQ(runner.Run(cfg, Passthrough, loaded, out),
+              sim::AudioRunner::Result::OK);
+    EXPECT_EQ(out.channels, 2u);
+    EXPECT_EQ(out.bits, 24u);
+    EXPECT_EQ(out.samplerate, 32000u);
+    ASSERT_EQ(out.GetFrames(), 500u);
+    for(size_t i = 0; i < 500; i++)
+    {
+        ASSERT_EQ(out.samples[i * 2], mono.samples[i]);
+        ASSERT_EQ(out.samples[i * 2 + 1], mono.samples[i]);
+    }
+    remove(path.c_str());
+
+    EXPECT_FALSE(sim::LoadWav(path.c_str(), loaded));
+}
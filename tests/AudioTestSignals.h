@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/** Block of audio the tests push through the recording and playback
+ ** classes at a time, as the audio callback would. */
+constexpr size_t kBlockSize = 48;
+
+/** Deterministic test signal: channels of frames samples in [-1, 1),
+ ** different for every channel and position. */
+inline std::vector<std::vector<float>> MakeChannels(size_t channels,
+                                                    size_t frames)
+{
+    std::vector<std::vector<float>> ch(channels, std::vector<float>(frames));
+    for(size_t c = 0; c < channels; c++)
+        for(size_t i = 0; i < frames; i++)
+            ch[c][i] = ((i * 37 + c * 1001) % 2000) / 1000.f - 1.f;
+    return ch;
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "util/BrightnessCurve.h"
+
+using namespace daisy;
+
+namespace
+{
+using Gamma28 = BrightnessTable<BrightnessCurve::Gamma<28>, 8, 12>;
+using Cube    = BrightnessTable<BrightnessCurve::Gamma<30>, 8, 12>;
+using Cie16   = BrightnessTable<BrightnessCurve::Cie, 8, 16>;
+
+// Built by the compiler
+static_assert(Gamma28::Get(0) == 0, "");
+static_assert(Gamma28::Get(255) == 4095, "");
+static_assert(Cie16::Get(255) == 65535, "");
+
+double CieExact(double x)
+{
+    double l = x * 100.0;
+    return l <= 8.0 ? l / 903.3 : std::pow((l + 16.0) / 116.0, 3.0);
+}
+
+} // namespace
+
+TEST(util_BrightnessCurve, a_constexprMath)
+{
+    for(double x = 1e-4; x < 100.0; x *= 1.37)
+    {
+        EXPECT_NEAR(BrightnessCurve::Log(x), std::log(x), 1e-14) << x;
+        EXPECT_NEAR(BrightnessCurve::Pow(x, 2.8) / std::pow(x, 2.8),
+                    1.0,
+                    1e-13)
+            << x;
+    }
+    for(double x = -30.0; x < 30.0; x += 0.77)
+        EXPECT_NEAR(BrightnessCurve::Exp(x) / std::exp(x), 1.0, 1e-13) << x;
+    EXPECT_EQ(BrightnessCurve::Pow(0.0, 2.2), 0.0);
+}
+
+TEST(util_BrightnessCurve, b_tables)
+{
+    // Rounded to the nearest step, at least 1 above 0, and monotonic
+    for(uint32_t i = 1; i < 256; i++)
+    {
+        double g = std::pow(i / 255.0, 2.8) * 4095.0;
+        EXPECT_NEAR(Gamma28::Get(i), std::max(std::round(g), 1.0), 1e-9)
+            << i;
+        double c = CieExact(i / 255.0) * 65535.0;
+        EXPECT_NEAR(Cie16::Get(i), std::max(std::round(c), 1.0), 1e-9) << i;
+        EXPECT_GE(Gamma28::Get(i), Gamma28::Get(i - 1));
+        EXPECT_GE(Cie16::Get(i), Cie16::Get(i - 1));
+    }
+    EXPECT_EQ(Gamma28::Get(1000), 4095);
+
+    // The table the PCA9685 driver had, which differs at 12 to 15
+    EXPECT_EQ(Gamma28::Get(11), 1);
+    EXPECT_EQ(Gamma28::Get(16), 2);
+    EXPECT_EQ(Gamma28::Get(128), 594);
+    EXPECT_EQ(Gamma28::Get(200), 2074);
+
+    // Other sizes
+    using Small = BrightnessTable<BrightnessCurve::Gamma<22>, 4, 8>;
+    EXPECT_EQ(Small::kSize, 16u);
+    EXPECT_EQ(Small::Get(15), 255);
+    EXPECT_EQ(Small::Get(8), std::round(std::pow(8 / 15.0, 2.2) * 255.0));
+}
+
+TEST(util_BrightnessCurve, c_interpolate)
+{
+    // Within a step of the cube Led used to compute: half a step from
+    // rounding the entries, half from rounding the result
+    double worst = 0.0;
+    for(int i = 0; i <= 100000; i++)
+    {
+        float  x     = i / 100000.f;
+        double exact = std::pow((double)x, 3.0) * 4095.0;
+        double error = std::fabs(Cube::Interpolate(x) - exact);
+        if(exact >= 1.0)
+            worst = std::max(worst, error);
+    }
+    EXPECT_LT(worst, 1.0);
+
+    // CIE at 16 bits out, within 0.5% of the exact curve above the toe
+    for(int i = 100; i <= 1000; i++)
+    {
+        float  x     = i / 1000.f;
+        double exact = CieExact(x) * 65535.0;
+        EXPECT_NEAR(Cie16::Interpolate(x), exact, exact * 0.005 + 1.0) << x;
+    }
+
+    // The entries themselves, and clamping
+    for(uint32_t i = 0; i < 256; i++)
+        EXPECT_EQ(Cube::Interpolate(i / 255.f), Cube::Get(i)) << i;
+    EXPECT_EQ(Cube::Interpolate(-1.f), 0);
+    EXPECT_EQ(Cube::Interpolate(NAN), 0);
+    EXPECT_EQ(Cube::Interpolate(2.f), 4095);
+    EXPECT_EQ(Cube::Interpolate(0.99999994f), 4095);
+}
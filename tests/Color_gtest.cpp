@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include "util/color.h"
+#include "dev/leddriver.h"
+#include "hid/rgb_led.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+// Float HSV to RGB, the way the animations did it
+void HsvFloat(float h, float s, float v, float* rgb)
+{
+    h             = fmodf(h, 1.f) * 6.f;
+    int   i       = (int)h;
+    float f       = h - i;
+    float p       = v * (1.f - s);
+    float q       = v * (1.f - s * f);
+    float t       = v * (1.f - s * (1.f - f));
+    float c[6][3] = {
+        {v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+    for(int k = 0; k < 3; k++)
+        rgb[k] = c[i % 6][k];
+}
+
+int MaxDiff(PackedColor c, const float* rgb)
+{
+    int d = 0;
+    d     = std::max(d, std::abs(c.Red() - (int)lroundf(rgb[0] * 255.f)));
+    d     = std::max(d, std::abs(c.Green() - (int)lroundf(rgb[1] * 255.f)));
+    d     = std::max(d, std::abs(c.Blue() - (int)lroundf(rgb[2] * 255.f)));
+    return d;
+}
+
+} // namespace
+
+TEST(util_Color, a_hsv)
+{
+    EXPECT_EQ(PackedColor::FromHsv(0, 255, 255), PackedColor(0xff0000));
+    EXPECT_EQ(PackedColor::FromHsv(21845, 255, 255), PackedColor(0x00ff00));
+    EXPECT_EQ(PackedColor::FromHsv(43691, 255, 255), PackedColor(0x0000ff));
+    EXPECT_EQ(PackedColor::FromHsv(12345, 0, 200), PackedColor(200, 200, 200));
+    EXPECT_EQ(PackedColor::FromHsv(12345, 255, 0), PackedColor(0));
+
+    // Within 2 steps of the float conversion, whose hue is 8 bits finer
+    int worst = 0;
+    for(uint32_t h = 0; h < 65536; h += 97)
+    {
+        for(int s = 0; s < 256; s += 15)
+        {
+            for(int v = 0; v < 256; v += 17)
+            {
+                float rgb[3];
+                HsvFloat(h / 65536.f, s / 255.f, v / 255.f, rgb);
+                worst = std::max(
+                    worst, MaxDiff(PackedColor::FromHsv(h, s, v), rgb));
+            }
+        }
+    }
+    EXPECT_LE(worst, 2);
+}
+
+TEST(util_Color, b_hsl)
+{
+    // 128 is a hair over half way, so not quite saturated
+    PackedColor red = PackedColor::FromHsl(0, 255, 128);
+    EXPECT_EQ(red.Red(), 255);
+    EXPECT_LE(red.Green(), 1);
+    EXPECT_EQ(red.Blue(), red.Green());
+    EXPECT_EQ(PackedColor::FromHsl(0, 255, 255), PackedColor(0xffffff));
+    EXPECT_EQ(PackedColor::FromHsl(0, 255, 0), PackedColor(0));
+    EXPECT_EQ(PackedColor::FromHsl(21845, 0, 100), PackedColor(100, 100, 100));
+    // Pastel: half way from the color to white
+    PackedColor c = PackedColor::FromHsl(43691, 255, 191);
+    EXPECT_NEAR(c.Red(), 127, 2);
+    EXPECT_NEAR(c.Green(), 127, 2);
+    EXPECT_EQ(c.Blue(), 255);
+}
+
+TEST(util_Color, c_blending)
+{
+    PackedColor a(10, 100, 250), b(250, 0, 30);
+    EXPECT_EQ(PackedColor::Lerp(a, b, 0), a);
+    EXPECT_EQ(PackedColor::Lerp(a, b, 255), b);
+    for(int t = 0; t < 256; t++)
+    {
+        PackedColor c = PackedColor::Lerp(a, b, t);
+        float       w = (t + (t >> 7)) / 256.f;
+        EXPECT_NEAR(c.Red(), 10 + 240 * w, 1.f) << t;
+        EXPECT_NEAR(c.Green(), 100 - 100 * w, 1.f) << t;
+        EXPECT_NEAR(c.Blue(), 250 - 220 * w, 1.f) << t;
+    }
+
+    EXPECT_EQ(a.Scale(255), a);
+    EXPECT_EQ(a.Scale(0), PackedColor(0));
+    EXPECT_EQ(PackedColor(200, 100, 50).Scale(128), PackedColor(100, 50, 25));
+
+    for(int x = 0; x < 256; x++)
+        for(int y = 0; y < 256; y++)
+            ASSERT_EQ(PackedColor::Mul8(x, y), (x * y + 127) / 255) << x << y;
+    EXPECT_EQ(
+        PackedColor::Multiply(PackedColor(0xff8040), PackedColor(0x80ff00)),
+        PackedColor(128, 128, 0));
+}
+
+TEST(util_Color, d_paletteAndArrays)
+{
+    static const PackedColor palette[] = {PackedColor(0xff0000),
+                                          PackedColor(0x00ff00),
+                                          PackedColor(0x0000ff),
+                                          PackedColor(0xffffff)};
+    EXPECT_EQ(PackedColor::FromPalette(palette, 0), palette[0]);
+    EXPECT_EQ(PackedColor::FromPalette(palette, 16384), palette[1]);
+    EXPECT_EQ(PackedColor::FromPalette(palette, 49152), palette[3]);
+    // Half way between two entries (128 weighs 129/256), and back around
+    // to the first
+    EXPECT_EQ(PackedColor::FromPalette(palette, 8192),
+              PackedColor(126, 128, 0));
+    EXPECT_EQ(PackedColor::FromPalette(palette, 65535), palette[0]);
+    EXPECT_EQ(PackedColor::FromPalette(palette, 65280),
+              PackedColor(255, 2, 2));
+
+    PackedColor leds[12], dark[12];
+    PackedColor::FillRainbow(leds, 12, 0, 65536 / 12, 255, 255);
+    EXPECT_EQ(leds[0], PackedColor(0xff0000));
+    EXPECT_EQ(leds[4], PackedColor::FromHsv(4 * (65536 / 12), 255, 255));
+    PackedColor::Fill(dark, 12, PackedColor(0));
+    PackedColor::Lerp(leds, dark, dark, 12, 128);
+    EXPECT_EQ(dark[0], PackedColor(126, 0, 0));
+    PackedColor::Scale(leds, 12, 0);
+    EXPECT_EQ(leds[11], PackedColor(0));
+
+    // To and from floats
+    Color c = PackedColor(255, 0, 51).ToColor();
+    EXPECT_FLOAT_EQ(c.Red(), 1.f);
+    EXPECT_FLOAT_EQ(c.Blue(), 0.2f);
+    EXPECT_EQ(PackedColor::FromColor(c), PackedColor(255, 0, 51));
+    c.Init(2.f, -1.f, 0.5f);
+    EXPECT_EQ(PackedColor::FromColor(c), PackedColor(255, 0, 128));
+}
+
+TEST(util_Color, e_outputs)
+{
+    sim::Reset();
+    using Periph = TimerHandle::Config::Peripheral;
+    using Chn    = TimerHandle::Channel;
+    // PC7, PC6 and PB1 are all on TIM3, with 12 bits
+    TimerHandle         tim;
+    TimerHandle::Config cfg;
+    cfg.periph = Periph::TIM_3;
+    cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    tim.Init(cfg);
+    tim.SetPeriod(4095);
+    RgbLed rgb;
+    rgb.Init({DSY_GPIOC, 7}, {DSY_GPIOC, 6}, {DSY_GPIOB, 1}, false, tim);
+    rgb.SetColor(PackedColor(255, 128, 0));
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 4096u);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::ONE).compare, 518u);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::FOUR).compare, 0u);
+}
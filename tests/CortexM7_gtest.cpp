@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "cyclesim/CortexM7.h"
+#include "cyclesim/CycleTable.h"
+
+using namespace cyclesim;
+
+namespace
+{
+const uint32_t kCode  = 0x08000000;
+const uint32_t kStack = 0x20001000;
+
+// Thumb code, encoded with llvm-mc, on a fresh model
+class Program
+{
+  public:
+    Program(std::initializer_list<uint8_t> code)
+    {
+        cpu.Map(kCode, 0x1000);
+        cpu.Map(kStack - 0x1000, 0x1000);
+        std::copy(code.begin(), code.end(), cpu.Pointer(kCode, code.size()));
+        cpu.SetReg(13, kStack);
+    }
+
+    bool Run(const std::vector<uint32_t> &args = {})
+    {
+        return cpu.Call(kCode | 1, args, 10000);
+    }
+
+    uint64_t Cycles() const { return cpu.GetStats().cycles; }
+
+    CortexM7 cpu;
+};
+
+void ReturnSeven(CortexM7 &cpu)
+{
+    cpu.SetReg(0, 7);
+    cpu.AddCycles(10);
+}
+
+} // namespace
+
+TEST(cyclesim_CortexM7, a_integer)
+{
+    Program p({
+        0x40, 0x18,             // adds r0, r0, r1
+        0xc1, 0x00,             // lsls r1, r0, #3
+        0x88, 0x42,             // cmp r0, r1
+        0x34, 0xbf,             // ite lo
+        0x01, 0x22,             // movlo r2, #1
+        0x02, 0x22,             // movhs r2, #2
+        0xc1, 0xf3, 0x07, 0x13, // ubfx r3, r1, #4, #8
+        0x91, 0xfb, 0xf0, 0xf0, // sdiv r0, r1, r0
+        0x70, 0x47,             // bx lr
+    });
+    ASSERT_TRUE(p.Run({40, 2})) << p.cpu.Error();
+    EXPECT_EQ(p.cpu.Reg(0), 8u);
+    EXPECT_EQ(p.cpu.Reg(1), 336u);
+    EXPECT_EQ(p.cpu.Reg(2), 1u);
+    EXPECT_EQ(p.cpu.Reg(3), 21u);
+    EXPECT_EQ(p.cpu.GetStats().instructions, 9u);
+}
+
+TEST(cyclesim_CortexM7, b_branchPrediction)
+{
+    Program p({
+        0x00, 0x20, // movs r0, #0
+        0x01, 0x30, // adds r0, #1
+        0x64, 0x28, // cmp r0, #100
+        0xfc, 0xd1, // bne 2
+        0x70, 0x47, // bx lr
+    });
+    ASSERT_TRUE(p.Run()) << p.cpu.Error();
+    EXPECT_EQ(p.cpu.Reg(0), 100u);
+    EXPECT_EQ(p.cpu.GetStats().instructions, 302u);
+    // The first taken branch and the loop exit are mispredicted
+    EXPECT_EQ(p.Cycles(), 302 + 2 * cycles::kMispredict + cycles::kIndirect);
+
+    // The predictor remembers the branch, only the exit is mispredicted
+    p.cpu.ResetStats();
+    ASSERT_TRUE(p.Run()) << p.cpu.Error();
+    EXPECT_EQ(p.Cycles(), 302 + cycles::kMispredict + cycles::kIndirect);
+}
+
+TEST(cyclesim_CortexM7, c_latencies)
+{
+    Program load({
+        0x08, 0x68, // ldr r0, [r1]
+        0x01, 0x30, // adds r0, #1
+        0x70, 0x47, // bx lr
+    });
+    memcpy(load.cpu.Pointer(kStack - 16, 4), "\x29\0\0\0", 4);
+    ASSERT_TRUE(load.Run({0, kStack - 16})) << load.cpu.Error();
+    EXPECT_EQ(load.cpu.Reg(0), 42u);
+    // The add waits for the load
+    EXPECT_EQ(load.Cycles(), cycles::kLoad + 2 + cycles::kIndirect);
+
+    Program fpu({
+        0x20, 0xee, 0x20, 0x0a, // vmul.f32 s0, s0, s1
+        0x30, 0xee, 0x20, 0x0a, // vadd.f32 s0, s0, s1
+        0x70, 0x47,             // bx lr
+    });
+    fpu.cpu.SetSReg(0, 3.f);
+    fpu.cpu.SetSReg(1, 0.5f);
+    ASSERT_TRUE(fpu.Run()) << fpu.cpu.Error();
+    EXPECT_EQ(fpu.cpu.SReg(0), 2.f);
+    EXPECT_EQ(fpu.Cycles(), cycles::kFpu + 2 + cycles::kIndirect);
+}
+
+TEST(cyclesim_CortexM7, d_floatingPoint)
+{
+    Program p({
+        0x00, 0xee, 0x10, 0x0a, // vmov s0, r0
+        0xb8, 0xee, 0xc0, 0x0a, // vcvt.f32.s32 s0, s0
+        0xf6, 0xee, 0x00, 0x0a, // vmov.f32 s1, #0.5
+        0x90, 0xee, 0x60, 0x1a, // vfnma.f32 s2, s0, s1
+        0xbe, 0xee, 0x46, 0x0a, // vcvt.s16.f32 s0, s0, #4
+        0xf5, 0xee, 0x40, 0x0a, // vcmp.f32 s1, #0
+        0xf1, 0xee, 0x10, 0xfa, // vmrs APSR_nzcv, fpscr
+        0x70, 0xfe, 0x81, 0x1a, // vselgt.f32 s3, s1, s2
+        0xbc, 0xfe, 0xe0, 0x2a, // vcvta.s32.f32 s4, s1
+        0x70, 0x47,             // bx lr
+    });
+    ASSERT_TRUE(p.Run({3})) << p.cpu.Error();
+    EXPECT_EQ(p.cpu.SRegBits(0), 48u);
+    EXPECT_EQ(p.cpu.SReg(1), 0.5f);
+    EXPECT_EQ(p.cpu.SReg(2), -1.5f);
+    EXPECT_EQ(p.cpu.SReg(3), 0.5f);
+    EXPECT_EQ(p.cpu.SRegBits(4), 1u);
+}
+
+TEST(cyclesim_CortexM7, e_hostFunctionsAndFaults)
+{
+    Program p({
+        0x10, 0xb5, // push {r4, lr}
+        0x90, 0x47, // blx r2
+        0x01, 0x30, // adds r0, #1
+        0x10, 0xbd, // pop {r4, pc}
+    });
+    const uint32_t fn = p.cpu.AddHostFunction(ReturnSeven);
+    ASSERT_TRUE(p.Run({0, 0, fn})) << p.cpu.Error();
+    EXPECT_EQ(p.cpu.Reg(0), 8u);
+    EXPECT_EQ(p.cpu.Reg(13), kStack);
+    EXPECT_GE(p.Cycles(), 10u + 2 * cycles::kIndirect);
+
+    // A call to unmapped memory stops the model with an error
+    EXPECT_FALSE(p.Run({0, 0, 0x30000001}));
+    EXPECT_NE(p.cpu.Error().find("0x30000000"), std::string::npos);
+
+    Program udf({0xfe, 0xde}); // udf #254
+    EXPECT_FALSE(udf.Run());
+    EXPECT_NE(udf.cpu.Error().find("unsupported"), std::string::npos);
+}
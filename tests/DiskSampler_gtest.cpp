@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "util/DiskSampler.h"
+#include "MemoryFileSystem.h"
+#include "AudioTestSignals.h"
+
+using namespace daisy;
+
+namespace
+{
+using Sampler = DiskSampler<8, 16384, MemoryFileReader>;
+
+std::vector<uint8_t> head_memory(1024 * 1024);
+
+// Distinct values per sample and position, exact in 16 bit
+std::vector<float> MakeSamples(size_t frames, int id)
+{
+    std::vector<float> s(frames);
+    for(size_t i = 0; i < frames; i++)
+        s[i] = static_cast<int16_t>((i * 7 + id * 1000) % 30000 - 15000)
+               / 32768.f;
+    return s;
+}
+
+Sampler::Config MakeConfig(float head_ms)
+{
+    Sampler::Config cfg;
+    cfg.Defaults();
+    cfg.head_ms = head_ms;
+    return cfg;
+}
+} // namespace
+
+TEST(util_DiskSampler, a_headAndStream)
+{
+    MemoryFileSystem::Clear();
+    const size_t frames  = 20000;
+    auto         samples = MakeSamples(frames, 1);
+    MemoryFileSystem::Files()["long.wav"] = MakeWavFile(1, 1, 2, samples);
+
+    Sampler sampler;
+    sampler.Init(MakeConfig(10.f), head_memory.data(), head_memory.size());
+    ASSERT_EQ(sampler.LoadSample("long.wav"), 0);
+    // 10ms at 48kHz, 16 bit mono
+    EXPECT_EQ(sampler.GetHeadMemoryUsed(), 480u * 2);
+
+    // Starts from RAM without any file access
+    MemoryFileSystem::ReadLog().clear();
+    ASSERT_EQ(sampler.Trigger(0, 0.5f), 0);
+    std::vector<float> out((frames + 2 * kBlockSize) * 2);
+    sampler.Read(&out[0], kBlockSize);
+    EXPECT_TRUE(MemoryFileSystem::ReadLog().empty());
+    EXPECT_EQ(out[0], samples[0] * 0.5f);
+
+    // Seamless from the head into the stream
+    for(size_t pos = kBlockSize; pos < frames + kBlockSize; pos += kBlockSize)
+    {
+        sampler.Prepare();
+        sampler.Read(&out[pos * 2], kBlockSize);
+    }
+    for(size_t i = 0; i < frames; i++)
+    {
+        ASSERT_EQ(out[i * 2], samples[i] * 0.5f) << i;
+        ASSERT_EQ(out[i * 2 + 1], samples[i] * 0.5f) << i;
+    }
+    for(size_t i = frames * 2; i < out.size(); i++)
+        ASSERT_EQ(out[i], 0.f);
+    EXPECT_EQ(sampler.GetUnderruns(), 0u);
+    EXPECT_EQ(sampler.GetNumPlaying(), 0u);
+    // The stream caught up after the first Prepare, 48 frames into the head
+    EXPECT_EQ(sampler.GetMinHeadMargin(), 480u - kBlockSize);
+}
+
+TEST(util_DiskSampler, b_shortSampleFromRam)
+{
+    MemoryFileSystem::Clear();
+    auto samples = MakeSamples(1000, 2);
+    MemoryFileSystem::Files()["short.wav"] = MakeWavFile(1, 1, 2, samples);
+
+    Sampler sampler;
+    sampler.Init(MakeConfig(100.f), head_memory.data(), head_memory.size());
+    ASSERT_EQ(sampler.LoadSample("short.wav"), 0);
+    EXPECT_EQ(sampler.GetHeadMemoryUsed(), 2000u);
+
+    MemoryFileSystem::ReadLog().clear();
+    sampler.Trigger(0);
+    std::vector<float> out(kBlockSize * 2);
+    for(size_t pos = 0; pos < 1000; pos += kBlockSize)
+    {
+        sampler.Prepare();
+        sampler.Read(out.data(), kBlockSize);
+        for(size_t i = 0; i < kBlockSize && pos + i < 1000; i++)
+            ASSERT_EQ(out[i * 2], samples[pos + i]);
+    }
+    EXPECT_TRUE(MemoryFileSystem::ReadLog().empty());
+    EXPECT_EQ(sampler.GetNumPlaying(), 0u);
+}
+
+TEST(util_DiskSampler, c_retrigger)
+{
+    MemoryFileSystem::Clear();
+    const size_t frames = 20000;
+    auto         a      = MakeSamples(frames, 3);
+    auto         b      = MakeSamples(frames, 4);
+    MemoryFileSystem::Files()["a.wav"] = MakeWavFile(1, 1, 2, a);
+    MemoryFileSystem::Files()["b.wav"] = MakeWavFile(1, 1, 2, b);
+
+    Sampler::Config cfg = MakeConfig(5.f);
+    Sampler         sampler;
+    sampler.Init(cfg, head_memory.data(), head_memory.size());
+    ASSERT_EQ(sampler.LoadSample("a.wav"), 0);
+    ASSERT_EQ(sampler.LoadSample("b.wav"), 1);
+    ASSERT_EQ(sampler.LoadSample("missing.wav"), -1);
+
+    // Fill all voices with a, and play well into the stream
+    std::vector<float> out(kBlockSize * 2);
+    for(int i = 0; i < 8; i++)
+        ASSERT_EQ(sampler.Trigger(0), i);
+    for(int i = 0; i < 20; i++)
+    {
+        sampler.Prepare();
+        sampler.Read(out.data(), kBlockSize);
+    }
+    // Retriggering with b replaces voice 0, without stopping the others.
+    // The other voices keep their place in a, 960 frames in.
+    ASSERT_EQ(sampler.Trigger(1, 1.f), 0);
+    for(size_t pos = 0; pos < 5000; pos += kBlockSize)
+    {
+        sampler.Prepare();
+        sampler.Read(out.data(), kBlockSize);
+        for(size_t i = 0; i < kBlockSize; i++)
+            ASSERT_FLOAT_EQ(out[i * 2], b[pos + i] + 7 * a[960 + pos + i])
+                << pos + i;
+    }
+    EXPECT_EQ(sampler.GetUnderruns(), 0u);
+    EXPECT_EQ(sampler.Trigger(2), -1);
+}
+
+namespace
+{
+// Runs a drum pattern on 8 voices against the SD Card model:
+// a new hit every 30ms, from 8 samples of 1 second.
+// Returns the number of underruns.
+uint32_t RunDrumPattern(Sampler&     sampler,
+                        SdCardModel& sd,
+                        float        seconds,
+                        float        head_ms)
+{
+    MemoryFileSystem::Clear();
+    sampler.Init(MakeConfig(head_ms), head_memory.data(), head_memory.size());
+    for(int i = 0; i < 8; i++)
+    {
+        std::string name = "drum" + std::to_string(i) + ".wav";
+        MemoryFileSystem::Files()[name]
+            = MakeWavFile(1, 2, 2, MakeSamples(48000 * 2, i));
+        EXPECT_EQ(sampler.LoadSample(name.c_str()), i);
+    }
+
+    std::vector<float> out(kBlockSize * 2);
+    uint32_t           block = 0;
+    sd.audio_callback        = [&]() {
+        if(block % 30 == 0)
+            sampler.Trigger((block / 30) % 8);
+        sampler.Read(out.data(), kBlockSize);
+        block++;
+    };
+    SdCardModel::Active() = &sd;
+    while(sd.now_us < seconds * 1e6)
+    {
+        sampler.Prepare();
+        sd.Advance(50.); // the rest of the main loop
+    }
+    SdCardModel::Active() = nullptr;
+    return sampler.GetUnderruns();
+}
+} // namespace
+
+TEST(util_DiskSampler, d_sdLatency)
+{
+    // A card with 2ms to open a file, 5MB/s, and a 1% chance of stalling
+    // for up to 40ms on every access.
+    SdCardModel sd;
+    sd.open_us      = 2000.;
+    sd.bytes_per_us = 5.;
+    sd.stall_chance = 0.01;
+    sd.max_stall_us = 40000.;
+
+    // 100ms heads and 16kB buffers (85ms of stereo 16 bit) ride it out
+    Sampler sampler;
+    EXPECT_EQ(RunDrumPattern(sampler, sd, 10.f, 100.f), 0u);
+    EXPECT_GT(sampler.GetMinHeadMargin(), 0u);
+    EXPECT_LT(sampler.GetMinHeadMargin(), 4800u);
+
+    // 3ms heads don't cover opening the files
+    SdCardModel sd2 = sd;
+    sd2.now_us = sd2.next_audio_us = 0.;
+    EXPECT_GT(RunDrumPattern(sampler, sd2, 10.f, 3.f), 0u);
+    EXPECT_EQ(sampler.GetMinHeadMargin(), 0u);
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/** Host-side model of a NOR flash region, used as a backend for flash based
+ ** storage in the tests.
+ **
+ ** Programming can only clear bits, erasing sets a whole sector to 0xFF.
+ ** For fault injection, power can be cut after a given number of bytes have
+ ** been programmed or erased. The operation in progress is left half done
+ ** (the byte being programmed gets only some of its bits cleared, a sector
+ ** being erased is left with garbage), and every later operation fails
+ ** until PowerOn() is called.
+ **
+ ** Erases run in the background, as LogStore drives them: StartEraseSector()
+ ** returns right away, and each PollErase() erases a quarter of the sector.
+ ** */
+class FlashSimulator
+{
+  public:
+    FlashSimulator(uint32_t size, uint32_t sector_size)
+    : mem_(size, 0xFF), erase_counts_(size / sector_size, 0),
+      sector_size_(sector_size)
+    {
+    }
+
+    uint32_t GetSize() const { return mem_.size(); }
+    uint32_t GetSectorSize() const { return sector_size_; }
+
+    const uint8_t* GetReadPtr(uint32_t address) const
+    {
+        return &mem_[address];
+    }
+
+    bool Write(uint32_t address, const uint8_t* data, uint32_t size)
+    {
+        if(!powered_ || address + size > mem_.size())
+            return false;
+        for(uint32_t i = 0; i < size; i++)
+        {
+            if(!Consume())
+            {
+                // Some of the bits made it
+                mem_[address + i] &= data[i] | (std::rand() & 0xFF);
+                return false;
+            }
+            mem_[address + i] &= data[i];
+        }
+        num_writes_++;
+        return true;
+    }
+
+    bool StartEraseSector(uint32_t address)
+    {
+        uint32_t base = address - (address % sector_size_);
+        if(!powered_ || base >= mem_.size() || erase_pending_)
+            return false;
+        erase_pending_ = true;
+        erase_base_    = base;
+        erase_pos_     = 0;
+        return true;
+    }
+
+    bool PollErase()
+    {
+        if(!erase_pending_)
+            return false;
+        for(uint32_t n = 0; n < sector_size_ / 4; n++, erase_pos_++)
+        {
+            if(!powered_ || !Consume())
+            {
+                for(uint32_t j = erase_pos_; j < sector_size_; j++)
+                    mem_[erase_base_ + j] |= std::rand() & 0xFF;
+                erase_pending_ = false;
+                return false;
+            }
+            mem_[erase_base_ + erase_pos_] = 0xFF;
+        }
+        if(erase_pos_ < sector_size_)
+            return true;
+        erase_counts_[erase_base_ / sector_size_]++;
+        erase_pending_ = false;
+        return false;
+    }
+
+    /** \return true between StartEraseSector() and the end of the erase */
+    bool IsErasePending() const { return erase_pending_; }
+
+    /** Cuts the power after num_bytes more bytes have been programmed or erased. */
+    void CutPowerAfter(uint32_t num_bytes)
+    {
+        budget_     = num_bytes;
+        use_budget_ = true;
+    }
+
+    /** Restores power, and disables the pending power cut */
+    void PowerOn()
+    {
+        powered_    = true;
+        use_budget_ = false;
+    }
+
+    bool IsPowered() const { return powered_; }
+
+    uint32_t GetEraseCount(uint32_t sector) const
+    {
+        return erase_counts_[sector];
+    }
+
+    uint32_t GetNumWrites() const { return num_writes_; }
+
+  private:
+    bool Consume()
+    {
+        if(!use_budget_)
+            return true;
+        if(budget_ == 0)
+        {
+            powered_ = false;
+            return false;
+        }
+        budget_--;
+        return true;
+    }
+
+    std::vector<uint8_t>  mem_;
+    std::vector<uint32_t> erase_counts_;
+    uint32_t              sector_size_;
+    uint32_t              budget_        = 0;
+    bool                  use_budget_    = false;
+    bool                  powered_       = true;
+    uint32_t              num_writes_    = 0;
+    bool                  erase_pending_ = false;
+    uint32_t              erase_base_    = 0;
+    uint32_t              erase_pos_     = 0;
+};
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "util/ImaAdpcm.h"
+#include "util/WavHeader.h"
+
+using namespace daisy;
+
+namespace
+{
+std::vector<int16_t> MakeSignal(size_t channels, size_t frames)
+{
+    std::vector<int16_t> s(channels * frames);
+    for(size_t i = 0; i < frames; i++)
+        for(size_t c = 0; c < channels; c++)
+            s[i * channels + c] = static_cast<int16_t>(
+                12000.f * std::sin(i * 0.0576f * (c + 1))
+                + 6000.f * std::sin(i * 0.17f + c));
+    return s;
+}
+
+std::vector<uint8_t>
+Encode(const std::vector<int16_t>& in, size_t channels, size_t block_align)
+{
+    ImaAdpcmEncoder enc;
+    EXPECT_TRUE(enc.Init(channels, block_align));
+    const size_t         frames = in.size() / channels;
+    const size_t         fpb    = enc.GetFramesPerBlock();
+    std::vector<uint8_t> file(ImaAdpcmEncoder::kWavHeaderSize);
+    enc.WriteWavHeader(file.data(), 48000, frames);
+    for(size_t pos = 0; pos < frames; pos += fpb)
+    {
+        size_t n = std::min(fpb, frames - pos);
+        size_t block = file.size();
+        file.resize(block + block_align);
+        enc.EncodeBlock(&in[pos * channels], n, &file[block]);
+    }
+    return file;
+}
+} // namespace
+
+TEST(util_ImaAdpcm, a_roundTrip)
+{
+    const size_t channels = 2, frames = 48000, block_align = 256;
+    auto         in   = MakeSignal(channels, frames);
+    auto         file = Encode(in, channels, block_align);
+
+    // A quarter of the size of 16 bit PCM, plus the block headers
+    EXPECT_LT(file.size(), frames * channels * 2 / 4 * 1.05);
+
+    ImaAdpcmReader<256> reader;
+    ASSERT_TRUE(reader.Init(file.data(), file.size()));
+    EXPECT_EQ(reader.GetLengthFrames(), frames);
+    EXPECT_EQ(reader.GetChannels(), channels);
+    EXPECT_EQ(reader.GetSampleRate(), 48000u);
+
+    // Read in audio blocks, which don't line up with the ADPCM blocks
+    std::vector<float> out(frames * channels + 100);
+    size_t             total = 0;
+    while(total < frames)
+    {
+        size_t n = reader.Read(&out[total * channels], 48);
+        ASSERT_GT(n, 0u);
+        total += n;
+    }
+    EXPECT_EQ(total, frames);
+    EXPECT_EQ(reader.Read(out.data(), 48), 0u);
+
+    double signal = 0., noise = 0.;
+    for(size_t i = 0; i < frames * channels; i++)
+    {
+        double x = in[i] / 32768.;
+        signal += x * x;
+        noise += (out[i] - x) * (out[i] - x);
+    }
+    EXPECT_GT(10. * std::log10(signal / noise), 25.);
+}
+
+TEST(util_ImaAdpcm, b_seek)
+{
+    const size_t channels = 1, frames = 10000, block_align = 512;
+    auto         in   = MakeSignal(channels, frames);
+    auto         file = Encode(in, channels, block_align);
+
+    // Block aligned reads are decoded straight to the output
+    ImaAdpcmReader<512> reader;
+    ASSERT_TRUE(reader.Init(file.data(), file.size()));
+    const size_t fpb = ImaAdpcm::GetFramesPerBlock(block_align, channels);
+    EXPECT_EQ(fpb, 1017u);
+    std::vector<float> all(frames);
+    size_t             total = 0;
+    while(total < frames)
+        total += reader.Read(&all[total], fpb);
+
+    // Every block decodes on its own
+    for(uint32_t pos : {0u, 1u, 1016u, 1017u, 5000u, 9990u})
+    {
+        float buf[64];
+        ASSERT_TRUE(reader.Seek(pos));
+        size_t n = reader.Read(buf, 64);
+        EXPECT_EQ(n, std::min<size_t>(64, frames - pos));
+        for(size_t i = 0; i < n; i++)
+            ASSERT_EQ(buf[i], all[pos + i]) << pos + i;
+    }
+    EXPECT_FALSE(reader.Seek(frames + 1));
+}
+
+TEST(util_ImaAdpcm, c_header)
+{
+    auto file = Encode(MakeSignal(2, 1000), 2, 1024);
+
+    // Parsed like any other WAV file
+    struct Reader
+    {
+        const std::vector<uint8_t>& f;
+        uint32_t                    pos;
+        size_t                      Read(void* dst, size_t n)
+        {
+            n = std::min<size_t>(n, f.size() - pos);
+            std::memcpy(dst, &f[pos], n);
+            pos += n;
+            return n;
+        }
+        bool Seek(uint32_t p)
+        {
+            pos = p;
+            return p <= f.size();
+        }
+        uint32_t GetSize() const { return f.size(); }
+    } reader{file, 0};
+    WavHeader header;
+    ASSERT_TRUE(header.Parse(reader));
+    EXPECT_EQ(header.format_tag, WAVE_FORMAT_IMA_ADPCM);
+    EXPECT_EQ(header.channels, 2);
+    EXPECT_EQ(header.block_align, 1024);
+    EXPECT_EQ(header.fact_frames, 1000u);
+    EXPECT_EQ(header.data_start, 60u);
+    EXPECT_EQ(header.data_size, 1024u);
+
+    // Blocks that don't fit the channels
+    ImaAdpcmEncoder enc;
+    EXPECT_FALSE(enc.Init(2, 1020));
+    EXPECT_FALSE(enc.Init(0, 1024));
+    ImaAdpcmReader<512> small;
+    EXPECT_FALSE(small.Init(file.data(), file.size()));
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include "dev/leddriver.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+using Driver = LedDriverPca9685<2, true>;
+
+Driver::DmaBuffer buffer_a, buffer_b;
+
+struct Leds
+{
+    Driver                 driver;
+    sim::I2cRegisterDevice chips[2];
+    uint16_t               raw[32] = {};
+
+    Leds()
+    {
+        sim::Reset();
+        I2CHandle::Config cfg;
+        cfg.periph = I2CHandle::Config::Peripheral::I2C_1;
+        sim::AttachI2cDevice(cfg.periph, 0x40, &chips[0]);
+        sim::AttachI2cDevice(cfg.periph, 0x41, &chips[1]);
+        cfg.speed  = I2CHandle::Config::Speed::I2C_1MHZ;
+        cfg.mode   = I2CHandle::Config::Mode::I2C_MASTER;
+        I2CHandle i2c;
+        i2c.Init(cfg);
+        const uint8_t addresses[2] = {0x00, 0x01};
+        driver.Init(i2c, addresses, buffer_a, buffer_b);
+        sim::ClearI2cLog();
+    }
+
+    void Set(int led, uint16_t value)
+    {
+        raw[led] = value;
+        driver.SetLedRaw(led, value);
+    }
+
+    // Waits for the frame to go out
+    void Finish()
+    {
+        while(driver.IsTransmitting())
+            sim::Step();
+    }
+
+    // Checks the registers of both chips against the raw values
+    void ExpectRegisters() const
+    {
+        for(int led = 0; led < 32; led++)
+        {
+            const uint8_t* reg = &chips[led / 16].regs[6 + (led % 16) * 4];
+            uint16_t       on  = (led << 2) & 0x0FFF;
+            uint16_t       off = (on + raw[led]) & 0x0FFF;
+            if(raw[led] >= 0x0FFF)
+                on |= 0x1000;
+            EXPECT_EQ(reg[0] | (reg[1] << 8), on) << "led " << led;
+            EXPECT_EQ(reg[2] | (reg[3] << 8), off) << "led " << led;
+        }
+    }
+};
+
+} // namespace
+
+TEST(dev_LedDriverPca9685, a_firstFrameIsFull)
+{
+    Leds leds;
+    leds.Set(5, 100);
+    EXPECT_TRUE(leds.driver.SwapBuffersAndTransmit());
+    leds.Finish();
+    const std::vector<sim::I2cTransfer>& log = sim::GetI2cLog();
+    ASSERT_EQ(log.size(), 2u);
+    EXPECT_EQ(log[0].address, 0x40);
+    EXPECT_EQ(log[1].address, 0x41);
+    for(const sim::I2cTransfer& t : log)
+    {
+        EXPECT_TRUE(t.dma);
+        EXPECT_EQ(t.data.size(), 65u);
+        EXPECT_EQ(t.data[0], 0x06);
+    }
+    leds.ExpectRegisters();
+
+    // nothing changed, nothing sent
+    sim::ClearI2cLog();
+    EXPECT_TRUE(leds.driver.SwapBuffersAndTransmit());
+    EXPECT_FALSE(leds.driver.IsTransmitting());
+    leds.Finish();
+    EXPECT_TRUE(sim::GetI2cLog().empty());
+}
+
+TEST(dev_LedDriverPca9685, b_onlyChangesAreSent)
+{
+    Leds leds;
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+
+    // one run of registers from the first to the last change
+    sim::ClearI2cLog();
+    leds.Set(3, 1000);
+    leds.Set(9, 4095);
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+    ASSERT_EQ(sim::GetI2cLog().size(), 1u);
+    EXPECT_EQ(sim::GetI2cLog()[0].address, 0x40);
+    EXPECT_EQ(sim::GetI2cLog()[0].data[0], 0x06 + 3 * 4);
+    EXPECT_EQ(sim::GetI2cLog()[0].data.size(), 7 * 4 + 1u);
+    leds.ExpectRegisters();
+
+    // The byte in front of led 20 held the register address while it was
+    // sent, led 19 must still be right when it's sent next
+    for(int frame = 0; frame < 3; frame++)
+    {
+        sim::ClearI2cLog();
+        leds.Set(20 - frame % 2, 700 + frame);
+        leds.driver.SwapBuffersAndTransmit();
+        leds.Finish();
+        ASSERT_EQ(sim::GetI2cLog().size(), 1u);
+        EXPECT_EQ(sim::GetI2cLog()[0].address, 0x41);
+        EXPECT_EQ(sim::GetI2cLog()[0].data.size(), 5u);
+        leds.ExpectRegisters();
+    }
+
+    // setting the same value again is no change
+    sim::ClearI2cLog();
+    leds.Set(3, 1000);
+    leds.driver.SwapBuffersAndTransmit();
+    EXPECT_TRUE(sim::GetI2cLog().empty());
+}
+
+TEST(dev_LedDriverPca9685, c_busyFramesAreCoalesced)
+{
+    Leds leds;
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+
+    sim::ClearI2cLog();
+    leds.Set(0, 10);
+    EXPECT_TRUE(leds.driver.SwapBuffersAndTransmit());
+    // the bus is still busy, so these wait for the next call
+    leds.Set(1, 20);
+    leds.Set(31, 30);
+    EXPECT_FALSE(leds.driver.SwapBuffersAndTransmit());
+    leds.Set(2, 40);
+    EXPECT_FALSE(leds.driver.SwapBuffersAndTransmit());
+    leds.Finish();
+    ASSERT_EQ(sim::GetI2cLog().size(), 1u);
+
+    EXPECT_TRUE(leds.driver.SwapBuffersAndTransmit());
+    leds.Finish();
+    const std::vector<sim::I2cTransfer>& log = sim::GetI2cLog();
+    ASSERT_EQ(log.size(), 3u);
+    EXPECT_EQ(log[1].data[0], 0x06 + 1 * 4);
+    EXPECT_EQ(log[1].data.size(), 2 * 4 + 1u);
+    EXPECT_EQ(log[2].data[0], 0x06 + 15 * 4);
+    leds.ExpectRegisters();
+}
+
+TEST(dev_LedDriverPca9685, d_failedTransferSendsAll)
+{
+    Leds leds;
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+
+    // the second chip drops off the bus and misses its update
+    sim::AttachI2cDevice(I2CHandle::Config::Peripheral::I2C_1, 0x41, nullptr);
+    leds.Set(16, 500);
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+    sim::AttachI2cDevice(
+        I2CHandle::Config::Peripheral::I2C_1, 0x41, &leds.chips[1]);
+
+    sim::ClearI2cLog();
+    leds.driver.SwapBuffersAndTransmit();
+    leds.Finish();
+    const std::vector<sim::I2cTransfer>& log = sim::GetI2cLog();
+    ASSERT_EQ(log.size(), 2u);
+    EXPECT_EQ(log[0].data.size(), 65u);
+    EXPECT_EQ(log[1].data.size(), 65u);
+    leds.ExpectRegisters();
+}
+
+TEST(dev_LedDriverPca9685, e_gammaAndColors)
+{
+    Leds leds;
+    // 8 bit and float brightness through the gamma table, interpolated
+    leds.driver.SetLed(0, (uint8_t)128);
+    leds.raw[0] = 594;
+    leds.driver.SetLed(1, 0.5f);
+    leds.raw[1] = 588;
+
+    // Colors on the elements of two RGB leds, wired in a different order
+    const PackedColor colors[2]
+        = {PackedColor(255, 128, 0), PackedColor(0, 0, 255)};
+    const uint8_t rgb_leds[][3] = {{2, 3, 4}, {31, 30, 29}};
+    leds.driver.SetColors(colors, rgb_leds, 2);
+    leds.raw[2]  = 4095;
+    leds.raw[3]  = 594;
+    leds.raw[29] = 4095;
+    EXPECT_TRUE(leds.driver.SwapBuffersAndTransmit());
+    leds.Finish();
+    leds.ExpectRegisters();
+}
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "hid/led.h"
+#include "hid/rgb_led.h"
+#include "per/gpio_pwm.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+using Periph = TimerHandle::Config::Peripheral;
+using Chn    = TimerHandle::Channel;
+
+// Words of a pattern that touch a pin
+size_t CountBits(const std::vector<uint32_t>& pattern, uint8_t pin)
+{
+    size_t n = 0;
+    for(uint32_t word : pattern)
+        n += ((word >> pin) & 1) + ((word >> (pin + 16)) & 1);
+    return n;
+}
+
+} // namespace
+
+TEST(hid_Led, a_timerPwm)
+{
+    sim::Reset();
+    const dsy_gpio_pin pin = {DSY_GPIOC, 7}; // TIM3 channel 2
+    Periph             periph;
+    Chn                chn;
+    ASSERT_TRUE(TimerHandle::GetPwmChannel(pin, periph, chn));
+    EXPECT_EQ(periph, Periph::TIM_3);
+    EXPECT_EQ(chn, Chn::TWO);
+
+    // Without a timer, the pin keeps software PWM
+    Led plain;
+    plain.Init(pin, false);
+    EXPECT_FALSE(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).enabled);
+    EXPECT_EQ(sim::GetPinMode(pin), DSY_GPIO_MODE_OUTPUT_PP);
+
+    // The timer is the user's, and can be shared
+    TimerHandle         tim;
+    TimerHandle::Config cfg;
+    cfg.periph = Periph::TIM_3;
+    cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    tim.Init(cfg);
+    tim.SetPeriod(4095);
+    Led led;
+    led.Init(pin, false, tim);
+    sim::TimPwm pwm = sim::GetTimPwm(Periph::TIM_3, Chn::TWO);
+    EXPECT_TRUE(pwm.enabled);
+    EXPECT_FALSE(pwm.invert);
+    EXPECT_EQ(pwm.compare, 0u);
+    EXPECT_EQ(sim::GetTimPeriod(Periph::TIM_3), 4095u);
+
+    // Cubed, in 12 bits, and full on beyond the period
+    led.Set(0.5f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 512u);
+    led.Set(1.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 4096u);
+    led.Set(2.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 4096u);
+
+    // Another LED on the same timer leaves the first one alone
+    Led other;
+    other.Init({DSY_GPIOC, 6}, true, tim);
+    other.Set(0.1f);
+    EXPECT_TRUE(sim::GetTimPwm(Periph::TIM_3, Chn::ONE).invert);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::ONE).compare, 4u);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 4096u);
+    EXPECT_EQ(sim::GetTimPeriod(Periph::TIM_3), 4095u);
+
+    // The period is left alone, the compare value follows it
+    tim.SetPeriod(1023);
+    led.Set(0.5f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 128u);
+    led.Set(1.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).compare, 1024u);
+
+    // A pin on another timer falls back to software PWM
+    Led elsewhere;
+    elsewhere.Init({DSY_GPIOB, 6}, false, tim);
+    EXPECT_FALSE(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).enabled);
+    EXPECT_EQ(sim::GetPinMode({DSY_GPIOB, 6}), DSY_GPIO_MODE_OUTPUT_PP);
+
+    // Nothing to do per frame
+    for(int i = 0; i < 100; i++)
+        led.Update();
+    EXPECT_EQ(sim::GetPinWrites(pin), 0u);
+}
+
+TEST(hid_Led, b_softwarePwm)
+{
+    sim::Reset();
+    const dsy_gpio_pin pin = {DSY_GPIOC, 1};
+    Periph             periph;
+    Chn                chn;
+    EXPECT_FALSE(TimerHandle::GetPwmChannel(pin, periph, chn));
+    // TIM2 keeps the system time
+    EXPECT_FALSE(TimerHandle::GetPwmChannel({DSY_GPIOA, 5}, periph, chn));
+
+    Led led;
+    led.Init(pin, false, 1000.f);
+    EXPECT_EQ(sim::GetPinMode(pin), DSY_GPIO_MODE_OUTPUT_PP);
+    led.Set(0.5f);
+    int high = 0;
+    for(int i = 0; i < 1000; i++)
+    {
+        led.Update();
+        high += sim::GetPin(pin) ? 1 : 0;
+    }
+    // 120Hz with about 8 updates per period, so only roughly 1/8 on
+    EXPECT_EQ(sim::GetPinWrites(pin), 1000u);
+    EXPECT_GT(high, 100);
+    EXPECT_LT(high, 200);
+}
+
+TEST(hid_Led, c_gpioPwm)
+{
+    sim::Reset();
+    std::vector<uint32_t> pattern(256, 0xdeadbeef);
+    GpioPwm               pwm;
+    GpioPwm::Config       cfg;
+    cfg.Defaults();
+    cfg.port = DSY_GPIOB;
+
+    cfg.periph = Periph::TIM_2;
+    EXPECT_EQ(pwm.Init(cfg, pattern.data(), 256), GpioPwm::Result::ERR);
+    cfg.periph = Periph::TIM_4;
+    EXPECT_EQ(pwm.Init(cfg, pattern.data(), 1), GpioPwm::Result::ERR);
+    cfg.freq = 1000000;
+    EXPECT_EQ(pwm.Init(cfg, pattern.data(), 256), GpioPwm::Result::ERR);
+    cfg.freq = 500;
+    ASSERT_EQ(pwm.Init(cfg, pattern.data(), 256), GpioPwm::Result::OK);
+    EXPECT_EQ(pattern, std::vector<uint32_t>(256, 0));
+    EXPECT_EQ(pwm.InitPin(16, false), GpioPwm::Result::ERR);
+    ASSERT_EQ(pwm.Start(), GpioPwm::Result::OK);
+
+    const dsy_gpio_pin red = {DSY_GPIOB, 12}, inv = {DSY_GPIOB, 2};
+    Led                led, inverted, elsewhere;
+    led.Init(red, false, pwm);
+    inverted.Init(inv, true, pwm);
+    EXPECT_EQ(sim::GetPinMode(red), DSY_GPIO_MODE_OUTPUT_PP);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 0.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(inv), 1.f);
+
+    led.Set(0.5f);
+    EXPECT_EQ(pwm.Get(12), 32u);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 32.f / 256.f);
+    inverted.Set(0.5f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(inv), 1.f - 32.f / 256.f);
+    EXPECT_EQ(pattern[0], (1u << 12) | (0x10000u << 2));
+    EXPECT_EQ(pattern[32], (0x10000u << 12) | (1u << 2));
+
+    // Changing the level moves the edge, and only touches 2 words
+    for(int i = 0; i <= 100; i++)
+        led.Set(i / 100.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 1.f);
+    EXPECT_EQ(CountBits(pattern, 12), 1u);
+    led.Set(0.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 0.f);
+    EXPECT_EQ(CountBits(pattern, 12), 1u);
+    led.Set(0.9f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 187.f / 256.f);
+    EXPECT_EQ(CountBits(pattern, 12), 2u);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(inv), 1.f - 32.f / 256.f);
+    led.Update();
+    EXPECT_EQ(sim::GetPinWrites(red), 1u); // from InitPin()
+
+    // A pin on another port falls back to software PWM
+    elsewhere.Init({DSY_GPIOC, 7}, false, pwm);
+    EXPECT_FALSE(sim::GetTimPwm(Periph::TIM_3, Chn::TWO).enabled);
+    EXPECT_EQ(sim::GetPinMode({DSY_GPIOC, 7}), DSY_GPIO_MODE_OUTPUT_PP);
+
+    RgbLed rgb;
+    rgb.Init({DSY_GPIOB, 3}, {DSY_GPIOB, 4}, {DSY_GPIOB, 5}, false, pwm);
+    rgb.Set(1.f, 0.5f, 0.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty({DSY_GPIOB, 3}), 1.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty({DSY_GPIOB, 4}), 32.f / 256.f);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty({DSY_GPIOB, 5}), 0.f);
+
+    EXPECT_EQ(pwm.Stop(), GpioPwm::Result::OK);
+    EXPECT_FLOAT_EQ(sim::GetPinDuty(red), 0.f);
+}
+
+TEST(hid_Led, d_timerDefaultPeriod)
+{
+    sim::Reset();
+    // TIM4 keeps its default period of 0xffff
+    TimerHandle         tim;
+    TimerHandle::Config cfg;
+    cfg.periph = Periph::TIM_4;
+    cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    tim.Init(cfg);
+    EXPECT_EQ(sim::GetTimPeriod(Periph::TIM_4), 0xffffu);
+
+    // The compare register only holds 16 bits
+    tim.SetPwmCompare(Chn::ONE, 0x10000);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).compare, 0u);
+
+    // Full on stays on, short of one tick
+    Led led;
+    led.Init({DSY_GPIOB, 6}, false, tim);
+    EXPECT_TRUE(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).enabled);
+    led.Set(1.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).compare, 0xffffu);
+    led.Set(0.5f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).compare, 8192u);
+    led.Set(0.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_4, Chn::ONE).compare, 0u);
+
+    // The 32-bit TIM5 has no such limit below its own default period
+    TimerHandle tim5;
+    cfg.periph = Periph::TIM_5;
+    tim5.Init(cfg);
+    Led wide;
+    wide.Init({DSY_GPIOA, 0}, false, tim5);
+    wide.Set(1.f);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_5, Chn::ONE).compare, 0xffffffffu);
+    tim5.SetPwmCompare(Chn::ONE, 0x10000);
+    EXPECT_EQ(sim::GetTimPwm(Periph::TIM_5, Chn::ONE).compare, 0x10000u);
+}
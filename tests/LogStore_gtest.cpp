@@ -0,0 +1,277 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include "util/LogStore.h"
+#include "FlashSimulator.h"
+
+using namespace daisy;
+
+namespace
+{
+constexpr uint32_t kSectorSize = 512;
+constexpr uint32_t kNumSectors = 8;
+constexpr size_t   kNumKeys    = 16;
+
+using Store = LogStore<FlashSimulator, kNumKeys>;
+
+std::string GetString(const Store& store, uint16_t key)
+{
+    uint16_t       size;
+    const uint8_t* data = store.Get(key, &size);
+    if(data == nullptr)
+        return "<none>";
+    return std::string(reinterpret_cast<const char*>(data), size);
+}
+
+Store::Result WriteString(Store& store, uint16_t key, const std::string& str)
+{
+    return store.Write(key, str.data(), str.size());
+}
+
+// Value of the n-th write in the pseudo random test sequences
+std::string MakeValue(uint32_t n)
+{
+    return std::string("value ") + std::to_string(n)
+           + std::string(n % 37, 'x');
+}
+} // namespace
+
+TEST(util_LogStore, a_basics)
+{
+    FlashSimulator flash(kSectorSize * kNumSectors, kSectorSize);
+    Store          store;
+    ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+    EXPECT_FALSE(store.Contains(0));
+    EXPECT_EQ(store.Get(0), nullptr);
+    EXPECT_EQ(store.GetUsedBytes(), 0u);
+
+    EXPECT_EQ(WriteString(store, 0, "hello"), Store::Result::OK);
+    EXPECT_EQ(WriteString(store, 3, "world!"), Store::Result::OK);
+    EXPECT_EQ(GetString(store, 0), "hello");
+    EXPECT_EQ(GetString(store, 3), "world!");
+    EXPECT_EQ(store.GetUsedBytes(), 16u + 16u);
+
+    // overwrite
+    EXPECT_EQ(WriteString(store, 0, "hi"), Store::Result::OK);
+    EXPECT_EQ(GetString(store, 0), "hi");
+
+    // copying read
+    char buf[4] = {};
+    EXPECT_EQ(store.Read(3, buf, 3), 3u);
+    EXPECT_EQ(std::string(buf), "wor");
+    EXPECT_EQ(store.Read(1, buf, 3), 0u);
+
+    // invalid arguments
+    EXPECT_EQ(WriteString(store, kNumKeys, "x"),
+              Store::Result::ERR_INVALID_ARGUMENT);
+    std::vector<uint8_t> big(store.GetMaxValueSize() + 1);
+    EXPECT_EQ(store.Write(1, big.data(), big.size()),
+              Store::Result::ERR_INVALID_ARGUMENT);
+    EXPECT_EQ(store.Delete(1), Store::Result::ERR_NOT_FOUND);
+
+    // delete
+    EXPECT_EQ(store.Delete(3), Store::Result::OK);
+    EXPECT_FALSE(store.Contains(3));
+
+    // remount
+    Store store2;
+    ASSERT_EQ(store2.Init(&flash), Store::Result::OK);
+    EXPECT_EQ(GetString(store2, 0), "hi");
+    EXPECT_EQ(GetString(store2, 3), "<none>");
+    EXPECT_EQ(store2.GetUsedBytes(), 12u);
+}
+
+TEST(util_LogStore, b_compactionAndWear)
+{
+    FlashSimulator flash(kSectorSize * kNumSectors, kSectorSize);
+    Store          store;
+    ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+
+    // A few static values, and a lot of churn on the others
+    for(uint16_t key = 0; key < 4; key++)
+        ASSERT_EQ(WriteString(store, key, "static " + std::to_string(key)),
+                  Store::Result::OK);
+    std::map<uint16_t, std::string> model;
+    for(uint32_t n = 0; n < 5000; n++)
+    {
+        uint16_t key   = 4 + (n * 7) % (kNumKeys - 4);
+        model[key]     = MakeValue(n);
+        ASSERT_EQ(WriteString(store, key, model[key]), Store::Result::OK);
+        if(n % 3 == 0)
+            store.Process();
+        ASSERT_GE(store.GetFreeSectors(), 1u);
+    }
+
+    for(uint16_t key = 0; key < 4; key++)
+        EXPECT_EQ(GetString(store, key), "static " + std::to_string(key));
+    for(auto& kv : model)
+        EXPECT_EQ(GetString(store, kv.first), kv.second);
+
+    // Every sector is used in turn, including the ones with static data
+    uint32_t min = 0xFFFFFFFF, max = 0;
+    for(uint32_t s = 0; s < kNumSectors; s++)
+    {
+        min = std::min(min, flash.GetEraseCount(s));
+        max = std::max(max, flash.GetEraseCount(s));
+        EXPECT_LE(store.GetEraseCount(s), flash.GetEraseCount(s));
+    }
+    EXPECT_GT(min, 10u);
+    EXPECT_LE(max - min, 1u);
+
+    Store store2;
+    ASSERT_EQ(store2.Init(&flash), Store::Result::OK);
+    for(uint16_t key = 0; key < 4; key++)
+        EXPECT_EQ(GetString(store2, key), "static " + std::to_string(key));
+    for(auto& kv : model)
+        EXPECT_EQ(GetString(store2, kv.first), kv.second);
+}
+
+TEST(util_LogStore, c_deleteSurvivesCompaction)
+{
+    FlashSimulator flash(kSectorSize * kNumSectors, kSectorSize);
+    Store          store;
+    ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+    ASSERT_EQ(WriteString(store, 1, "deleted"), Store::Result::OK);
+    ASSERT_EQ(store.Delete(1), Store::Result::OK);
+    // Churn until all sectors have been compacted a couple times
+    for(uint32_t n = 0; n < 1000; n++)
+        ASSERT_EQ(WriteString(store, 2, MakeValue(n)), Store::Result::OK);
+
+    Store store2;
+    ASSERT_EQ(store2.Init(&flash), Store::Result::OK);
+    EXPECT_FALSE(store2.Contains(1));
+    EXPECT_EQ(GetString(store2, 2), MakeValue(999));
+}
+
+TEST(util_LogStore, d_full)
+{
+    FlashSimulator flash(kSectorSize * 3, kSectorSize);
+    Store          store;
+    ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+
+    // One sector of capacity with 3 sectors
+    EXPECT_EQ(store.GetCapacity(), kSectorSize - 20);
+    std::vector<uint8_t> value(100, 0x55);
+    uint16_t             key = 0;
+    while(store.Write(key, value.data(), value.size()) == Store::Result::OK)
+        key++;
+    EXPECT_EQ(key, 4);
+    EXPECT_EQ(store.Write(key, value.data(), value.size()),
+              Store::Result::ERR_FULL);
+    // Overwriting still works, as the old value is garbage
+    for(int i = 0; i < 20; i++)
+        EXPECT_EQ(store.Write(0, value.data(), value.size()),
+                  Store::Result::OK);
+    // Deleting makes room
+    EXPECT_EQ(store.Delete(1), Store::Result::OK);
+    EXPECT_EQ(store.Write(key, value.data(), value.size()), Store::Result::OK);
+}
+
+TEST(util_LogStore, e_powerLoss)
+{
+    // Runs the same sequence of writes and deletes, and cuts the power at
+    // every n-th byte that is programmed or erased. After remounting, all
+    // completed operations must have persisted, and the interrupted one must
+    // either be complete or not have happened at all.
+    std::srand(42);
+    for(uint32_t cut = 0; cut < 40000; cut += 37)
+    {
+        FlashSimulator flash(kSectorSize * kNumSectors, kSectorSize);
+        Store          store;
+        ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+        flash.CutPowerAfter(cut);
+
+        std::map<uint16_t, std::string> model;
+        uint16_t                        pending_key = 0;
+        std::string                     pending_value;
+        for(uint32_t n = 0; n < 800; n++)
+        {
+            uint16_t key  = (n * 5) % kNumKeys;
+            pending_key   = key;
+            Store::Result res;
+            if(n % 11 == 10 && model.count(key))
+            {
+                pending_value = "<none>";
+                res           = store.Delete(key);
+            }
+            else
+            {
+                pending_value = MakeValue(n);
+                res           = WriteString(store, key, pending_value);
+            }
+            if(res != Store::Result::OK)
+                break;
+            if(pending_value == "<none>")
+                model.erase(key);
+            else
+                model[key] = pending_value;
+            store.Process();
+        }
+        if(flash.IsPowered())
+            continue; // sequence finished before the cut
+
+        flash.PowerOn();
+        Store store2;
+        ASSERT_EQ(store2.Init(&flash), Store::Result::OK) << "cut " << cut;
+        for(uint16_t key = 0; key < kNumKeys; key++)
+        {
+            std::string expected
+                = model.count(key) ? model[key] : std::string("<none>");
+            std::string actual = GetString(store2, key);
+            if(key == pending_key && actual == pending_value)
+                expected = pending_value;
+            ASSERT_EQ(actual, expected) << "cut " << cut << " key " << key;
+        }
+
+        // The store keeps working after recovery
+        for(uint32_t n = 0; n < 200; n++)
+        {
+            uint16_t key = n % kNumKeys;
+            ASSERT_EQ(WriteString(store2, key, MakeValue(n)),
+                      Store::Result::OK)
+                << "cut " << cut;
+            store2.Process();
+        }
+        Store store3;
+        ASSERT_EQ(store3.Init(&flash), Store::Result::OK);
+        for(uint16_t key = 0; key < kNumKeys; key++)
+            ASSERT_EQ(GetString(store3, key),
+                      MakeValue(key < 8 ? 192 + key : 176 + key))
+                << "cut " << cut;
+    }
+}
+
+TEST(util_LogStore, f_backgroundErase)
+{
+    FlashSimulator flash(kSectorSize * kNumSectors, kSectorSize);
+    Store          store;
+    ASSERT_EQ(store.Init(&flash), Store::Result::OK);
+
+    // With Process() in the loop, writes neither start nor wait for an erase,
+    // and each erase is spread over several Process() calls.
+    uint32_t compactions = 0, erasing = 0;
+    for(uint32_t n = 0; n < 2000; n++)
+    {
+        const bool pending = flash.IsErasePending();
+        ASSERT_EQ(WriteString(store, n % 4, MakeValue(n)), Store::Result::OK);
+        EXPECT_EQ(flash.IsErasePending(), pending) << n;
+        if(store.Process())
+            compactions++;
+        if(flash.IsErasePending())
+            erasing++;
+    }
+    EXPECT_GT(compactions, 10u);
+    EXPECT_GE(erasing, 4 * compactions);
+
+    // Without Process(), writes compact and wait as a last resort
+    for(uint32_t n = 0; n < 2000; n++)
+        ASSERT_EQ(WriteString(store, n % 4, MakeValue(n)), Store::Result::OK);
+    for(uint16_t key = 0; key < 4; key++)
+        EXPECT_EQ(GetString(store, key), MakeValue(1996 + key));
+
+    Store store2;
+    ASSERT_EQ(store2.Init(&flash), Store::Result::OK);
+    for(uint16_t key = 0; key < 4; key++)
+        EXPECT_EQ(GetString(store2, key), MakeValue(1996 + key));
+}
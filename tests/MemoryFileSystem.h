@@ -0,0 +1,434 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Host-side stand-in for the file system, for testing the streaming audio
+ ** classes without an SD Card.
+ **
+ ** Files live in a global map from path to contents. MemoryFileReader
+ ** implements the FileReader backend (see FatFileReader), and logs each read
+ ** so tests can check the order in which files were accessed. MemoryFileWriter
+ ** implements the FileWriter backend (see FatFileWriter), and
+ ** MemoryDirectory the Directory backend (see FatDirectory). Directories
+ ** exist as long as there are files in them. File operations take virtual
+ ** time if an SdCardModel is active.
+ ** */
+struct MemoryFileSystem
+{
+    struct ReadLogEntry
+    {
+        std::string path;
+        size_t      size;
+    };
+
+    static std::map<std::string, std::vector<uint8_t>>& Files()
+    {
+        static std::map<std::string, std::vector<uint8_t>> files;
+        return files;
+    }
+
+    static std::vector<ReadLogEntry>& ReadLog()
+    {
+        static std::vector<ReadLogEntry> log;
+        return log;
+    }
+
+    /** Number of times a file grew into a new cluster, which makes FatFs
+     ** update the FAT */
+    static uint32_t& FatUpdates()
+    {
+        static uint32_t updates = 0;
+        return updates;
+    }
+
+    /** Date and time of the last change of a file, as FatFs reports it */
+    static std::map<std::string, uint32_t>& Times()
+    {
+        static std::map<std::string, uint32_t> times;
+        return times;
+    }
+
+    /** Number of bytes that can still be written, e.g. 0 for a full card */
+    static size_t& FreeBytes()
+    {
+        static size_t free_bytes = SIZE_MAX;
+        return free_bytes;
+    }
+
+    /** Set to make creating, removing and renaming files fail, like on a
+     ** write protected card */
+    static bool& WriteProtected()
+    {
+        static bool write_protected = false;
+        return write_protected;
+    }
+
+    static void Clear()
+    {
+        Files().clear();
+        Times().clear();
+        ReadLog().clear();
+        FatUpdates()     = 0;
+        FreeBytes()      = SIZE_MAX;
+        WriteProtected() = false;
+    }
+};
+
+struct SdCardModel;
+inline void SdCardOperation(size_t bytes, bool open);
+
+class MemoryFileReader
+{
+  public:
+    bool Open(const char* path)
+    {
+        auto it = MemoryFileSystem::Files().find(path);
+        SdCardOperation(0, true);
+        if(it == MemoryFileSystem::Files().end())
+            return false;
+        path_ = path;
+        data_ = &it->second;
+        pos_  = 0;
+        return true;
+    }
+
+    void Close() { data_ = nullptr; }
+
+    size_t Read(void* dst, size_t size)
+    {
+        if(data_ == nullptr)
+            return 0;
+        SdCardOperation(size, false);
+        size_t n = pos_ < data_->size() ? data_->size() - pos_ : 0;
+        if(n > size)
+            n = size;
+        std::memcpy(dst, data_->data() + pos_, n);
+        pos_ += n;
+        MemoryFileSystem::ReadLog().push_back({path_, size});
+        return n;
+    }
+
+    bool Seek(uint32_t pos)
+    {
+        if(data_ == nullptr || pos > data_->size())
+            return false;
+        SdCardOperation(0, false);
+        pos_ = pos;
+        return true;
+    }
+
+    uint32_t GetSize() const { return data_ ? data_->size() : 0; }
+
+    bool IsOpen() const { return data_ != nullptr; }
+
+  private:
+    std::string                 path_;
+    const std::vector<uint8_t>* data_ = nullptr;
+    size_t                      pos_  = 0;
+};
+
+/** Implements the FileWriter backend (see FatFileWriter).
+ ** Growing the file beyond the allocated clusters costs an extra operation
+ ** for updating the FAT, unless the space was preallocated.
+ ** */
+class MemoryFileWriter
+{
+  public:
+    static constexpr size_t kClusterSize = 32768;
+
+    bool Open(const char* path)
+    {
+        SdCardOperation(0, true);
+        if(MemoryFileSystem::WriteProtected())
+            return false;
+        data_ = &MemoryFileSystem::Files()[path];
+        data_->clear();
+        pos_       = 0;
+        allocated_ = 0;
+        return true;
+    }
+
+    bool Preallocate(uint32_t size)
+    {
+        if(data_ == nullptr || !data_->empty())
+            return false;
+        Allocate(size);
+        return true;
+    }
+
+    bool Close()
+    {
+        data_ = nullptr;
+        return true;
+    }
+
+    size_t Write(const void* src, size_t size)
+    {
+        if(data_ == nullptr)
+            return 0;
+        if(size > MemoryFileSystem::FreeBytes())
+            size = MemoryFileSystem::FreeBytes();
+        MemoryFileSystem::FreeBytes() -= size;
+        if(pos_ + size > allocated_)
+            Allocate(pos_ + size);
+        SdCardOperation(size, false);
+        if(data_->size() < pos_ + size)
+            data_->resize(pos_ + size);
+        std::memcpy(data_->data() + pos_, src, size);
+        pos_ += size;
+        return size;
+    }
+
+    bool Seek(uint32_t pos)
+    {
+        if(data_ == nullptr || pos > data_->size())
+            return false;
+        SdCardOperation(0, false);
+        pos_ = pos;
+        return true;
+    }
+
+    bool IsOpen() const { return data_ != nullptr; }
+
+  private:
+    void Allocate(size_t size)
+    {
+        SdCardOperation(512, false);
+        MemoryFileSystem::FatUpdates()++;
+        allocated_ = (size + kClusterSize - 1) / kClusterSize * kClusterSize;
+    }
+
+    std::vector<uint8_t>* data_      = nullptr;
+    size_t                pos_       = 0;
+    size_t                allocated_ = 0;
+};
+
+/** Implements the Directory backend (see FatDirectory). The entries are
+ ** listed in alphabetical order. */
+class MemoryDirectory
+{
+  public:
+    class Entry
+    {
+      public:
+        const char* GetName() const { return name_.c_str(); }
+        uint32_t    GetSize() const { return size_; }
+        uint32_t    GetTime() const { return time_; }
+        bool        IsDir() const { return is_dir_; }
+        bool        IsHidden() const { return false; }
+
+      private:
+        friend class MemoryDirectory;
+        std::string name_;
+        uint32_t    size_   = 0;
+        uint32_t    time_   = 0;
+        bool        is_dir_ = false;
+    };
+
+    bool Open(const char* path)
+    {
+        std::string prefix = path;
+        if(!prefix.empty() && prefix.back() != '/')
+            prefix += '/';
+        entries_.clear();
+        next_ = 0;
+        for(const auto& f : MemoryFileSystem::Files())
+        {
+            if(f.first.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            Entry       e;
+            std::string rest = f.first.substr(prefix.size());
+            size_t      sep  = rest.find('/');
+            e.name_          = rest.substr(0, sep);
+            e.is_dir_        = sep != std::string::npos;
+            if(!e.is_dir_)
+            {
+                e.size_ = f.second.size();
+                e.time_ = MemoryFileSystem::Times()[f.first];
+            }
+            if(entries_.empty() || entries_.back().name_ != e.name_)
+                entries_.push_back(e);
+        }
+        open_ = !entries_.empty();
+        return open_;
+    }
+
+    void Close() { open_ = false; }
+
+    bool Read(Entry* entry)
+    {
+        if(!open_ || next_ >= entries_.size())
+            return false;
+        *entry = entries_[next_++];
+        return true;
+    }
+
+    static bool Remove(const char* path)
+    {
+        return !MemoryFileSystem::WriteProtected()
+               && MemoryFileSystem::Files().erase(path) > 0;
+    }
+
+    static bool Rename(const char* from, const char* to)
+    {
+        auto& files = MemoryFileSystem::Files();
+        auto  it    = files.find(from);
+        if(MemoryFileSystem::WriteProtected() || it == files.end())
+            return false;
+        std::vector<uint8_t> data = std::move(it->second);
+        files.erase(it);
+        files[to] = std::move(data);
+        return true;
+    }
+
+  private:
+    std::vector<Entry> entries_;
+    size_t             next_ = 0;
+    bool               open_ = false;
+};
+
+/** Builds a WAV file in memory
+ ** \param format_tag 1 for PCM, 3 for float, 0xFFFE for extensible (PCM subformat)
+ ** \param channels number of channels
+ ** \param bytes container size per sample: 2, 3 or 4
+ ** \param samples interleaved samples in the range [-1, 1)
+ ** \param extra_chunk adds a LIST chunk between "fmt " and "data"
+ */
+inline std::vector<uint8_t> MakeWavFile(uint16_t                  format_tag,
+                                        uint16_t                  channels,
+                                        uint16_t                  bytes,
+                                        const std::vector<float>& samples,
+                                        bool                      extra_chunk = false)
+{
+    std::vector<uint8_t> f;
+    auto put16 = [&f](uint32_t v) {
+        f.push_back(v & 0xFF);
+        f.push_back((v >> 8) & 0xFF);
+    };
+    auto put32 = [&](uint32_t v) {
+        put16(v & 0xFFFF);
+        put16(v >> 16);
+    };
+    auto putId = [&f](const char* id) { f.insert(f.end(), id, id + 4); };
+
+    bool     extensible = format_tag == 0xFFFE;
+    uint32_t fmt_size   = extensible ? 40 : 16;
+    uint32_t data_size  = samples.size() * bytes;
+    putId("RIFF");
+    put32(0); // patched below
+    putId("WAVE");
+    putId("fmt ");
+    put32(fmt_size);
+    put16(format_tag);
+    put16(channels);
+    put32(48000);
+    put32(48000 * channels * bytes);
+    put16(channels * bytes);
+    put16(bytes * 8);
+    if(extensible)
+    {
+        put16(22);
+        put16(bytes * 8);
+        put32(0);
+        put16(1); // KSDATAFORMAT_SUBTYPE_PCM
+        for(int i = 0; i < 14; i++)
+            f.push_back(0);
+    }
+    if(extra_chunk)
+    {
+        putId("LIST");
+        put32(7);
+        for(int i = 0; i < 8; i++) // odd size + pad byte
+            f.push_back('x');
+    }
+    putId("data");
+    put32(data_size);
+    for(float s : samples)
+    {
+        if(format_tag == 3)
+        {
+            uint32_t v;
+            std::memcpy(&v, &s, 4);
+            put32(v);
+            continue;
+        }
+        int64_t v = static_cast<int64_t>(s * 2147483648.0);
+        if(v > 2147483647)
+            v = 2147483647;
+        uint32_t u = static_cast<uint32_t>(v);
+        for(int b = 4 - bytes; b < 4; b++)
+            f.push_back((u >> (8 * b)) & 0xFF);
+    }
+    uint32_t riff_size = f.size() - 8;
+    std::memcpy(&f[4], &riff_size, 4);
+    return f;
+}
+
+/** Timing model of an SD Card, to check buffer sizes of the streaming
+ ** classes on the host.
+ **
+ ** Every file operation of MemoryFileReader takes virtual time: a command
+ ** latency, the transfer time at the given throughput, and now and then a
+ ** long stall (like the card's internal housekeeping). While an operation is
+ ** in progress, the audio callback keeps running every audio_period_us, like
+ ** the audio interrupt preempting the main loop on the target.
+ ** */
+struct SdCardModel
+{
+    double command_us      = 300.;  /**< latency of every operation */
+    double open_us         = 2000.; /**< extra latency of opening a file */
+    double bytes_per_us    = 10.;   /**< throughput, 10MB/s */
+    double stall_chance    = 0.;    /**< chance of a stall per operation */
+    double max_stall_us    = 0.;    /**< stalls are uniformly up to this long */
+    double audio_period_us = 1000.; /**< 48 frames at 48kHz */
+    std::function<void()> audio_callback;
+
+    double   now_us        = 0.;
+    double   next_audio_us = 0.;
+    uint32_t seed          = 1;
+
+    /** Lets time pass, running the audio callback when it is due */
+    void Advance(double us)
+    {
+        now_us += us;
+        while(next_audio_us <= now_us)
+        {
+            next_audio_us += audio_period_us;
+            if(audio_callback)
+                audio_callback();
+        }
+    }
+
+    /** Accounts for a file operation transferring the given number of bytes */
+    void Operation(size_t bytes, bool open = false)
+    {
+        double t = command_us + bytes / bytes_per_us + (open ? open_us : 0.);
+        if(Random() < stall_chance)
+            t += Random() * max_stall_us;
+        Advance(t);
+    }
+
+    /** \return pseudo random number in [0, 1) */
+    double Random()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.;
+    }
+
+    /** The model in use by MemoryFileReader, if any */
+    static SdCardModel*& Active()
+    {
+        static SdCardModel* model = nullptr;
+        return model;
+    }
+};
+
+inline void SdCardOperation(size_t bytes, bool open)
+{
+    if(SdCardModel::Active())
+        SdCardModel::Active()->Operation(bytes, open);
+}
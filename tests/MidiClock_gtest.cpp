@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include "hid/midi_clock.h"
+
+using namespace daisy;
+
+namespace
+{
+// 120 BPM
+constexpr float kPeriodUs = 2500000.f / 120.f;
+
+// Feeds num_ticks clocks at the given period, with +/- jitter_us of random jitter.
+uint32_t FeedClocks(MidiClockTracker& clock,
+                    uint32_t          start_us,
+                    int               num_ticks,
+                    float             period_us,
+                    int               jitter_us)
+{
+    double t = start_us;
+    for(int i = 0; i < num_ticks; i++)
+    {
+        int jitter = jitter_us > 0
+                         ? (std::rand() % (2 * jitter_us + 1)) - jitter_us
+                         : 0;
+        clock.Tick(static_cast<uint32_t>(t) + jitter);
+        t += period_us;
+    }
+    return static_cast<uint32_t>(t - period_us);
+}
+} // namespace
+
+TEST(hid_MidiClockTracker, a_tempoEstimate)
+{
+    MidiClockTracker clock;
+    clock.Init();
+    EXPECT_FLOAT_EQ(clock.GetBpm(), 0.f);
+    EXPECT_FALSE(clock.IsLocked());
+
+    // clean clock
+    FeedClocks(clock, 1000, 48, kPeriodUs, 0);
+    EXPECT_TRUE(clock.IsLocked());
+    EXPECT_NEAR(clock.GetBpm(), 120.f, 0.01f);
+
+    // jittery clock, +/- 1ms of jitter on 20.8ms ticks
+    std::srand(1234);
+    clock.Init();
+    FeedClocks(clock, 1000, 24 * 16, kPeriodUs, 1000);
+    EXPECT_NEAR(clock.GetBpm(), 120.f, 0.5f);
+    EXPECT_GT(clock.GetJitterUs(), 100.f);
+}
+
+TEST(hid_MidiClockTracker, b_tempoChange)
+{
+    MidiClockTracker clock;
+    clock.Init();
+    uint32_t last = FeedClocks(clock, 0, 24 * 8, kPeriodUs, 0);
+    const float period90 = 2500000.f / 90.f;
+    FeedClocks(clock, last + period90, 24 * 16, period90, 0);
+    EXPECT_NEAR(clock.GetBpm(), 90.f, 0.1f);
+}
+
+TEST(hid_MidiClockTracker, c_timestampWrap)
+{
+    MidiClockTracker clock;
+    clock.Init();
+    // start right before the 32 bit microsecond counter wraps
+    FeedClocks(clock, 0xFFFFFFFFu - 10 * 20833u, 48, kPeriodUs, 0);
+    EXPECT_NEAR(clock.GetBpm(), 120.f, 0.01f);
+}
+
+TEST(hid_MidiClockTracker, d_transport)
+{
+    MidiClockTracker clock;
+    clock.Init();
+    EXPECT_FALSE(clock.IsRunning());
+
+    // Clocks while stopped don't advance the song position
+    uint32_t last = FeedClocks(clock, 0, 48, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 0u);
+
+    // The first clock after start is tick 0
+    clock.ProcessRealTime(0xFA, last);
+    EXPECT_TRUE(clock.IsRunning());
+    last = FeedClocks(clock, last + kPeriodUs, 1, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 0u);
+    last = FeedClocks(clock, last + kPeriodUs, 30, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 30u);
+    EXPECT_NEAR(clock.GetBeatPosition(last), 30.f / 24.f, 1e-3f);
+
+    // Stop holds the position
+    clock.ProcessRealTime(0xFC, last);
+    EXPECT_FALSE(clock.IsRunning());
+    last = FeedClocks(clock, last + kPeriodUs, 10, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 30u);
+
+    // Song position pointer + continue lands on the new position
+    clock.SetSongPosition(8); // 8 16ths = 2 beats
+    clock.ProcessRealTime(0xFB, last);
+    last = FeedClocks(clock, last + kPeriodUs, 1, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 48u);
+    FeedClocks(clock, last + kPeriodUs, 1, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 49u);
+}
+
+TEST(hid_MidiClockTracker, e_beatPrediction)
+{
+    MidiClockTracker clock;
+    clock.Init();
+    clock.Start();
+    // 2 beats + 6 ticks
+    uint32_t last = FeedClocks(clock, 5000, 24 * 2 + 7, kPeriodUs, 0);
+    EXPECT_EQ(clock.GetSongTick(), 54u);
+
+    // halfway into the 7th tick of the beat
+    uint32_t now = last + static_cast<uint32_t>(kPeriodUs / 2);
+    EXPECT_NEAR(clock.GetBeatPhase(now), 6.5f / 24.f, 1e-3f);
+
+    // next beat is 18 ticks after the last received clock
+    uint32_t expected = last + static_cast<uint32_t>(18 * kPeriodUs);
+    EXPECT_NEAR(static_cast<float>(clock.GetNextBeatTime(now)),
+                static_cast<float>(expected),
+                2.f);
+
+    // ...which is 17.5 ticks from now at 48kHz
+    float samples = 17.5f * kPeriodUs * 48000.f * 1e-6f;
+    EXPECT_NEAR(
+        static_cast<float>(clock.GetSamplesToNextBeat(now, 48000.f)),
+        samples,
+        2.f);
+}
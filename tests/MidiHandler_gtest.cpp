@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include "hid/midi.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+const UartHandler::Config::Peripheral kUart
+    = UartHandler::Config::Peripheral::USART_1;
+
+void Send(const std::vector<uint8_t>& bytes)
+{
+    sim::UartReceive(kUart, bytes.data(), bytes.size());
+    // 320us per byte at 31250 baud
+    sim::Advance(bytes.size() * 320);
+}
+
+} // namespace
+
+TEST(hid_MidiHandler, a_uartInput)
+{
+    sim::Reset();
+    MidiHandler midi;
+    midi.Init(MidiHandler::INPUT_MODE_UART1, MidiHandler::OUTPUT_MODE_UART1);
+    midi.StartReceive();
+
+    // note on, then another by running status, with a clock in between
+    Send({0x91, 60, 100, 0xF8, 62, 90});
+    midi.Listen();
+    ASSERT_TRUE(midi.HasEvents());
+    MidiEvent e = midi.PopEvent();
+    EXPECT_EQ(e.type, NoteOn);
+    EXPECT_EQ(e.channel, 1);
+    EXPECT_EQ(e.AsNoteOn().note, 60);
+    ASSERT_TRUE(midi.HasEvents());
+    e = midi.PopEvent();
+    EXPECT_EQ(e.AsNoteOn().note, 62);
+    EXPECT_EQ(e.AsNoteOn().velocity, 90);
+    EXPECT_FALSE(midi.HasEvents());
+
+    uint8_t cc[3] = {0xB0, 7, 127};
+    midi.SendMessage(cc, 3);
+    ASSERT_EQ(sim::GetUartOutput(kUart).size(), 3u);
+    EXPECT_EQ(sim::GetUartOutput(kUart)[0], 0xB0);
+}
+
+TEST(hid_MidiHandler, b_overrunRecovery)
+{
+    sim::Reset();
+    MidiHandler midi;
+    midi.Init(MidiHandler::INPUT_MODE_UART1, MidiHandler::OUTPUT_MODE_NONE);
+    midi.StartReceive();
+
+    // a dense burst while the main loop is busy overruns the receiver
+    std::vector<uint8_t> burst;
+    for(int i = 0; i < 100; i++)
+        burst.insert(burst.end(), {0xB0, uint8_t(i), 64});
+    Send(burst);
+    midi.Listen();
+    while(midi.HasEvents())
+        midi.PopEvent();
+
+    // Listen() restarted the reception, and the parser
+    Send({0x80, 60, 0});
+    midi.Listen();
+    ASSERT_TRUE(midi.HasEvents());
+    EXPECT_EQ(midi.PopEvent().type, NoteOff);
+}
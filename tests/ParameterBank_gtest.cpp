@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "hid/parameter_bank.h"
+
+using namespace daisy;
+
+TEST(hid_ParameterBank, a_exp2Accuracy)
+{
+    float max_error = 0.f;
+    for(int i = -126 * 256; i < 128 * 256; i++)
+    {
+        float  x     = i / 256.f + 0.001f;
+        double exact = exp2((double)x);
+        float  error = (float)fabs(ParameterBank<1>::Exp2(x) / exact - 1.0);
+        max_error    = error > max_error ? error : max_error;
+    }
+    EXPECT_LT(max_error, 2e-7f);
+    EXPECT_FLOAT_EQ(ParameterBank<1>::Exp2(10.f), 1024.f);
+    EXPECT_FLOAT_EQ(ParameterBank<1>::Exp2(-0.5f), sqrtf(0.5f));
+    // clamped instead of overflowing
+    EXPECT_GT(ParameterBank<1>::Exp2(1000.f), 1e38f);
+    EXPECT_GT(ParameterBank<1>::Exp2(-1000.f), 0.f);
+}
+
+TEST(hid_ParameterBank, b_matchesParameter)
+{
+    const Parameter::Curve curves[] = {Parameter::LINEAR,
+                                       Parameter::EXPONENTIAL,
+                                       Parameter::LOGARITHMIC,
+                                       Parameter::CUBE};
+    const float            ranges[][2]
+        = {{0.f, 1.f}, {20.f, 20000.f}, {-5.f, 5.f}, {0.f, 0.001f}};
+    const size_t kNum = 16;
+
+    uint16_t                 adc[kNum];
+    AnalogControl            bank_ctrl[kNum], param_ctrl[kNum];
+    Parameter                param[kNum];
+    ParameterBank<kNum + 1> bank;
+    for(size_t i = 0; i < kNum; i++)
+    {
+        adc[i] = 0;
+        bank_ctrl[i].Init(&adc[i], 1000.f);
+        param_ctrl[i].Init(&adc[i], 1000.f);
+        const float* r = ranges[i / 4];
+        // log curves need a positive range
+        float min = curves[i % 4] == Parameter::LOGARITHMIC ? 1.f + r[0] * r[0]
+                                                             : r[0];
+        param[i].Init(param_ctrl[i], min, r[1] + 10.f, curves[i % 4]);
+        bank.Init(i, &bank_ctrl[i], min, r[1] + 10.f, curves[i % 4]);
+    }
+
+    for(int n = 0; n < 2000; n++)
+    {
+        for(size_t i = 0; i < kNum; i++)
+            adc[i] = (uint16_t)((n * 337 + i * 4099) % 65536);
+        bank.Process();
+        for(size_t i = 0; i < kNum; i++)
+        {
+            float expected = param[i].Process();
+            // the exponent is rounded differently, which Parameter has too
+            ASSERT_NEAR(
+                bank.Value(i), expected, fabsf(expected) * 4e-6f + 1e-6f)
+                << "parameter " << i << " block " << n;
+            ASSERT_EQ(bank.Values()[i], bank.Value(i));
+        }
+    }
+    // never initialized
+    EXPECT_EQ(bank.Value(kNum), 0.f);
+    EXPECT_EQ(bank.Value(kNum + 1), 0.f);
+}
+
+TEST(hid_ParameterBank, c_changeCurve)
+{
+    uint16_t      adc = 32768;
+    AnalogControl ctrl;
+    ctrl.Init(&adc, 1000.f); // no slew at this rate
+
+    ParameterBank<2> bank;
+    bank.Init(0, &ctrl, 1.f, 100.f, Parameter::LOGARITHMIC);
+    bank.Process();
+    EXPECT_NEAR(bank.Value(0), 10.f, 1e-4f);
+
+    // no longer goes through the exponential
+    bank.Init(0, &ctrl, 1.f, 100.f, Parameter::LINEAR);
+    bank.Process();
+    EXPECT_NEAR(bank.Value(0), 50.5f, 1e-4f);
+
+    bank.Init(1, &ctrl, 1.f, 100.f, Parameter::LOGARITHMIC);
+    bank.Init(1, &ctrl, 0.f, 8.f, Parameter::CUBE);
+    bank.Process();
+    EXPECT_NEAR(bank.Value(1), 1.f, 1e-5f);
+}
+
+TEST(hid_ParameterBank, d_controlSettings)
+{
+    // Flipped, inverted and bipolar inputs are smoothed like
+    // AnalogControl::Process() does
+    uint16_t      adc = 0;
+    AnalogControl bank_ctrl[3], ref_ctrl[3];
+    bank_ctrl[0].Init(&adc, 1000.f, true);
+    ref_ctrl[0].Init(&adc, 1000.f, true);
+    bank_ctrl[1].Init(&adc, 1000.f, false, true, 0.01f);
+    ref_ctrl[1].Init(&adc, 1000.f, false, true, 0.01f);
+    bank_ctrl[2].InitBipolarCv(&adc, 1000.f);
+    ref_ctrl[2].InitBipolarCv(&adc, 1000.f);
+
+    ParameterBank<3> bank;
+    for(size_t i = 0; i < 3; i++)
+        bank.Init(i, &bank_ctrl[i], 0.f, 1.f, Parameter::LINEAR);
+    for(int n = 0; n < 500; n++)
+    {
+        adc = (uint16_t)(n * 1237);
+        bank.Process();
+        for(size_t i = 0; i < 3; i++)
+        {
+            float expected = ref_ctrl[i].Process();
+            ASSERT_NEAR(bank.Value(i), expected, 1e-5f) << i << " " << n;
+            // the control's value is kept current
+            ASSERT_EQ(bank_ctrl[i].Value(), bank.Value(i));
+        }
+    }
+}
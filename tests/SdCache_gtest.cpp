@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/sd_cache.h"
+
+namespace
+{
+constexpr uint32_t kSector = 512;
+
+// Simulated card behind the cache, logs each transfer
+struct Card
+{
+    struct Read
+    {
+        uint32_t sector, count;
+    };
+
+    std::vector<uint8_t> data;
+    std::vector<Read>    reads;
+
+    void Resize(uint32_t sectors)
+    {
+        data.resize(sectors * kSector);
+        for(size_t i = 0; i < data.size(); i++)
+            data[i] = uint8_t(i / kSector * 7 + i);
+    }
+
+    uint32_t Sectors() const { return data.size() / kSector; }
+
+    // Writes through the cache the way SD_write does
+    void Write(const std::vector<uint8_t>& buff, uint32_t sector)
+    {
+        std::copy(buff.begin(), buff.end(), data.begin() + sector * kSector);
+        dsy_sd_cache_write(buff.data(), sector, buff.size() / kSector);
+    }
+};
+
+Card card;
+
+class util_SdCache : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        card.Resize(256);
+        card.reads.clear();
+        // 4 lines of 8 sectors, read ahead 2 lines, unaligned on purpose
+        memory.resize(4 * (8 * kSector + 8) + 32 + 1);
+        uint32_t lines
+            = dsy_sd_cache_init(memory.data() + 1, memory.size() - 1, 8, 2);
+        ASSERT_EQ(lines, 4u);
+    }
+
+    void TearDown() override { dsy_sd_cache_disable(); }
+
+    // Reads through the cache and checks the data against the card
+    void Read(uint32_t sector, uint32_t count)
+    {
+        std::vector<uint8_t> buff(count * kSector);
+        ASSERT_EQ(dsy_sd_cache_read(buff.data(), sector, count), 0);
+        EXPECT_TRUE(std::equal(
+            buff.begin(), buff.end(), card.data.begin() + sector * kSector))
+            << "sector " << sector;
+    }
+
+    dsy_sd_cache_stats Stats()
+    {
+        dsy_sd_cache_stats s;
+        dsy_sd_cache_get_stats(&s);
+        return s;
+    }
+
+    std::vector<uint8_t> memory;
+};
+} // namespace
+
+extern "C" int
+dsy_sd_cache_read_card(uint8_t* buff, uint32_t sector, uint32_t count)
+{
+    card.reads.push_back({sector, count});
+    if(sector + count > card.Sectors())
+        return -1;
+    std::copy(card.data.begin() + sector * kSector,
+              card.data.begin() + (sector + count) * kSector,
+              buff);
+    return 0;
+}
+
+extern "C" uint32_t dsy_sd_cache_card_sectors(void)
+{
+    return card.Sectors();
+}
+
+TEST_F(util_SdCache, a_hitAndMiss)
+{
+    Read(10, 1);
+    ASSERT_EQ(card.reads.size(), 1u);
+    EXPECT_EQ(card.reads[0].sector, 8u);
+    EXPECT_EQ(card.reads[0].count, 8u);
+
+    // The rest of the line is a hit
+    Read(8, 2);
+    Read(15, 1);
+    EXPECT_EQ(card.reads.size(), 1u);
+
+    // Across two lines: one hit, one miss
+    Read(14, 4);
+    EXPECT_EQ(card.reads.size(), 2u);
+
+    dsy_sd_cache_stats s = Stats();
+    EXPECT_EQ(s.misses, 3u);
+    EXPECT_EQ(s.hits, 3u + 2u);
+    EXPECT_EQ(s.direct, 0u);
+}
+
+TEST_F(util_SdCache, b_largeReadsBypass)
+{
+    Read(0, 8);
+    Read(3, 20);
+    ASSERT_EQ(card.reads.size(), 2u);
+    EXPECT_EQ(card.reads[1].sector, 3u);
+    EXPECT_EQ(card.reads[1].count, 20u);
+    EXPECT_EQ(Stats().direct, 28u);
+
+    // Nothing was cached
+    Read(0, 1);
+    EXPECT_EQ(card.reads.size(), 3u);
+}
+
+TEST_F(util_SdCache, c_lruEviction)
+{
+    // Fill the 4 lines, far apart so there's no read ahead
+    Read(0, 1);
+    Read(80, 1);
+    Read(160, 1);
+    Read(240, 1);
+    ASSERT_EQ(card.reads.size(), 4u);
+
+    // Use line 0 again, then line 5 has to evict line 10
+    Read(1, 1);
+    Read(40, 1);
+    EXPECT_EQ(card.reads.size(), 5u);
+    Read(2, 1);
+    Read(161, 1);
+    Read(241, 1);
+    Read(41, 1);
+    EXPECT_EQ(card.reads.size(), 5u);
+    Read(81, 1);
+    ASSERT_EQ(card.reads.size(), 6u);
+    EXPECT_EQ(card.reads.back().sector, 80u);
+}
+
+TEST_F(util_SdCache, d_readahead)
+{
+    Read(0, 1);
+    // Sequential miss reads two lines at once
+    Read(8, 1);
+    ASSERT_EQ(card.reads.size(), 2u);
+    EXPECT_EQ(card.reads[1].sector, 8u);
+    EXPECT_EQ(card.reads[1].count, 16u);
+    Read(16, 1);
+    EXPECT_EQ(card.reads.size(), 2u);
+    EXPECT_EQ(Stats().readahead, 8u);
+}
+
+TEST_F(util_SdCache, e_readaheadClampedToCard)
+{
+    card.Resize(36);
+    dsy_sd_cache_invalidate();
+
+    // Line 3 (24..31) is the last full line, the read ahead stops there
+    Read(16, 1);
+    Read(24, 1);
+    ASSERT_EQ(card.reads.size(), 2u);
+    EXPECT_EQ(card.reads[1].sector, 24u);
+    EXPECT_EQ(card.reads[1].count, 8u);
+
+    // The partial line at the end is read directly
+    Read(33, 2);
+    ASSERT_EQ(card.reads.size(), 3u);
+    EXPECT_EQ(card.reads[2].sector, 33u);
+    EXPECT_EQ(card.reads[2].count, 2u);
+    EXPECT_EQ(Stats().direct, 2u);
+}
+
+TEST_F(util_SdCache, f_smallerCard)
+{
+    // Looks up the size of the 256 sector card
+    Read(0, 1);
+
+    // A smaller card after initializing the disk again
+    card.Resize(20);
+    dsy_sd_cache_invalidate();
+    card.reads.clear();
+    Read(0, 1);
+    Read(8, 1);
+    ASSERT_EQ(card.reads.size(), 2u);
+    EXPECT_EQ(card.reads[1].sector, 8u);
+    EXPECT_EQ(card.reads[1].count, 8u);
+    for(const auto& r : card.reads)
+        EXPECT_LE(r.sector + r.count, 20u);
+}
+
+TEST_F(util_SdCache, g_writeThrough)
+{
+    Read(0, 1);
+    Read(8, 1);
+    ASSERT_EQ(card.reads.size(), 2u);
+
+    // Write across the end of line 0 and into line 1 and 2
+    std::vector<uint8_t> buff(12 * kSector, 0xAB);
+    card.Write(buff, 6);
+    Read(0, 7);
+    Read(8, 7);
+    Read(15, 3);
+    EXPECT_EQ(card.reads.size(), 2u);
+
+    // A failed write drops the lines
+    dsy_sd_cache_write(nullptr, 3, 1);
+    Read(5, 1);
+    EXPECT_EQ(card.reads.size(), 3u);
+    Read(10, 1);
+    EXPECT_EQ(card.reads.size(), 3u);
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include "sim/sim.h"
+#include "sys/system.h"
+
+using namespace daisy;
+
+namespace
+{
+struct Order
+{
+    std::vector<int> seen;
+    int              id;
+};
+
+void Record(void* context)
+{
+    Order* o = static_cast<Order*>(context);
+    o->seen.push_back(o->id);
+}
+
+struct DmaChain
+{
+    I2CHandle i2c;
+    uint8_t   data[4];
+    int       done    = 0;
+    int       restart = 0;
+};
+
+// Starts the next transfer from the callback, the way the LED driver does
+void ChainCallback(void* context, I2CHandle::Result result)
+{
+    DmaChain* c = static_cast<DmaChain*>(context);
+    EXPECT_EQ(result, I2CHandle::Result::OK);
+    c->done++;
+    if(c->restart-- > 0)
+        c->i2c.TransmitDma(0x40, c->data, sizeof(c->data), ChainCallback, c);
+}
+
+I2CHandle InitI2c(I2CHandle::Config::Peripheral periph)
+{
+    I2CHandle::Config cfg;
+    cfg.periph = periph;
+    cfg.speed  = I2CHandle::Config::Speed::I2C_400KHZ;
+    cfg.mode   = I2CHandle::Config::Mode::I2C_MASTER;
+    I2CHandle i2c;
+    i2c.Init(cfg);
+    return i2c;
+}
+
+} // namespace
+
+TEST(sim_Peripherals, a_virtualTime)
+{
+    sim::Reset();
+    EXPECT_EQ(System::GetNow(), 0u);
+    System::Delay(5);
+    EXPECT_EQ(System::GetUs(), 5000u);
+    System::DelayUs(20);
+    EXPECT_EQ(sim::GetNowUs(), 5020u);
+    // TIM2 at 200MHz
+    EXPECT_EQ(System::GetTick(), 5020u * 200u);
+
+    // events due at the same time run in the order they were scheduled
+    Order a, b;
+    a.id = 1;
+    b.id = 2;
+    sim::Schedule(sim::GetNowNs() + 1000, Record, &b);
+    sim::Schedule(sim::GetNowNs() + 500, Record, &a);
+    sim::Schedule(sim::GetNowNs() + 1000, Record, &a);
+    sim::Advance(1);
+    EXPECT_EQ(a.seen.size(), 2u);
+    EXPECT_EQ(b.seen.size(), 1u);
+    EXPECT_FALSE(sim::Step());
+
+    TimerHandle::Config cfg;
+    cfg.periph = TimerHandle::Config::Peripheral::TIM_3;
+    cfg.dir    = TimerHandle::Config::CounterDir::UP;
+    TimerHandle tim;
+    tim.Init(cfg);
+    tim.SetPrescaler(199);
+    tim.Start();
+    sim::Advance(70000);
+    // 1MHz, wrapping at 16 bits
+    EXPECT_EQ(tim.GetTick(), 70000u % 65536u);
+}
+
+TEST(sim_Peripherals, b_gpio)
+{
+    sim::Reset();
+    dsy_gpio in;
+    in.pin  = {DSY_GPIOA, 2};
+    in.mode = DSY_GPIO_MODE_INPUT;
+    in.pull = DSY_GPIO_PULLUP;
+    dsy_gpio_init(&in);
+    EXPECT_EQ(dsy_gpio_read(&in), 1);
+    sim::SetPin(in.pin, false);
+    EXPECT_EQ(dsy_gpio_read(&in), 0);
+
+    dsy_gpio out;
+    out.pin  = {DSY_GPIOC, 7};
+    out.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    out.pull = DSY_GPIO_NOPULL;
+    dsy_gpio_init(&out);
+    EXPECT_EQ(sim::GetPinMode(out.pin), DSY_GPIO_MODE_OUTPUT_PP);
+    dsy_gpio_write(&out, 1);
+    dsy_gpio_toggle(&out);
+    EXPECT_FALSE(sim::GetPin(out.pin));
+    EXPECT_EQ(sim::GetPinWrites(out.pin), 2u);
+}
+
+TEST(sim_Peripherals, c_i2cBlocking)
+{
+    sim::Reset();
+    sim::I2cRegisterDevice dev;
+    dev.regs[0x10] = 0xAB;
+    sim::AttachI2cDevice(I2CHandle::Config::Peripheral::I2C_1, 0x1A, &dev);
+    I2CHandle i2c = InitI2c(I2CHandle::Config::Peripheral::I2C_1);
+
+    uint8_t write[3] = {0x20, 1, 2};
+    EXPECT_EQ(i2c.TransmitBlocking(0x1A, write, 3, 10), I2CHandle::Result::OK);
+    EXPECT_EQ(dev.regs[0x20], 1);
+    EXPECT_EQ(dev.regs[0x21], 2);
+    // address and 3 bytes, 9 bits each at 400kHz
+    EXPECT_EQ(sim::GetNowNs(), 4u * 22500u);
+
+    uint8_t read;
+    EXPECT_EQ(i2c.ReadDataAtAddress(0x1A, 0x10, 1, &read, 1, 10),
+              I2CHandle::Result::OK);
+    EXPECT_EQ(read, 0xAB);
+
+    // nobody at this address
+    EXPECT_EQ(i2c.TransmitBlocking(0x1B, write, 3, 10), I2CHandle::Result::ERR);
+    const std::vector<sim::I2cTransfer>& log = sim::GetI2cLog();
+    ASSERT_EQ(log.size(), 4u);
+    EXPECT_EQ(log[0].data.size(), 3u);
+    EXPECT_TRUE(log[2].read);
+    EXPECT_FALSE(log[3].ack);
+}
+
+TEST(sim_Peripherals, d_i2cDma)
+{
+    sim::Reset();
+    sim::I2cRegisterDevice dev;
+    sim::AttachI2cDevice(I2CHandle::Config::Peripheral::I2C_1, 0x40, &dev);
+    sim::AttachI2cDevice(I2CHandle::Config::Peripheral::I2C_2, 0x40, &dev);
+    DmaChain a, b;
+    a.i2c     = InitI2c(I2CHandle::Config::Peripheral::I2C_1);
+    b.i2c     = InitI2c(I2CHandle::Config::Peripheral::I2C_2);
+    a.restart = 2;
+
+    EXPECT_EQ(a.i2c.TransmitDma(0x40, a.data, 4, ChainCallback, &a),
+              I2CHandle::Result::OK);
+    EXPECT_TRUE(sim::IsI2cBusy(I2CHandle::Config::Peripheral::I2C_1));
+    // the DMA is shared, so this one waits in the queue
+    EXPECT_EQ(b.i2c.TransmitDma(0x40, b.data, 4, ChainCallback, &b),
+              I2CHandle::Result::OK);
+    EXPECT_EQ(sim::GetNowNs(), 0u);
+    EXPECT_EQ(dev.GetWrites(), 1u);
+
+    while(sim::Step()) {}
+    EXPECT_EQ(a.done, 3);
+    EXPECT_EQ(b.done, 1);
+    EXPECT_FALSE(sim::IsI2cBusy(I2CHandle::Config::Peripheral::I2C_2));
+    // a restarts from its callback before the queued job gets the DMA
+    const std::vector<sim::I2cTransfer>& log = sim::GetI2cLog();
+    ASSERT_EQ(log.size(), 4u);
+    EXPECT_EQ(log[1].periph, I2CHandle::Config::Peripheral::I2C_1);
+    EXPECT_EQ(log[3].periph, I2CHandle::Config::Peripheral::I2C_2);
+    EXPECT_EQ(log[3].start_ns, log[2].end_ns);
+}
+
+TEST(sim_Peripherals, e_uart)
+{
+    sim::Reset();
+    UartHandler::Config cfg;
+    cfg.periph     = UartHandler::Config::Peripheral::USART_1;
+    cfg.stopbits   = UartHandler::Config::StopBits::BITS_1;
+    cfg.parity     = UartHandler::Config::Parity::NONE;
+    cfg.mode       = UartHandler::Config::Mode::TX_RX;
+    cfg.wordlength = UartHandler::Config::WordLength::BITS_8;
+    cfg.baudrate   = 31250;
+    UartHandler uart;
+    uart.Init(cfg);
+
+    uint8_t tx[3] = {1, 2, 3};
+    uart.PollTx(tx, 3);
+    EXPECT_EQ(sim::GetUartOutput(cfg.periph).size(), 3u);
+    // 10 bits per byte
+    EXPECT_EQ(sim::GetNowUs(), 960u);
+
+    // lost before reception starts
+    sim::UartReceive(cfg.periph, tx, 3);
+    sim::Advance(1000);
+    EXPECT_EQ(uart.Readable(), 0u);
+
+    uart.StartRx();
+    sim::UartReceive(cfg.periph, tx, 3);
+    sim::Advance(320);
+    EXPECT_EQ(uart.Readable(), 1u);
+    sim::Advance(640);
+    EXPECT_EQ(uart.Readable(), 3u);
+    EXPECT_EQ(uart.PopRx(), 1);
+
+    // more than the queue holds
+    std::vector<uint8_t> flood(300, 0x55);
+    sim::UartReceive(cfg.periph, flood.data(), flood.size());
+    sim::Advance(300 * 320);
+    EXPECT_FALSE(uart.RxActive());
+    EXPECT_NE(uart.CheckError(), 0);
+
+    uint8_t rx[2];
+    sim::UartReceive(cfg.periph, tx, 2);
+    EXPECT_EQ(uart.PollReceive(rx, 2, 10), 0);
+    EXPECT_EQ(rx[1], 2);
+    EXPECT_NE(uart.PollReceive(rx, 1, 10), 0);
+}
+
+TEST(sim_Peripherals, f_spi)
+{
+    sim::Reset();
+    SpiHandle::Config cfg;
+    cfg.periph         = SpiHandle::Config::Peripheral::SPI_1;
+    cfg.mode           = SpiHandle::Config::Mode::MASTER;
+    cfg.direction      = SpiHandle::Config::Direction::TWO_LINES;
+    cfg.datasize       = 8;
+    cfg.clock_polarity = SpiHandle::Config::ClockPolarity::LOW;
+    cfg.clock_phase    = SpiHandle::Config::ClockPhase::ONE_EDGE;
+    cfg.nss            = SpiHandle::Config::NSS::SOFT;
+    cfg.baud_prescaler = SpiHandle::Config::BaudPrescaler::PS_8;
+    SpiHandle spi;
+    spi.Init(cfg);
+
+    uint8_t data[4] = {9, 8, 7, 6};
+    spi.BlockingTransmit(data, 4);
+    ASSERT_EQ(sim::GetSpiLog().size(), 1u);
+    EXPECT_EQ(sim::GetSpiLog()[0].data[3], 6);
+    // 25MHz / 8
+    EXPECT_EQ(sim::GetNowNs(), 4u * 8u * 320u);
+
+    sim::SetSpiInput(cfg.periph, data, 2);
+    uint8_t in[3];
+    spi.BlockingReceive(in, 3, 10);
+    EXPECT_EQ(in[0], 9);
+    EXPECT_EQ(in[1], 8);
+    EXPECT_EQ(in[2], 0xFF);
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "util/WavFileIndex.h"
+#include "MemoryFileSystem.h"
+
+using namespace daisy;
+
+namespace
+{
+using Index = WavFileIndex<MemoryFileReader,
+                           MemoryFileWriter,
+                           MemoryDirectory,
+                           4>;
+
+const char kRoot[]      = "/sd";
+const char kIndexPath[] = "/sd/wavindex.bin";
+
+void AddFile(const std::string& path, uint16_t channels = 1, size_t n = 8)
+{
+    std::vector<float> samples(n * channels, 0.25f);
+    MemoryFileSystem::Files()[path] = MakeWavFile(1, channels, 2, samples);
+    MemoryFileSystem::Times()[path] = 0x52210000;
+}
+
+// Four files, two of them in nested directories, and files to be skipped
+void MakeCard()
+{
+    MemoryFileSystem::Clear();
+    AddFile("/sd/a.wav");
+    AddFile("/sd/b.WAV");
+    AddFile("/sd/sub/c.wav");
+    AddFile("/sd/sub/deeper/d.wav");
+    MemoryFileSystem::Files()["/sd/notes.txt"] = {'h', 'i'};
+    MemoryFileSystem::Files()["/sd/.hidden.wav"]
+        = MemoryFileSystem::Files()["/sd/a.wav"];
+}
+
+std::vector<std::string> Names(Index& index)
+{
+    std::vector<std::string> names;
+    WavFileInfo              info;
+    for(size_t i = 0; i < index.GetNumFiles(); i++)
+    {
+        EXPECT_TRUE(index.GetFileInfo(i, &info));
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+const std::vector<std::string> kAllFiles
+    = {"/sd/a.wav", "/sd/b.WAV", "/sd/sub/c.wav", "/sd/sub/deeper/d.wav"};
+} // namespace
+
+TEST(util_WavFileIndex, a_build)
+{
+    MakeCard();
+    // Not a supported WAV file, left out
+    MemoryFileSystem::Files()["/sd/bad.wav"] = std::vector<uint8_t>(100, 1);
+
+    Index index;
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_FALSE(index.IsInMemory());
+    EXPECT_EQ(index.GetNumParsed(), 5u);
+    EXPECT_EQ(Names(index), kAllFiles);
+    EXPECT_EQ(MemoryFileSystem::Files().count(kIndexPath), 1u);
+    EXPECT_EQ(MemoryFileSystem::Files().count("/sd/wavindex.bin.tmp"), 0u);
+
+    WavFileInfo info;
+    ASSERT_TRUE(index.GetFileInfo(2, &info));
+    EXPECT_EQ(info.raw_data.NbrChannels, 1);
+    EXPECT_EQ(info.raw_data.SampleRate, 48000u);
+    EXPECT_EQ(info.raw_data.BitPerSample, 16);
+    EXPECT_EQ(info.raw_data.SubCHunk2Size, 16u);
+    EXPECT_EQ(info.data_offset, 44u);
+    EXPECT_EQ(info.file_size, 60u);
+    EXPECT_FALSE(index.GetFileInfo(4, &info));
+}
+
+TEST(util_WavFileIndex, b_unchanged)
+{
+    MakeCard();
+    Index first, index;
+    ASSERT_EQ(first.Init(kRoot, kIndexPath), Index::Result::OK);
+
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_FALSE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 0u);
+    EXPECT_EQ(Names(index), kAllFiles);
+}
+
+TEST(util_WavFileIndex, c_changedTimeAndSize)
+{
+    MakeCard();
+    Index index;
+    ASSERT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+
+    // Only the changed files are parsed again
+    MemoryFileSystem::Times()["/sd/b.WAV"]++;
+    AddFile("/sd/sub/c.wav", 2, 100);
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 2u);
+    EXPECT_EQ(Names(index), kAllFiles);
+
+    WavFileInfo info;
+    ASSERT_TRUE(index.GetFileInfo(2, &info));
+    EXPECT_EQ(info.raw_data.NbrChannels, 2);
+    EXPECT_EQ(info.raw_data.SubCHunk2Size, 400u);
+}
+
+TEST(util_WavFileIndex, d_addedAndDeleted)
+{
+    MakeCard();
+    Index index;
+    ASSERT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+
+    MemoryFileSystem::Files().erase("/sd/a.wav");
+    AddFile("/sd/sub/deeper/e.wav");
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 1u);
+    EXPECT_EQ(Names(index),
+              (std::vector<std::string>{"/sd/b.WAV",
+                                        "/sd/sub/c.wav",
+                                        "/sd/sub/deeper/d.wav",
+                                        "/sd/sub/deeper/e.wav"}));
+
+    // A deleted file at the end
+    MemoryFileSystem::Files().erase("/sd/sub/deeper/e.wav");
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 0u);
+    EXPECT_EQ(index.GetNumFiles(), 3u);
+}
+
+TEST(util_WavFileIndex, e_staleVersion)
+{
+    MakeCard();
+    Index index;
+    ASSERT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+
+    // An index written by an older version is rebuilt from scratch
+    MemoryFileSystem::Files()[kIndexPath][4] = 1;
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 4u);
+    EXPECT_EQ(Names(index), kAllFiles);
+
+    // So is a truncated one
+    MemoryFileSystem::Files()[kIndexPath].resize(100);
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_TRUE(index.WasRebuilt());
+    EXPECT_EQ(index.GetNumParsed(), 4u);
+}
+
+TEST(util_WavFileIndex, f_withoutVerify)
+{
+    MakeCard();
+    Index index;
+    ASSERT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+
+    MemoryFileSystem::Files().erase("/sd/a.wav");
+    EXPECT_EQ(index.Init(kRoot, kIndexPath, false), Index::Result::OK);
+    EXPECT_FALSE(index.WasRebuilt());
+    EXPECT_EQ(Names(index), kAllFiles);
+}
+
+TEST(util_WavFileIndex, g_writeProtected)
+{
+    MakeCard();
+    MemoryFileSystem::WriteProtected() = true;
+
+    Index index;
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::ERR_INDEX);
+    EXPECT_TRUE(index.IsInMemory());
+    EXPECT_FALSE(index.WasRebuilt());
+    EXPECT_EQ(Names(index), kAllFiles);
+    EXPECT_EQ(MemoryFileSystem::Files().count(kIndexPath), 0u);
+
+    // Only the first max_fallback files are kept
+    AddFile("/sd/sub/deeper/e.wav");
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::ERR_INDEX);
+    EXPECT_EQ(Names(index), kAllFiles);
+
+    // The index is written once the card can be written again
+    MemoryFileSystem::WriteProtected() = false;
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    EXPECT_FALSE(index.IsInMemory());
+    EXPECT_EQ(index.GetNumFiles(), 5u);
+}
+
+TEST(util_WavFileIndex, h_staleIndexOnWriteProtectedCard)
+{
+    MakeCard();
+    Index index;
+    ASSERT_EQ(index.Init(kRoot, kIndexPath), Index::Result::OK);
+    std::vector<uint8_t> old_index = MemoryFileSystem::Files()[kIndexPath];
+
+    // The entries of the old index are still used for unchanged files
+    MemoryFileSystem::WriteProtected() = true;
+    MemoryFileSystem::Files().erase("/sd/b.WAV");
+    AddFile("/sd/sub/c.wav", 2);
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::ERR_INDEX);
+    EXPECT_TRUE(index.IsInMemory());
+    EXPECT_EQ(index.GetNumParsed(), 1u);
+    EXPECT_EQ(Names(index),
+              (std::vector<std::string>{
+                  "/sd/a.wav", "/sd/sub/c.wav", "/sd/sub/deeper/d.wav"}));
+    WavFileInfo info;
+    ASSERT_TRUE(index.GetFileInfo(1, &info));
+    EXPECT_EQ(info.raw_data.NbrChannels, 2);
+    EXPECT_EQ(MemoryFileSystem::Files()[kIndexPath], old_index);
+    MemoryFileSystem::Clear();
+}
+
+TEST(util_WavFileIndex, i_cardFull)
+{
+    MakeCard();
+    MemoryFileSystem::FreeBytes() = 1000;
+
+    Index index;
+    EXPECT_EQ(index.Init(kRoot, kIndexPath), Index::Result::ERR_INDEX);
+    EXPECT_TRUE(index.IsInMemory());
+    EXPECT_EQ(Names(index), kAllFiles);
+    EXPECT_EQ(MemoryFileSystem::Files().count(kIndexPath), 0u);
+    EXPECT_EQ(MemoryFileSystem::Files().count("/sd/wavindex.bin.tmp"), 0u);
+    MemoryFileSystem::Clear();
+}
+
+TEST(util_WavFileIndex, j_missingDirectory)
+{
+    MakeCard();
+    Index index;
+    EXPECT_EQ(index.Init("/nope", kIndexPath), Index::Result::ERR_DIR);
+    EXPECT_EQ(index.GetNumFiles(), 0u);
+}
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/WavHeader.h"
+#include "util/WavStreamer.h"
+#include "MemoryFileSystem.h"
+
+using namespace daisy;
+
+namespace
+{
+// Builds a WAV file chunk by chunk
+struct RiffBuilder
+{
+    std::vector<uint8_t> f;
+
+    void Put16(uint32_t v)
+    {
+        f.push_back(v & 0xFF);
+        f.push_back((v >> 8) & 0xFF);
+    }
+    void Put32(uint32_t v)
+    {
+        Put16(v & 0xFFFF);
+        Put16(v >> 16);
+    }
+    void PutId(const char* id) { f.insert(f.end(), id, id + 4); }
+
+    void Start(const char* id = "RIFF")
+    {
+        PutId(id);
+        Put32(0);
+        PutId("WAVE");
+    }
+
+    // A chunk of filler, padded to an even size
+    void Chunk(const char* id, uint32_t size)
+    {
+        PutId(id);
+        Put32(size);
+        f.insert(f.end(), size + (size & 1), 0xAA);
+    }
+
+    void Format(uint16_t tag, uint16_t channels, uint16_t bits, bool ext)
+    {
+        PutId("fmt ");
+        Put32(ext ? 40 : 16);
+        Put16(ext ? 0xFFFE : tag);
+        Put16(channels);
+        Put32(44100);
+        Put32(44100 * channels * bits / 8);
+        Put16(channels * bits / 8);
+        Put16(bits);
+        if(ext)
+        {
+            Put16(22);
+            Put16(bits);
+            Put32(3);
+            Put16(tag);
+            f.insert(f.end(), 14, 0);
+        }
+    }
+
+    void Data(uint32_t bytes, uint32_t size_field)
+    {
+        PutId("data");
+        Put32(size_field);
+        for(uint32_t i = 0; i < bytes; i++)
+            f.push_back(i & 0xFF);
+    }
+
+    // Sampler chunk with loops given as start and inclusive end
+    void Sampler(std::vector<std::pair<uint32_t, uint32_t>> loops)
+    {
+        PutId("smpl");
+        Put32(36 + 24 * loops.size());
+        for(int i = 0; i < 3; i++)
+            Put32(0);
+        Put32(48); // unity note
+        for(int i = 0; i < 3; i++)
+            Put32(0);
+        Put32(loops.size());
+        Put32(0);
+        for(auto& l : loops)
+        {
+            Put32(0);
+            Put32(0);
+            Put32(l.first);
+            Put32(l.second);
+            Put32(0);
+            Put32(0);
+        }
+    }
+};
+
+size_t BytesRead()
+{
+    size_t total = 0;
+    for(auto& e : MemoryFileSystem::ReadLog())
+        total += e.size;
+    return total;
+}
+} // namespace
+
+TEST(util_WavHeader, a_dawExport)
+{
+    // Chunks around the data, as written by most DAWs
+    RiffBuilder b;
+    b.Start();
+    b.Chunk("LIST", 5);
+    b.Format(WAVE_FORMAT_IEEE_FLOAT, 2, 32, true);
+    b.Chunk("bext", 602);
+    const uint32_t data_start = b.f.size() + 8;
+    b.Data(800 * 8, 800 * 8);
+    b.Chunk("cue ", 28);
+    b.Sampler({{100, 299}, {400, 399}, {10, 19}});
+    MemoryFileSystem::Files()["daw.wav"] = b.f;
+
+    MemoryFileReader reader;
+    WavHeader        header;
+    MemoryFileSystem::ReadLog().clear();
+    ASSERT_TRUE(reader.Open("daw.wav"));
+    ASSERT_TRUE(header.Parse(reader));
+    EXPECT_EQ(header.format_tag, WAVE_FORMAT_IEEE_FLOAT);
+    EXPECT_TRUE(header.extensible);
+    EXPECT_FALSE(header.rf64);
+    EXPECT_EQ(header.channels, 2);
+    EXPECT_EQ(header.samplerate, 44100u);
+    EXPECT_EQ(header.block_align, 8);
+    EXPECT_EQ(header.bits_per_sample, 32);
+    EXPECT_EQ(header.channel_mask, 3u);
+    EXPECT_EQ(header.data_start, data_start);
+    EXPECT_EQ(header.data_size, 800u * 8);
+    EXPECT_EQ(header.unity_note, 48);
+
+    // The empty loop is left out, ends are exclusive
+    ASSERT_EQ(header.num_loops, 2u);
+    EXPECT_EQ(header.loops[0].start, 100u);
+    EXPECT_EQ(header.loops[0].end, 300u);
+    EXPECT_EQ(header.loops[1].start, 10u);
+    EXPECT_EQ(header.loops[1].end, 20u);
+
+    // Only the chunk headers, "fmt " and "smpl" are read, and the reader is
+    // left at the first frame
+    EXPECT_EQ(BytesRead(), 12u + 6 * 8 + 40 + 36 + 3 * 24);
+    uint8_t first[4];
+    ASSERT_EQ(reader.Read(first, 4), 4u);
+    EXPECT_EQ(first[3], 3);
+
+    // The same file for streaming, without looking past the data
+    WavStreamFormat format;
+    ASSERT_TRUE(reader.Open("daw.wav"));
+    ASSERT_TRUE(format.Parse(reader, 8));
+    EXPECT_EQ(format.encoding, WavStreamFormat::Encoding::FLOAT32);
+    EXPECT_EQ(format.data_start, data_start);
+    EXPECT_EQ(format.GetLengthFrames(), 800u);
+    ASSERT_TRUE(reader.Open("daw.wav"));
+    ASSERT_TRUE(header.Parse(reader, false));
+    EXPECT_EQ(header.num_loops, 0u);
+}
+
+TEST(util_WavHeader, b_rf64)
+{
+    RiffBuilder b;
+    b.Start("RF64");
+    b.PutId("ds64");
+    b.Put32(28);
+    b.Put32(0); // riffSize
+    b.Put32(0);
+    b.Put32(3000); // dataSize
+    b.Put32(0);
+    b.Put32(1500); // sampleCount
+    b.Put32(0);
+    b.Put32(0); // table length
+    b.Format(WAVE_FORMAT_PCM, 1, 16, false);
+    b.Data(3000, 0xFFFFFFFF);
+    MemoryFileSystem::Files()["rf64.wav"] = b.f;
+
+    MemoryFileReader reader;
+    WavHeader        header;
+    ASSERT_TRUE(reader.Open("rf64.wav"));
+    ASSERT_TRUE(header.Parse(reader));
+    EXPECT_TRUE(header.rf64);
+    EXPECT_EQ(header.format_tag, WAVE_FORMAT_PCM);
+    EXPECT_EQ(header.data_size, 3000u);
+    EXPECT_EQ(header.num_loops, 0u);
+}
+
+TEST(util_WavHeader, c_broken)
+{
+    MemoryFileReader reader;
+    WavHeader        header;
+
+    // Unfinished recording, the data size was never written
+    RiffBuilder b;
+    b.Start();
+    b.Format(WAVE_FORMAT_PCM, 2, 24, false);
+    b.Data(600, 0);
+    b.f[40] = 0xFF;
+    b.f[41] = 0xFF;
+    MemoryFileSystem::Files()["rec.wav"] = b.f;
+    ASSERT_TRUE(reader.Open("rec.wav"));
+    ASSERT_TRUE(header.Parse(reader));
+    EXPECT_EQ(header.data_size, 600u);
+
+    // No format before the data
+    RiffBuilder no_fmt;
+    no_fmt.Start();
+    no_fmt.Data(100, 100);
+    MemoryFileSystem::Files()["no_fmt.wav"] = no_fmt.f;
+    ASSERT_TRUE(reader.Open("no_fmt.wav"));
+    EXPECT_FALSE(header.Parse(reader));
+
+    // Not a WAVE file
+    RiffBuilder avi;
+    avi.Start();
+    avi.f[8] = 'A';
+    MemoryFileSystem::Files()["avi.wav"] = avi.f;
+    ASSERT_TRUE(reader.Open("avi.wav"));
+    EXPECT_FALSE(header.Parse(reader));
+
+    // No data chunk
+    RiffBuilder no_data;
+    no_data.Start();
+    no_data.Format(WAVE_FORMAT_PCM, 1, 16, false);
+    no_data.Chunk("LIST", 20);
+    MemoryFileSystem::Files()["no_data.wav"] = no_data.f;
+    ASSERT_TRUE(reader.Open("no_data.wav"));
+    EXPECT_FALSE(header.Parse(reader));
+}
@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "util/WavStreamer.h"
+#include "daisy_core.h"
+#include "MemoryFileSystem.h"
+#include "AudioTestSignals.h"
+
+using namespace daisy;
+
+namespace
+{
+constexpr size_t kBufferBytes = 4096;
+
+using Streamer = WavStreamer<8, kBufferBytes, MemoryFileReader>;
+
+std::vector<float> MakeRamp(size_t num_samples, float offset = 0.f)
+{
+    std::vector<float> s(num_samples);
+    for(size_t i = 0; i < num_samples; i++)
+        s[i] = std::fmod(offset + i * 0.001f, 1.f) - 0.5f;
+    return s;
+}
+
+Streamer::Config SmallReads()
+{
+    Streamer::Config cfg;
+    cfg.Defaults();
+    cfg.read_size = 1024;
+    return cfg;
+}
+
+// Plays the whole file on one voice, and returns the interleaved stereo output.
+std::vector<float> PlayAll(Streamer& streamer, const char* path, size_t frames)
+{
+    std::vector<float> out(frames * 2);
+    EXPECT_EQ(streamer.Play(path), 0);
+    for(size_t pos = 0; pos < frames; pos += kBlockSize)
+    {
+        streamer.Prepare();
+        size_t n = std::min(kBlockSize, frames - pos);
+        streamer.Read(&out[pos * 2], n);
+    }
+    return out;
+}
+} // namespace
+
+TEST(util_WavStreamer, a_formats)
+{
+    struct TestCase
+    {
+        uint16_t format_tag, channels, bytes;
+        bool     extra_chunk;
+        float    tolerance;
+    };
+    const TestCase cases[] = {
+        {1, 1, 2, false, 1.f / 32768.f},
+        {1, 2, 2, true, 1.f / 32768.f},
+        {1, 2, 3, false, 1.f / 8388608.f},
+        {1, 2, 4, false, 1e-6f},
+        {3, 2, 4, false, 0.f},
+        {0xFFFE, 2, 3, true, 1.f / 8388608.f},
+    };
+    for(const TestCase& tc : cases)
+    {
+        MemoryFileSystem::Clear();
+        const size_t frames  = 3000;
+        auto         samples = MakeRamp(frames * tc.channels);
+        MemoryFileSystem::Files()["a.wav"] = MakeWavFile(
+            tc.format_tag, tc.channels, tc.bytes, samples, tc.extra_chunk);
+
+        Streamer streamer;
+        streamer.Init(SmallReads());
+        auto out = PlayAll(streamer, "a.wav", frames + 100);
+        for(size_t i = 0; i < frames; i++)
+        {
+            float l = samples[i * tc.channels];
+            float r = samples[i * tc.channels + tc.channels - 1];
+            ASSERT_NEAR(out[i * 2], l, tc.tolerance)
+                << "format " << tc.format_tag << " bytes " << tc.bytes;
+            ASSERT_NEAR(out[i * 2 + 1], r, tc.tolerance);
+        }
+        // Silence after the end, the voice is finished and not an underrun
+        for(size_t i = frames * 2; i < out.size(); i++)
+            ASSERT_EQ(out[i], 0.f);
+        EXPECT_EQ(streamer.GetNumPlaying(), 0u);
+        EXPECT_EQ(streamer.GetUnderruns(), 0u);
+        streamer.Prepare();
+        EXPECT_FALSE(streamer.GetVoice(0).IsOpen());
+    }
+
+    // Unsupported files aren't played
+    MemoryFileSystem::Files()["alaw.wav"] = MakeWavFile(6, 1, 1, MakeRamp(10));
+    MemoryFileSystem::Files()["junk.wav"] = std::vector<uint8_t>(100, 0x55);
+    Streamer streamer;
+    streamer.Init();
+    EXPECT_EQ(streamer.Play("alaw.wav"), -1);
+    EXPECT_EQ(streamer.Play("junk.wav"), -1);
+    EXPECT_EQ(streamer.Play("missing.wav"), -1);
+}
+
+TEST(util_WavStreamer, b_looping)
+{
+    MemoryFileSystem::Clear();
+    const size_t frames  = 1500;
+    auto         samples = MakeRamp(frames * 2);
+    MemoryFileSystem::Files()["loop.wav"] = MakeWavFile(1, 2, 2, samples);
+
+    Streamer streamer;
+    streamer.Init(SmallReads());
+    ASSERT_EQ(streamer.Play(3, "loop.wav", 0.5f, true), Streamer::Result::OK);
+    std::vector<float> out(kBlockSize * 2);
+    for(size_t pos = 0; pos < frames * 3; pos += kBlockSize)
+    {
+        streamer.Prepare();
+        streamer.Read(out.data(), kBlockSize);
+        for(size_t i = 0; i < kBlockSize; i++)
+        {
+            size_t src = (pos + i) % frames;
+            ASSERT_NEAR(out[i * 2], samples[src * 2] * 0.5f, 1e-4f);
+            ASSERT_NEAR(out[i * 2 + 1], samples[src * 2 + 1] * 0.5f, 1e-4f);
+        }
+    }
+    EXPECT_EQ(streamer.GetNumPlaying(), 1u);
+    streamer.Stop(3);
+    streamer.Read(out.data(), kBlockSize);
+    EXPECT_EQ(out[0], 0.f);
+    streamer.Prepare();
+    EXPECT_FALSE(streamer.GetVoice(3).IsOpen());
+}
+
+TEST(util_WavStreamer, c_underrun)
+{
+    MemoryFileSystem::Clear();
+    MemoryFileSystem::Files()["long.wav"]
+        = MakeWavFile(1, 2, 2, MakeRamp(20000 * 2));
+    Streamer streamer;
+    streamer.Init(SmallReads());
+    ASSERT_EQ(streamer.Play("long.wav"), 0);
+
+    // Half the buffer is filled before starting, 4096 / 4 / 2 = 512 frames
+    auto& voice = streamer.GetVoice(0);
+    EXPECT_EQ(voice.GetBufferedFrames(), 512u);
+    std::vector<float> out(kBlockSize * 2);
+    size_t             blocks = 0;
+    while(voice.GetUnderruns() == 0 && blocks < 100)
+    {
+        streamer.Read(out.data(), kBlockSize);
+        blocks++;
+    }
+    EXPECT_EQ(blocks, 512 / kBlockSize + 1);
+    EXPECT_TRUE(voice.IsPlaying());
+
+    // Catches up again once the main loop reads
+    streamer.Prepare();
+    streamer.Read(out.data(), kBlockSize);
+    EXPECT_EQ(voice.GetUnderruns(), 1u);
+}
+
+TEST(util_WavStreamer, d_scheduler)
+{
+    MemoryFileSystem::Clear();
+    const char* names[] = {"0.wav", "1.wav", "2.wav"};
+    for(const char* name : names)
+        MemoryFileSystem::Files()[name]
+            = MakeWavFile(1, 2, 2, MakeRamp(20000 * 2));
+
+    Streamer::Config cfg = SmallReads();
+    cfg.max_reads        = 1;
+    Streamer streamer;
+    streamer.Init(cfg);
+    for(int i = 0; i < 3; i++)
+        ASSERT_EQ(streamer.Play(names[i]), i);
+
+    // Drain the voices by different amounts: voice 1 the most, then 2
+    std::vector<float> out(kBlockSize * 2);
+    for(int i = 0; i < 8; i++)
+        streamer.GetVoice(1).Read(out.data(), kBlockSize);
+    for(int i = 0; i < 5; i++)
+        streamer.GetVoice(2).Read(out.data(), kBlockSize);
+    for(int i = 0; i < 2; i++)
+        streamer.GetVoice(0).Read(out.data(), kBlockSize);
+
+    MemoryFileSystem::ReadLog().clear();
+    streamer.Prepare();
+    ASSERT_EQ(MemoryFileSystem::ReadLog().size(), 1u);
+    EXPECT_EQ(MemoryFileSystem::ReadLog()[0].path, "1.wav");
+    EXPECT_EQ(MemoryFileSystem::ReadLog()[0].size, 1024u);
+
+    // Voice 1 now has 512 - 384 + 256 = 384 frames, voice 2 has 272
+    streamer.Prepare();
+    EXPECT_EQ(MemoryFileSystem::ReadLog().back().path, "2.wav");
+    // Voice 0 has 416, the others 384 and 528
+    streamer.Prepare();
+    EXPECT_EQ(MemoryFileSystem::ReadLog().back().path, "1.wav");
+}
+
+TEST(util_WavStreamer, e_drumVoices)
+{
+    MemoryFileSystem::Clear();
+    const size_t frames = 2000;
+    for(int i = 0; i < 9; i++)
+        MemoryFileSystem::Files()["drum" + std::to_string(i) + ".wav"]
+            = MakeWavFile(1, 1, 2, std::vector<float>(frames, 0.01f * (i + 1)));
+
+    Streamer streamer;
+    streamer.Init(SmallReads());
+    for(int i = 0; i < 8; i++)
+    {
+        std::string name = "drum" + std::to_string(i) + ".wav";
+        ASSERT_EQ(streamer.Play(name.c_str()), i);
+    }
+    EXPECT_EQ(streamer.GetNumPlaying(), 8u);
+
+    // The mix is the sum of all voices: 0.01 * (1 + 2 + ... + 8)
+    std::vector<float> out(kBlockSize * 2);
+    for(size_t pos = 0; pos < frames / 2; pos += kBlockSize)
+    {
+        streamer.Prepare();
+        streamer.Read(out.data(), kBlockSize);
+        ASSERT_NEAR(out[0], 0.36f, 1e-3f);
+        ASSERT_NEAR(out[kBlockSize * 2 - 1], 0.36f, 1e-3f);
+    }
+
+    // A 9th sound replaces the oldest voice
+    EXPECT_EQ(streamer.Play("drum8.wav"), 0);
+    streamer.Read(out.data(), kBlockSize);
+    EXPECT_NEAR(out[0], 0.36f - 0.01f + 0.09f, 1e-3f);
+    EXPECT_EQ(streamer.GetUnderruns(), 0u);
+}
+
+TEST(util_WavStreamer, f_toFloatInPlace)
+{
+    // Data read into the back of a float buffer, as WaveTableLoader does
+    const size_t n = 1000;
+    for(size_t bytes = 2; bytes <= 4; bytes++)
+    {
+        WavStreamFormat format;
+        format.encoding = bytes == 2   ? WavStreamFormat::Encoding::PCM16
+                          : bytes == 3 ? WavStreamFormat::Encoding::PCM24
+                                       : WavStreamFormat::Encoding::PCM32;
+        std::vector<float> buf(n);
+        std::vector<float> expected(n);
+        uint8_t* back = reinterpret_cast<uint8_t*>(buf.data());
+        back += (4 - bytes) * n;
+        for(size_t i = 0; i < n; i++)
+        {
+            int32_t v = static_cast<int32_t>(i * 2654435761u);
+            v &= ~0u << (32 - bytes * 8);
+            for(size_t k = 0; k < bytes; k++)
+                back[i * bytes + k] = v >> (32 - bytes * 8 + k * 8);
+            expected[i] = s322f(v);
+        }
+        format.ToFloat(back, n, buf.data());
+        for(size_t i = 0; i < n; i++)
+            ASSERT_NEAR(buf[i], expected[i], 1e-7f) << bytes << " " << i;
+    }
+}
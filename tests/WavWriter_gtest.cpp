@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/WavWriter.h"
+#include "util/WavStreamer.h"
+#include "MemoryFileSystem.h"
+#include "AudioTestSignals.h"
+
+using namespace daisy;
+
+namespace
+{
+// Reads sample i (interleaved) from the data of a file written by WavWriter
+float ReadSample(const std::vector<uint8_t>& file,
+                 int                         bits,
+                 bool                        is_float,
+                 size_t                      i,
+                 size_t                      header = 44)
+{
+    const uint8_t* p = &file[header + i * bits / 8];
+    int32_t        v = 0;
+    switch(bits)
+    {
+        case 16: return s162f(static_cast<int16_t>(p[0] | p[1] << 8));
+        case 24: return s242f(p[0] | p[1] << 8 | p[2] << 16);
+        default:
+            std::memcpy(&v, p, 4);
+            if(is_float)
+            {
+                float f;
+                std::memcpy(&f, p, 4);
+                return f;
+            }
+            return s322f(v);
+    }
+}
+
+uint32_t Read32(const std::vector<uint8_t>& file, size_t pos)
+{
+    uint32_t v;
+    std::memcpy(&v, &file[pos], 4);
+    return v;
+}
+
+uint16_t Read16(const std::vector<uint8_t>& file, size_t pos)
+{
+    uint16_t v;
+    std::memcpy(&v, &file[pos], 2);
+    return v;
+}
+} // namespace
+
+TEST(util_WavWriter, a_formats)
+{
+    struct TestCase
+    {
+        int32_t bits;
+        bool    is_float;
+        float   tolerance;
+    };
+    const TestCase cases[] = {
+        {16, false, 2.f / 32768.f},
+        {24, false, 1.f / 8388607.f},
+        {32, false, 1e-6f},
+        {32, true, 0.f},
+    };
+    // 3 channels, so frames wrap around the end of the buffer
+    const size_t channels = 3;
+    const size_t frames   = 5000;
+    auto         input    = MakeChannels(channels, frames);
+    for(const TestCase& tc : cases)
+    {
+        MemoryFileSystem::Clear();
+        WavWriter<1024, 3, MemoryFileWriter>::Config cfg;
+        cfg.channels      = channels;
+        cfg.bitspersample = tc.bits;
+        cfg.float_samples = tc.is_float;
+        WavWriter<1024, 3, MemoryFileWriter> writer;
+        writer.Init(cfg);
+        ASSERT_EQ(writer.OpenFile("rec.wav"),
+                  (WavWriter<1024, 3, MemoryFileWriter>::Result::OK));
+        for(size_t pos = 0; pos < frames; pos += kBlockSize)
+        {
+            const float* in[channels];
+            for(size_t c = 0; c < channels; c++)
+                in[c] = &input[c][pos];
+            writer.Sample(in, std::min(kBlockSize, frames - pos));
+            writer.Write();
+        }
+        EXPECT_EQ(writer.GetLengthSamps(), frames);
+        writer.SaveFile();
+        EXPECT_EQ(writer.GetOverruns(), 0u);
+        EXPECT_FALSE(writer.IsRecording());
+
+        const auto&  file       = MemoryFileSystem::Files()["rec.wav"];
+        const size_t data_bytes = frames * channels * tc.bits / 8;
+        ASSERT_EQ(file.size(), 44 + data_bytes);
+        EXPECT_EQ(Read32(file, 4), 36 + data_bytes);
+        EXPECT_EQ(Read16(file, 20), tc.is_float ? 3 : 1);
+        EXPECT_EQ(Read16(file, 22), channels);
+        EXPECT_EQ(Read32(file, 24), 48000u);
+        EXPECT_EQ(Read32(file, 28), 48000u * channels * tc.bits / 8);
+        EXPECT_EQ(Read16(file, 32), channels * tc.bits / 8);
+        EXPECT_EQ(Read16(file, 34), tc.bits);
+        EXPECT_EQ(Read32(file, 40), data_bytes);
+        for(size_t i = 0; i < frames; i++)
+        {
+            for(size_t c = 0; c < channels; c++)
+            {
+                // Integer formats are clipped
+                float x = input[c][i];
+                if(!tc.is_float)
+                    x = std::max(std::min(x, FBIPMAX), FBIPMIN);
+                ASSERT_NEAR(
+                    ReadSample(file, tc.bits, tc.is_float, i * 3 + c),
+                    x,
+                    tc.tolerance)
+                    << "bits " << tc.bits << " frame " << i;
+            }
+        }
+    }
+}
+
+TEST(util_WavWriter, b_singleFrames)
+{
+    MemoryFileSystem::Clear();
+    WavWriter<1024, 2, MemoryFileWriter>         writer;
+    WavWriter<1024, 2, MemoryFileWriter>::Config cfg;
+    writer.Init(cfg);
+    writer.OpenFile("rec.wav");
+    for(int i = 0; i < 1000; i++)
+    {
+        float frame[2] = {i / 1000.f, -i / 1000.f};
+        writer.Sample(frame);
+        writer.Write();
+    }
+    writer.SaveFile();
+    const auto& file = MemoryFileSystem::Files()["rec.wav"];
+    ASSERT_EQ(file.size(), 44u + 4000u);
+    for(int i = 0; i < 1000; i++)
+    {
+        ASSERT_EQ(ReadSample(file, 16, false, i * 2),
+                  s162f(f2s16(i / 1000.f)));
+        ASSERT_EQ(ReadSample(file, 16, false, i * 2 + 1),
+                  s162f(f2s16(-i / 1000.f)));
+    }
+}
+
+namespace
+{
+// Records 20 seconds of 8 channels of 24 bit audio, in a preallocated file,
+// while the SD Card stalls for up to 100ms. Checks that the file holds
+// exactly the frames that weren't dropped.
+template <size_t num_buffers>
+uint32_t RecordWithStalls(size_t* max_buffered)
+{
+    MemoryFileSystem::Clear();
+    using Writer = WavWriter<16384, num_buffers, MemoryFileWriter>;
+    static Writer           writer;
+    typename Writer::Config cfg;
+    cfg.channels      = 8;
+    cfg.bitspersample = 24;
+    cfg.preallocate   = 21.f;
+    writer.Init(cfg);
+
+    SdCardModel sd;
+    sd.bytes_per_us = 5.;
+    sd.stall_chance = 0.01;
+    sd.max_stall_us = 100000.;
+
+    auto         input  = MakeChannels(8, kBlockSize);
+    uint32_t     blocks = 0;
+    const float* in[8];
+    for(size_t c = 0; c < 8; c++)
+        in[c] = input[c].data();
+    sd.audio_callback = [&]() {
+        if(writer.IsRecording())
+        {
+            writer.Sample(in, kBlockSize);
+            blocks++;
+        }
+    };
+    SdCardModel::Active() = &sd;
+    EXPECT_EQ(writer.OpenFile("rec.wav"), Writer::Result::OK);
+    while(sd.now_us < 20e6)
+    {
+        writer.Write();
+        sd.Advance(50.);
+    }
+    writer.SaveFile();
+    SdCardModel::Active() = nullptr;
+
+    uint32_t recorded = blocks * kBlockSize - writer.GetDroppedFrames();
+    EXPECT_EQ(writer.GetLengthSamps(), recorded);
+    EXPECT_EQ(MemoryFileSystem::Files()["rec.wav"].size(),
+              512 + recorded * 24);
+    EXPECT_EQ(writer.GetWriteErrors(), 0u);
+    *max_buffered = writer.GetMaxBuffered();
+    return writer.GetOverruns();
+}
+} // namespace
+
+TEST(util_WavWriter, c_stalls)
+{
+    // 100ms at 1152 bytes per ms take 7 blocks, plus the one being written
+    size_t max_buffered;
+    EXPECT_EQ(RecordWithStalls<9>(&max_buffered), 0u);
+    EXPECT_GT(max_buffered, 16384u * 4);
+    EXPECT_LE(max_buffered, 16384u * 9);
+
+    EXPECT_GT(RecordWithStalls<2>(&max_buffered), 0u);
+    EXPECT_GT(max_buffered, 16384u * 2 - 24);
+}
+
+namespace
+{
+// Records a second of stereo 16 bit audio, and checks the file
+void RecordSecond(float preallocate)
+{
+    MemoryFileSystem::Clear();
+    using Writer = WavWriter<4096, 4, MemoryFileWriter>;
+    Writer         writer;
+    Writer::Config cfg;
+    cfg.preallocate = preallocate;
+    writer.Init(cfg);
+    ASSERT_EQ(writer.OpenFile("rec.wav"), Writer::Result::OK);
+    auto input = MakeChannels(2, 48000);
+    for(size_t pos = 0; pos < 48000; pos += kBlockSize)
+    {
+        const float* in[2] = {&input[0][pos], &input[1][pos]};
+        writer.Sample(in, kBlockSize);
+        writer.Write();
+    }
+    ASSERT_EQ(writer.SaveFile(), Writer::Result::OK);
+
+    // Readers skip the padding
+    MemoryFileReader reader;
+    WavStreamFormat  format;
+    ASSERT_TRUE(reader.Open("rec.wav"));
+    ASSERT_TRUE(format.Parse(reader, 8));
+    size_t header = preallocate > 0.f ? 512 : 44;
+    EXPECT_EQ(format.data_start, header);
+    EXPECT_EQ(format.data_end, header + 48000 * 4);
+    EXPECT_EQ(reader.GetSize(), header + 48000 * 4);
+    const auto& file = MemoryFileSystem::Files()["rec.wav"];
+    for(size_t i = 0; i < 48000; i++)
+        ASSERT_NEAR(ReadSample(file, 16, false, i * 2 + 1, header),
+                    input[1][i],
+                    2.f / 32768.f);
+}
+} // namespace
+
+TEST(util_WavWriter, d_preallocate)
+{
+    // A cluster at a time
+    RecordSecond(0.f);
+    EXPECT_EQ(MemoryFileSystem::FatUpdates(), 6u);
+
+    // Allocated once, when opening
+    RecordSecond(1.f);
+    EXPECT_EQ(MemoryFileSystem::FatUpdates(), 1u);
+
+    // Grows as usual after the reserved half second
+    RecordSecond(0.5f);
+    EXPECT_EQ(MemoryFileSystem::FatUpdates(), 4u);
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "util/WaveTableMipmap.h"
+
+using namespace daisy;
+
+namespace
+{
+const double kTwoPi = 6.283185307179586;
+
+// Amplitude of a harmonic of a single cycle table
+double Harmonic(const float* table, size_t size, size_t harmonic)
+{
+    double re = 0., im = 0.;
+    for(size_t n = 0; n < size; n++)
+    {
+        double phase = kTwoPi * harmonic * n / size;
+        re += table[n] * std::cos(phase);
+        im -= table[n] * std::sin(phase);
+    }
+    return 2. * std::sqrt(re * re + im * im) / size;
+}
+
+std::vector<float> MakeTable(size_t size, std::vector<size_t> harmonics)
+{
+    std::vector<float> t(size, 0.f);
+    for(size_t n = 0; n < size; n++)
+        for(size_t h : harmonics)
+            t[n] += std::sin(kTwoPi * h * n / size + h);
+    return t;
+}
+} // namespace
+
+TEST(util_WaveTableMipmap, a_bandLimit)
+{
+    // The half length table holds up to harmonic 512
+    const size_t       size  = 2048;
+    std::vector<float> table = MakeTable(size, {1, 100, 400, 520, 600, 1000});
+    std::vector<float> half(size / 2);
+    WaveTableMipmap    mipmap;
+    mipmap.Downsample(table.data(), size, half.data());
+
+    // Passband
+    EXPECT_NEAR(Harmonic(half.data(), size / 2, 1), 1., 1e-3);
+    EXPECT_NEAR(Harmonic(half.data(), size / 2, 100), 1., 1e-3);
+    EXPECT_NEAR(Harmonic(half.data(), size / 2, 400), 1., 1e-2);
+
+    // Harmonics above 512 alias to 1024 - h, and are gone
+    EXPECT_LT(Harmonic(half.data(), size / 2, 1024 - 520), 3e-4);
+    EXPECT_LT(Harmonic(half.data(), size / 2, 1024 - 600), 3e-4);
+    EXPECT_LT(Harmonic(half.data(), size / 2, 1024 - 1000), 3e-4);
+}
+
+TEST(util_WaveTableMipmap, b_bank)
+{
+    // 4 tables of 256 samples, down to 16 samples
+    const size_t size = 256, count = 4, levels = 5;
+    EXPECT_EQ(WaveTableMipmap::GetBankSize(size, count, 1), size * count);
+    EXPECT_EQ(WaveTableMipmap::GetBankSize(size, count, levels),
+              count * (256 + 128 + 64 + 32 + 16));
+    std::vector<float> bank(WaveTableMipmap::GetBankSize(size, count, levels));
+    for(size_t i = 0; i < count; i++)
+    {
+        auto t = MakeTable(size, {i + 1, 100});
+        std::copy(t.begin(), t.end(), &bank[i * size]);
+    }
+    WaveTableMipmap mipmap;
+    mipmap.Build(bank.data(), size, count, levels);
+
+    for(size_t level = 0; level < levels; level++)
+    {
+        size_t level_size = size >> level;
+        for(size_t i = 0; i < count; i++)
+        {
+            const float* t
+                = &bank[WaveTableMipmap::GetOffset(size, count, level)
+                        + i * level_size];
+            // The low harmonic is kept, even where the table is shorter
+            // than the filter
+            EXPECT_NEAR(Harmonic(t, level_size, i + 1), 1., 1e-3)
+                << "level " << level << " table " << i;
+            // Harmonic 100 only fits the full length tables, and doesn't
+            // alias into the others
+            if(level == 0)
+            {
+                EXPECT_NEAR(Harmonic(t, level_size, 100), 1., 1e-3);
+                continue;
+            }
+            for(size_t h = 1; h <= level_size / 2; h++)
+            {
+                if(h != i + 1)
+                {
+                    EXPECT_LT(Harmonic(t, level_size, h), 3e-4)
+                        << "level " << level << " harmonic " << h;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "dev/ws2812.h"
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+// 6.25MHz SPI
+const uint32_t kSpiBitNs = 160;
+
+// One LED bit: the line goes high, then low until the next one
+struct Pulse
+{
+    uint32_t high_ns;
+    uint32_t low_ns;
+};
+
+// The waveform on MOSI, starting low
+std::vector<Pulse> GetPulses(const std::vector<uint8_t>& data)
+{
+    std::vector<Pulse> pulses;
+    bool               last = false;
+    for(uint8_t byte : data)
+    {
+        for(int b = 7; b >= 0; b--)
+        {
+            const bool level = (byte >> b) & 1;
+            if(level && !last)
+                pulses.push_back({0, 0});
+            if(!pulses.empty())
+                (level ? pulses.back().high_ns : pulses.back().low_ns)
+                    += kSpiBitNs;
+            last = level;
+        }
+    }
+    return pulses;
+}
+
+// Datasheet timing, +-150ns
+struct Timing
+{
+    uint32_t t0h, t0l, t1h, t1l, reset;
+};
+const Timing kWs2812 = {400, 850, 800, 450, 280000};
+const Timing kSk6812 = {300, 900, 600, 600, 80000};
+
+// Checks the pulses against the timing, and decodes them to bytes
+std::vector<uint8_t> Decode(const std::vector<uint8_t>& data,
+                            const Timing&               timing)
+{
+    std::vector<Pulse>   pulses = GetPulses(data);
+    std::vector<uint8_t> bytes;
+    for(size_t i = 0; i < pulses.size(); i++)
+    {
+        const bool one = pulses[i].high_ns > (timing.t0h + timing.t1h) / 2;
+        EXPECT_NEAR(pulses[i].high_ns, one ? timing.t1h : timing.t0h, 150)
+            << i;
+        if(i + 1 < pulses.size())
+        {
+            EXPECT_NEAR(pulses[i].low_ns, one ? timing.t1l : timing.t0l, 150)
+                << i;
+            // 1.25us +-600ns
+            EXPECT_NEAR(pulses[i].high_ns + pulses[i].low_ns, 1250, 600);
+        }
+        else
+        {
+            EXPECT_GE(pulses[i].low_ns, timing.reset);
+        }
+        if(i % 8 == 0)
+            bytes.push_back(0);
+        bytes.back() = (bytes.back() << 1) | (one ? 1 : 0);
+    }
+    return bytes;
+}
+
+} // namespace
+
+TEST(dev_Ws2812, a_protocolTiming)
+{
+    sim::Reset();
+    static Ws2812<4>::DmaBuffer bufferA, bufferB;
+    Ws2812<4>                   leds;
+    Ws2812<4>::Config           cfg;
+    cfg.Defaults();
+    cfg.periph = SpiHandle::Config::Peripheral::SPI_4;
+    EXPECT_EQ(leds.Init(cfg, bufferA, bufferB), Ws2812<4>::Result::ERR);
+    cfg.periph = SpiHandle::Config::Peripheral::SPI_2;
+    ASSERT_EQ(leds.Init(cfg, bufferA, bufferB), Ws2812<4>::Result::OK);
+    EXPECT_EQ(sizeof(bufferA), 4 * 24 + 235u);
+
+    // Green, red, blue, MSB first
+    leds.SetPixel(0, PackedColor(0x123456));
+    leds.SetPixel(1, PackedColor(0xff0000));
+    leds.SetPixel(3, PackedColor(0x0000ff));
+    leds.SetPixel(4, PackedColor(0xffffff)); // ignored
+    const uint64_t start = sim::GetNowNs();
+    EXPECT_TRUE(leds.SwapBuffersAndTransmit());
+    EXPECT_EQ(sim::GetNowNs(), start);
+    EXPECT_TRUE(leds.IsTransmitting());
+
+    ASSERT_EQ(sim::GetSpiLog().size(), 1u);
+    const sim::SpiTransfer& t = sim::GetSpiLog()[0];
+    EXPECT_EQ(t.periph, SpiHandle::Config::Peripheral::SPI_2);
+    EXPECT_EQ(Decode(t.data, kWs2812),
+              std::vector<uint8_t>({0x34,
+                                    0x12,
+                                    0x56,
+                                    0x00,
+                                    0xff,
+                                    0x00,
+                                    0x00,
+                                    0x00,
+                                    0x00,
+                                    0x00,
+                                    0x00,
+                                    0xff}));
+
+    // The whole frame goes out without the CPU, latched 300us later
+    sim::AdvanceNs(4 * 24 * 1280 + 300000);
+    EXPECT_TRUE(leds.IsTransmitting());
+    sim::AdvanceNs(Ws2812<4>::kBufferSize * 1280 - (4 * 24 * 1280 + 300000));
+    EXPECT_FALSE(leds.IsTransmitting());
+
+    // SK6812 RGBW: shorter 1s, and a white byte
+    using Rgbw = Ws2812<2, true>;
+    static Rgbw::DmaBuffer rgbwA, rgbwB;
+    Rgbw                   rgbw;
+    Rgbw::Config           rgbw_cfg;
+    rgbw_cfg.Defaults();
+    rgbw_cfg.chip = Rgbw::Config::Chip::SK6812;
+    ASSERT_EQ(rgbw.Init(rgbw_cfg, rgbwA, rgbwB), Rgbw::Result::OK);
+    rgbw.Fill(PackedColor(0x00a000), 0x81);
+    EXPECT_TRUE(rgbw.SwapBuffersAndTransmit());
+    EXPECT_EQ(
+        Decode(sim::GetSpiLog().back().data, kSk6812),
+        std::vector<uint8_t>({0xa0, 0x00, 0x00, 0x81, 0xa0, 0x00, 0x00, 0x81}));
+}
+
+TEST(dev_Ws2812, b_doubleBuffering)
+{
+    sim::Reset();
+    using Leds = Ws2812<60>;
+    static Leds::DmaBuffer bufferA, bufferB;
+    Leds                   leds;
+    Leds::Config           cfg;
+    cfg.Defaults();
+    ASSERT_EQ(leds.Init(cfg, bufferA, bufferB), Leds::Result::OK);
+
+    PackedColor frame[60];
+    PackedColor::FillRainbow(frame, 60, 0, 65536 / 60, 255, 128);
+    leds.SetPixels(frame, 60);
+    EXPECT_TRUE(leds.SwapBuffersAndTransmit());
+
+    // The next frame is drawn while the first one is sent. Until that
+    // is done, it stays in the draw buffer.
+    leds.SetPixel(10, PackedColor(0x010203));
+    EXPECT_FALSE(leds.SwapBuffersAndTransmit());
+    const sim::SpiTransfer first = sim::GetSpiLog().back();
+    while(leds.IsTransmitting())
+        sim::AdvanceNs(10000);
+    EXPECT_TRUE(leds.SwapBuffersAndTransmit());
+    ASSERT_EQ(sim::GetSpiLog().size(), 2u);
+    EXPECT_GE(sim::GetSpiLog()[1].time_ns,
+              first.time_ns + Leds::kBufferSize * 1280);
+
+    // The pixels that weren't set are kept from the frame before
+    std::vector<uint8_t> expected = Decode(first.data, kWs2812);
+    ASSERT_EQ(expected.size(), 180u);
+    expected[30] = 0x02;
+    expected[31] = 0x01;
+    expected[32] = 0x03;
+    EXPECT_EQ(Decode(sim::GetSpiLog()[1].data, kWs2812), expected);
+
+    // Another transfer on the DMA holds the frame back
+    while(leds.IsTransmitting())
+        sim::AdvanceNs(10000);
+    SpiHandle         other;
+    SpiHandle::Config other_cfg = {};
+    other_cfg.periph            = SpiHandle::Config::Peripheral::SPI_3;
+    other_cfg.datasize          = 8;
+    ASSERT_EQ(other.Init(other_cfg), SpiHandle::Result::OK);
+    uint8_t data[16] = {};
+    ASSERT_EQ(other.DmaTransmit(data, 16, nullptr, nullptr),
+              SpiHandle::Result::OK);
+    EXPECT_EQ(other.DmaTransmit(data, 16, nullptr, nullptr),
+              SpiHandle::Result::ERR);
+    EXPECT_FALSE(leds.SwapBuffersAndTransmit());
+    EXPECT_FALSE(leds.IsTransmitting());
+    sim::AdvanceNs(1000000);
+    EXPECT_TRUE(leds.SwapBuffersAndTransmit());
+    EXPECT_EQ(Decode(sim::GetSpiLog().back().data, kWs2812), expected);
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim/audio_runner.h"
+
+using namespace daisy;
+
+// Usage: libDaisy_audiorun [options] in.wav out.wav
+//   --bits=16|24|32    bit depth of the SAI (24)
+//   --blocksize=n      frames per block (48)
+//   --postgain=x       AudioHandle postgain (1)
+//   --gain=x           gain applied by the callback (1)
+//   --interleaved      use the interleaving callback, 2 channels only
+//   --times=path       write the time of each block in ns, one per line
+//
+// Runs the file through AudioHandle, the way it runs on the Seed, with the
+// callbacks below. Replace them with your own to test or profile them,
+// e.g. under perf or valgrind.
+
+static float gain = 1.f;
+
+static void Callback(AudioHandle::InputBuffer  in,
+                     AudioHandle::OutputBuffer out,
+                     size_t                    size,
+                     size_t                    channels)
+{
+    for(size_t c = 0; c < channels; c++)
+        for(size_t i = 0; i < size; i++)
+            out[c][i] = in[c][i] * gain;
+}
+
+static void Callback2(AudioHandle::InputBuffer  in,
+                      AudioHandle::OutputBuffer out,
+                      size_t                    size)
+{
+    Callback(in, out, size, 2);
+}
+
+static void Callback4(AudioHandle::InputBuffer  in,
+                      AudioHandle::OutputBuffer out,
+                      size_t                    size)
+{
+    Callback(in, out, size, 4);
+}
+
+static void InterleavedCallback(AudioHandle::InterleavingInputBuffer  in,
+                                AudioHandle::InterleavingOutputBuffer out,
+                                size_t                                size)
+{
+    for(size_t i = 0; i < size; i++)
+        out[i] = in[i] * gain;
+}
+
+static const char *Arg(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0 && arg[len] == '=' ? arg + len + 1
+                                                           : nullptr;
+}
+
+static bool GetSampleRate(uint32_t hz, SaiHandle::Config::SampleRate &sr)
+{
+    switch(hz)
+    {
+        case 8000: sr = SaiHandle::Config::SampleRate::SAI_8KHZ; return true;
+        case 16000: sr = SaiHandle::Config::SampleRate::SAI_16KHZ; return true;
+        case 32000: sr = SaiHandle::Config::SampleRate::SAI_32KHZ; return true;
+        case 48000: sr = SaiHandle::Config::SampleRate::SAI_48KHZ; return true;
+        case 96000: sr = SaiHandle::Config::SampleRate::SAI_96KHZ; return true;
+        default: return false;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sim::AudioRunner::Config config;
+    bool                     interleaved = false;
+    const char *             times       = nullptr;
+    const char *             files[2]    = {nullptr, nullptr};
+    int                      num_files   = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        const char *value;
+        if((value = Arg(argv[i], "--bits")))
+        {
+            int bits = atoi(value);
+            if(bits == 16)
+                config.bit_depth = SaiHandle::Config::BitDepth::SAI_16BIT;
+            else if(bits == 24)
+                config.bit_depth = SaiHandle::Config::BitDepth::SAI_24BIT;
+            else if(bits == 32)
+                config.bit_depth = SaiHandle::Config::BitDepth::SAI_32BIT;
+            else
+            {
+                fprintf(stderr, "bits must be 16, 24 or 32\n");
+                return 1;
+            }
+        }
+        else if((value = Arg(argv[i], "--blocksize")))
+            config.blocksize = atoi(value);
+        else if((value = Arg(argv[i], "--postgain")))
+            config.postgain = atof(value);
+        else if((value = Arg(argv[i], "--gain")))
+            gain = atof(value);
+        else if((value = Arg(argv[i], "--times")))
+            times = value;
+        else if(strcmp(argv[i], "--interleaved") == 0)
+            interleaved = true;
+        else if(argv[i][0] != '-' && num_files < 2)
+            files[num_files++] = argv[i];
+        else
+        {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(num_files != 2)
+    {
+        fprintf(stderr, "usage: %s [options] in.wav out.wav\n", argv[0]);
+        return 1;
+    }
+
+    sim::WavAudio in, out;
+    if(!sim::LoadWav(files[0], in))
+    {
+        fprintf(stderr, "can't read %s\n", files[0]);
+        return 1;
+    }
+    if(!GetSampleRate(in.samplerate, config.samplerate) || in.channels > 4)
+    {
+        fprintf(stderr, "%s: the SAI can't run at %lu Hz with %u channels\n",
+                files[0],
+                (unsigned long)in.samplerate,
+                in.channels);
+        return 1;
+    }
+
+    sim::AudioRunner           runner;
+    sim::AudioRunner::Result   result;
+    if(interleaved)
+        result = runner.Run(config, InterleavedCallback, in, out);
+    else if(in.channels > 2)
+        result = runner.Run(config, Callback4, in, out);
+    else
+        result = runner.Run(config, Callback2, in, out);
+    if(result != sim::AudioRunner::Result::OK)
+    {
+        fprintf(stderr, "invalid configuration\n");
+        return 1;
+    }
+    if(!sim::SaveWav(files[1], out))
+    {
+        fprintf(stderr, "can't write %s\n", files[1]);
+        return 1;
+    }
+
+    if(times)
+    {
+        FILE *file = fopen(times, "w");
+        if(!file)
+        {
+            fprintf(stderr, "can't write %s\n", times);
+            return 1;
+        }
+        for(uint64_t t : runner.GetBlockTimes())
+            fprintf(file, "%llu\n", (unsigned long long)t);
+        fclose(file);
+    }
+
+    sim::AudioRunner::BlockTimes stats = runner.GetBlockTimeStats();
+    printf("%zu blocks of %zu frames, %.3f us each at %lu Hz\n",
+           stats.blocks,
+           config.blocksize,
+           stats.budget / 1000.0,
+           (unsigned long)in.samplerate);
+    printf("time per block: min %.3f us, mean %.3f us, max %.3f us\n",
+           stats.min / 1000.0,
+           stats.mean / 1000.0,
+           stats.max / 1000.0);
+    printf("mean load %.2f%%, %zu blocks over budget\n",
+           100.0 * stats.mean / stats.budget,
+           stats.overruns);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include "Bench.h"
+#include "hid/ctrl.h"
+
+using namespace daisy;
+
+DSY_BENCHMARK(AnalogControl, Process)
+{
+    uint16_t      adc = 0;
+    AnalogControl ctrl;
+    ctrl.Init(&adc, 1000.f);
+    while(state.KeepRunning())
+    {
+        adc += 97;
+        bench::ClobberMemory();
+        bench::DoNotOptimize(ctrl.Process());
+    }
+}
+
+DSY_BENCHMARK(AnalogControl, ProcessBipolarCv)
+{
+    uint16_t      adc = 0;
+    AnalogControl ctrl;
+    ctrl.InitBipolarCv(&adc, 1000.f);
+    while(state.KeepRunning())
+    {
+        adc += 97;
+        bench::ClobberMemory();
+        bench::DoNotOptimize(ctrl.Process());
+    }
+}
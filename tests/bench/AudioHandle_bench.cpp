@@ -0,0 +1,88 @@
+#include "Bench.h"
+#include "hid/audio.h"
+
+// The callback runs from the DMA interrupt, which can only be driven
+// synchronously by the simulated SAI, so this is host-only for now.
+#ifdef UNIT_TEST
+#include "sim/sim.h"
+
+using namespace daisy;
+
+namespace
+{
+void Passthrough(AudioHandle::InputBuffer  in,
+                 AudioHandle::OutputBuffer out,
+                 size_t                    size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[0][i] = in[0][i];
+        out[1][i] = in[1][i];
+    }
+}
+
+void PassthroughInterleaved(const float* in, float* out, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        out[i] = in[i];
+}
+
+AudioHandle StartAudio()
+{
+    sim::Reset();
+    SaiHandle::Config sai_cfg;
+    sai_cfg.periph    = SaiHandle::Config::Peripheral::SAI_1;
+    sai_cfg.sr        = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    sai_cfg.bit_depth = SaiHandle::Config::BitDepth::SAI_24BIT;
+    sai_cfg.a_sync    = SaiHandle::Config::Sync::MASTER;
+    sai_cfg.b_sync    = SaiHandle::Config::Sync::SLAVE;
+    sai_cfg.a_dir     = SaiHandle::Config::Direction::TRANSMIT;
+    sai_cfg.b_dir     = SaiHandle::Config::Direction::RECEIVE;
+    SaiHandle sai;
+    sai.Init(sai_cfg);
+
+    AudioHandle::Config cfg;
+    cfg.blocksize  = 48;
+    cfg.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.postgain   = 1.f;
+    AudioHandle audio;
+    audio.Init(cfg, sai);
+    return audio;
+}
+
+} // namespace
+
+// One block of 48 stereo frames per iteration. Each step of the simulation
+// is a DMA half transfer, so this includes its small bookkeeping.
+DSY_BENCHMARK(AudioHandle, InternalCallback)
+{
+    AudioHandle audio = StartAudio();
+    audio.Start(Passthrough);
+    while(state.KeepRunning())
+        sim::Step();
+    audio.Stop();
+}
+
+// The same with the input and output meters running
+DSY_BENCHMARK(AudioHandle, InternalCallbackMetered)
+{
+    AudioHandle              audio = StartAudio();
+    AudioHandle::MeterConfig meter_cfg;
+    meter_cfg.Defaults();
+    audio.StartMetering(meter_cfg);
+    audio.Start(Passthrough);
+    while(state.KeepRunning())
+        sim::Step();
+    audio.Stop();
+}
+
+DSY_BENCHMARK(AudioHandle, InternalCallbackInterleaved)
+{
+    AudioHandle audio = StartAudio();
+    audio.Start(PassthroughInterleaved);
+    while(state.KeepRunning())
+        sim::Step();
+    audio.Stop();
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "Bench.h"
+#ifdef UNIT_TEST
+#include <chrono>
+#else
+#include "stm32h7xx_hal.h"
+#include "sys/system.h"
+#endif
+
+namespace daisy
+{
+namespace bench
+{
+namespace
+{
+struct Benchmark
+{
+    const char *name;
+    Function    function;
+};
+
+// Filled by the registrars during static initialization. Plain arrays are
+// zeroed before any constructor runs, so the order doesn't matter.
+Benchmark benchmarks[kMaxBenchmarks];
+size_t    num_benchmarks;
+Result    results[kMaxBenchmarks];
+size_t    num_results;
+
+// Ends calibration when a benchmark is too fast for the timer
+const uint32_t kMaxIterations = 100000000;
+
+// Fixed point for printing, newlib-nano's printf has no floats
+struct Fixed
+{
+    unsigned long whole, frac;
+};
+
+Fixed Split(float value)
+{
+    uint64_t milli = (uint64_t)(value * 1000.f + 0.5f);
+    return {(unsigned long)(milli / 1000), (unsigned long)(milli % 1000)};
+}
+
+Ticks TicksPerUs()
+{
+#ifdef UNIT_TEST
+    return 1000;
+#else
+    return System::GetSysClkFreq() / 1000000;
+#endif
+}
+
+void StartCounter()
+{
+#ifndef UNIT_TEST
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR    = 0xC5ACCE55;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint32_t Repetitions(const Options &options)
+{
+    return std::max<uint32_t>(1,
+                              std::min(options.repetitions, kMaxRepetitions));
+}
+
+Ticks RunOnce(Function function, uint32_t iterations)
+{
+    State state(iterations);
+    function(state);
+    return state.Elapsed();
+}
+
+// Grows the iterations until a run takes min_ticks, by at most 10x per
+// step so a slow first run doesn't overshoot
+uint32_t Calibrate(Function function, Ticks min_ticks)
+{
+    uint32_t iterations = 1;
+    for(;;)
+    {
+        Ticks t = RunOnce(function, iterations);
+        if(t >= min_ticks || iterations >= kMaxIterations)
+            return iterations;
+        uint64_t next = t > 0 ? (uint64_t)iterations * min_ticks * 6 / 5 / t
+                              : (uint64_t)iterations * 10;
+        next       = std::max<uint64_t>(next, iterations + 1);
+        next       = std::min<uint64_t>(next, (uint64_t)iterations * 10);
+        iterations = std::min<uint64_t>(next, kMaxIterations);
+    }
+}
+
+void Summarize(float *samples, uint32_t n, Result &result)
+{
+    std::sort(samples, samples + n);
+    float sum = 0.f;
+    for(uint32_t i = 0; i < n; i++)
+        sum += samples[i];
+    const float mean = sum / n;
+    float       var  = 0.f;
+    for(uint32_t i = 0; i < n; i++)
+        var += (samples[i] - mean) * (samples[i] - mean);
+
+    result.min    = samples[0];
+    result.max    = samples[n - 1];
+    result.median = n & 1 ? samples[n / 2]
+                          : (samples[n / 2 - 1] + samples[n / 2]) / 2.f;
+    result.mean   = mean;
+    result.stddev = n > 1 ? sqrtf(var / (n - 1)) : 0.f;
+}
+
+} // namespace
+
+Ticks Now()
+{
+#ifdef UNIT_TEST
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+const char *Unit()
+{
+#ifdef UNIT_TEST
+    return "ns";
+#else
+    return "cycles";
+#endif
+}
+
+Registrar::Registrar(const char *name, Function function)
+{
+    if(num_benchmarks < kMaxBenchmarks)
+        benchmarks[num_benchmarks++] = {name, function};
+}
+
+size_t Run(const Options &options, PrintFunction print)
+{
+    const uint32_t reps      = Repetitions(options);
+    const Ticks    min_ticks = TicksPerUs() * options.min_time_us;
+    StartCounter();
+
+    print("%-40s %10s %14s %14s %12s\n",
+          "benchmark",
+          "iterations",
+          "median",
+          "min",
+          "stddev");
+    num_results = 0;
+    for(size_t b = 0; b < num_benchmarks; b++)
+    {
+        const Benchmark &bm = benchmarks[b];
+        if(options.filter && !strstr(bm.name, options.filter))
+            continue;
+
+        const uint32_t iterations = Calibrate(bm.function, min_ticks);
+        for(uint32_t w = 0; w < options.warmup; w++)
+            RunOnce(bm.function, iterations);
+        float samples[kMaxRepetitions];
+        for(uint32_t r = 0; r < reps; r++)
+            samples[r] = (float)RunOnce(bm.function, iterations) / iterations;
+
+        Result &result     = results[num_results++];
+        result.name        = bm.name;
+        result.iterations  = iterations;
+        result.repetitions = reps;
+        Summarize(samples, reps, result);
+
+        Fixed median = Split(result.median), min = Split(result.min),
+              stddev = Split(result.stddev);
+        print("%-40s %10lu %10lu.%03lu %10lu.%03lu %8lu.%03lu %s\n",
+              result.name,
+              (unsigned long)iterations,
+              median.whole,
+              median.frac,
+              min.whole,
+              min.frac,
+              stddev.whole,
+              stddev.frac,
+              Unit());
+    }
+    return num_results;
+}
+
+const Result &GetResult(size_t idx)
+{
+    return results[idx];
+}
+
+void PrintJson(const Options &options, PrintFunction print)
+{
+    // Printed in pieces, the Logger formats at most 128 bytes at a time
+    print("{\n  \"context\": {\"unit\": \"%s\", \"warmup\": %lu, ",
+          Unit(),
+          (unsigned long)options.warmup);
+    print("\"repetitions\": %lu, \"min_time_us\": %lu},\n",
+          (unsigned long)Repetitions(options),
+          (unsigned long)options.min_time_us);
+    print("  \"benchmarks\": [\n");
+    for(size_t i = 0; i < num_results; i++)
+    {
+        const Result &r = results[i];
+        print("    {\"name\": \"%s\", \"iterations\": %lu, ",
+              r.name,
+              (unsigned long)r.iterations);
+        const char *keys[5]   = {"min", "median", "mean", "stddev", "max"};
+        const float values[5] = {r.min, r.median, r.mean, r.stddev, r.max};
+        for(size_t k = 0; k < 5; k++)
+        {
+            Fixed v = Split(values[k]);
+            print("\"%s\": %lu.%03lu%s",
+                  keys[k],
+                  v.whole,
+                  v.frac,
+                  k < 4 ? ", " : "}");
+        }
+        print(i + 1 < num_results ? ",\n" : "\n");
+    }
+    print("  ]\n}\n");
+}
+
+} // namespace bench
+} // namespace daisy
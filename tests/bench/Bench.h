@@ -0,0 +1,159 @@
+#pragma once
+#ifndef DSY_BENCH_H
+#define DSY_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+namespace bench
+{
+/** Time as counted by the benchmarks: nanoseconds on the host,
+ ** CPU cycles (DWT->CYCCNT) on the target.
+ */
+#ifdef UNIT_TEST
+typedef uint64_t Ticks;
+#else
+typedef uint32_t Ticks;
+#endif
+
+/** \return the current time in Ticks */
+Ticks Now();
+
+/** \return name of the unit of Ticks, "ns" or "cycles" */
+const char *Unit();
+
+/** Handed to a benchmark, which runs the code under test in
+ ** `while(state.KeepRunning())`. Everything before the loop is setup and
+ ** isn't timed.
+ */
+class State
+{
+  public:
+    explicit State(uint32_t iterations)
+    : iterations_(iterations),
+      remaining_(iterations),
+      started_(false),
+      elapsed_(0),
+      start_(0)
+    {
+    }
+
+    /** \return true while there are iterations left to run */
+    bool KeepRunning()
+    {
+        if(!started_)
+        {
+            started_ = true;
+            start_   = Now();
+        }
+        if(remaining_ > 0)
+        {
+            remaining_--;
+            return true;
+        }
+        elapsed_ += Now() - start_;
+        return false;
+    }
+
+    /** Stops timing, for work in the loop that shouldn't count */
+    void PauseTiming() { elapsed_ += Now() - start_; }
+
+    /** Restarts timing after PauseTiming() */
+    void ResumeTiming() { start_ = Now(); }
+
+    /** \return the number of iterations this run does */
+    uint32_t Iterations() const { return iterations_; }
+
+    /** \return the time taken by the loop, once it is done */
+    Ticks Elapsed() const { return elapsed_; }
+
+  private:
+    uint32_t iterations_, remaining_;
+    bool     started_;
+    Ticks    elapsed_, start_;
+};
+
+/** Keeps the compiler from optimizing away a value that is never used */
+template <typename T>
+inline void DoNotOptimize(T const &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** Keeps the compiler from dropping or reordering stores to memory */
+inline void ClobberMemory()
+{
+    asm volatile("" : : : "memory");
+}
+
+typedef void (*Function)(State &state);
+
+/** printf-like output, so results can go to stdout or the Logger */
+typedef void (*PrintFunction)(const char *format, ...);
+
+/** Adds a benchmark to the ones Run() knows about. Use DSY_BENCHMARK(). */
+class Registrar
+{
+  public:
+    Registrar(const char *name, Function function);
+};
+
+/** How benchmarks are run */
+struct Options
+{
+    /** Only run benchmarks with this in their name, all when nullptr */
+    const char *filter = nullptr;
+    /** Repetitions run and discarded before the timed ones */
+    uint32_t warmup = 1;
+    /** Timed repetitions, up to kMaxRepetitions */
+    uint32_t repetitions = 10;
+    /** Iterations are scaled so each repetition takes at least this long */
+    uint32_t min_time_us = 2000;
+};
+
+/** Statistics of one benchmark, in Ticks per iteration */
+struct Result
+{
+    const char *name;
+    uint32_t    iterations;
+    uint32_t    repetitions;
+    float       min, median, mean, stddev, max;
+};
+
+const uint32_t kMaxRepetitions = 64;
+const size_t   kMaxBenchmarks  = 32;
+
+/** Runs the registered benchmarks, printing a line for each one
+ ** as it completes.
+ ** \return number of results, which are then available from GetResult()
+ */
+size_t Run(const Options &options, PrintFunction print);
+
+/** \return a result of the last Run() */
+const Result &GetResult(size_t idx);
+
+/** Prints the results of the last Run() as JSON */
+void PrintJson(const Options &options, PrintFunction print);
+
+} // namespace bench
+} // namespace daisy
+
+/** Defines a benchmark named group/name:
+ ** ~~~~
+ ** DSY_BENCHMARK(RingBuffer, Write)
+ ** {
+ **     RingBuffer<int, 64> buffer;
+ **     while(state.KeepRunning())
+ **         ...
+ ** }
+ ** ~~~~
+ */
+#define DSY_BENCHMARK(group, name)                              \
+    static void group##_##name(daisy::bench::State &state);     \
+    static daisy::bench::Registrar group##_##name##_registrar(  \
+        #group "/" #name, group##_##name);                      \
+    static void group##_##name(daisy::bench::State &state)
+
+#endif
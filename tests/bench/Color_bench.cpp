@@ -0,0 +1,97 @@
+#include "Bench.h"
+#include "util/color.h"
+#include <math.h>
+
+using namespace daisy;
+
+// One frame of a rainbow animation, faded into a background color, for
+// 64 RGB LEDs: the float path as the animations did it, and PackedColor.
+namespace
+{
+const size_t kNumLeds = 64;
+
+Color HsvFloat(float h, float s, float v)
+{
+    h       = fmodf(h, 1.f) * 6.f;
+    int   i = (int)h;
+    float f = h - i;
+    float p = v * (1.f - s);
+    float q = v * (1.f - s * f);
+    float t = v * (1.f - s * (1.f - f));
+    Color c;
+    switch(i % 6)
+    {
+        case 0: c.Init(v, t, p); break;
+        case 1: c.Init(q, v, p); break;
+        case 2: c.Init(p, v, t); break;
+        case 3: c.Init(p, q, v); break;
+        case 4: c.Init(t, p, v); break;
+        default: c.Init(v, p, q); break;
+    }
+    return c;
+}
+
+Color LerpFloat(const Color& a, const Color& b, float t)
+{
+    Color c;
+    c.Init(a.Red() + (b.Red() - a.Red()) * t,
+           a.Green() + (b.Green() - a.Green()) * t,
+           a.Blue() + (b.Blue() - a.Blue()) * t);
+    return c;
+}
+} // namespace
+
+DSY_BENCHMARK(Color, FloatFrame64)
+{
+    Color leds[kNumLeds], background;
+    background.Init(Color::PURPLE);
+    float hue = 0.f;
+    while(state.KeepRunning())
+    {
+        hue += 0.01f;
+        bench::ClobberMemory();
+        for(size_t i = 0; i < kNumLeds; i++)
+        {
+            Color c = HsvFloat(hue + i * (1.f / kNumLeds), 1.f, 0.8f);
+            leds[i] = LerpFloat(c, background, 0.25f);
+        }
+        bench::DoNotOptimize(leds[kNumLeds - 1]);
+    }
+}
+
+DSY_BENCHMARK(Color, PackedFrame64)
+{
+    PackedColor leds[kNumLeds], background[kNumLeds];
+    Color       purple;
+    purple.Init(Color::PURPLE);
+    PackedColor::Fill(background, kNumLeds, PackedColor::FromColor(purple));
+    uint16_t hue = 0;
+    while(state.KeepRunning())
+    {
+        hue += 655;
+        bench::ClobberMemory();
+        PackedColor::FillRainbow(
+            leds, kNumLeds, hue, 65536 / kNumLeds, 255, 204);
+        PackedColor::Lerp(leds, background, leds, kNumLeds, 64);
+        bench::DoNotOptimize(leds[kNumLeds - 1]);
+    }
+}
+
+// Palette lookups, with the blend between entries
+DSY_BENCHMARK(Color, Palette64)
+{
+    static const PackedColor palette[] = {PackedColor(0xff0000),
+                                          PackedColor(0xffa000),
+                                          PackedColor(0x00ff40),
+                                          PackedColor(0x2000ff)};
+    PackedColor              leds[kNumLeds];
+    uint16_t                 pos = 0;
+    while(state.KeepRunning())
+    {
+        pos += 300;
+        bench::ClobberMemory();
+        for(size_t i = 0; i < kNumLeds; i++)
+            leds[i] = PackedColor::FromPalette(palette, pos + i * 1024);
+        bench::DoNotOptimize(leds[kNumLeds - 1]);
+    }
+}
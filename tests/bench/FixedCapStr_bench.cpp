@@ -0,0 +1,17 @@
+#include "Bench.h"
+#include "util/FixedCapStr.h"
+
+using namespace daisy;
+
+DSY_BENCHMARK(FixedCapStr, AppendFloat)
+{
+    FixedCapStr<16> str;
+    float           value = -12.345f;
+    while(state.KeepRunning())
+    {
+        str.Clear();
+        str.AppendFloat(value, 3);
+        value += 0.25f;
+        bench::DoNotOptimize(str.Cstr()[0]);
+    }
+}
@@ -0,0 +1,22 @@
+#include "Bench.h"
+#include "hid/midi.h"
+
+using namespace daisy;
+
+// Note on, note off by running status and a control change, one message
+// per iteration with the event popped again
+DSY_BENCHMARK(MidiHandler, Parse)
+{
+    static MidiHandler midi;
+    midi.Init(MidiHandler::INPUT_MODE_UART1, MidiHandler::OUTPUT_MODE_NONE);
+    const uint8_t stream[9] = {0x90, 60, 100, 60, 0, 0, 0xB3, 7, 64};
+    size_t        idx       = 0;
+    while(state.KeepRunning())
+    {
+        for(size_t i = 0; i < 3; i++)
+            midi.Parse(stream[idx + i]);
+        idx = idx < 6 ? idx + 3 : 0;
+        while(midi.HasEvents())
+            bench::DoNotOptimize(midi.PopEvent());
+    }
+}
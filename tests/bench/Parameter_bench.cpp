@@ -0,0 +1,82 @@
+#include "Bench.h"
+#include "hid/parameter.h"
+#include "hid/parameter_bank.h"
+#include <math.h>
+
+using namespace daisy;
+
+// 24 controls, the size of a Field patch, half of them logarithmic
+namespace
+{
+const size_t kNumParams = 24;
+
+Parameter::Curve CurveFor(size_t i)
+{
+    return i % 2 ? Parameter::LOGARITHMIC : (Parameter::Curve)(i % 4);
+}
+} // namespace
+
+DSY_BENCHMARK(Parameter, Process24)
+{
+    static uint16_t adc[kNumParams];
+    AnalogControl   ctrl;
+    Parameter       params[kNumParams];
+    for(size_t i = 0; i < kNumParams; i++)
+    {
+        ctrl.Init(&adc[i], 1000.f);
+        params[i].Init(ctrl, 20.f, 20000.f, CurveFor(i));
+    }
+    while(state.KeepRunning())
+    {
+        adc[0] += 97;
+        bench::ClobberMemory();
+        for(size_t i = 0; i < kNumParams; i++)
+            bench::DoNotOptimize(params[i].Process());
+    }
+}
+
+DSY_BENCHMARK(Parameter, Bank24)
+{
+    static uint16_t           adc[kNumParams];
+    AnalogControl             ctrl[kNumParams];
+    ParameterBank<kNumParams> bank;
+    for(size_t i = 0; i < kNumParams; i++)
+    {
+        ctrl[i].Init(&adc[i], 1000.f);
+        bank.Init(i, &ctrl[i], 20.f, 20000.f, CurveFor(i));
+    }
+    while(state.KeepRunning())
+    {
+        adc[0] += 97;
+        bench::ClobberMemory();
+        bank.Process();
+        bench::DoNotOptimize(bank.Values()[kNumParams - 1]);
+    }
+}
+
+// The curve of a logarithmic parameter on its own
+DSY_BENCHMARK(Parameter, Expf24)
+{
+    float x[kNumParams];
+    for(size_t i = 0; i < kNumParams; i++)
+        x[i] = i * 0.3f;
+    while(state.KeepRunning())
+    {
+        bench::ClobberMemory();
+        for(size_t i = 0; i < kNumParams; i++)
+            bench::DoNotOptimize(expf(x[i]));
+    }
+}
+
+DSY_BENCHMARK(Parameter, Exp2_24)
+{
+    float x[kNumParams];
+    for(size_t i = 0; i < kNumParams; i++)
+        x[i] = i * 0.3f;
+    while(state.KeepRunning())
+    {
+        bench::ClobberMemory();
+        for(size_t i = 0; i < kNumParams; i++)
+            bench::DoNotOptimize(ParameterBank<1>::Exp2(x[i]));
+    }
+}
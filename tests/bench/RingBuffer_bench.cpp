@@ -0,0 +1,33 @@
+#include "Bench.h"
+#include "util/ringbuffer.h"
+
+using namespace daisy;
+
+// A byte at a time, the way the UART and MIDI queues are used
+DSY_BENCHMARK(RingBuffer, WriteRead)
+{
+    RingBuffer<uint8_t, 256> buffer;
+    buffer.Init();
+    uint8_t value = 0;
+    while(state.KeepRunning())
+    {
+        buffer.Write(value++);
+        bench::DoNotOptimize(buffer.Read());
+    }
+}
+
+// A block of audio in and out again
+DSY_BENCHMARK(RingBuffer, Block48)
+{
+    static RingBuffer<float, 1024> buffer;
+    float                          in[48], out[48];
+    for(size_t i = 0; i < 48; i++)
+        in[i] = i;
+    buffer.Init();
+    while(state.KeepRunning())
+    {
+        buffer.Overwrite(in, 48);
+        buffer.ImmediateRead(out, 48);
+        bench::DoNotOptimize(out[47]);
+    }
+}
@@ -0,0 +1,55 @@
+#include "Bench.h"
+#include "dev/oled_ssd130x.h"
+
+using namespace daisy;
+
+namespace
+{
+// Takes the place of the bus, so only the driver is measured
+class NullTransport
+{
+  public:
+    struct Config
+    {
+    };
+    void Init(const Config&) {}
+    void SendCommand(uint8_t cmd) { sum_ += cmd; }
+    void SendData(uint8_t* buff, size_t size)
+    {
+        sum_ += buff[0] + buff[size - 1];
+    }
+
+  private:
+    uint32_t sum_ = 0;
+};
+
+typedef SSD130xDriver<128, 64, NullTransport> Driver;
+
+} // namespace
+
+// A diagonal line across the whole display per iteration
+DSY_BENCHMARK(SSD130x, DrawPixel)
+{
+    static Driver display;
+    display.Init({});
+    bool on = true;
+    while(state.KeepRunning())
+    {
+        for(uint_fast8_t x = 0; x < 128; x++)
+            display.DrawPixel(x, x / 2, on);
+        on = !on;
+        bench::ClobberMemory();
+    }
+}
+
+DSY_BENCHMARK(SSD130x, Update)
+{
+    static Driver display;
+    display.Init({});
+    display.Fill(true);
+    while(state.KeepRunning())
+    {
+        display.Update();
+        bench::ClobberMemory();
+    }
+}
@@ -0,0 +1,30 @@
+#include "Bench.h"
+#include "dev/ws2812.h"
+
+using namespace daisy;
+
+// Encoding a frame of 300 RGB pixels into the DMA buffer, which is all
+// the CPU does per frame
+namespace
+{
+using Strip = Ws2812<300, false, false>;
+Strip::DmaBuffer buffer_a, buffer_b;
+} // namespace
+
+DSY_BENCHMARK(Ws2812, SetPixels300)
+{
+    Strip         strip;
+    Strip::Config cfg;
+    cfg.Defaults();
+    strip.Init(cfg, buffer_a, buffer_b);
+    PackedColor frame[300];
+    uint16_t    hue = 0;
+    while(state.KeepRunning())
+    {
+        hue += 655;
+        PackedColor::FillRainbow(frame, 300, hue, 65536 / 300, 255, 255);
+        bench::ClobberMemory();
+        strip.SetPixels(frame, 300);
+        bench::DoNotOptimize(buffer_a[100]);
+    }
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+
+using namespace daisy;
+
+#ifdef UNIT_TEST
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Usage: libDaisy_bench [--filter=str] [--warmup=n] [--repetitions=n]
+//                       [--min_time_us=n] [--json=path]
+// The table goes to stdout, and the JSON to the file when given.
+
+static FILE *json_file;
+
+static void PrintStdout(const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    vprintf(format, va);
+    va_end(va);
+}
+
+static void PrintJsonFile(const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    vfprintf(json_file, format, va);
+    va_end(va);
+}
+
+static const char *Arg(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0 && arg[len] == '=' ? arg + len + 1
+                                                           : nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    bench::Options options;
+    const char *   json = nullptr;
+    for(int i = 1; i < argc; i++)
+    {
+        const char *value;
+        if((value = Arg(argv[i], "--filter")))
+            options.filter = value;
+        else if((value = Arg(argv[i], "--warmup")))
+            options.warmup = atoi(value);
+        else if((value = Arg(argv[i], "--repetitions")))
+            options.repetitions = atoi(value);
+        else if((value = Arg(argv[i], "--min_time_us")))
+            options.min_time_us = atoi(value);
+        else if((value = Arg(argv[i], "--json")))
+            json = value;
+        else
+        {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    bench::Run(options, PrintStdout);
+    if(json)
+    {
+        json_file = fopen(json, "w");
+        if(!json_file)
+        {
+            fprintf(stderr, "can't write %s\n", json);
+            return 1;
+        }
+        bench::PrintJson(options, PrintJsonFile);
+        fclose(json_file);
+    }
+    return 0;
+}
+
+#else
+#include "daisy_seed.h"
+
+// On the Seed the results are printed to the USB logger once the terminal
+// is open, the table first and then the JSON.
+DaisySeed hw;
+
+int main(void)
+{
+    hw.Configure();
+    hw.Init(true);
+    Logger<LOGGER_INTERNAL>::StartLog(true);
+
+    bench::Options options;
+    bench::Run(options, Logger<LOGGER_INTERNAL>::Print);
+    bench::PrintJson(options, Logger<LOGGER_INTERNAL>::Print);
+    for(;;) {}
+}
+
+#endif
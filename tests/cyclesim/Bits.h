@@ -0,0 +1,103 @@
+#pragma once
+#ifndef DSY_CYCLESIM_BITS_H
+#define DSY_CYCLESIM_BITS_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace cyclesim
+{
+/** \return bits hi down to lo of x */
+inline uint32_t Bits(uint32_t x, int hi, int lo)
+{
+    return (x >> lo) & (0xffffffffu >> (31 - (hi - lo)));
+}
+
+inline uint32_t Bit(uint32_t x, int n)
+{
+    return (x >> n) & 1;
+}
+
+/** \return a mask of the lowest n bits, n from 1 to 32 */
+inline uint32_t Mask(uint32_t n)
+{
+    return 0xffffffffu >> (32 - n);
+}
+
+/** Sign extends the lowest bits of x */
+inline int32_t SignExtend(uint32_t x, uint32_t bits)
+{
+    return int32_t(x << (32 - bits)) >> (32 - bits);
+}
+
+inline uint32_t Ror(uint32_t x, uint32_t n)
+{
+    n &= 31;
+    return n ? (x >> n) | (x << (32 - n)) : x;
+}
+
+inline uint32_t Align(uint32_t x, uint32_t n)
+{
+    return x & ~(n - 1);
+}
+
+inline uint32_t PopCount(uint32_t x)
+{
+    uint32_t count = 0;
+    for(; x; x &= x - 1)
+        count++;
+    return count;
+}
+
+inline uint32_t CountLeadingZeros(uint32_t x)
+{
+    uint32_t n = 0;
+    for(uint32_t bit = 0x80000000u; bit && !(x & bit); bit >>= 1)
+        n++;
+    return n;
+}
+
+inline uint32_t ByteSwap(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+inline uint32_t BitReverse(uint32_t x)
+{
+    uint32_t result = 0;
+    for(int i = 0; i < 32; i++)
+        result |= ((x >> i) & 1) << (31 - i);
+    return result;
+}
+
+inline float BitsToFloat(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint32_t FloatToBits(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline double BitsToDouble(uint64_t bits)
+{
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+inline uint64_t DoubleToBits(double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+} // namespace cyclesim
+
+#endif
@@ -0,0 +1,1578 @@
+#include "CortexM7.h"
+#include "CycleTable.h"
+#include "Bits.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace cyclesim
+{
+constexpr uint32_t CortexM7::kReturnAddress;
+constexpr uint32_t CortexM7::kHostBase;
+
+namespace
+{
+enum ShiftType
+{
+    LSL,
+    LSR,
+    ASR,
+    ROR,
+    RRX,
+};
+
+// Shift of the immediate shift encodings, DecodeImmShift() in the ARM ARM
+void DecodeImmShift(uint32_t type, uint32_t imm5, int *shift, uint32_t *n)
+{
+    *shift = type;
+    *n     = imm5;
+    if(type == LSR || type == ASR)
+        *n = imm5 ? imm5 : 32;
+    else if(type == ROR && imm5 == 0)
+    {
+        *shift = RRX;
+        *n     = 1;
+    }
+}
+
+int32_t Saturate(int64_t value, uint32_t bits, bool *saturated)
+{
+    const int64_t max = (int64_t(1) << (bits - 1)) - 1;
+    const int64_t min = -(int64_t(1) << (bits - 1));
+    *saturated        = value > max || value < min;
+    return int32_t(value > max ? max : value < min ? min : value);
+}
+
+uint32_t UnsignedSaturate(int64_t value, uint32_t bits, bool *saturated)
+{
+    const int64_t max = (int64_t(1) << bits) - 1;
+    *saturated        = value > max || value < 0;
+    return uint32_t(value > max ? max : value < 0 ? 0 : value);
+}
+
+int32_t Half(uint32_t value, bool high)
+{
+    return int16_t(high ? value >> 16 : value);
+}
+
+} // namespace
+
+CortexM7::CortexM7()
+{
+    memset(r_, 0, sizeof(r_));
+    memset(s_, 0, sizeof(s_));
+    memset(ready_, 0, sizeof(ready_));
+    n_ = z_ = c_ = v_ = q_ = false;
+    ge_ = fpscr_ = itstate_ = 0;
+    pc_ = next_pc_ = 0;
+    running_       = false;
+    now_ = issue_ = cycles_base_ = 0;
+    issue_cycles_ = latency_ = penalty_ = 0;
+    num_dsts_                           = 0;
+    stats_.instructions = stats_.cycles = 0;
+}
+
+bool CortexM7::Map(uint32_t base, uint32_t size)
+{
+    for(const Region &r : regions_)
+        if(uint64_t(base) < r.base + uint64_t(r.data.size())
+           && r.base < uint64_t(base) + size)
+            return false;
+    regions_.push_back({base, std::vector<uint8_t>(size)});
+    return true;
+}
+
+uint8_t *CortexM7::Pointer(uint32_t addr, uint32_t size)
+{
+    for(Region &r : regions_)
+        if(addr >= r.base
+           && uint64_t(addr) + size <= r.base + uint64_t(r.data.size()))
+            return r.data.data() + (addr - r.base);
+    return nullptr;
+}
+
+uint32_t CortexM7::AddHostFunction(HostFunction fn)
+{
+    host_functions_.push_back(fn);
+    return (kHostBase + (host_functions_.size() - 1) * 4) | 1;
+}
+
+float CortexM7::SReg(int n) const
+{
+    return BitsToFloat(s_[n]);
+}
+
+void CortexM7::SetSReg(int n, float value)
+{
+    s_[n] = FloatToBits(value);
+}
+
+double CortexM7::DReg(int n) const
+{
+    return BitsToDouble(s_[2 * n] | uint64_t(s_[2 * n + 1]) << 32);
+}
+
+void CortexM7::SetDReg(int n, double value)
+{
+    uint64_t bits = DoubleToBits(value);
+    s_[2 * n]     = uint32_t(bits);
+    s_[2 * n + 1] = uint32_t(bits >> 32);
+}
+
+void CortexM7::Fault(const std::string &error)
+{
+    if(!running_)
+        return;
+    char where[32];
+    snprintf(where, sizeof(where), " at 0x%08x", pc_);
+    error_   = error + where;
+    running_ = false;
+}
+
+void CortexM7::ResetStats()
+{
+    stats_.instructions = 0;
+    stats_.cycles       = 0;
+    cycles_base_        = now_;
+}
+
+bool CortexM7::Call(uint32_t                     addr,
+                    const std::vector<uint32_t> &args,
+                    uint64_t                     max_instructions)
+{
+    error_.clear();
+    if(args.size() > 4 || !(addr & 1))
+    {
+        error_ = "can only call Thumb functions with up to 4 arguments";
+        return false;
+    }
+    for(size_t i = 0; i < args.size(); i++)
+        r_[i] = args[i];
+    r_[14]   = kReturnAddress | 1;
+    pc_      = addr & ~1u;
+    itstate_ = 0;
+    running_ = true;
+
+    const uint64_t limit = stats_.instructions + max_instructions;
+    while(running_)
+    {
+        if(!Step())
+            return false;
+        if(stats_.instructions > limit)
+        {
+            Fault("instruction limit reached");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CortexM7::Step()
+{
+    if(pc_ == kReturnAddress)
+    {
+        running_ = false;
+        return true;
+    }
+    if(pc_ >= kHostBase && pc_ < kHostBase + host_functions_.size() * 4)
+    {
+        // Returns to the caller like a BX lr
+        host_functions_[(pc_ - kHostBase) / 4](*this);
+        if(!running_)
+            return false;
+        if(!(r_[14] & 1))
+        {
+            Fault("return to ARM state");
+            return false;
+        }
+        pc_ = r_[14] & ~1u;
+        now_ += cycles::kIndirect;
+        stats_.cycles = now_ - cycles_base_;
+        return true;
+    }
+
+    uint32_t hw1, hw2 = 0;
+    if(!Read(pc_, 2, &hw1))
+        return false;
+    const bool wide = (hw1 >> 11) >= 0x1d;
+    if(wide && !Read(pc_ + 2, 2, &hw2))
+        return false;
+
+    issue_        = now_;
+    issue_cycles_ = 1;
+    latency_      = cycles::kAlu;
+    penalty_      = 0;
+    num_dsts_     = 0;
+    next_pc_      = pc_ + (wide ? 4 : 2);
+
+    const bool in_it = InITBlock();
+    bool       pass  = true;
+    if(in_it)
+    {
+        UseFlags();
+        pass = ConditionPassed(itstate_ >> 4);
+    }
+    if(pass && !(wide ? Execute32(hw1, hw2) : Execute16(hw1)))
+        return false;
+    if(!running_)
+        return false;
+    if(in_it)
+        ITAdvance();
+
+    for(int i = 0; i < num_dsts_; i++)
+        ready_[dsts_[i]] = issue_ + dst_latency_[i];
+    now_ = issue_ + issue_cycles_ + penalty_;
+    stats_.instructions++;
+    stats_.cycles = now_ - cycles_base_;
+    pc_           = next_pc_;
+    return true;
+}
+
+bool CortexM7::Unsupported(uint32_t encoding)
+{
+    char msg[64];
+    snprintf(msg, sizeof(msg), "unsupported instruction 0x%08x", encoding);
+    Fault(msg);
+    return false;
+}
+
+// Operands
+
+uint32_t CortexM7::R(int n)
+{
+    if(n == 15)
+        return pc_ + 4;
+    if(ready_[n] > issue_)
+        issue_ = ready_[n];
+    return r_[n];
+}
+
+void CortexM7::W(int n, uint32_t value)
+{
+    if(n == 15)
+    {
+        // ALUWritePC()
+        next_pc_ = value & ~1u;
+        penalty_ = cycles::kIndirect;
+        return;
+    }
+    r_[n]                    = value;
+    dsts_[num_dsts_]         = n;
+    dst_latency_[num_dsts_++] = latency_;
+}
+
+uint32_t CortexM7::S(int n)
+{
+    if(ready_[kSlotS + n] > issue_)
+        issue_ = ready_[kSlotS + n];
+    return s_[n];
+}
+
+void CortexM7::WS(int n, uint32_t bits)
+{
+    s_[n]                     = bits;
+    dsts_[num_dsts_]          = kSlotS + n;
+    dst_latency_[num_dsts_++] = latency_;
+}
+
+uint64_t CortexM7::D(int n)
+{
+    if(n >= 16)
+        Fault("no d16-d31 on the FPv5-D16");
+    n &= 15;
+    uint64_t lo = S(2 * n);
+    return lo | uint64_t(S(2 * n + 1)) << 32;
+}
+
+void CortexM7::WD(int n, uint64_t bits)
+{
+    if(n >= 16)
+        Fault("no d16-d31 on the FPv5-D16");
+    n &= 15;
+    WS(2 * n, uint32_t(bits));
+    WS(2 * n + 1, uint32_t(bits >> 32));
+}
+
+void CortexM7::UseFlags()
+{
+    if(ready_[kSlotFlags] > issue_)
+        issue_ = ready_[kSlotFlags];
+}
+
+void CortexM7::FlagsWritten()
+{
+    dsts_[num_dsts_]          = kSlotFlags;
+    dst_latency_[num_dsts_++] = cycles::kAlu;
+}
+
+void CortexM7::SetNZ(uint32_t result)
+{
+    n_ = result >> 31;
+    z_ = result == 0;
+    FlagsWritten();
+}
+
+void CortexM7::SetNZCV(uint32_t result, bool carry, bool overflow)
+{
+    SetNZ(result);
+    c_ = carry;
+    v_ = overflow;
+}
+
+// Arithmetic helpers
+
+uint32_t CortexM7::AddWithCarry(uint32_t x,
+                                uint32_t y,
+                                bool     carry_in,
+                                bool *   carry_out,
+                                bool *   overflow)
+{
+    uint64_t usum   = uint64_t(x) + y + carry_in;
+    int64_t  ssum   = int64_t(int32_t(x)) + int32_t(y) + carry_in;
+    uint32_t result = uint32_t(usum);
+    *carry_out      = usum >> 32;
+    *overflow       = int64_t(int32_t(result)) != ssum;
+    return result;
+}
+
+uint32_t CortexM7::Shift(uint32_t value,
+                         int      type,
+                         uint32_t amount,
+                         bool     carry_in,
+                         bool *   carry_out)
+{
+    *carry_out = carry_in;
+    if(amount == 0 && type != RRX)
+        return value;
+    switch(type)
+    {
+        case LSL:
+            if(amount > 32)
+                *carry_out = false;
+            else
+                *carry_out = (value >> (32 - amount)) & 1;
+            return amount >= 32 ? 0 : value << amount;
+        case LSR:
+            if(amount > 32)
+                *carry_out = false;
+            else
+                *carry_out = (value >> (amount - 1)) & 1;
+            return amount >= 32 ? 0 : value >> amount;
+        case ASR:
+            if(amount >= 32)
+            {
+                *carry_out = value >> 31;
+                return uint32_t(int32_t(value) >> 31);
+            }
+            *carry_out = (value >> (amount - 1)) & 1;
+            return uint32_t(int32_t(value) >> amount);
+        case ROR:
+        {
+            uint32_t result = Ror(value, amount);
+            *carry_out      = result >> 31;
+            return result;
+        }
+        default:
+            *carry_out = value & 1;
+            return (uint32_t(carry_in) << 31) | (value >> 1);
+    }
+}
+
+uint32_t CortexM7::ExpandImm(uint32_t imm12, bool *carry_out)
+{
+    *carry_out = c_;
+    if((imm12 >> 10) == 0)
+    {
+        uint32_t imm8 = imm12 & 0xff;
+        switch((imm12 >> 8) & 3)
+        {
+            case 0: return imm8;
+            case 1: return imm8 << 16 | imm8;
+            case 2: return imm8 << 24 | imm8 << 8;
+            default: return imm8 * 0x01010101u;
+        }
+    }
+    uint32_t result = Ror(0x80 | (imm12 & 0x7f), imm12 >> 7);
+    *carry_out      = result >> 31;
+    return result;
+}
+
+// The opcodes shared by the modified immediate and shifted register forms
+bool CortexM7::DataProcessing(int      op,
+                              bool     setflags,
+                              int      d,
+                              int      n,
+                              uint32_t operand,
+                              bool     carry)
+{
+    uint32_t result;
+    bool     c = false, v = false;
+    bool     logical = true, write = true;
+    switch(op)
+    {
+        case 0x0:
+            result = R(n) & operand;
+            write  = d != 15;
+            break;
+        case 0x1: result = R(n) & ~operand; break;
+        case 0x2: result = n == 15 ? operand : R(n) | operand; break;
+        case 0x3: result = n == 15 ? ~operand : R(n) | ~operand; break;
+        case 0x4:
+            result = R(n) ^ operand;
+            write  = d != 15;
+            break;
+        case 0x8:
+            result  = AddWithCarry(R(n), operand, false, &c, &v);
+            logical = false;
+            write   = d != 15;
+            break;
+        case 0xa:
+            result  = AddWithCarry(R(n), operand, c_, &c, &v);
+            logical = false;
+            break;
+        case 0xb:
+            result  = AddWithCarry(R(n), ~operand, c_, &c, &v);
+            logical = false;
+            break;
+        case 0xd:
+            result  = AddWithCarry(R(n), ~operand, true, &c, &v);
+            logical = false;
+            write   = d != 15;
+            break;
+        case 0xe:
+            result  = AddWithCarry(~R(n), operand, true, &c, &v);
+            logical = false;
+            break;
+        default: return false;
+    }
+    // TST, TEQ, CMN and CMP are the forms with Rd = 15 and S set
+    if(!write && !setflags)
+        return false;
+    if(write)
+        W(d, result);
+    if(setflags)
+    {
+        if(logical)
+        {
+            SetNZ(result);
+            c_ = carry;
+        }
+        else
+            SetNZCV(result, c, v);
+    }
+    return true;
+}
+
+// Memory
+
+bool CortexM7::Read(uint32_t addr, uint32_t size, uint32_t *value)
+{
+    const uint8_t *p = Pointer(addr, size);
+    if(!p)
+    {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "read of unmapped 0x%08x", addr);
+        Fault(msg);
+        return false;
+    }
+    *value = 0;
+    for(uint32_t i = 0; i < size; i++)
+        *value |= uint32_t(p[i]) << (8 * i);
+    return true;
+}
+
+bool CortexM7::Write(uint32_t addr, uint32_t size, uint32_t value)
+{
+    uint8_t *p = Pointer(addr, size);
+    if(!p)
+    {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "write to unmapped 0x%08x", addr);
+        Fault(msg);
+        return false;
+    }
+    for(uint32_t i = 0; i < size; i++)
+        p[i] = uint8_t(value >> (8 * i));
+    return true;
+}
+
+bool CortexM7::Load(int t, uint32_t addr, uint32_t size, bool sign)
+{
+    uint32_t value;
+    if(!Read(addr, size, &value))
+        return false;
+    if(sign)
+        value = uint32_t(SignExtend(value, size * 8));
+    if(t == 15)
+        return LoadWritePC(value);
+    Latency(cycles::kLoad);
+    W(t, value);
+    Latency(cycles::kAlu);
+    return true;
+}
+
+// Control flow
+
+bool CortexM7::ConditionPassed(int cond) const
+{
+    bool result;
+    switch(cond >> 1)
+    {
+        case 0: result = z_; break;
+        case 1: result = c_; break;
+        case 2: result = n_; break;
+        case 3: result = v_; break;
+        case 4: result = c_ && !z_; break;
+        case 5: result = n_ == v_; break;
+        case 6: result = n_ == v_ && !z_; break;
+        default: return true;
+    }
+    return cond & 1 ? !result : result;
+}
+
+void CortexM7::ITAdvance()
+{
+    if((itstate_ & 7) == 0)
+        itstate_ = 0;
+    else
+        itstate_ = (itstate_ & 0xe0) | ((itstate_ << 1) & 0x1f);
+}
+
+void CortexM7::Branch(uint32_t target)
+{
+    BranchCond(true, target);
+}
+
+void CortexM7::BranchCond(bool taken, uint32_t target)
+{
+    // Branches that were never taken have no entry, and are predicted not
+    // taken. Taken ones get a 2 bit counter.
+    auto       it        = predictor_.find(pc_);
+    const bool predicted = it != predictor_.end() && it->second >= 2;
+    if(predicted != taken)
+        penalty_ = cycles::kMispredict;
+    if(taken)
+    {
+        if(it == predictor_.end())
+            predictor_[pc_] = 2;
+        else if(it->second < 3)
+            it->second++;
+        next_pc_ = target;
+    }
+    else if(it != predictor_.end() && it->second > 0)
+        it->second--;
+}
+
+bool CortexM7::BranchIndirect(uint32_t target)
+{
+    // BXWritePC(), the M profile only runs Thumb code
+    if(!(target & 1))
+    {
+        Fault("branch to ARM state");
+        return false;
+    }
+    next_pc_ = target & ~1u;
+    penalty_ = cycles::kIndirect;
+    return true;
+}
+
+// 16 bit instructions
+
+bool CortexM7::Execute16(uint16_t hw)
+{
+    const bool setflags = !InITBlock();
+    bool       c = false, v = false;
+    uint32_t   result;
+
+    if((hw >> 14) == 0)
+    {
+        // Shift (immediate), add, subtract, move, and compare
+        const uint32_t op = Bits(hw, 13, 9);
+        const int      d = hw & 7, n = Bits(hw, 5, 3), m = Bits(hw, 8, 6);
+        if(op < 12)
+        {
+            int      type;
+            uint32_t amount;
+            DecodeImmShift(op >> 2, Bits(hw, 10, 6), &type, &amount);
+            result = Shift(R(n), type, amount, c_, &c);
+            W(d, result);
+            if(setflags)
+            {
+                SetNZ(result);
+                c_ = c;
+            }
+            return true;
+        }
+        if(op < 16)
+        {
+            const uint32_t operand = op & 2 ? m : R(m);
+            if(op & 1)
+                result = AddWithCarry(R(n), ~operand, true, &c, &v);
+            else
+                result = AddWithCarry(R(n), operand, false, &c, &v);
+            W(d, result);
+            if(setflags)
+                SetNZCV(result, c, v);
+            return true;
+        }
+        const int      dn   = Bits(hw, 10, 8);
+        const uint32_t imm8 = hw & 0xff;
+        switch(op >> 2)
+        {
+            case 4:
+                W(dn, imm8);
+                if(setflags)
+                    SetNZ(imm8);
+                return true;
+            case 5:
+                result = AddWithCarry(R(dn), ~imm8, true, &c, &v);
+                SetNZCV(result, c, v);
+                return true;
+            case 6: result = AddWithCarry(R(dn), imm8, false, &c, &v); break;
+            default: result = AddWithCarry(R(dn), ~imm8, true, &c, &v); break;
+        }
+        W(dn, result);
+        if(setflags)
+            SetNZCV(result, c, v);
+        return true;
+    }
+
+    if((hw >> 10) == 0x10)
+    {
+        // Data processing
+        const uint32_t op = Bits(hw, 9, 6);
+        const int      dn = hw & 7, m = Bits(hw, 5, 3);
+        bool           write = true, arith = false, shift = false;
+        switch(op)
+        {
+            case 0x0: result = R(dn) & R(m); break;
+            case 0x1: result = R(dn) ^ R(m); break;
+            case 0x2:
+            case 0x3:
+            case 0x4:
+            case 0x7:
+            {
+                static const int types[8] = {0, 0, LSL, LSR, ASR, 0, 0, ROR};
+                result = Shift(R(dn), types[op], R(m) & 0xff, c_, &c);
+                shift  = true;
+                break;
+            }
+            case 0x5:
+                result = AddWithCarry(R(dn), R(m), c_, &c, &v);
+                arith  = true;
+                break;
+            case 0x6:
+                result = AddWithCarry(R(dn), ~R(m), c_, &c, &v);
+                arith  = true;
+                break;
+            case 0x8:
+                result = R(dn) & R(m);
+                write  = false;
+                break;
+            case 0x9:
+                result = AddWithCarry(~R(m), 0, true, &c, &v);
+                arith  = true;
+                break;
+            case 0xa:
+                result = AddWithCarry(R(dn), ~R(m), true, &c, &v);
+                arith  = true;
+                write  = false;
+                break;
+            case 0xb:
+                result = AddWithCarry(R(dn), R(m), false, &c, &v);
+                arith  = true;
+                write  = false;
+                break;
+            case 0xc: result = R(dn) | R(m); break;
+            case 0xd:
+                result = R(dn) * R(m);
+                Latency(cycles::kMul);
+                break;
+            case 0xe: result = R(dn) & ~R(m); break;
+            default: result = ~R(m); break;
+        }
+        if(write)
+            W(dn, result);
+        Latency(cycles::kAlu);
+        if(setflags || !write)
+        {
+            if(arith)
+                SetNZCV(result, c, v);
+            else
+            {
+                SetNZ(result);
+                if(shift)
+                    c_ = c;
+            }
+        }
+        return true;
+    }
+
+    if((hw >> 10) == 0x11)
+    {
+        // Special data instructions and branch and exchange
+        const int m = Bits(hw, 6, 3);
+        const int d = (Bit(hw, 7) << 3) | (hw & 7);
+        switch(Bits(hw, 9, 8))
+        {
+            case 0: W(d, R(d) + R(m)); return true;
+            case 1:
+                result = AddWithCarry(R(d), ~R(m), true, &c, &v);
+                SetNZCV(result, c, v);
+                return true;
+            case 2: W(d, R(m)); return true;
+            default:
+            {
+                const uint32_t target = R(m);
+                if(Bit(hw, 7))
+                    W(14, (pc_ + 2) | 1);
+                return BranchIndirect(target);
+            }
+        }
+    }
+
+    if((hw >> 11) == 0x09)
+    {
+        // LDR (literal)
+        const uint32_t addr = Align(pc_ + 4, 4) + (hw & 0xff) * 4;
+        return Load(Bits(hw, 10, 8), addr, 4, false);
+    }
+
+    const uint32_t top = hw >> 12;
+    if(top == 0x5)
+    {
+        // Load/store single data item, register offset
+        const int      t = hw & 7, n = Bits(hw, 5, 3), m = Bits(hw, 8, 6);
+        const uint32_t addr = R(n) + R(m);
+        switch(Bits(hw, 11, 9))
+        {
+            case 0: return Write(addr, 4, R(t));
+            case 1: return Write(addr, 2, R(t));
+            case 2: return Write(addr, 1, R(t));
+            case 3: return Load(t, addr, 1, true);
+            case 4: return Load(t, addr, 4, false);
+            case 5: return Load(t, addr, 2, false);
+            case 6: return Load(t, addr, 1, false);
+            default: return Load(t, addr, 2, true);
+        }
+    }
+    if(top >= 0x6 && top <= 0x9)
+    {
+        // Load/store single data item, immediate offset
+        const bool load = Bit(hw, 11);
+        int        t = hw & 7, n = Bits(hw, 5, 3);
+        uint32_t   size, offset;
+        switch(top)
+        {
+            case 0x6:
+                size   = 4;
+                offset = Bits(hw, 10, 6) * 4;
+                break;
+            case 0x7:
+                size   = 1;
+                offset = Bits(hw, 10, 6);
+                break;
+            case 0x8:
+                size   = 2;
+                offset = Bits(hw, 10, 6) * 2;
+                break;
+            default:
+                size   = 4;
+                offset = (hw & 0xff) * 4;
+                t      = Bits(hw, 10, 8);
+                n      = 13;
+                break;
+        }
+        const uint32_t addr = R(n) + offset;
+        return load ? Load(t, addr, size, false) : Write(addr, size, R(t));
+    }
+
+    if((hw >> 11) == 0x14)
+    {
+        // ADR
+        W(Bits(hw, 10, 8), Align(pc_ + 4, 4) + (hw & 0xff) * 4);
+        return true;
+    }
+    if((hw >> 11) == 0x15)
+    {
+        // ADD (SP plus immediate)
+        W(Bits(hw, 10, 8), R(13) + (hw & 0xff) * 4);
+        return true;
+    }
+
+    if(top == 0xb)
+    {
+        // Miscellaneous 16 bit instructions
+        if((hw & 0x0f00) == 0x0000)
+        {
+            const uint32_t imm = (hw & 0x7f) * 4;
+            W(13, Bit(hw, 7) ? R(13) - imm : R(13) + imm);
+            return true;
+        }
+        if((hw & 0x0500) == 0x0100)
+        {
+            // CBZ, CBNZ
+            const uint32_t offset = (Bit(hw, 9) << 6) | (Bits(hw, 7, 3) << 1);
+            const bool     zero   = R(hw & 7) == 0;
+            BranchCond(zero != Bit(hw, 11), pc_ + 4 + offset);
+            return true;
+        }
+        if((hw & 0x0f00) == 0x0200)
+        {
+            const uint32_t value = R(Bits(hw, 5, 3));
+            switch(Bits(hw, 7, 6))
+            {
+                case 0: result = uint32_t(int16_t(value)); break;
+                case 1: result = uint32_t(int8_t(value)); break;
+                case 2: result = value & 0xffff; break;
+                default: result = value & 0xff; break;
+            }
+            W(hw & 7, result);
+            return true;
+        }
+        if((hw & 0x0e00) == 0x0400)
+            return BlockTransfer(
+                13, (hw & 0xff) | (Bit(hw, 8) << 14), false, true, true);
+        if((hw & 0x0e00) == 0x0c00)
+            return BlockTransfer(
+                13, (hw & 0xff) | (Bit(hw, 8) << 15), true, true, false);
+        if((hw & 0x0f00) == 0x0a00)
+        {
+            const uint32_t value = R(Bits(hw, 5, 3));
+            switch(Bits(hw, 7, 6))
+            {
+                case 0: result = ByteSwap(value); break;
+                case 1: result = Ror(ByteSwap(value), 16); break;
+                case 3:
+                    result = uint32_t(int16_t(ByteSwap(value) >> 16));
+                    break;
+                default: return Unsupported(hw);
+            }
+            W(hw & 7, result);
+            return true;
+        }
+        if((hw & 0x0f00) == 0x0f00)
+        {
+            if(hw & 0xf)
+            {
+                // IT, folded into the instructions it makes conditional
+                itstate_ = hw & 0xff;
+                Issue(0);
+            }
+            return true;
+        }
+        if((hw & 0x0fe8) == 0x0660)
+            return true; // CPS
+        return Unsupported(hw);
+    }
+
+    if((hw >> 11) == 0x18 || (hw >> 11) == 0x19)
+    {
+        // STM, LDM
+        const int      n    = Bits(hw, 10, 8);
+        const uint32_t list = hw & 0xff;
+        const bool     load = Bit(hw, 11);
+        return BlockTransfer(n, list, load, !load || !(list & (1 << n)), false);
+    }
+
+    if(top == 0xd)
+    {
+        // Conditional branch, and supervisor call
+        const int cond = Bits(hw, 11, 8);
+        if(cond >= 0xe)
+            return Unsupported(hw);
+        UseFlags();
+        BranchCond(ConditionPassed(cond),
+                   pc_ + 4 + SignExtend((hw & 0xff) << 1, 9));
+        return true;
+    }
+
+    if((hw >> 11) == 0x1c)
+    {
+        Branch(pc_ + 4 + SignExtend((hw & 0x7ff) << 1, 12));
+        return true;
+    }
+    return Unsupported(hw);
+}
+
+bool CortexM7::BlockTransfer(int      n,
+                             uint32_t list,
+                             bool     load,
+                             bool     wback,
+                             bool     decrement)
+{
+    const uint32_t count = PopCount(list);
+    if(count == 0)
+        return Unsupported(list);
+    const uint32_t base  = R(n);
+    const uint32_t start = decrement ? base - 4 * count : base;
+    if(start & 3)
+    {
+        Fault("unaligned LDM or STM");
+        return false;
+    }
+    Issue((count + cycles::kWordsPerCycle - 1) / cycles::kWordsPerCycle);
+
+    uint32_t values[16];
+    uint32_t addr = start;
+    for(int i = 0; i < 16; i++)
+    {
+        if(!(list & (1 << i)))
+            continue;
+        if(load ? !Read(addr, 4, &values[i]) : !Write(addr, 4, R(i)))
+            return false;
+        addr += 4;
+    }
+    if(wback && !(load && (list & (1 << n))))
+        W(n, decrement ? start : base + 4 * count);
+    if(!load)
+        return true;
+    Latency(cycles::kLoad);
+    for(int i = 0; i < 15; i++)
+        if(list & (1 << i))
+            W(i, values[i]);
+    Latency(cycles::kAlu);
+    return (list & (1 << 15)) ? LoadWritePC(values[15]) : true;
+}
+
+// 32 bit instructions
+
+bool CortexM7::Execute32(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op1 = Bits(hw1, 12, 11);
+    const uint32_t op2 = Bits(hw1, 10, 4);
+    if(op1 == 1)
+    {
+        if((op2 & 0x64) == 0x00)
+            return LoadStoreMultiple(hw1, hw2);
+        if((op2 & 0x64) == 0x04)
+            return LoadStoreDual(hw1, hw2);
+        if((op2 & 0x60) == 0x20)
+            return DataProcessingShifted(hw1, hw2);
+        return Coprocessor(hw1, hw2);
+    }
+    if(op1 == 2)
+    {
+        if(Bit(hw2, 15))
+            return BranchesAndMisc(hw1, hw2);
+        if(op2 & 0x20)
+            return DataProcessingPlain(hw1, hw2);
+        return DataProcessingModified(hw1, hw2);
+    }
+    if((op2 & 0x71) == 0x00 || (op2 & 0x61) == 0x01)
+        return LoadStoreSingle(hw1, hw2);
+    if((op2 & 0x70) == 0x20)
+        return DataProcessingRegister(hw1, hw2);
+    if((op2 & 0x78) == 0x30)
+        return Multiply(hw1, hw2);
+    if((op2 & 0x78) == 0x38)
+        return MultiplyLong(hw1, hw2);
+    if(op2 & 0x40)
+        return Coprocessor(hw1, hw2);
+    return Unsupported(uint32_t(hw1) << 16 | hw2);
+}
+
+bool CortexM7::LoadStoreMultiple(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op = Bits(hw1, 8, 7);
+    if(op != 1 && op != 2)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    return BlockTransfer(hw1 & 0xf, hw2, Bit(hw1, 4), Bit(hw1, 5), op == 2);
+}
+
+bool CortexM7::LoadStoreDual(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op1 = Bits(hw1, 8, 7), op2 = Bits(hw1, 5, 4);
+    const int      n = hw1 & 0xf, t = hw2 >> 12, t2 = Bits(hw2, 11, 8);
+
+    if(op1 == 0 && op2 < 2)
+    {
+        // STREX, LDREX. There's only one core, the store always succeeds.
+        const uint32_t addr = R(n) + (hw2 & 0xff) * 4;
+        if(op2 == 1)
+            return Load(t, addr, 4, false);
+        if(!Write(addr, 4, R(t)))
+            return false;
+        W(t2, 0);
+        return true;
+    }
+    if(op1 == 1 && op2 < 2)
+    {
+        const uint32_t op3 = Bits(hw2, 7, 4);
+        const int      m   = hw2 & 0xf;
+        if(op2 == 1 && op3 < 2)
+        {
+            // TBB, TBH
+            uint32_t offset;
+            const uint32_t addr = op3 ? R(n) + 2 * R(m) : R(n) + R(m);
+            if(!Read(addr, op3 ? 2 : 1, &offset))
+                return false;
+            Issue(cycles::kLoad);
+            next_pc_ = pc_ + 4 + 2 * offset;
+            penalty_ = cycles::kIndirect;
+            return true;
+        }
+        if(op3 == 4 || op3 == 5)
+        {
+            const uint32_t size = op3 == 4 ? 1 : 2;
+            if(op2 == 1)
+                return Load(t, R(n), size, false);
+            if(!Write(R(n), size, R(t)))
+                return false;
+            W(m, 0);
+            return true;
+        }
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    }
+
+    // LDRD, STRD
+    const bool     p = Bit(hw1, 8), u = Bit(hw1, 7), w = Bit(hw1, 5);
+    const uint32_t imm    = (hw2 & 0xff) * 4;
+    const uint32_t base   = n == 15 ? Align(pc_ + 4, 4) : R(n);
+    const uint32_t offset = u ? base + imm : base - imm;
+    const uint32_t addr   = p ? offset : base;
+    if(addr & 3)
+    {
+        Fault("unaligned LDRD or STRD");
+        return false;
+    }
+    if(Bit(hw1, 4))
+    {
+        uint32_t lo, hi;
+        if(!Read(addr, 4, &lo) || !Read(addr + 4, 4, &hi))
+            return false;
+        if(w)
+            W(n, offset);
+        Latency(cycles::kLoad);
+        W(t, lo);
+        W(t2, hi);
+        Latency(cycles::kAlu);
+        return true;
+    }
+    if(!Write(addr, 4, R(t)) || !Write(addr + 4, 4, R(t2)))
+        return false;
+    if(w)
+        W(n, offset);
+    return true;
+}
+
+bool CortexM7::DataProcessingShifted(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op = Bits(hw1, 8, 5);
+    const int      n = hw1 & 0xf, d = Bits(hw2, 11, 8), m = hw2 & 0xf;
+    const uint32_t imm5 = (Bits(hw2, 14, 12) << 2) | Bits(hw2, 7, 6);
+    int            type;
+    uint32_t       amount;
+    bool           carry;
+    DecodeImmShift(Bits(hw2, 5, 4), imm5, &type, &amount);
+    const uint32_t operand = Shift(R(m), type, amount, c_, &carry);
+
+    if(op == 0x6)
+    {
+        // PKHBT, PKHTB
+        const uint32_t rn = R(n);
+        W(d,
+          Bit(hw2, 5) ? (rn & 0xffff0000) | (operand & 0xffff)
+                      : (operand & 0xffff0000) | (rn & 0xffff));
+        return true;
+    }
+    if(!DataProcessing(op, Bit(hw1, 4), d, n, operand, carry))
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    return true;
+}
+
+bool CortexM7::DataProcessingModified(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t imm12
+        = (Bit(hw1, 10) << 11) | (Bits(hw2, 14, 12) << 8) | (hw2 & 0xff);
+    bool           carry;
+    const uint32_t imm = ExpandImm(imm12, &carry);
+    if(!DataProcessing(Bits(hw1, 8, 5),
+                       Bit(hw1, 4),
+                       Bits(hw2, 11, 8),
+                       hw1 & 0xf,
+                       imm,
+                       carry))
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    return true;
+}
+
+bool CortexM7::DataProcessingPlain(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op = Bits(hw1, 8, 4);
+    const int      n = hw1 & 0xf, d = Bits(hw2, 11, 8);
+    const uint32_t imm12
+        = (Bit(hw1, 10) << 11) | (Bits(hw2, 14, 12) << 8) | (hw2 & 0xff);
+    const uint32_t imm16 = ((hw1 & 0xf) << 12) | imm12;
+    const uint32_t lsb   = (Bits(hw2, 14, 12) << 2) | Bits(hw2, 7, 6);
+    const uint32_t field = hw2 & 0x1f;
+    bool           saturated;
+
+    switch(op)
+    {
+        case 0x00:
+            W(d, n == 15 ? Align(pc_ + 4, 4) + imm12 : R(n) + imm12);
+            return true;
+        case 0x0a:
+            W(d, n == 15 ? Align(pc_ + 4, 4) - imm12 : R(n) - imm12);
+            return true;
+        case 0x04: W(d, imm16); return true;
+        case 0x0c: W(d, (R(d) & 0xffff) | (imm16 << 16)); return true;
+        case 0x10:
+        case 0x12:
+        case 0x18:
+        case 0x1a:
+        {
+            const bool sign = op < 0x18;
+            const uint32_t bits = sign ? field + 1 : field;
+            const uint32_t value = R(n);
+            if(Bit(hw1, 5) && lsb == 0)
+            {
+                // SSAT16, USAT16
+                bool     sat_lo, sat_hi;
+                uint32_t lo, hi;
+                if(sign)
+                {
+                    lo = uint32_t(Saturate(Half(value, false), bits, &sat_lo));
+                    hi = uint32_t(Saturate(Half(value, true), bits, &sat_hi));
+                }
+                else
+                {
+                    lo = UnsignedSaturate(Half(value, false), bits, &sat_lo);
+                    hi = UnsignedSaturate(Half(value, true), bits, &sat_hi);
+                }
+                W(d, (lo & 0xffff) | (hi << 16));
+                q_ = q_ || sat_lo || sat_hi;
+                return true;
+            }
+            bool    c;
+            int64_t operand
+                = int32_t(Shift(value, Bit(hw1, 5) ? ASR : LSL, lsb, c_, &c));
+            W(d,
+              sign ? uint32_t(Saturate(operand, bits, &saturated))
+                   : UnsignedSaturate(operand, bits, &saturated));
+            q_ = q_ || saturated;
+            return true;
+        }
+        case 0x14:
+        case 0x1c:
+        {
+            const uint32_t width = field + 1;
+            if(lsb + width > 32)
+                return Unsupported(uint32_t(hw1) << 16 | hw2);
+            const uint32_t value = R(n) >> lsb;
+            W(d,
+              op == 0x14 ? uint32_t(SignExtend(value, width))
+                         : value & Mask(width));
+            return true;
+        }
+        case 0x16:
+        {
+            if(field < lsb)
+                return Unsupported(uint32_t(hw1) << 16 | hw2);
+            const uint32_t mask = Mask(field - lsb + 1) << lsb;
+            const uint32_t src  = n == 15 ? 0 : R(n) << lsb;
+            W(d, (R(d) & ~mask) | (src & mask));
+            return true;
+        }
+        default: return Unsupported(uint32_t(hw1) << 16 | hw2);
+    }
+}
+
+bool CortexM7::BranchesAndMisc(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op = Bits(hw1, 10, 4), op1 = Bits(hw2, 14, 12);
+    const uint32_t s = Bit(hw1, 10), j1 = Bit(hw2, 13), j2 = Bit(hw2, 11);
+
+    if((op1 & 5) == 0)
+    {
+        if((op & 0x38) != 0x38)
+        {
+            // B<c>.W
+            const uint32_t imm = (s << 20) | (j2 << 19) | (j1 << 18)
+                                 | ((hw1 & 0x3f) << 12) | ((hw2 & 0x7ff) << 1);
+            UseFlags();
+            BranchCond(ConditionPassed(Bits(hw1, 9, 6)),
+                       pc_ + 4 + SignExtend(imm, 21));
+            return true;
+        }
+        const uint32_t sysm = hw2 & 0xff;
+        switch(op)
+        {
+            case 0x38:
+            case 0x39:
+            {
+                // MSR, only the APSR is kept, writes to the rest are ignored
+                const uint32_t value = R(hw1 & 0xf);
+                if(sysm < 4)
+                {
+                    if(Bit(hw2, 11))
+                    {
+                        n_ = Bit(value, 31);
+                        z_ = Bit(value, 30);
+                        c_ = Bit(value, 29);
+                        v_ = Bit(value, 28);
+                        q_ = Bit(value, 27);
+                        FlagsWritten();
+                    }
+                    if(Bit(hw2, 10))
+                        ge_ = Bits(value, 19, 16);
+                }
+                return true;
+            }
+            case 0x3a:
+            case 0x3b: return true; // hints, barriers
+            case 0x3e:
+            case 0x3f:
+            {
+                uint32_t value = 0;
+                if(sysm < 4)
+                {
+                    UseFlags();
+                    value = (uint32_t(n_) << 31) | (uint32_t(z_) << 30)
+                            | (uint32_t(c_) << 29) | (uint32_t(v_) << 28)
+                            | (uint32_t(q_) << 27) | (ge_ << 16);
+                }
+                else if(sysm == 8 || sysm == 9)
+                    value = R(13);
+                W(Bits(hw2, 11, 8), value);
+                return true;
+            }
+            default: return Unsupported(uint32_t(hw1) << 16 | hw2);
+        }
+    }
+    if(op1 & 1)
+    {
+        // B.W, BL
+        const uint32_t i1  = !(j1 ^ s), i2 = !(j2 ^ s);
+        const uint32_t imm = (s << 24) | (i1 << 23) | (i2 << 22)
+                             | ((hw1 & 0x3ff) << 12) | ((hw2 & 0x7ff) << 1);
+        if(op1 & 4)
+            W(14, (pc_ + 4) | 1);
+        Branch(pc_ + 4 + SignExtend(imm, 25));
+        return true;
+    }
+    return Unsupported(uint32_t(hw1) << 16 | hw2);
+}
+
+bool CortexM7::LoadStoreSingle(uint16_t hw1, uint16_t hw2)
+{
+    const bool     load = Bit(hw1, 4), sign = Bit(hw1, 8);
+    const uint32_t size_bits = Bits(hw1, 6, 5);
+    const int      n = hw1 & 0xf, t = hw2 >> 12;
+    if(size_bits == 3 || (!load && sign))
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    const uint32_t size = 1 << size_bits;
+
+    uint32_t addr, offset = 0;
+    bool     wback = false;
+    if(load && n == 15)
+    {
+        const uint32_t imm  = hw2 & 0xfff;
+        const uint32_t base = Align(pc_ + 4, 4);
+        addr                = Bit(hw1, 7) ? base + imm : base - imm;
+    }
+    else if(Bit(hw1, 7))
+        addr = R(n) + (hw2 & 0xfff);
+    else if(Bit(hw2, 11))
+    {
+        const bool     p = Bit(hw2, 10), u = Bit(hw2, 9);
+        const uint32_t imm = hw2 & 0xff, base = R(n);
+        if(!p && !Bit(hw2, 8))
+            return Unsupported(uint32_t(hw1) << 16 | hw2);
+        offset = u ? base + imm : base - imm;
+        addr   = p ? offset : base;
+        wback  = Bit(hw2, 8);
+    }
+    else if(Bits(hw2, 11, 6) == 0)
+        addr = R(n) + (R(hw2 & 0xf) << Bits(hw2, 5, 4));
+    else
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+
+    if(!load)
+    {
+        if(!Write(addr, size, R(t)))
+            return false;
+        if(wback)
+            W(n, offset);
+        return true;
+    }
+    if(t == 15 && size < 4)
+        return true; // PLD, PLI
+    if(wback)
+        W(n, offset);
+    return Load(t, addr, size, sign);
+}
+
+bool CortexM7::DataProcessingRegister(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op1 = Bits(hw1, 7, 4), op2 = Bits(hw2, 7, 4);
+    const int      n = hw1 & 0xf, d = Bits(hw2, 11, 8), m = hw2 & 0xf;
+    if((hw2 & 0xf000) != 0xf000)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+
+    if(!(op1 & 8) && op2 == 0)
+    {
+        // LSL, LSR, ASR, ROR (register)
+        bool           carry;
+        const uint32_t result
+            = Shift(R(n), Bits(hw1, 6, 5), R(m) & 0xff, c_, &carry);
+        W(d, result);
+        if(Bit(hw1, 4))
+        {
+            SetNZ(result);
+            c_ = carry;
+        }
+        return true;
+    }
+    if(!(op1 & 8) && (op2 & 8))
+    {
+        // Sign and zero extension, with or without an add
+        const uint32_t value = Ror(R(m), Bits(hw2, 5, 4) * 8);
+        const uint32_t add   = n == 15 ? 0 : R(n);
+        uint32_t       result;
+        switch(op1 & 7)
+        {
+            case 0: result = add + uint32_t(int16_t(value)); break;
+            case 1: result = add + (value & 0xffff); break;
+            case 2:
+            case 3:
+            {
+                uint32_t lo = value & 0xff, hi = (value >> 16) & 0xff;
+                if(op1 == 2)
+                {
+                    lo = uint32_t(int8_t(lo));
+                    hi = uint32_t(int8_t(hi));
+                }
+                result = ((add + lo) & 0xffff) | ((add >> 16) + hi) << 16;
+                break;
+            }
+            case 4: result = add + uint32_t(int8_t(value)); break;
+            case 5: result = add + (value & 0xff); break;
+            default: return Unsupported(uint32_t(hw1) << 16 | hw2);
+        }
+        W(d, result);
+        return true;
+    }
+    if((op1 & 8) && (op2 & 8) == 0)
+        return ParallelAddSub(hw1, hw2);
+    if((op1 & 0xc) == 8 && (op2 & 0xc) == 8)
+    {
+        const uint32_t rm = R(m);
+        uint32_t       result;
+        bool           sat1 = false, sat2 = false;
+        switch(((op1 & 3) << 2) | (op2 & 3))
+        {
+            case 0x0:
+                result = Saturate(
+                    int64_t(int32_t(rm)) + int32_t(R(n)), 32, &sat1);
+                break;
+            case 0x1:
+            {
+                int64_t twice = Saturate(2 * int64_t(int32_t(R(n))), 32, &sat2);
+                result        = Saturate(int32_t(rm) + twice, 32, &sat1);
+                break;
+            }
+            case 0x2:
+                result = Saturate(
+                    int64_t(int32_t(rm)) - int32_t(R(n)), 32, &sat1);
+                break;
+            case 0x3:
+            {
+                int64_t twice = Saturate(2 * int64_t(int32_t(R(n))), 32, &sat2);
+                result        = Saturate(int32_t(rm) - twice, 32, &sat1);
+                break;
+            }
+            case 0x4: result = ByteSwap(rm); break;
+            case 0x5: result = Ror(ByteSwap(rm), 16); break;
+            case 0x6: result = BitReverse(rm); break;
+            case 0x7: result = uint32_t(int16_t(ByteSwap(rm) >> 16)); break;
+            case 0x8:
+            {
+                const uint32_t rn = R(n);
+                result            = 0;
+                for(int i = 0; i < 4; i++)
+                    result |= ((ge_ >> i) & 1 ? rn : rm) & (0xffu << (8 * i));
+                break;
+            }
+            case 0xc: result = CountLeadingZeros(rm); break;
+            default: return Unsupported(uint32_t(hw1) << 16 | hw2);
+        }
+        q_ = q_ || sat1 || sat2;
+        W(d, result);
+        return true;
+    }
+    return Unsupported(uint32_t(hw1) << 16 | hw2);
+}
+
+bool CortexM7::ParallelAddSub(uint16_t hw1, uint16_t hw2)
+{
+    // SADD16, UQSUB8, SHASX, ...: op picks the lanes and the operation, the
+    // prefix picks signed or unsigned, and plain, saturating or halving
+    const uint32_t op = Bits(hw1, 6, 4), prefix = Bits(hw2, 5, 4);
+    const bool     is_unsigned = Bit(hw2, 6);
+    if(prefix == 3 || op == 3 || op == 7)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    const bool     bytes = !(op & 1) && op != 2 && op != 6;
+    const int      lanes = bytes ? 4 : 2;
+    const uint32_t width = bytes ? 8 : 16;
+    const uint32_t rn = R(hw1 & 0xf), rm = R(hw2 & 0xf);
+
+    uint32_t result = 0, ge = 0;
+    for(int i = 0; i < lanes; i++)
+    {
+        // ASX and SAX exchange the halves of rm, and subtract in one lane
+        int      mi  = (op == 2 || op == 6) ? 1 - i : i;
+        bool     sub = op == 4 || op == 5 || (op == 2 && i == 0)
+                   || (op == 6 && i == 1);
+        uint32_t a = (rn >> (width * i)) & Mask(width);
+        uint32_t b = (rm >> (width * mi)) & Mask(width);
+        int64_t  x = is_unsigned ? a : SignExtend(a, width);
+        int64_t  y = is_unsigned ? b : SignExtend(b, width);
+        int64_t  r = sub ? x - y : x + y;
+        bool     sat;
+        if(prefix == 1)
+            r = is_unsigned ? UnsignedSaturate(r, width, &sat)
+                            : Saturate(r, width, &sat);
+        else if(prefix == 2)
+            r >>= 1;
+        else if(is_unsigned ? (sub ? r >= 0 : r >= (int64_t(1) << width))
+                            : r >= 0)
+            ge |= (bytes ? 1u : 3u) << (i * (bytes ? 1 : 2));
+        result |= (uint32_t(r) & Mask(width)) << (width * i);
+    }
+    if(prefix == 0)
+        ge_ = ge;
+    W(Bits(hw2, 11, 8), result);
+    return true;
+}
+
+bool CortexM7::Multiply(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op1 = Bits(hw1, 6, 4), op2 = Bits(hw2, 5, 4);
+    const int      a = hw2 >> 12, d = Bits(hw2, 11, 8);
+    const uint32_t rn = R(hw1 & 0xf), rm = R(hw2 & 0xf);
+    const int64_t  acc = a == 15 ? 0 : int32_t(R(a));
+    uint32_t       result;
+    bool           sat = false;
+    Latency(cycles::kMul);
+    switch(op1)
+    {
+        case 0:
+            if(op2 > 1)
+                return Unsupported(uint32_t(hw1) << 16 | hw2);
+            result = op2 ? uint32_t(acc) - rn * rm : uint32_t(acc) + rn * rm;
+            break;
+        case 1:
+        {
+            int64_t product
+                = int64_t(Half(rn, Bit(hw2, 5))) * Half(rm, Bit(hw2, 4));
+            result = uint32_t(product + acc);
+            sat             = product + acc != int32_t(result);
+            break;
+        }
+        case 2:
+        case 4:
+        {
+            const uint32_t m2 = Bit(hw2, 4) ? Ror(rm, 16) : rm;
+            int64_t        p1 = int64_t(Half(rn, false)) * Half(m2, false);
+            int64_t        p2 = int64_t(Half(rn, true)) * Half(m2, true);
+            int64_t        r  = (op1 == 2 ? p1 + p2 : p1 - p2) + acc;
+            result            = uint32_t(r);
+            sat               = r != int32_t(result);
+            break;
+        }
+        case 3:
+        {
+            int64_t r
+                = ((int64_t(int32_t(rn)) * Half(rm, Bit(hw2, 4))) >> 16) + acc;
+            result = uint32_t(r);
+            sat       = r != int32_t(result);
+            break;
+        }
+        case 5:
+        case 6:
+        {
+            int64_t product = int64_t(int32_t(rn)) * int32_t(rm);
+            int64_t r       = op1 == 5 ? (acc << 32) + product
+                                       : (acc << 32) - product;
+            if(Bit(hw2, 4))
+                r += 0x80000000;
+            result = uint32_t(uint64_t(r) >> 32);
+            break;
+        }
+        default:
+        {
+            result = uint32_t(acc);
+            for(int i = 0; i < 32; i += 8)
+            {
+                int32_t diff
+                    = int32_t((rn >> i) & 0xff) - int32_t((rm >> i) & 0xff);
+                result += diff < 0 ? -diff : diff;
+            }
+            break;
+        }
+    }
+    q_ = q_ || sat;
+    W(d, result);
+    return true;
+}
+
+bool CortexM7::MultiplyLong(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t op1 = Bits(hw1, 6, 4), op2 = Bits(hw2, 7, 4);
+    const int      lo = hw2 >> 12, hi = Bits(hw2, 11, 8);
+    const uint32_t rn = R(hw1 & 0xf), rm = R(hw2 & 0xf);
+
+    if((op1 == 1 || op1 == 3) && op2 == 0xf)
+    {
+        // SDIV, UDIV. Division by 0 gives 0, as with DIV_0_TRP clear.
+        uint32_t result;
+        if(rm == 0)
+            result = 0;
+        else if(op1 == 1)
+            result = (rn == 0x80000000 && rm == 0xffffffff)
+                         ? rn
+                         : uint32_t(int32_t(rn) / int32_t(rm));
+        else
+            result = rn / rm;
+        uint32_t magnitude = op1 == 1 && int32_t(result) < 0 ? -result : result;
+        uint32_t cost
+            = cycles::kDivBase + (32 - CountLeadingZeros(magnitude) + 3) / 4;
+        Issue(cost < cycles::kDivMax ? cost : cycles::kDivMax);
+        W(hi, result);
+        return true;
+    }
+
+    const uint64_t acc = uint64_t(R(lo)) | uint64_t(R(hi)) << 32;
+    uint64_t       result;
+    if(op1 == 0 && op2 == 0)
+        result = uint64_t(int64_t(int32_t(rn)) * int32_t(rm));
+    else if(op1 == 2 && op2 == 0)
+        result = uint64_t(rn) * rm;
+    else if(op1 == 4 && op2 == 0)
+        result = acc + uint64_t(int64_t(int32_t(rn)) * int32_t(rm));
+    else if(op1 == 4 && (op2 & 0xc) == 8)
+        result = acc
+                 + uint64_t(int64_t(Half(rn, Bit(hw2, 5)))
+                            * Half(rm, Bit(hw2, 4)));
+    else if((op1 == 4 || op1 == 5) && (op2 & 0xe) == 0xc)
+    {
+        const uint32_t m2 = Bit(hw2, 4) ? Ror(rm, 16) : rm;
+        int64_t        p1 = int64_t(Half(rn, false)) * Half(m2, false);
+        int64_t        p2 = int64_t(Half(rn, true)) * Half(m2, true);
+        result            = acc + uint64_t(op1 == 4 ? p1 + p2 : p1 - p2);
+    }
+    else if(op1 == 6 && op2 == 0)
+        result = acc + uint64_t(rn) * rm;
+    else if(op1 == 6 && op2 == 6)
+        result = uint64_t(rn) * rm + R(lo) + R(hi);
+    else
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+
+    Latency(cycles::kMulLong);
+    W(lo, uint32_t(result));
+    W(hi, uint32_t(result >> 32));
+    return true;
+}
+
+} // namespace cyclesim
@@ -0,0 +1,222 @@
+#pragma once
+#ifndef DSY_CYCLESIM_CORTEXM7_H
+#define DSY_CYCLESIM_CORTEXM7_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclesim
+{
+/** Instruction level model of a Cortex-M7 with the double precision FPU,
+ ** as on the Daisy. Runs ARMv7E-M Thumb-2 code with FPv5, counts the
+ ** instructions, and estimates the cycles with the costs from CycleTable.h.
+ **
+ ** Only thread mode code is run: no exceptions, system registers or
+ ** peripherals. Functions that aren't in the loaded code, like memcpy or
+ ** expf, run on the host, see AddHostFunction().
+ */
+class CortexM7
+{
+  public:
+    /** A function run on the host, with its arguments in the registers
+     ** as on the target. It sets the return value with SetReg() or
+     ** SetSReg(), and its cost with AddCycles().
+     */
+    typedef void (*HostFunction)(CortexM7 &cpu);
+
+    /** Counts since the last ResetStats() */
+    struct Stats
+    {
+        uint64_t instructions;
+        uint64_t cycles;
+    };
+
+    /** Calls return to this address */
+    static constexpr uint32_t kReturnAddress = 0xFFFFFFFE;
+    /** Host functions are called through addresses from here on */
+    static constexpr uint32_t kHostBase = 0x08F00000;
+
+    CortexM7();
+
+    /** Adds zeroed memory
+     ** \return false if it overlaps memory that was added before
+     */
+    bool Map(uint32_t base, uint32_t size);
+
+    /** \return pointer to size bytes of memory at addr, nullptr if they
+     ** aren't all mapped */
+    uint8_t *Pointer(uint32_t addr, uint32_t size);
+
+    /** Makes a host function callable
+     ** \return its address, with the Thumb bit set
+     */
+    uint32_t AddHostFunction(HostFunction fn);
+
+    /** Calls the function at addr with up to four arguments, and runs
+     ** until it returns
+     ** \param max_instructions limit, against endless loops
+     ** \return false on a fault, see Error()
+     */
+    bool Call(uint32_t                     addr,
+              const std::vector<uint32_t> &args             = {},
+              uint64_t                     max_instructions = 100000000);
+
+    uint32_t Reg(int n) const { return r_[n]; }
+    void     SetReg(int n, uint32_t value) { r_[n] = value; }
+
+    float    SReg(int n) const;
+    void     SetSReg(int n, float value);
+    double   DReg(int n) const;
+    void     SetDReg(int n, double value);
+    uint32_t SRegBits(int n) const { return s_[n]; }
+
+    /** Adds to the cycle count, for host functions */
+    void AddCycles(uint32_t cycles) { now_ += cycles; }
+
+    /** Stops the running call with an error */
+    void Fault(const std::string &error);
+
+    const Stats &GetStats() const { return stats_; }
+
+    /** Sets the counts to 0, but keeps the state of the branch predictor */
+    void ResetStats();
+
+    /** \return what went wrong after Call() returned false */
+    const std::string &Error() const { return error_; }
+
+  private:
+    struct Region
+    {
+        uint32_t             base;
+        std::vector<uint8_t> data;
+    };
+
+    // Scoreboard slots: r0-r15, s0-s31, the APSR and the FPSCR flags
+    enum
+    {
+        kSlotS       = 16,
+        kSlotFlags   = 48,
+        kSlotFpFlags = 49,
+        kNumSlots    = 50,
+        kMaxDsts     = 40,
+    };
+
+    bool Step();
+    bool Execute16(uint16_t hw);
+    bool Execute32(uint16_t hw1, uint16_t hw2);
+
+    // Integer groups of 32 bit instructions
+    bool LoadStoreMultiple(uint16_t hw1, uint16_t hw2);
+    bool LoadStoreDual(uint16_t hw1, uint16_t hw2);
+    bool DataProcessingShifted(uint16_t hw1, uint16_t hw2);
+    bool DataProcessingModified(uint16_t hw1, uint16_t hw2);
+    bool DataProcessingPlain(uint16_t hw1, uint16_t hw2);
+    bool BranchesAndMisc(uint16_t hw1, uint16_t hw2);
+    bool LoadStoreSingle(uint16_t hw1, uint16_t hw2);
+    bool DataProcessingRegister(uint16_t hw1, uint16_t hw2);
+    bool ParallelAddSub(uint16_t hw1, uint16_t hw2);
+    bool Multiply(uint16_t hw1, uint16_t hw2);
+    bool MultiplyLong(uint16_t hw1, uint16_t hw2);
+
+    // Floating-point, in CortexM7Fpu.cpp
+    bool Coprocessor(uint16_t hw1, uint16_t hw2);
+    bool FpDataProcessing(uint16_t hw1, uint16_t hw2);
+    bool FpV8(uint16_t hw1, uint16_t hw2);
+    bool FpLoadStore(uint16_t hw1, uint16_t hw2);
+    bool FpTransfer(uint16_t hw1, uint16_t hw2);
+
+    // Operands, with the scoreboard
+    uint32_t R(int n);
+    void     W(int n, uint32_t value);
+    uint32_t S(int n);
+    void     WS(int n, uint32_t bits);
+    uint64_t D(int n);
+    void     WD(int n, uint64_t bits);
+    void     UseFlags();
+    void     FlagsWritten();
+    void     SetNZ(uint32_t result);
+    void     SetNZCV(uint32_t result, bool carry, bool overflow);
+
+    // Arithmetic helpers
+    uint32_t AddWithCarry(uint32_t x,
+                          uint32_t y,
+                          bool     carry_in,
+                          bool *   carry_out,
+                          bool *   overflow);
+    uint32_t Shift(uint32_t value,
+                   int      type,
+                   uint32_t amount,
+                   bool     carry_in,
+                   bool *   carry_out);
+    uint32_t ExpandImm(uint32_t imm12, bool *carry_out);
+    bool     DataProcessing(int      op,
+                            bool     setflags,
+                            int      d,
+                            int      n,
+                            uint32_t operand,
+                            bool     carry);
+
+    // Memory
+    bool Read(uint32_t addr, uint32_t size, uint32_t *value);
+    bool Write(uint32_t addr, uint32_t size, uint32_t value);
+    bool Load(int t, uint32_t addr, uint32_t size, bool sign);
+    bool BlockTransfer(int      n,
+                       uint32_t list,
+                       bool     load,
+                       bool     wback,
+                       bool     decrement);
+
+    // Control flow
+    bool ConditionPassed(int cond) const;
+    bool InITBlock() const { return (itstate_ & 0xf) != 0; }
+    void ITAdvance();
+    void Branch(uint32_t target);
+    void BranchCond(bool taken, uint32_t target);
+    bool BranchIndirect(uint32_t target);
+    bool LoadWritePC(uint32_t value) { return BranchIndirect(value); }
+
+    // Timing of the instruction being run
+    void Issue(uint32_t cycles) { issue_cycles_ = cycles; }
+    void Latency(uint32_t cycles) { latency_ = cycles; }
+
+    bool Unsupported(uint32_t encoding);
+
+    std::vector<Region>       regions_;
+    std::vector<HostFunction> host_functions_;
+
+    // Architectural state
+    uint32_t r_[16];
+    uint32_t s_[32];
+    bool     n_, z_, c_, v_, q_;
+    uint32_t ge_;
+    uint32_t fpscr_;
+    uint32_t itstate_;
+    uint32_t pc_;       // address of the instruction being run
+    uint32_t next_pc_;  // address of the next one
+    bool     running_;
+
+    // Timing
+    uint64_t now_;
+    uint64_t cycles_base_;
+    uint64_t issue_;
+    uint64_t ready_[kNumSlots];
+    uint32_t issue_cycles_;
+    uint32_t latency_;
+    int      dsts_[kMaxDsts];
+    uint32_t dst_latency_[kMaxDsts];
+    int      num_dsts_;
+    uint32_t penalty_;
+
+    // Branch target cache with 2 bit counters, by branch address
+    std::unordered_map<uint32_t, uint8_t> predictor_;
+
+    Stats       stats_;
+    std::string error_;
+};
+
+} // namespace cyclesim
+
+#endif
@@ -0,0 +1,584 @@
+#include "CortexM7.h"
+#include "CycleTable.h"
+#include "Bits.h"
+#include <cmath>
+
+// The floating-point extension, FPv5 with double precision and 16 double
+// registers, as on the Cortex-M7 of the Daisy
+namespace cyclesim
+{
+namespace
+{
+// Rounding modes: the FPSCR ones, and ties away from zero
+enum Rounding
+{
+    kNearest,
+    kPlusInf,
+    kMinusInf,
+    kZero,
+    kTiesAway,
+};
+
+// From the RM field of VRINTA/N/P/M and VCVTA/N/P/M
+const int kRm[4] = {kTiesAway, kNearest, kPlusInf, kMinusInf};
+
+template <typename T>
+T RoundToIntegral(T x, int mode)
+{
+    switch(mode)
+    {
+        case kNearest: return std::nearbyint(x);
+        case kPlusInf: return std::ceil(x);
+        case kMinusInf: return std::floor(x);
+        case kZero: return std::trunc(x);
+        default: return std::round(x);
+    }
+}
+
+// Saturating conversion to a 32 bit integer, FPToFixed() with no fraction
+uint32_t ToInteger(double x, bool is_signed, int mode)
+{
+    if(std::isnan(x))
+        return 0;
+    const double r = RoundToIntegral(x, mode);
+    if(is_signed)
+    {
+        if(r >= 2147483648.0)
+            return 0x7fffffff;
+        if(r < -2147483648.0)
+            return 0x80000000;
+        return uint32_t(int32_t(r));
+    }
+    if(r >= 4294967296.0)
+        return 0xffffffff;
+    return r < 0 ? 0 : uint32_t(r);
+}
+
+template <typename T>
+uint32_t CompareFlags(T a, T b)
+{
+    if(std::isnan(a) || std::isnan(b))
+        return 0x3;
+    if(a == b)
+        return 0x6;
+    return a < b ? 0x8 : 0x2;
+}
+
+// VMLA, VMUL, VADD, VDIV, VFMA and friends, by opc1 and op
+template <typename T>
+bool Arithmetic(uint32_t opc1, bool op, T n, T m, T d, T *result)
+{
+    switch(opc1)
+    {
+        case 0:
+        {
+            const T product = n * m;
+            *result         = op ? d - product : d + product;
+            return true;
+        }
+        case 1:
+        {
+            const T product = n * m;
+            *result         = op ? -d - product : -d + product;
+            return true;
+        }
+        case 2: *result = op ? -(n * m) : n * m; return true;
+        case 3: *result = op ? n - m : n + m; return true;
+        case 4:
+            *result = n / m;
+            return !op;
+        case 5: *result = std::fma(op ? -n : n, m, -d); return true;
+        case 6: *result = std::fma(op ? -n : n, m, d); return true;
+        default: return false;
+    }
+}
+
+float HalfToFloat(uint32_t h)
+{
+    const float    sign = h & 0x8000 ? -1.f : 1.f;
+    const uint32_t exp = (h >> 10) & 0x1f, frac = h & 0x3ff;
+    if(exp == 0)
+        return sign * std::ldexp(float(frac), -24);
+    if(exp == 31)
+        return frac ? BitsToFloat(0x7fc00000 | (frac << 13))
+                    : sign * INFINITY;
+    return sign * std::ldexp(float(frac | 0x400), int(exp) - 25);
+}
+
+uint32_t FloatToHalf(float f)
+{
+    const uint32_t x    = FloatToBits(f);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const float    a    = std::fabs(f);
+    if(std::isnan(f))
+        return sign | 0x7e00 | ((x >> 13) & 0x1ff);
+    if(a >= 65520.f)
+        return sign | 0x7c00;
+    if(a < 6.103515625e-05f)
+        return sign | uint32_t(std::nearbyint(a * 16777216.f));
+    uint32_t exp = ((x >> 23) & 0xff) - 127 + 15;
+    uint32_t m = (x >> 13) & 0x3ff, rem = x & 0x1fff;
+    if(rem > 0x1000 || (rem == 0x1000 && (m & 1)))
+        m++;
+    if(m == 0x400)
+    {
+        m = 0;
+        exp++;
+    }
+    return exp >= 31 ? sign | 0x7c00 : sign | (exp << 10) | m;
+}
+
+} // namespace
+
+bool CortexM7::Coprocessor(uint16_t hw1, uint16_t hw2)
+{
+    if((Bits(hw2, 11, 8) & 0xe) != 0xa)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    if(Bit(hw1, 12))
+    {
+        if((hw1 >> 8) == 0xfe && !Bit(hw2, 4))
+            return FpV8(hw1, hw2);
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    }
+    const uint32_t op1 = Bits(hw1, 9, 4);
+    if((op1 & 0x3e) == 0x04 || ((op1 & 0x20) == 0 && (op1 & 0x3a) != 0))
+        return FpLoadStore(hw1, hw2);
+    if((op1 & 0x30) == 0x20)
+        return Bit(hw2, 4) ? FpTransfer(hw1, hw2) : FpDataProcessing(hw1, hw2);
+    return Unsupported(uint32_t(hw1) << 16 | hw2);
+}
+
+bool CortexM7::FpLoadStore(uint16_t hw1, uint16_t hw2)
+{
+    const bool     dbl = Bit(hw2, 8), load = Bit(hw1, 4);
+    const int      n = hw1 & 0xf, vd = hw2 >> 12;
+    const uint32_t imm8 = hw2 & 0xff;
+
+    if((Bits(hw1, 9, 4) & 0x3e) == 0x04)
+    {
+        // VMOV between two core registers and a double or two singles
+        const int t = vd, t2 = hw1 & 0xf;
+        const int m = dbl ? (Bit(hw2, 5) << 4) | (hw2 & 0xf)
+                          : ((hw2 & 0xf) << 1) | Bit(hw2, 5);
+        if(Bits(hw2, 7, 6) != 0 || !Bit(hw2, 4) || (dbl && m >= 16)
+           || (!dbl && m == 31))
+            return Unsupported(uint32_t(hw1) << 16 | hw2);
+        if(load)
+        {
+            Latency(cycles::kFpuToCore);
+            W(t, S(dbl ? 2 * m : m));
+            W(t2, S(dbl ? 2 * m + 1 : m + 1));
+        }
+        else
+        {
+            Latency(cycles::kFpuMove);
+            WS(dbl ? 2 * m : m, R(t));
+            WS(dbl ? 2 * m + 1 : m + 1, R(t2));
+        }
+        return true;
+    }
+
+    const bool p = Bit(hw1, 8), u = Bit(hw1, 7), w = Bit(hw1, 5);
+    const int  d = dbl ? (Bit(hw1, 6) << 4) | vd : (vd << 1) | Bit(hw1, 6);
+    // The first single register of the transfer
+    const int first = dbl ? 2 * d : d;
+
+    uint32_t addr, words;
+    if(p && !w)
+    {
+        // VLDR, VSTR
+        const uint32_t base = n == 15 ? Align(pc_ + 4, 4) : R(n);
+        addr  = u ? base + imm8 * 4 : base - imm8 * 4;
+        words = dbl ? 2 : 1;
+    }
+    else if(p == u)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    else
+    {
+        // VLDM, VSTM, VPUSH, VPOP
+        const uint32_t base = R(n);
+        words               = dbl ? imm8 & ~1u : imm8;
+        addr                = u ? base : base - imm8 * 4;
+        Issue((words + cycles::kWordsPerCycle - 1) / cycles::kWordsPerCycle);
+        if(w)
+            W(n, u ? base + imm8 * 4 : base - imm8 * 4);
+    }
+    if(words == 0 || first + words > 32)
+        return Unsupported(uint32_t(hw1) << 16 | hw2);
+    if(addr & 3)
+    {
+        Fault("unaligned VLDR, VSTR, VLDM or VSTM");
+        return false;
+    }
+    Latency(cycles::kLoad);
+    for(uint32_t i = 0; i < words; i++, addr += 4)
+    {
+        uint32_t value;
+        if(!load)
+        {
+            if(!Write(addr, 4, S(first + i)))
+                return false;
+        }
+        else if(!Read(addr, 4, &value))
+            return false;
+        else
+            WS(first + i, value);
+    }
+    return true;
+}
+
+bool CortexM7::FpTransfer(uint16_t hw1, uint16_t hw2)
+{
+    const bool     load = Bit(hw1, 4), c = Bit(hw2, 8);
+    const uint32_t a = Bits(hw1, 7, 5);
+    const int      t = hw2 >> 12;
+
+    if(!c && a == 0)
+    {
+        // VMOV between a core register and a single
+        const int n = ((hw1 & 0xf) << 1) | Bit(hw2, 7);
+        if(load)
+        {
+            Latency(cycles::kFpuToCore);
+            W(t, S(n));
+        }
+        else
+        {
+            Latency(cycles::kFpuMove);
+            WS(n, R(t));
+        }
+        return true;
+    }
+    if(!c && a == 7)
+    {
+        // VMRS, VMSR. Only the FPSCR is kept.
+        const bool fpscr = (hw1 & 0xf) == 1;
+        if(!load)
+        {
+            if(fpscr)
+                fpscr_ = R(t);
+            return true;
+        }
+        if(fpscr && ready_[kSlotFpFlags] > issue_)
+            issue_ = ready_[kSlotFpFlags];
+        const uint32_t value = fpscr ? fpscr_ : 0;
+        if(t != 15)
+        {
+            W(t, value);
+            return true;
+        }
+        n_ = Bit(value, 31);
+        z_ = Bit(value, 30);
+        c_ = Bit(value, 29);
+        v_ = Bit(value, 28);
+        FlagsWritten();
+        return true;
+    }
+    if(c && Bits(hw1, 6, 6) == 0 && Bits(hw2, 6, 5) == 0 && !Bit(hw1, 7))
+    {
+        // VMOV between a core register and half of a double
+        const int d = (Bit(hw2, 7) << 4) | (hw1 & 0xf);
+        if(d >= 16)
+            return Unsupported(uint32_t(hw1) << 16 | hw2);
+        const int s = 2 * d + Bit(hw1, 5);
+        if(load)
+        {
+            Latency(cycles::kFpuToCore);
+            W(t, S(s));
+        }
+        else
+        {
+            Latency(cycles::kFpuMove);
+            WS(s, R(t));
+        }
+        return true;
+    }
+    return Unsupported(uint32_t(hw1) << 16 | hw2);
+}
+
+bool CortexM7::FpDataProcessing(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t opc1 = (Bit(hw1, 7) << 2) | Bits(hw1, 5, 4);
+    const uint32_t opc2 = hw1 & 0xf, opc3 = Bits(hw2, 7, 6);
+    const bool     dbl = Bit(hw2, 8), op = Bit(hw2, 6);
+    const uint32_t vd = hw2 >> 12, vn = hw1 & 0xf, vm = hw2 & 0xf;
+    const uint32_t dd = Bit(hw1, 6), nn = Bit(hw2, 7), mm = Bit(hw2, 5);
+    // Single and double register numbers of the operands
+    const int sd = (vd << 1) | dd, sn = (vn << 1) | nn, sm = (vm << 1) | mm;
+    const int d = (dd << 4) | vd, n = (nn << 4) | vn, m = (mm << 4) | vm;
+    const uint32_t encoding = uint32_t(hw1) << 16 | hw2;
+
+    if(opc1 != 7)
+    {
+        if(opc1 == 0 || opc1 == 1)
+            Latency(cycles::kFpuChained);
+        else if(opc1 == 4)
+            Latency(dbl ? cycles::kFpuDivF64 : cycles::kFpuDivF32);
+        else
+            Latency(cycles::kFpu);
+        if(dbl && opc1 != 3 && opc1 != 4)
+        {
+            // The double multiplier takes another pass
+            Latency(latency_ + cycles::kFpuMulF64);
+            Issue(1 + cycles::kFpuMulF64);
+        }
+        if(dbl)
+        {
+            double r, x = BitsToDouble(D(n)), y = BitsToDouble(D(m));
+            double acc = opc1 < 2 || opc1 > 4 ? BitsToDouble(D(d)) : 0;
+            if(!Arithmetic(opc1, op, x, y, acc, &r))
+                return Unsupported(encoding);
+            WD(d, DoubleToBits(r));
+        }
+        else
+        {
+            float r, x = BitsToFloat(S(sn)), y = BitsToFloat(S(sm));
+            float acc = opc1 < 2 || opc1 > 4 ? BitsToFloat(S(sd)) : 0;
+            if(!Arithmetic(opc1, op, x, y, acc, &r))
+                return Unsupported(encoding);
+            WS(sd, FloatToBits(r));
+        }
+        return true;
+    }
+
+    if(!(opc3 & 1))
+    {
+        // VMOV (immediate)
+        const uint32_t imm8 = (opc2 << 4) | vm;
+        const uint32_t b6 = Bit(imm8, 6), frac = imm8 & 0xf;
+        const uint64_t sign = Bit(imm8, 7);
+        Latency(cycles::kFpuMove);
+        if(dbl)
+        {
+            const uint64_t exp = ((b6 ^ 1) << 10) | (b6 ? 0x3fc : 0)
+                                 | Bits(imm8, 5, 4);
+            WD(d, sign << 63 | exp << 52 | uint64_t(frac) << 48);
+        }
+        else
+        {
+            const uint32_t exp = ((b6 ^ 1) << 7) | (b6 ? 0x7c : 0)
+                                 | Bits(imm8, 5, 4);
+            WS(sd, uint32_t(sign) << 31 | exp << 23 | frac << 19);
+        }
+        return true;
+    }
+
+    const int rmode = Bits(fpscr_, 23, 22);
+    switch(opc2)
+    {
+        case 0x0:
+        case 0x1:
+        case 0x6:
+        case 0x7:
+            if(opc2 == 0x7 && opc3 == 3)
+            {
+                // VCVT between double and single
+                Latency(cycles::kFpu);
+                if(dbl)
+                    WS(sd, FloatToBits(float(BitsToDouble(D(m)))));
+                else
+                    WD(d, DoubleToBits(double(BitsToFloat(S(sm)))));
+                break;
+            }
+            // VMOV, VABS, VNEG, VSQRT, VRINTR, VRINTZ, VRINTX
+            if(opc2 == 1 && opc3 == 3)
+                Latency(dbl ? cycles::kFpuDivF64 : cycles::kFpuDivF32);
+            else
+                Latency(opc2 < 2 ? cycles::kFpuMove : cycles::kFpu);
+            if(dbl)
+            {
+                double x = BitsToDouble(D(m)), r;
+                switch((opc2 << 1) | (opc3 >> 1))
+                {
+                    case 0: r = x; break;
+                    case 1: r = std::fabs(x); break;
+                    case 2: r = -x; break;
+                    case 3: r = std::sqrt(x); break;
+                    case 12:
+                    case 14: r = RoundToIntegral(x, rmode); break;
+                    case 13: r = RoundToIntegral(x, kZero); break;
+                    default: return Unsupported(encoding);
+                }
+                WD(d, DoubleToBits(r));
+            }
+            else
+            {
+                float x = BitsToFloat(S(sm)), r;
+                switch((opc2 << 1) | (opc3 >> 1))
+                {
+                    case 0: r = x; break;
+                    case 1: r = std::fabs(x); break;
+                    case 2: r = -x; break;
+                    case 3: r = std::sqrt(x); break;
+                    case 12:
+                    case 14: r = RoundToIntegral(x, rmode); break;
+                    case 13: r = RoundToIntegral(x, kZero); break;
+                    default: return Unsupported(encoding);
+                }
+                WS(sd, FloatToBits(r));
+            }
+            break;
+        case 0x2:
+        case 0x3:
+        {
+            // VCVTB, VCVTT between half and single precision
+            if(dbl)
+                return Unsupported(encoding);
+            const int shift = opc3 & 2 ? 16 : 0;
+            Latency(cycles::kFpu);
+            if(opc2 == 0x2)
+                WS(sd, FloatToBits(HalfToFloat((S(sm) >> shift) & 0xffff)));
+            else
+            {
+                const uint32_t h = FloatToHalf(BitsToFloat(S(sm)));
+                WS(sd, (S(sd) & ~(0xffffu << shift)) | (h << shift));
+            }
+            break;
+        }
+        case 0x4:
+        case 0x5:
+        {
+            // VCMP, VCMPE
+            uint32_t flags;
+            if(dbl)
+                flags = CompareFlags(BitsToDouble(D(d)),
+                                     opc2 == 5 ? 0.0 : BitsToDouble(D(m)));
+            else
+                flags = CompareFlags(BitsToFloat(S(sd)),
+                                     opc2 == 5 ? 0.f : BitsToFloat(S(sm)));
+            fpscr_                    = (fpscr_ & 0x0fffffff) | flags << 28;
+            dsts_[num_dsts_]          = kSlotFpFlags;
+            dst_latency_[num_dsts_++] = cycles::kFpuMove;
+            break;
+        }
+        case 0x8:
+        {
+            // VCVT from integer
+            const uint32_t x = S(sm);
+            Latency(cycles::kFpu);
+            if(dbl)
+                WD(d, DoubleToBits(nn ? double(int32_t(x)) : double(x)));
+            else
+                WS(sd, FloatToBits(nn ? float(int32_t(x)) : float(x)));
+            break;
+        }
+        case 0xa:
+        case 0xb:
+        case 0xe:
+        case 0xf:
+        {
+            // VCVT between floating-point and fixed-point, in place
+            const bool     to_fixed = Bit(opc2, 2), is_unsigned = Bit(opc2, 0);
+            const uint32_t size = nn ? 32 : 16;
+            const uint32_t imm  = (vm << 1) | mm;
+            if(imm > size)
+                return Unsupported(encoding);
+            const int frac = int(size - imm);
+            Latency(cycles::kFpu);
+            if(to_fixed)
+            {
+                double x = dbl ? BitsToDouble(D(d)) : BitsToFloat(S(sd));
+                x        = std::trunc(std::ldexp(x, frac));
+                int64_t max = is_unsigned ? (int64_t(1) << size) - 1
+                                          : (int64_t(1) << (size - 1)) - 1;
+                int64_t min = is_unsigned ? 0 : -(int64_t(1) << (size - 1));
+                int64_t r   = std::isnan(x) ? 0
+                              : x > double(max) ? max
+                              : x < double(min) ? min
+                                                : int64_t(x);
+                if(dbl)
+                    WD(d, uint64_t(r));
+                else
+                    WS(sd, uint32_t(r));
+            }
+            else
+            {
+                uint64_t bits = dbl ? D(d) : S(sd);
+                int64_t  x;
+                if(size == 16)
+                    x = is_unsigned ? int64_t(bits & 0xffff)
+                                    : int64_t(int16_t(bits));
+                else
+                    x = is_unsigned ? int64_t(uint32_t(bits))
+                                    : int64_t(int32_t(bits));
+                if(dbl)
+                    WD(d, DoubleToBits(std::ldexp(double(x), -frac)));
+                else
+                    WS(sd, FloatToBits(std::ldexp(float(x), -frac)));
+            }
+            break;
+        }
+        case 0xc:
+        case 0xd:
+        {
+            // VCVT, VCVTR to integer
+            const double x = dbl ? BitsToDouble(D(m)) : BitsToFloat(S(sm));
+            Latency(cycles::kFpu);
+            WS(sd, ToInteger(x, opc2 == 0xd, nn ? int(kZero) : rmode));
+            break;
+        }
+        default: return Unsupported(encoding);
+    }
+    return true;
+}
+
+bool CortexM7::FpV8(uint16_t hw1, uint16_t hw2)
+{
+    const bool     dbl = Bit(hw2, 8);
+    const uint32_t vd = hw2 >> 12, vn = hw1 & 0xf, vm = hw2 & 0xf;
+    const uint32_t dd = Bit(hw1, 6), nn = Bit(hw2, 7), mm = Bit(hw2, 5);
+    const int sd = (vd << 1) | dd, sn = (vn << 1) | nn, sm = (vm << 1) | mm;
+    const int d = (dd << 4) | vd, n = (nn << 4) | vn, m = (mm << 4) | vm;
+    const uint32_t encoding = uint32_t(hw1) << 16 | hw2;
+
+    if(!Bit(hw1, 7))
+    {
+        // VSEL, on the APSR flags
+        static const int conds[4] = {0x0, 0x6, 0xa, 0xc};
+        UseFlags();
+        const bool pass = ConditionPassed(conds[Bits(hw1, 5, 4)]);
+        Latency(cycles::kFpuMove);
+        if(dbl)
+            WD(d, pass ? D(n) : D(m));
+        else
+            WS(sd, pass ? S(sn) : S(sm));
+    }
+    else if(Bits(hw1, 5, 4) == 0)
+    {
+        // VMAXNM, VMINNM
+        const bool min = Bit(hw2, 6);
+        Latency(cycles::kFpu);
+        if(dbl)
+        {
+            double x = BitsToDouble(D(n)), y = BitsToDouble(D(m));
+            WD(d, DoubleToBits(min ? std::fmin(x, y) : std::fmax(x, y)));
+        }
+        else
+        {
+            float x = BitsToFloat(S(sn)), y = BitsToFloat(S(sm));
+            WS(sd, FloatToBits(min ? std::fmin(x, y) : std::fmax(x, y)));
+        }
+    }
+    else if(Bits(hw1, 5, 2) == 0xe && Bits(hw2, 7, 6) == 1)
+    {
+        // VRINTA, VRINTN, VRINTP, VRINTM
+        const int mode = kRm[hw1 & 3];
+        Latency(cycles::kFpu);
+        if(dbl)
+            WD(d, DoubleToBits(RoundToIntegral(BitsToDouble(D(m)), mode)));
+        else
+            WS(sd, FloatToBits(RoundToIntegral(BitsToFloat(S(sm)), mode)));
+    }
+    else if(Bits(hw1, 5, 2) == 0xf && Bit(hw2, 6))
+    {
+        // VCVTA, VCVTN, VCVTP, VCVTM to integer
+        const double x = dbl ? BitsToDouble(D(m)) : BitsToFloat(S(sm));
+        Latency(cycles::kFpu);
+        WS(sd, ToInteger(x, nn, kRm[hw1 & 3]));
+    }
+    else
+        return Unsupported(encoding);
+    return true;
+}
+
+} // namespace cyclesim
@@ -0,0 +1,75 @@
+#pragma once
+#ifndef DSY_CYCLESIM_CYCLETABLE_H
+#define DSY_CYCLESIM_CYCLETABLE_H
+
+#include <stdint.h>
+
+namespace cyclesim
+{
+/** Cycle costs used by the Cortex-M7 model.
+ **
+ ** The model issues one instruction per cycle, in order. An instruction
+ ** waits until the registers it reads are ready, and its results are ready
+ ** a latency after it issued. Most instructions issue in one cycle, the
+ ** rest have an issue cost here as well.
+ **
+ ** The numbers follow the Cortex-M7 pipeline as far as it is documented,
+ ** the rest are estimates. Not modelled: dual issue (so pairs of simple
+ ** instructions count twice), caches and wait states (all memory acts like
+ ** TCM) and interrupts. Counts are for comparing one build of the code with
+ ** the next, they aren't DWT cycles from the hardware.
+ */
+namespace cycles
+{
+/** Result latency of most integer instructions */
+constexpr uint32_t kAlu = 1;
+/** Result latency of loads (LDR, LDRB, LDRD, ...) */
+constexpr uint32_t kLoad = 2;
+/** Result latency of MUL, MLA and the DSP multiplies */
+constexpr uint32_t kMul = 2;
+/** Result latency of the 64 bit multiplies (SMULL, UMLAL, ...) */
+constexpr uint32_t kMulLong = 2;
+/** SDIV and UDIV stall for kDivBase + 1 cycle for each 4 bits of quotient,
+ ** at most kDivMax */
+constexpr uint32_t kDivBase = 2;
+constexpr uint32_t kDivMax  = 12;
+
+/** LDM, STM, PUSH, POP, VLDM and VSTM move two words per cycle */
+constexpr uint32_t kWordsPerCycle = 2;
+
+/** Penalty of a branch the predictor got wrong */
+constexpr uint32_t kMispredict = 5;
+/** Penalty of a branch to a register or loaded address (BX, BLX, POP
+ ** {pc}, TBB, ...), which isn't predicted */
+constexpr uint32_t kIndirect = 4;
+
+/** Result latency of VADD, VSUB, VMUL, VFMA and the conversions */
+constexpr uint32_t kFpu = 3;
+/** Result latency of VMLA and VMLS, a multiply followed by an add */
+constexpr uint32_t kFpuChained = 6;
+/** Result latency of VMOV, VNEG, VABS, VSEL and other moves */
+constexpr uint32_t kFpuMove = 1;
+/** Result latency of a move from an FP register to a core register */
+constexpr uint32_t kFpuToCore = 2;
+/** Latency of VDIV and VSQRT */
+constexpr uint32_t kFpuDivF32 = 14;
+constexpr uint32_t kFpuDivF64 = 29;
+/** Extra result latency and issue cycle of double precision VMUL */
+constexpr uint32_t kFpuMulF64 = 1;
+
+/** Cost of calls into the C library, which runs on the host. memcpy and
+ ** friends cost kMemBase plus one cycle per kMemBytesPerCycle bytes. */
+constexpr uint32_t kMemBase          = 10;
+constexpr uint32_t kMemBytesPerCycle = 4;
+/** 64 bit division from the run-time library, __aeabi_ldivmod and
+ ** __aeabi_uldivmod */
+constexpr uint32_t kLongDiv = 40;
+/** Single precision functions from <math.h>: expf, logf, sinf, ... */
+constexpr uint32_t kLibmF32 = 60;
+/** Double precision functions from <math.h> */
+constexpr uint32_t kLibmF64 = 150;
+
+} // namespace cycles
+} // namespace cyclesim
+
+#endif
@@ -0,0 +1,468 @@
+#include "ElfImage.h"
+#include "HostLibrary.h"
+#include "Bits.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace cyclesim
+{
+constexpr uint32_t ElfImage::kFlashBase;
+constexpr uint32_t ElfImage::kFlashSize;
+constexpr uint32_t ElfImage::kRamBase;
+constexpr uint32_t ElfImage::kRamSize;
+constexpr uint32_t ElfImage::kStackSize;
+
+namespace
+{
+// From the ELF and the ELF for the ARM Architecture specifications
+enum
+{
+    SHT_PROGBITS   = 1,
+    SHT_SYMTAB     = 2,
+    SHT_RELA       = 4,
+    SHT_NOBITS     = 8,
+    SHT_REL        = 9,
+    SHT_INIT_ARRAY = 14,
+    SHT_GROUP      = 17,
+    SHT_ARM_EXIDX  = 0x70000001,
+
+    SHF_WRITE = 1,
+    SHF_ALLOC = 2,
+
+    GRP_COMDAT = 1,
+
+    STB_LOCAL  = 0,
+    STB_GLOBAL = 1,
+    STB_WEAK   = 2,
+
+    SHN_UNDEF  = 0,
+    SHN_ABS    = 0xfff1,
+    SHN_COMMON = 0xfff2,
+
+    R_ARM_NONE            = 0,
+    R_ARM_ABS32           = 2,
+    R_ARM_REL32           = 3,
+    R_ARM_THM_CALL        = 10,
+    R_ARM_THM_JUMP24      = 30,
+    R_ARM_TARGET1         = 38,
+    R_ARM_THM_MOVW_ABS_NC = 47,
+    R_ARM_THM_MOVT_ABS    = 48,
+    R_ARM_THM_JUMP19      = 51,
+};
+
+const uint32_t kHeaderSize        = 52;
+const uint32_t kSectionHeaderSize = 40;
+const uint32_t kSymbolSize        = 16;
+
+// Immediates of the Thumb-2 instructions the relocations patch
+int32_t BranchOffset(uint16_t hw1, uint16_t hw2)
+{
+    const uint32_t s = Bit(hw1, 10);
+    const uint32_t i1 = !(Bit(hw2, 13) ^ s), i2 = !(Bit(hw2, 11) ^ s);
+    return SignExtend(s << 24 | i1 << 23 | i2 << 22 | (hw1 & 0x3ff) << 12
+                          | (hw2 & 0x7ff) << 1,
+                      25);
+}
+
+void SetBranchOffset(uint16_t *hw1, uint16_t *hw2, int32_t offset)
+{
+    const uint32_t x = uint32_t(offset), s = Bit(x, 24);
+    const uint32_t j1 = !Bit(x, 23) ^ s, j2 = !Bit(x, 22) ^ s;
+    *hw1 = uint16_t((*hw1 & 0xf800) | s << 10 | Bits(x, 21, 12));
+    *hw2 = uint16_t((*hw2 & 0xd000) | j1 << 13 | j2 << 11 | Bits(x, 11, 1));
+}
+
+int32_t CondBranchOffset(uint16_t hw1, uint16_t hw2)
+{
+    return SignExtend(Bit(hw1, 10) << 20 | Bit(hw2, 11) << 19
+                          | Bit(hw2, 13) << 18 | (hw1 & 0x3f) << 12
+                          | (hw2 & 0x7ff) << 1,
+                      21);
+}
+
+void SetCondBranchOffset(uint16_t *hw1, uint16_t *hw2, int32_t offset)
+{
+    const uint32_t x = uint32_t(offset);
+    *hw1 = uint16_t((*hw1 & 0xfbc0) | Bit(x, 20) << 10 | Bits(x, 17, 12));
+    *hw2 = uint16_t((*hw2 & 0xd000) | Bit(x, 18) << 13 | Bit(x, 19) << 11
+                    | Bits(x, 11, 1));
+}
+
+uint32_t MovImmediate(uint16_t hw1, uint16_t hw2)
+{
+    return (hw1 & 0xf) << 12 | Bit(hw1, 10) << 11 | Bits(hw2, 14, 12) << 8
+           | (hw2 & 0xff);
+}
+
+void SetMovImmediate(uint16_t *hw1, uint16_t *hw2, uint32_t imm16)
+{
+    *hw1 = uint16_t((*hw1 & 0xfbf0) | Bit(imm16, 11) << 10 | imm16 >> 12);
+    *hw2 = uint16_t((*hw2 & 0x8f00) | Bits(imm16, 10, 8) << 12
+                    | (imm16 & 0xff));
+}
+
+} // namespace
+
+uint32_t ElfImage::Word(const Object &obj, uint32_t offset) const
+{
+    uint32_t value;
+    memcpy(&value, obj.data.data() + offset, 4);
+    return value;
+}
+
+const char *ElfImage::String(const Object &obj, uint32_t table, uint32_t offset)
+{
+    if(table >= obj.sections.size())
+        return "";
+    const Section &s = obj.sections[table];
+    if(offset >= s.size)
+        return "";
+    const char *str = reinterpret_cast<const char *>(obj.data.data())
+                      + s.offset + offset;
+    return memchr(str, 0, s.size - offset) ? str : "";
+}
+
+bool ElfImage::Fail(const Object &obj, const std::string &error)
+{
+    error_ = obj.path + ": " + error;
+    return false;
+}
+
+bool ElfImage::AddObject(const char *path)
+{
+    objects_.push_back(Object());
+    Object &obj = objects_.back();
+    obj.path    = path;
+    obj.symtab  = 0;
+
+    FILE *f = fopen(path, "rb");
+    if(!f)
+        return Fail(obj, "can't open it");
+    uint8_t buf[4096];
+    size_t  n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        obj.data.insert(obj.data.end(), buf, buf + n);
+    fclose(f);
+
+    const std::vector<uint8_t> &d = obj.data;
+    if(d.size() < kHeaderSize || memcmp(d.data(), "\x7f" "ELF\x01\x01", 6)
+       || (d[16] | d[17] << 8) != 1 || (d[18] | d[19] << 8) != 40)
+        return Fail(obj, "not a little endian ARM relocatable object");
+    const uint32_t shoff = Word(obj, 32);
+    const uint32_t shentsize = d[46] | d[47] << 8, shnum = d[48] | d[49] << 8;
+    const uint32_t shstrndx = d[50] | d[51] << 8;
+    if(shentsize != kSectionHeaderSize
+       || uint64_t(shoff) + uint64_t(shnum) * kSectionHeaderSize > d.size())
+        return Fail(obj, "bad section headers");
+
+    for(uint32_t i = 0; i < shnum; i++)
+    {
+        const uint32_t h = shoff + i * kSectionHeaderSize;
+        Section        s;
+        s.type   = Word(obj, h + 4);
+        s.flags  = Word(obj, h + 8);
+        s.offset = Word(obj, h + 16);
+        s.size   = Word(obj, h + 20);
+        s.link   = Word(obj, h + 24);
+        s.info   = Word(obj, h + 28);
+        s.align  = Word(obj, h + 32);
+        s.addr   = 0;
+        if(s.type != SHT_NOBITS && uint64_t(s.offset) + s.size > d.size())
+            return Fail(obj, "section outside of the file");
+        if(s.type == SHT_SYMTAB)
+            obj.symtab = i;
+        obj.sections.push_back(s);
+    }
+    if(obj.symtab == 0)
+        return Fail(obj, "no symbol table");
+
+    for(uint32_t i = 0; i < shnum; i++)
+    {
+        Section &      s    = obj.sections[i];
+        const uint32_t name = Word(obj, shoff + i * kSectionHeaderSize);
+        s.name              = String(obj, shstrndx, name);
+        s.load = (s.flags & SHF_ALLOC) && s.type != SHT_ARM_EXIDX
+                 && s.name.compare(0, 10, ".ARM.extab") != 0;
+    }
+
+    // Only the first copy of a COMDAT group, inline functions and template
+    // instances, is kept
+    const Section &symtab = obj.sections[obj.symtab];
+    for(Section &g : obj.sections)
+    {
+        if(g.type != SHT_GROUP || g.size < 4
+           || !(Word(obj, g.offset) & GRP_COMDAT))
+            continue;
+        if(g.info * kSymbolSize >= symtab.size)
+            return Fail(obj, "bad group signature");
+        const char *signature = String(
+            obj, symtab.link, Word(obj, symtab.offset + g.info * kSymbolSize));
+        if(groups_.insert(signature).second)
+            continue;
+        for(uint32_t off = 4; off + 4 <= g.size; off += 4)
+        {
+            const uint32_t member = Word(obj, g.offset + off);
+            if(member < shnum)
+                obj.sections[member].load = false;
+        }
+    }
+    return DefineGlobals(obj);
+}
+
+bool ElfImage::DefineGlobals(Object &obj)
+{
+    const Section &symtab = obj.sections[obj.symtab];
+    for(uint32_t off = kSymbolSize; off + kSymbolSize <= symtab.size;
+        off += kSymbolSize)
+    {
+        const uint32_t sym   = symtab.offset + off;
+        const uint32_t bind  = obj.data[sym + 12] >> 4;
+        const uint32_t shndx = obj.data[sym + 14] | obj.data[sym + 15] << 8;
+        if((bind != STB_GLOBAL && bind != STB_WEAK) || shndx == SHN_UNDEF)
+            continue;
+        if(shndx == SHN_COMMON)
+            return Fail(obj, "common symbols aren't supported");
+        if(shndx != SHN_ABS
+           && (shndx >= obj.sections.size() || !obj.sections[shndx].load))
+            continue;
+
+        const std::string name = String(obj, symtab.link, Word(obj, sym));
+        auto              it   = globals_.find(name);
+        if(it != globals_.end() && !it->second.weak && bind != STB_WEAK)
+            return Fail(obj, "multiple definition of " + name);
+        // Addresses are filled in by Link(), once the sections are placed
+        if(it == globals_.end() || (it->second.weak && bind != STB_WEAK))
+            globals_[name] = {0, bind == STB_WEAK};
+    }
+    return true;
+}
+
+bool ElfImage::Place(Object &obj, Section &s, uint32_t *next, uint32_t end)
+{
+    const uint32_t align = s.align > 1 ? s.align : 1;
+    const uint32_t addr  = (*next + align - 1) & ~(align - 1);
+    if(uint64_t(addr) + s.size > end)
+        return Fail(obj, "out of memory placing " + s.name);
+    s.addr = addr;
+    *next  = addr + s.size;
+    return true;
+}
+
+bool ElfImage::SymbolAddress(Object &obj, uint32_t index, uint32_t *addr)
+{
+    const Section &symtab = obj.sections[obj.symtab];
+    if(uint64_t(index + 1) * kSymbolSize > symtab.size)
+        return Fail(obj, "bad symbol index");
+    const uint32_t    sym   = symtab.offset + index * kSymbolSize;
+    const uint32_t    value = Word(obj, sym + 4);
+    const uint32_t    bind  = obj.data[sym + 12] >> 4;
+    const uint32_t    shndx = obj.data[sym + 14] | obj.data[sym + 15] << 8;
+    const std::string name  = String(obj, symtab.link, Word(obj, sym));
+
+    if(bind == STB_LOCAL)
+    {
+        if(shndx == SHN_ABS)
+            *addr = value;
+        else if(shndx < obj.sections.size() && obj.sections[shndx].load)
+            *addr = obj.sections[shndx].addr + value;
+        else
+            return Fail(obj, "reference to a section that isn't loaded");
+        return true;
+    }
+
+    auto global = globals_.find(name);
+    if(global != globals_.end())
+    {
+        *addr = global->second.addr;
+        return true;
+    }
+    auto host = host_functions_.find(name);
+    if(host != host_functions_.end())
+    {
+        *addr = host->second;
+        return true;
+    }
+    if(CortexM7::HostFunction fn = FindHostFunction(name.c_str()))
+    {
+        *addr = host_functions_[name] = cpu_.AddHostFunction(fn);
+        return true;
+    }
+    if(name == "__dso_handle")
+    {
+        // Only its address is used, to tell shared objects apart
+        if(!dso_handle_)
+        {
+            Section s;
+            s.name  = name;
+            s.size  = 4;
+            s.align = 4;
+            if(!Place(obj, s, &ram_next_, kRamBase + kRamSize - kStackSize))
+                return false;
+            dso_handle_ = s.addr;
+        }
+        *addr = dso_handle_;
+        return true;
+    }
+    if(bind == STB_WEAK)
+    {
+        *addr = 0;
+        return true;
+    }
+    return Fail(obj, "undefined symbol " + name);
+}
+
+bool ElfImage::Relocate(Object &obj, const Section &rel)
+{
+    const Section &target = obj.sections[rel.info];
+    for(uint32_t off = 0; off + 8 <= rel.size; off += 8)
+    {
+        const uint32_t offset = Word(obj, rel.offset + off);
+        const uint32_t info   = Word(obj, rel.offset + off + 4);
+        const uint32_t type = info & 0xff, p = target.addr + offset;
+        uint32_t       s;
+        if(type == R_ARM_NONE)
+            continue;
+        if(uint64_t(offset) + 4 > target.size)
+            return Fail(obj, "relocation outside of " + target.name);
+        if(!SymbolAddress(obj, info >> 8, &s))
+            return false;
+
+        uint8_t *place = cpu_.Pointer(p, 4);
+        uint32_t word;
+        uint16_t hw1, hw2;
+        memcpy(&word, place, 4);
+        memcpy(&hw1, place, 2);
+        memcpy(&hw2, place + 2, 2);
+        switch(type)
+        {
+            case R_ARM_ABS32:
+            case R_ARM_TARGET1: word += s; break;
+            case R_ARM_REL32: word += s - p; break;
+            case R_ARM_THM_CALL:
+            case R_ARM_THM_JUMP24:
+            {
+                if(!(s & 1))
+                    return Fail(obj, "branch to ARM code in " + target.name);
+                const int32_t x
+                    = int32_t((s & ~1u) - p) + BranchOffset(hw1, hw2);
+                if(x < -(1 << 24) || x >= (1 << 24))
+                    return Fail(obj, "branch out of range in " + target.name);
+                SetBranchOffset(&hw1, &hw2, x);
+                break;
+            }
+            case R_ARM_THM_JUMP19:
+            {
+                const int32_t x
+                    = int32_t((s & ~1u) - p) + CondBranchOffset(hw1, hw2);
+                if(x < -(1 << 20) || x >= (1 << 20))
+                    return Fail(obj, "branch out of range in " + target.name);
+                SetCondBranchOffset(&hw1, &hw2, x);
+                break;
+            }
+            case R_ARM_THM_MOVW_ABS_NC:
+            case R_ARM_THM_MOVT_ABS:
+            {
+                const uint32_t x
+                    = s + uint32_t(SignExtend(MovImmediate(hw1, hw2), 16));
+                SetMovImmediate(&hw1,
+                                &hw2,
+                                type == R_ARM_THM_MOVT_ABS ? x >> 16
+                                                           : x & 0xffff);
+                break;
+            }
+            default:
+            {
+                char msg[64];
+                snprintf(msg, sizeof(msg), "relocation type %u in ", type);
+                return Fail(obj, msg + target.name);
+            }
+        }
+        if(type == R_ARM_ABS32 || type == R_ARM_TARGET1 || type == R_ARM_REL32)
+            memcpy(place, &word, 4);
+        else
+        {
+            memcpy(place, &hw1, 2);
+            memcpy(place + 2, &hw2, 2);
+        }
+    }
+    return true;
+}
+
+bool ElfImage::Link()
+{
+    const uint32_t flash_end = kFlashBase + kFlashSize;
+    const uint32_t ram_end   = kRamBase + kRamSize - kStackSize;
+    for(Object &obj : objects_)
+        for(Section &s : obj.sections)
+            if(s.load
+               && !Place(obj,
+                         s,
+                         s.flags & SHF_WRITE ? &ram_next_ : &flash_next_,
+                         s.flags & SHF_WRITE ? ram_end : flash_end))
+                return false;
+
+    if(!cpu_.Map(kFlashBase, kFlashSize) || !cpu_.Map(kRamBase, kRamSize))
+    {
+        error_ = "memory is mapped already";
+        return false;
+    }
+    for(Object &obj : objects_)
+        for(Section &s : obj.sections)
+            if(s.load && s.type != SHT_NOBITS && s.size)
+                memcpy(cpu_.Pointer(s.addr, s.size),
+                       obj.data.data() + s.offset,
+                       s.size);
+
+    // The addresses of the globals, now that the sections are placed
+    for(Object &obj : objects_)
+    {
+        const Section &symtab = obj.sections[obj.symtab];
+        for(uint32_t i = 1; (i + 1) * kSymbolSize <= symtab.size; i++)
+        {
+            const uint32_t sym   = symtab.offset + i * kSymbolSize;
+            const uint32_t bind  = obj.data[sym + 12] >> 4;
+            const uint32_t shndx = obj.data[sym + 14] | obj.data[sym + 15] << 8;
+            if(bind == STB_LOCAL || shndx == SHN_UNDEF)
+                continue;
+            if(shndx != SHN_ABS
+               && (shndx >= obj.sections.size() || !obj.sections[shndx].load))
+                continue;
+            auto it = globals_.find(String(obj, symtab.link, Word(obj, sym)));
+            if(it == globals_.end() || it->second.weak != (bind == STB_WEAK)
+               || it->second.addr)
+                continue;
+            const uint32_t base
+                = shndx == SHN_ABS ? 0 : obj.sections[shndx].addr;
+            it->second.addr = base + Word(obj, sym + 4);
+        }
+    }
+
+    for(Object &obj : objects_)
+        for(const Section &s : obj.sections)
+        {
+            if(s.type == SHT_RELA)
+                return Fail(obj, "RELA relocations aren't supported");
+            if(s.type == SHT_REL && s.info < obj.sections.size()
+               && obj.sections[s.info].load && !Relocate(obj, s))
+                return false;
+        }
+
+    for(Object &obj : objects_)
+        for(const Section &s : obj.sections)
+            if(s.load && s.type == SHT_INIT_ARRAY)
+                for(uint32_t off = 0; off + 4 <= s.size; off += 4)
+                {
+                    uint32_t fn;
+                    memcpy(&fn, cpu_.Pointer(s.addr + off, 4), 4);
+                    init_functions_.push_back(fn);
+                }
+    return true;
+}
+
+uint32_t ElfImage::Symbol(const char *name) const
+{
+    auto it = globals_.find(name);
+    return it == globals_.end() ? 0 : it->second.addr;
+}
+
+} // namespace cyclesim
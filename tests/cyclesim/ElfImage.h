@@ -0,0 +1,98 @@
+#pragma once
+#ifndef DSY_CYCLESIM_ELFIMAGE_H
+#define DSY_CYCLESIM_ELFIMAGE_H
+
+#include "CortexM7.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cyclesim
+{
+/** Links relocatable ARM objects, as built with -ffunction-sections and
+ ** -fdata-sections, into the memory of the model. A small static linker:
+ ** code and read-only data go to flash, the rest to RAM, and the symbols
+ ** that none of the objects define are looked up with FindHostFunction().
+ ** The unwind tables are left out.
+ */
+class ElfImage
+{
+  public:
+    static constexpr uint32_t kFlashBase = 0x08000000;
+    static constexpr uint32_t kFlashSize = 0x100000;
+    /** The DTCM, with the stack at the top */
+    static constexpr uint32_t kRamBase   = 0x20000000;
+    static constexpr uint32_t kRamSize   = 0x20000;
+    static constexpr uint32_t kStackSize = 0x4000;
+
+    explicit ElfImage(CortexM7 &cpu)
+    : cpu_(cpu), flash_next_(kFlashBase), ram_next_(kRamBase), dso_handle_(0)
+    {
+    }
+
+    /** Reads an object file, see Error() when it returns false */
+    bool AddObject(const char *path);
+
+    /** Places the sections, resolves the symbols and applies the
+     ** relocations, then maps the memory and copies the image to it */
+    bool Link();
+
+    /** \return address of a global symbol after Link(), 0 if undefined */
+    uint32_t Symbol(const char *name) const;
+
+    /** \return the constructors of static objects, to call in order */
+    const std::vector<uint32_t> &InitFunctions() const
+    {
+        return init_functions_;
+    }
+
+    uint32_t StackTop() const { return kRamBase + kRamSize; }
+
+    const std::string &Error() const { return error_; }
+
+  private:
+    struct Section
+    {
+        std::string name;
+        uint32_t    type, flags, offset, size, link, info, align;
+        uint32_t    addr;
+        bool        load;
+    };
+
+    struct Object
+    {
+        std::string          path;
+        std::vector<uint8_t> data;
+        std::vector<Section> sections;
+        uint32_t             symtab;
+    };
+
+    struct Global
+    {
+        uint32_t addr;
+        bool     weak;
+    };
+
+    uint32_t    Word(const Object &obj, uint32_t offset) const;
+    const char *String(const Object &obj, uint32_t table, uint32_t offset);
+    bool        Fail(const Object &obj, const std::string &error);
+    bool        Place(Object &obj, Section &s, uint32_t *next, uint32_t end);
+    bool        DefineGlobals(Object &obj);
+    bool        SymbolAddress(Object &obj, uint32_t index, uint32_t *addr);
+    bool        Relocate(Object &obj, const Section &rel);
+
+    CortexM7 &                      cpu_;
+    std::vector<Object>             objects_;
+    std::map<std::string, Global>   globals_;
+    std::map<std::string, uint32_t> host_functions_;
+    std::set<std::string>           groups_;
+    std::vector<uint32_t>           init_functions_;
+    uint32_t                        flash_next_, ram_next_;
+    uint32_t                        dso_handle_;
+    std::string                     error_;
+};
+
+} // namespace cyclesim
+
+#endif
@@ -0,0 +1,222 @@
+#include "HostLibrary.h"
+#include "CycleTable.h"
+#include <math.h>
+#include <string.h>
+
+namespace cyclesim
+{
+namespace
+{
+uint8_t *Bytes(CortexM7 &cpu, uint32_t addr, uint32_t size)
+{
+    uint8_t *p = size ? cpu.Pointer(addr, size) : nullptr;
+    if(size && !p)
+        cpu.Fault("memory function outside of the memory");
+    return p;
+}
+
+void MemCost(CortexM7 &cpu, uint32_t size)
+{
+    cpu.AddCycles(cycles::kMemBase + size / cycles::kMemBytesPerCycle);
+}
+
+// memcpy(dst, src, n) and memmove(dst, src, n), also __aeabi_memcpy and
+// __aeabi_memmove, which take the same arguments
+void Memmove(CortexM7 &cpu)
+{
+    const uint32_t dst = cpu.Reg(0), src = cpu.Reg(1), size = cpu.Reg(2);
+    uint8_t *      to = Bytes(cpu, dst, size), *from = Bytes(cpu, src, size);
+    if(to && from)
+        memmove(to, from, size);
+    MemCost(cpu, size);
+}
+
+// memset(dst, c, n)
+void Memset(CortexM7 &cpu)
+{
+    const uint32_t dst = cpu.Reg(0), size = cpu.Reg(2);
+    uint8_t *      to = Bytes(cpu, dst, size);
+    if(to)
+        memset(to, int(cpu.Reg(1) & 0xff), size);
+    MemCost(cpu, size);
+}
+
+// __aeabi_memset(dst, n, c), with the arguments swapped
+void AeabiMemset(CortexM7 &cpu)
+{
+    const uint32_t dst = cpu.Reg(0), size = cpu.Reg(1);
+    uint8_t *      to = Bytes(cpu, dst, size);
+    if(to)
+        memset(to, int(cpu.Reg(2) & 0xff), size);
+    MemCost(cpu, size);
+}
+
+// __aeabi_memclr(dst, n)
+void AeabiMemclr(CortexM7 &cpu)
+{
+    const uint32_t dst = cpu.Reg(0), size = cpu.Reg(1);
+    uint8_t *      to = Bytes(cpu, dst, size);
+    if(to)
+        memset(to, 0, size);
+    MemCost(cpu, size);
+}
+
+// 64 bit division, __aeabi_ldivmod(n, d) and __aeabi_uldivmod(n, d) in
+// r0:r1 and r2:r3, with the quotient in r0:r1 and the remainder in r2:r3
+void SetLong(CortexM7 &cpu, int n, uint64_t value)
+{
+    cpu.SetReg(n, uint32_t(value));
+    cpu.SetReg(n + 1, uint32_t(value >> 32));
+}
+
+void Ldivmod(CortexM7 &cpu)
+{
+    const int64_t n = int64_t(cpu.Reg(0) | uint64_t(cpu.Reg(1)) << 32);
+    const int64_t d = int64_t(cpu.Reg(2) | uint64_t(cpu.Reg(3)) << 32);
+    const bool    defined = d != 0 && !(d == -1 && n == INT64_MIN);
+    SetLong(cpu, 0, uint64_t(defined ? n / d : 0));
+    SetLong(cpu, 2, uint64_t(defined ? n % d : 0));
+    cpu.AddCycles(cycles::kLongDiv);
+}
+
+void Uldivmod(CortexM7 &cpu)
+{
+    const uint64_t n = cpu.Reg(0) | uint64_t(cpu.Reg(1)) << 32;
+    const uint64_t d = cpu.Reg(2) | uint64_t(cpu.Reg(3)) << 32;
+    SetLong(cpu, 0, d ? n / d : 0);
+    SetLong(cpu, 2, d ? n % d : 0);
+    cpu.AddCycles(cycles::kLongDiv);
+}
+
+// Floating-point arguments and results are in s0, s1 or d0, d1 with the
+// hard float ABI
+template <float (*fn)(float)>
+void UnaryF32(CortexM7 &cpu)
+{
+    cpu.SetSReg(0, fn(cpu.SReg(0)));
+    cpu.AddCycles(cycles::kLibmF32);
+}
+
+template <float (*fn)(float, float)>
+void BinaryF32(CortexM7 &cpu)
+{
+    cpu.SetSReg(0, fn(cpu.SReg(0), cpu.SReg(1)));
+    cpu.AddCycles(cycles::kLibmF32);
+}
+
+template <float (*fn)(float, float, float)>
+void TernaryF32(CortexM7 &cpu)
+{
+    cpu.SetSReg(0, fn(cpu.SReg(0), cpu.SReg(1), cpu.SReg(2)));
+    cpu.AddCycles(cycles::kLibmF32);
+}
+
+template <double (*fn)(double)>
+void UnaryF64(CortexM7 &cpu)
+{
+    cpu.SetDReg(0, fn(cpu.DReg(0)));
+    cpu.AddCycles(cycles::kLibmF64);
+}
+
+template <double (*fn)(double, double)>
+void BinaryF64(CortexM7 &cpu)
+{
+    cpu.SetDReg(0, fn(cpu.DReg(0), cpu.DReg(1)));
+    cpu.AddCycles(cycles::kLibmF64);
+}
+
+template <double (*fn)(double, double, double)>
+void TernaryF64(CortexM7 &cpu)
+{
+    cpu.SetDReg(0, fn(cpu.DReg(0), cpu.DReg(1), cpu.DReg(2)));
+    cpu.AddCycles(cycles::kLibmF64);
+}
+
+// Registers the destructors of static objects, which never run
+void Atexit(CortexM7 &cpu)
+{
+    cpu.SetReg(0, 0);
+}
+
+void NotSupported(CortexM7 &cpu)
+{
+    cpu.Fault("call to a C++ run-time function that isn't supported");
+}
+
+struct Entry
+{
+    const char *           name;
+    CortexM7::HostFunction fn;
+};
+
+const Entry kEntries[] = {
+    {"memcpy", Memmove},
+    {"memmove", Memmove},
+    {"memset", Memset},
+    {"__aeabi_memcpy", Memmove},
+    {"__aeabi_memcpy4", Memmove},
+    {"__aeabi_memcpy8", Memmove},
+    {"__aeabi_memmove", Memmove},
+    {"__aeabi_memmove4", Memmove},
+    {"__aeabi_memmove8", Memmove},
+    {"__aeabi_memset", AeabiMemset},
+    {"__aeabi_memset4", AeabiMemset},
+    {"__aeabi_memset8", AeabiMemset},
+    {"__aeabi_memclr", AeabiMemclr},
+    {"__aeabi_memclr4", AeabiMemclr},
+    {"__aeabi_memclr8", AeabiMemclr},
+
+    {"__aeabi_ldivmod", Ldivmod},
+    {"__aeabi_uldivmod", Uldivmod},
+
+    {"expf", UnaryF32<expf>},
+    {"exp2f", UnaryF32<exp2f>},
+    {"logf", UnaryF32<logf>},
+    {"log2f", UnaryF32<log2f>},
+    {"log10f", UnaryF32<log10f>},
+    {"sinf", UnaryF32<sinf>},
+    {"cosf", UnaryF32<cosf>},
+    {"tanf", UnaryF32<tanf>},
+    {"atanf", UnaryF32<atanf>},
+    {"tanhf", UnaryF32<tanhf>},
+    {"sqrtf", UnaryF32<sqrtf>},
+    {"powf", BinaryF32<powf>},
+    {"fmodf", BinaryF32<fmodf>},
+    {"atan2f", BinaryF32<atan2f>},
+    {"fmaf", TernaryF32<fmaf>},
+
+    {"exp", UnaryF64<exp>},
+    {"exp2", UnaryF64<exp2>},
+    {"log", UnaryF64<log>},
+    {"log2", UnaryF64<log2>},
+    {"log10", UnaryF64<log10>},
+    {"sin", UnaryF64<sin>},
+    {"cos", UnaryF64<cos>},
+    {"tan", UnaryF64<tan>},
+    {"atan", UnaryF64<atan>},
+    {"tanh", UnaryF64<tanh>},
+    {"sqrt", UnaryF64<sqrt>},
+    {"pow", BinaryF64<pow>},
+    {"fmod", BinaryF64<fmod>},
+    {"atan2", BinaryF64<atan2>},
+    {"fma", TernaryF64<fma>},
+
+    {"__aeabi_atexit", Atexit},
+    {"__cxa_atexit", Atexit},
+    {"__cxa_pure_virtual", NotSupported},
+    {"_ZdlPv", NotSupported},
+    {"_ZdlPvj", NotSupported},
+    {"abort", NotSupported},
+};
+
+} // namespace
+
+CortexM7::HostFunction FindHostFunction(const char *name)
+{
+    for(const Entry &e : kEntries)
+        if(strcmp(e.name, name) == 0)
+            return e.fn;
+    return nullptr;
+}
+
+} // namespace cyclesim
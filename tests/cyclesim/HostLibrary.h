@@ -0,0 +1,18 @@
+#pragma once
+#ifndef DSY_CYCLESIM_HOSTLIBRARY_H
+#define DSY_CYCLESIM_HOSTLIBRARY_H
+
+#include "CortexM7.h"
+
+namespace cyclesim
+{
+/** The parts of the C library and the ARM run-time ABI the kernels call,
+ ** run on the host with the costs from CycleTable.h: memcpy and friends,
+ ** the <math.h> functions, and the C++ run-time hooks.
+ ** \return the function for the symbol, nullptr if there is none
+ */
+CortexM7::HostFunction FindHostFunction(const char *name);
+
+} // namespace cyclesim
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef CYCLESIM_MATH_H
+#define CYCLESIM_MATH_H
+
+#define M_PI 3.14159265358979323846
+#define M_PI_2 1.57079632679489661923
+#define M_SQRT2 1.41421356237309504880
+#define M_LN2 0.69314718055994530942
+#define M_LN10 2.30258509299404568402
+#define HUGE_VALF __builtin_huge_valf()
+#define INFINITY __builtin_inff()
+#define NAN __builtin_nanf("")
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    float  fabsf(float x);
+    float  sqrtf(float x);
+    float  floorf(float x);
+    float  ceilf(float x);
+    float  roundf(float x);
+    float  truncf(float x);
+    float  rintf(float x);
+    float  nearbyintf(float x);
+    float  fmaf(float x, float y, float z);
+    float  fmodf(float x, float y);
+    float  fminf(float x, float y);
+    float  fmaxf(float x, float y);
+    float  expf(float x);
+    float  exp2f(float x);
+    float  logf(float x);
+    float  log2f(float x);
+    float  log10f(float x);
+    float  powf(float x, float y);
+    float  sinf(float x);
+    float  cosf(float x);
+    float  tanf(float x);
+    float  tanhf(float x);
+    float  atanf(float x);
+    float  atan2f(float y, float x);
+    double fabs(double x);
+    double sqrt(double x);
+    double floor(double x);
+    double ceil(double x);
+    double round(double x);
+    double trunc(double x);
+    double rint(double x);
+    double nearbyint(double x);
+    double fma(double x, double y, double z);
+    double fmin(double x, double y);
+    double fmax(double x, double y);
+    double fmod(double x, double y);
+    double exp(double x);
+    double exp2(double x);
+    double log(double x);
+    double log2(double x);
+    double log10(double x);
+    double pow(double x, double y);
+    double sin(double x);
+    double cos(double x);
+    double tan(double x);
+    double tanh(double x);
+    double atan(double x);
+    double atan2(double y, double x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
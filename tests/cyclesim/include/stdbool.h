@@ -0,0 +1,11 @@
+#pragma once
+#ifndef CYCLESIM_STDBOOL_H
+#define CYCLESIM_STDBOOL_H
+
+#ifndef __cplusplus
+#define bool _Bool
+#define true 1
+#define false 0
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+/* Freestanding C library headers for building the kernels for the Cortex-M7
+ * model. They only declare what the library code needs, so the kernels build
+ * the same with any installation of the compiler. */
+#pragma once
+#ifndef CYCLESIM_STDDEF_H
+#define CYCLESIM_STDDEF_H
+
+typedef __SIZE_TYPE__    size_t;
+typedef __PTRDIFF_TYPE__ ptrdiff_t;
+
+#ifdef __cplusplus
+#define NULL nullptr
+#else
+#define NULL ((void *)0)
+#endif
+
+#define offsetof(type, member) __builtin_offsetof(type, member)
+
+#endif
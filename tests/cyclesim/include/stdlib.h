@@ -0,0 +1,20 @@
+#pragma once
+#ifndef CYCLESIM_STDLIB_H
+#define CYCLESIM_STDLIB_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    int  abs(int x);
+    long labs(long x);
+    void abort(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef CYCLESIM_STRING_H
+#define CYCLESIM_STRING_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    void * memcpy(void *dst, const void *src, size_t n);
+    void * memmove(void *dst, const void *src, size_t n);
+    void * memset(void *dst, int c, size_t n);
+    int    memcmp(const void *a, const void *b, size_t n);
+    size_t strlen(const char *s);
+    int    strcmp(const char *a, const char *b);
+    char * strcpy(char *dst, const char *src);
+    char * strncpy(char *dst, const char *src, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
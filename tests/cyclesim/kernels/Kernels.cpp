@@ -0,0 +1,255 @@
+#include "Kernels.h"
+#include "daisy_core.h"
+#include "hid/ctrl.h"
+#include "hid/parameter.h"
+#include "hid/midi.h"
+#include "hid/disp/oled_display.h"
+#include "dev/oled_ssd130x.h"
+
+using namespace daisy;
+
+// The kernels run on the model and on the host. Inputs are generated with
+// integer math, so both see the same values.
+namespace
+{
+/** Sample conversion, one block of 48 stereo frames each way. This is the
+ ** conversion done by AudioHandle around the audio callback. */
+const size_t kFrames = 48;
+int32_t      sai_rx[kFrames * 2];
+int32_t      sai_tx[kFrames * 2];
+int16_t      sai_rx16[kFrames * 2];
+int16_t      sai_tx16[kFrames * 2];
+float        samples[kFrames * 2];
+float        postgain       = 1.f;
+float        postgain_recip = 1.f;
+
+void SamplesSetup()
+{
+    for(size_t i = 0; i < kFrames * 2; i++)
+    {
+        sai_rx[i]   = int32_t(i * 174763u) - 0x800000;
+        sai_rx16[i] = int16_t(i * 683u - 0x8000);
+    }
+    postgain       = 2.f;
+    postgain_recip = 0.5f;
+}
+
+void SamplesS24Run()
+{
+    for(size_t i = 0; i < kFrames * 2; i += 2)
+    {
+        samples[i]     = s242f(sai_rx[i]) * postgain_recip;
+        samples[i + 1] = s242f(sai_rx[i + 1]) * postgain_recip;
+    }
+    for(size_t i = 0; i < kFrames * 2; i += 2)
+    {
+        sai_tx[i]     = f2s24(samples[i] * postgain);
+        sai_tx[i + 1] = f2s24(samples[i + 1] * postgain);
+    }
+}
+
+float SamplesS24Result()
+{
+    float sum = 0.f;
+    for(size_t i = 0; i < kFrames * 2; i++)
+        sum += sai_tx[i] * (1.f / 8388608.f) + samples[i];
+    return sum;
+}
+
+void SamplesS16Run()
+{
+    for(size_t i = 0; i < kFrames * 2; i += 2)
+    {
+        samples[i]     = s162f(sai_rx16[i]) * postgain_recip;
+        samples[i + 1] = s162f(sai_rx16[i + 1]) * postgain_recip;
+    }
+    for(size_t i = 0; i < kFrames * 2; i += 2)
+    {
+        sai_tx16[i]     = f2s16(samples[i] * postgain);
+        sai_tx16[i + 1] = f2s16(samples[i + 1] * postgain);
+    }
+}
+
+float SamplesS16Result()
+{
+    float sum = 0.f;
+    for(size_t i = 0; i < kFrames * 2; i++)
+        sum += sai_tx16[i] * (1.f / 32768.f) + samples[i];
+    return sum;
+}
+
+/** Control processing: one knob, and 24 parameters as on a Field, half of
+ ** them logarithmic */
+const size_t  kNumParams = 24;
+uint16_t      adc[kNumParams];
+AnalogControl ctrl;
+AnalogControl param_ctrl[kNumParams];
+Parameter     params[kNumParams];
+float         ctrl_sum;
+
+void ControlSetup()
+{
+    ctrl.Init(&adc[0], 1000.f);
+    for(size_t i = 0; i < kNumParams; i++)
+    {
+        adc[i] = uint16_t(i * 2731u);
+        param_ctrl[i].Init(&adc[i], 1000.f);
+        Parameter::Curve curve
+            = i % 2 ? Parameter::LOGARITHMIC : (Parameter::Curve)(i % 4);
+        params[i].Init(param_ctrl[i], 20.f, 20000.f, curve);
+    }
+    ctrl_sum = 0.f;
+}
+
+void AnalogControlRun()
+{
+    adc[0] += 97;
+    ctrl_sum += ctrl.Process();
+}
+
+void ParameterRun()
+{
+    adc[0] += 97;
+    for(size_t i = 0; i < kNumParams; i++)
+        ctrl_sum += params[i].Process();
+}
+
+float ControlResult()
+{
+    return ctrl_sum;
+}
+
+/** MIDI parsing: note on, note off by running status and a control change,
+ ** with the events popped again */
+MidiHandler midi;
+uint32_t    midi_sum;
+size_t      midi_idx;
+
+void MidiSetup()
+{
+    midi.Init(MidiHandler::INPUT_MODE_UART1, MidiHandler::OUTPUT_MODE_NONE);
+    midi_sum = 0;
+    midi_idx = 0;
+}
+
+void MidiRun()
+{
+    static const uint8_t stream[9] = {0x90, 60, 100, 60, 0, 0, 0xB3, 7, 64};
+    for(size_t i = 0; i < 9; i++)
+        midi.Parse(stream[i]);
+    midi_idx++;
+    while(midi.HasEvents())
+    {
+        MidiEvent ev = midi.PopEvent();
+        midi_sum += ev.type * 7 + ev.channel + ev.data[0] * 3 + ev.data[1];
+    }
+}
+
+float MidiResult()
+{
+    return float(midi_sum) + float(midi_idx);
+}
+
+/** Display rendering on a 128x64 SSD130x, without the bus */
+class NullTransport
+{
+  public:
+    struct Config
+    {
+    };
+    void Init(const Config&) {}
+    void SendCommand(uint8_t cmd) { sum_ += cmd; }
+    void SendData(uint8_t* buff, size_t size)
+    {
+        sum_ += buff[0] + buff[size - 1];
+        if(checksum_)
+            for(size_t i = 0; i < size; i++)
+                sum_ += buff[i] * (i + 1);
+    }
+
+    static uint32_t sum_;
+    static bool     checksum_;
+};
+
+uint32_t NullTransport::sum_      = 0;
+bool     NullTransport::checksum_ = false;
+
+typedef SSD130xDriver<128, 64, NullTransport> Driver;
+
+OledDisplay<Driver> display;
+bool                pixel_on;
+
+void DisplaySetup()
+{
+    OledDisplay<Driver>::Config cfg;
+    display.Init(cfg);
+    display.Fill(false);
+    pixel_on            = true;
+    NullTransport::sum_ = 0;
+}
+
+// A diagonal line across the whole display
+void DrawPixelRun()
+{
+    for(uint_fast8_t x = 0; x < 128; x++)
+        display.DrawPixel(x, x / 2, pixel_on);
+    pixel_on = !pixel_on;
+}
+
+void UpdateRun()
+{
+    display.Update();
+}
+
+// Two lines of text in the 7x10 font
+void WriteStringRun()
+{
+    display.SetCursor(0, 0);
+    display.WriteString("Daisy 48kHz 24b", Font_7x10, pixel_on);
+    display.SetCursor(0, 12);
+    display.WriteString("CPU 12.5%", Font_7x10, !pixel_on);
+    pixel_on = !pixel_on;
+}
+
+// Lines and a rectangle, the primitives of most menus
+void ShapesRun()
+{
+    display.DrawLine(0, 0, 127, 63, pixel_on);
+    display.DrawLine(0, 63, 127, 0, pixel_on);
+    display.DrawRect(10, 10, 117, 53, pixel_on, false);
+    pixel_on = !pixel_on;
+}
+
+float DisplayResult()
+{
+    NullTransport::checksum_ = true;
+    display.Update();
+    NullTransport::checksum_ = false;
+    return float(NullTransport::sum_ % 16777216u);
+}
+
+} // namespace
+
+extern "C"
+{
+    const cyclesim::Kernel cyclesim_kernels[] = {
+        {"Samples.S24", SamplesSetup, SamplesS24Run, SamplesS24Result},
+        {"Samples.S16", SamplesSetup, SamplesS16Run, SamplesS16Result},
+        {"AnalogControl.Process",
+         ControlSetup,
+         AnalogControlRun,
+         ControlResult},
+        {"Parameter.Process24", ControlSetup, ParameterRun, ControlResult},
+        {"MidiHandler.Parse", MidiSetup, MidiRun, MidiResult},
+        {"SSD130x.DrawPixel", DisplaySetup, DrawPixelRun, DisplayResult},
+        {"SSD130x.Update", DisplaySetup, UpdateRun, DisplayResult},
+        {"OledDisplay.WriteString",
+         DisplaySetup,
+         WriteStringRun,
+         DisplayResult},
+        {"OledDisplay.Shapes", DisplaySetup, ShapesRun, DisplayResult},
+    };
+
+    const uint32_t cyclesim_num_kernels
+        = sizeof(cyclesim_kernels) / sizeof(cyclesim_kernels[0]);
+}
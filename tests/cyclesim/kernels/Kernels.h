@@ -0,0 +1,31 @@
+#pragma once
+#ifndef DSY_CYCLESIM_KERNELS_H
+#define DSY_CYCLESIM_KERNELS_H
+
+#include <stdint.h>
+
+namespace cyclesim
+{
+/** A kernel measured by the cycle model. Setup() runs once, then Run() is
+ ** measured over a number of calls, and Result() returns a checksum of what
+ ** the calls did, to compare the model against the same code on the host.
+ ** The runner reads the table from the target memory, so the layout on the
+ ** target is four 32 bit words.
+ */
+struct Kernel
+{
+    const char* name;
+    void (*setup)();
+    void (*run)();
+    float (*result)();
+};
+
+} // namespace cyclesim
+
+extern "C"
+{
+    extern const cyclesim::Kernel cyclesim_kernels[];
+    extern const uint32_t         cyclesim_num_kernels;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "per/uart.h"
+#include "sys/system.h"
+
+// The peripherals the kernels link against. The kernels never use the bus,
+// so these only have to exist. Built for the model and for the host, in
+// place of the HAL and src/sim.
+namespace daisy
+{
+UartHandler::Result UartHandler::Init(const Config&)
+{
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::StartRx()
+{
+    return Result::OK;
+}
+
+bool UartHandler::RxActive()
+{
+    return true;
+}
+
+UartHandler::Result UartHandler::FlushRx()
+{
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::PollTx(uint8_t*, size_t)
+{
+    return Result::OK;
+}
+
+uint8_t UartHandler::PopRx()
+{
+    return 0;
+}
+
+size_t UartHandler::Readable()
+{
+    return 0;
+}
+
+uint32_t System::GetNow()
+{
+    return 0;
+}
+
+uint32_t System::GetUs()
+{
+    return 0;
+}
+
+} // namespace daisy
@@ -0,0 +1,284 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "CortexM7.h"
+#include "ElfImage.h"
+#include "kernels/Kernels.h"
+
+using namespace cyclesim;
+
+// Usage: libDaisy_cyclesim [options] objects...
+//   --calls=n          measured calls of each kernel (64)
+//   --filter=str       only run the kernels with str in their name
+//   --json=path        write the counts per call, e.g. as the new baseline
+//   --baseline=path    compare the counts per call with the baseline
+//   --tolerance=pct    allowed increase over the baseline (2)
+//
+// Links the kernels, built for the Cortex-M7 (see kernels/Kernels.cpp), and
+// runs them on the model to count the instructions and cycles per call.
+// The same kernels are linked into this program as well, and each result
+// from the model has to match the one from the host, which checks the model
+// against the compiler. Exits with 1 when a kernel fails, or when its counts
+// are more than the tolerance over the baseline.
+
+namespace
+{
+struct Count
+{
+    std::string name;
+    double      instructions;
+    double      cycles;
+};
+
+const char *Arg(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0 && arg[len] == '=' ? arg + len + 1
+                                                           : nullptr;
+}
+
+bool ReadWord(CortexM7 &cpu, uint32_t addr, uint32_t *value)
+{
+    const uint8_t *p = cpu.Pointer(addr, 4);
+    if(p)
+        memcpy(value, p, 4);
+    return p != nullptr;
+}
+
+std::string ReadString(CortexM7 &cpu, uint32_t addr)
+{
+    std::string str;
+    for(const uint8_t *p; (p = cpu.Pointer(addr, 1)) && *p && str.size() < 64;
+        addr++)
+        str += char(*p);
+    return str;
+}
+
+bool Call(CortexM7 &cpu, uint32_t addr, const std::string &name)
+{
+    if(cpu.Call(addr))
+        return true;
+    fprintf(stderr, "%s: %s\n", name.c_str(), cpu.Error().c_str());
+    return false;
+}
+
+// The host and the model may contract or reorder float math differently
+bool SameResult(float model, float host)
+{
+    return fabsf(model - host) <= 1e-4f * fmaxf(1.f, fabsf(host));
+}
+
+bool ReadBaseline(const char *path, std::vector<Count> &baseline)
+{
+    FILE *f = fopen(path, "r");
+    if(!f)
+        return false;
+    char line[256];
+    while(fgets(line, sizeof(line), f))
+    {
+        char  name[64];
+        Count c;
+        if(sscanf(line,
+                  " {\"name\": \"%63[^\"]\", \"instructions\": %lf, "
+                  "\"cycles\": %lf",
+                  name,
+                  &c.instructions,
+                  &c.cycles)
+           == 3)
+        {
+            c.name = name;
+            baseline.push_back(c);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+bool WriteJson(const char *              path,
+               uint32_t                  calls,
+               const std::vector<Count> &counts)
+{
+    FILE *f = fopen(path, "w");
+    if(!f)
+        return false;
+    fprintf(f,
+            "{\n  \"context\": {\"model\": \"cortex-m7\", \"calls\": %u},\n",
+            calls);
+    fprintf(f, "  \"kernels\": [\n");
+    for(size_t i = 0; i < counts.size(); i++)
+        fprintf(f,
+                "    {\"name\": \"%s\", \"instructions\": %.1f, "
+                "\"cycles\": %.1f}%s\n",
+                counts[i].name.c_str(),
+                counts[i].instructions,
+                counts[i].cycles,
+                i + 1 < counts.size() ? "," : "");
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+// \return false when the count is over the tolerance
+bool Compare(const char *what, double now, double base, double tolerance)
+{
+    const double change = base > 0 ? (now - base) * 100 / base : 0;
+    printf(" %s %+.1f%%", what, change);
+    return change <= tolerance;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint32_t                  calls     = 64;
+    const char *              filter    = "";
+    const char *              json      = nullptr;
+    const char *              baseline  = nullptr;
+    double                    tolerance = 2;
+    std::vector<const char *> objects;
+    for(int i = 1; i < argc; i++)
+    {
+        const char *value;
+        if((value = Arg(argv[i], "--calls")))
+            calls = atoi(value);
+        else if((value = Arg(argv[i], "--filter")))
+            filter = value;
+        else if((value = Arg(argv[i], "--json")))
+            json = value;
+        else if((value = Arg(argv[i], "--baseline")))
+            baseline = value;
+        else if((value = Arg(argv[i], "--tolerance")))
+            tolerance = atof(value);
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 1;
+        }
+        else
+            objects.push_back(argv[i]);
+    }
+    if(objects.empty() || calls == 0)
+    {
+        fprintf(stderr, "usage: %s [options] objects...\n", argv[0]);
+        return 1;
+    }
+
+    CortexM7 cpu;
+    ElfImage image(cpu);
+    for(const char *path : objects)
+        if(!image.AddObject(path))
+        {
+            fprintf(stderr, "%s\n", image.Error().c_str());
+            return 1;
+        }
+    if(!image.Link())
+    {
+        fprintf(stderr, "%s\n", image.Error().c_str());
+        return 1;
+    }
+    cpu.SetReg(13, image.StackTop());
+    for(uint32_t fn : image.InitFunctions())
+        if(!Call(cpu, fn, "static constructors"))
+            return 1;
+
+    const uint32_t table = image.Symbol("cyclesim_kernels");
+    const uint32_t count = image.Symbol("cyclesim_num_kernels");
+    uint32_t       num_kernels = 0;
+    if(!table || !ReadWord(cpu, count, &num_kernels)
+       || num_kernels != cyclesim_num_kernels)
+    {
+        fprintf(stderr, "the objects don't have the kernels of this program\n");
+        return 1;
+    }
+
+    std::vector<Count> counts;
+    bool               ok = true;
+    printf("%-28s %14s %14s\n", "Kernel", "Instructions", "Cycles");
+    for(uint32_t k = 0; k < num_kernels; k++)
+    {
+        const Kernel &host = cyclesim_kernels[k];
+        uint32_t      fn[4];
+        for(uint32_t i = 0; i < 4; i++)
+            ReadWord(cpu, table + (k * 4 + i) * 4, &fn[i]);
+        const std::string name = ReadString(cpu, fn[0]);
+        if(name != host.name)
+        {
+            fprintf(stderr, "kernel %s on the model is %s on the host\n",
+                    name.c_str(), host.name);
+            return 1;
+        }
+        if(!strstr(host.name, filter))
+            continue;
+
+        // One call to warm up the branch predictor, then the measured ones
+        if(!Call(cpu, fn[1], name) || !Call(cpu, fn[2], name))
+            return 1;
+        cpu.ResetStats();
+        for(uint32_t i = 0; i < calls; i++)
+            if(!Call(cpu, fn[2], name))
+                return 1;
+        const CortexM7::Stats stats = cpu.GetStats();
+        if(!Call(cpu, fn[3], name))
+            return 1;
+        const float model = cpu.SReg(0);
+
+        host.setup();
+        for(uint32_t i = 0; i < calls + 1; i++)
+            host.run();
+        const float native = host.result();
+
+        Count c = {name,
+                   double(stats.instructions) / calls,
+                   double(stats.cycles) / calls};
+        counts.push_back(c);
+        printf("%-28s %14.1f %14.1f", name.c_str(), c.instructions, c.cycles);
+        if(!SameResult(model, native))
+        {
+            printf("  FAILED, result %g, %g on the host\n", model, native);
+            ok = false;
+            continue;
+        }
+        printf("\n");
+    }
+
+    if(json && !WriteJson(json, calls, counts))
+    {
+        fprintf(stderr, "can't write %s\n", json);
+        return 1;
+    }
+    if(!baseline)
+        return ok ? 0 : 1;
+
+    std::vector<Count> base;
+    if(!ReadBaseline(baseline, base))
+    {
+        fprintf(stderr, "can't read %s\n", baseline);
+        return 1;
+    }
+    printf("\nAgainst %s, tolerance %.1f%%:\n", baseline, tolerance);
+    for(const Count &c : counts)
+    {
+        const Count *b = nullptr;
+        for(const Count &x : base)
+            if(x.name == c.name)
+                b = &x;
+        printf("%-28s", c.name.c_str());
+        if(!b)
+        {
+            printf(" FAILED, not in the baseline\n");
+            ok = false;
+            continue;
+        }
+        bool within = Compare(
+            "instructions", c.instructions, b->instructions, tolerance);
+        within = Compare("cycles", c.cycles, b->cycles, tolerance) && within;
+        printf("%s\n", within ? "" : "  FAILED, over the tolerance");
+        ok = ok && within;
+    }
+    if(!ok)
+        printf("\nRun make cycles-baseline when the change is expected\n");
+    return ok ? 0 : 1;
+}